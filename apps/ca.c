@@ -73,6 +73,7 @@
 #define ENV_CERTOPT             "cert_opt"
 #define ENV_EXTCOPY             "copy_extensions"
 #define ENV_UNIQUE_SUBJECT      "unique_subject"
+#define ENV_APPEND_INDEX        "append_index"
 
 #define ENV_DATABASE            "database"
 
@@ -88,8 +89,23 @@ typedef enum {
 
 static char *lookup_conf(const CONF *conf, const char *group, const char *tag);
 
+/* A certificate request loaded ahead of its turn to be certified */
+typedef struct {
+    X509_REQ *req;
+    STACK_OF(OPENSSL_STRING) *vfyopts;
+    int verified; /* self-signature already checked and found good */
+} CA_REQ;
+
+static CA_REQ *preverify_reqs(const char *infile, char **argv, int argc,
+                              int informat,
+                              STACK_OF(OPENSSL_STRING) *vfyopts, int threads);
+static void free_reqs(CA_REQ *reqs, int num);
+static int sign_certs(STACK_OF(X509) *certs, EVP_PKEY *pkey,
+                      const EVP_MD *dgst, STACK_OF(OPENSSL_STRING) *sigopts,
+                      int threads);
+
 static int certify(X509 **xret, const char *infile, int informat,
-                   EVP_PKEY *pkey, X509 *x509,
+                   CA_REQ *pre, EVP_PKEY *pkey, X509 *x509,
                    const EVP_MD *dgst,
                    STACK_OF(OPENSSL_STRING) *sigopts,
                    STACK_OF(OPENSSL_STRING) *vfyopts,
@@ -141,6 +157,7 @@ static void write_new_certificate(BIO *bp, X509 *x, int output_der, int notext);
 static CONF *extfile_conf = NULL;
 static int preserve = 0;
 static int msie_hack = 0;
+static int sign_later = 0; /* With -threads, sign_certs() makes signatures */
 
 typedef enum OPTION_choice {
     OPT_ERR = -1, OPT_EOF = 0, OPT_HELP,
@@ -154,7 +171,7 @@ typedef enum OPTION_choice {
     OPT_CRLDAYS, OPT_CRLHOURS, OPT_CRLSEC,
     OPT_INFILES, OPT_SS_CERT, OPT_SPKAC, OPT_REVOKE, OPT_VALID,
     OPT_EXTENSIONS, OPT_EXTFILE, OPT_STATUS, OPT_UPDATEDB, OPT_CRLEXTS,
-    OPT_RAND_SERIAL,
+    OPT_RAND_SERIAL, OPT_THREADS,
     OPT_R_ENUM, OPT_PROV_ENUM,
     /* Do not change the order here; see related case statements below */
     OPT_CRL_REASON, OPT_CRL_HOLD, OPT_CRL_COMPROMISE, OPT_CRL_CA_COMPROMISE
@@ -178,6 +195,8 @@ const OPTIONS ca_options[] = {
     {"ss_cert", OPT_SS_CERT, '<', "File contains a self signed cert to sign"},
     {"spkac", OPT_SPKAC, '<',
      "File contains DN and signed public key and challenge"},
+    {"threads", OPT_THREADS, 'p',
+     "Number of threads verifying requests and signing certificates"},
 #ifndef OPENSSL_NO_ENGINE
     {"engine", OPT_ENGINE, 's', "Use engine, possibly a hardware device"},
 #endif
@@ -292,6 +311,8 @@ int ca_main(int argc, char **argv)
     int keyformat = FORMAT_PEM, multirdn = 1, notext = 0, output_der = 0;
     int ret = 1, email_dn = 1, req = 0, verbose = 0, gencrl = 0, dorevoke = 0;
     int rand_ser = 0, i, j, selfsign = 0, def_nid, def_ret;
+    int append_db = 0, db_rows = 0, threads = 1, num_pre = 0;
+    CA_REQ *pre = NULL;
     char *crl_lastupdate = NULL, *crl_nextupdate = NULL;
     long crldays = 0, crlhours = 0, crlsec = 0, days = 0;
     unsigned long chtype = MBSTRING_ASC, certopt = 0;
@@ -453,6 +474,13 @@ opthelp:
             spkac_file = opt_arg();
             req = 1;
             break;
+        case OPT_THREADS:
+            threads = atoi(opt_arg());
+            if (threads < 1 || threads > 1024) {
+                BIO_printf(bio_err, "%s: invalid number of threads\n", prog);
+                goto end;
+            }
+            break;
         case OPT_REVOKE:
             infile = opt_arg();
             dorevoke = 1;
@@ -547,6 +575,12 @@ end_of_options:
     else
         ERR_clear_error();
 
+    p = NCONF_get_string(conf, section, ENV_APPEND_INDEX);
+    if (p != NULL)
+        append_db = parse_yesno(p, 0);
+    else
+        ERR_clear_error();
+
     /*****************************************************************/
     /* report status of cert with serial number given on command line */
     if (ser_status) {
@@ -758,6 +792,8 @@ end_of_options:
                 BIO_printf(bio_err, "Done. %d entries marked as expired\n", i);
         }
     }
+    /* Rows added from here on can simply be appended to the database */
+    db_rows = sk_OPENSSL_PSTRING_num(db->db->data);
 
     /*****************************************************************/
     /* Read extensions config file                                   */
@@ -981,9 +1017,17 @@ end_of_options:
                 }
             }
         }
+        sign_later = threads > 1;
+        if (threads > 1 && (infile != NULL || argc > 0)) {
+            num_pre = (infile != NULL) + argc;
+            pre = preverify_reqs(infile, argv, argc, informat, vfyopts,
+                                 threads);
+            if (pre == NULL)
+                goto end;
+        }
         if (infile != NULL) {
             total++;
-            j = certify(&x, infile, informat, pkey, x509p, dgst,
+            j = certify(&x, infile, informat, pre, pkey, x509p, dgst,
                         sigopts, vfyopts, attribs, db,
                         serial, subj, chtype, multirdn, email_dn, startdate,
                         enddate, days, batch, extensions, conf, verbose,
@@ -1003,7 +1047,9 @@ end_of_options:
         }
         for (i = 0; i < argc; i++) {
             total++;
-            j = certify(&x, argv[i], informat, pkey, x509p, dgst,
+            j = certify(&x, argv[i], informat,
+                        pre != NULL ? &pre[(infile != NULL) + i] : NULL,
+                        pkey, x509p, dgst,
                         sigopts, vfyopts,
                         attribs, db,
                         serial, subj, chtype, multirdn, email_dn, startdate,
@@ -1025,6 +1071,9 @@ end_of_options:
                 }
             }
         }
+        if (sign_later
+                && !sign_certs(cert_sk, pkey, dgst, sigopts, threads))
+            goto end;
         /*
          * we have a stack of newly certified certificates and a data base
          * and serial number that need updating
@@ -1056,7 +1105,7 @@ end_of_options:
                     && !save_serial(serialfile, "new", serial, NULL))
                 goto end;
 
-            if (!save_index(dbfile, "new", db))
+            if (!append_db && !save_index(dbfile, "new", db))
                 goto end;
         }
 
@@ -1068,6 +1117,14 @@ end_of_options:
         if (verbose)
             BIO_printf(bio_err, "writing new certificates\n");
 
+        /* All new certificates go to the same output, so open it just once */
+        if (sk_X509_num(cert_sk) > 0) {
+            Sout = bio_open_default(outfile, 'w',
+                                    output_der ? FORMAT_ASN1 : FORMAT_TEXT);
+            if (Sout == NULL)
+                goto end;
+        }
+
         for (i = 0; i < sk_X509_num(cert_sk); i++) {
             BIO *Cout = NULL;
             X509 *xi = sk_X509_value(cert_sk, i);
@@ -1101,11 +1158,6 @@ end_of_options:
             if (verbose)
                 BIO_printf(bio_err, "writing %s\n", new_cert);
 
-            Sout = bio_open_default(outfile, 'w',
-                                    output_der ? FORMAT_ASN1 : FORMAT_TEXT);
-            if (Sout == NULL)
-                goto end;
-
             Cout = BIO_new_file(new_cert, "w");
             if (Cout == NULL) {
                 perror(new_cert);
@@ -1114,9 +1166,9 @@ end_of_options:
             write_new_certificate(Cout, xi, 0, notext);
             write_new_certificate(Sout, xi, output_der, notext);
             BIO_free_all(Cout);
-            BIO_free_all(Sout);
-            Sout = NULL;
         }
+        BIO_free_all(Sout);
+        Sout = NULL;
 
         if (sk_X509_num(cert_sk)) {
             /* Rename the database and the serial file */
@@ -1124,8 +1176,12 @@ end_of_options:
                     && !rotate_serial(serialfile, "new", "old"))
                 goto end;
 
-            if (!rotate_index(dbfile, "new", "old"))
+            if (append_db) {
+                if (!append_index(db, db_rows))
+                    goto end;
+            } else if (!rotate_index(dbfile, "new", "old")) {
                 goto end;
+            }
 
             BIO_printf(bio_err, "Data Base Updated\n");
         }
@@ -1319,6 +1375,7 @@ end_of_options:
     BIO_free_all(out);
     BIO_free_all(in);
     sk_X509_pop_free(cert_sk, X509_free);
+    free_reqs(pre, num_pre);
 
     cleanse(passin);
     if (free_passin)
@@ -1346,7 +1403,7 @@ static char *lookup_conf(const CONF *conf, const char *section, const char *tag)
 }
 
 static int certify(X509 **xret, const char *infile, int informat,
-                   EVP_PKEY *pkey, X509 *x509,
+                   CA_REQ *pre, EVP_PKEY *pkey, X509 *x509,
                    const EVP_MD *dgst,
                    STACK_OF(OPENSSL_STRING) *sigopts,
                    STACK_OF(OPENSSL_STRING) *vfyopts,
@@ -1362,7 +1419,12 @@ static int certify(X509 **xret, const char *infile, int informat,
     EVP_PKEY *pktmp = NULL;
     int ok = -1, i;
 
-    req = load_csr(infile, informat, "certificate request");
+    if (pre != NULL) {
+        req = pre->req;
+        pre->req = NULL;
+    } else {
+        req = load_csr(infile, informat, "certificate request");
+    }
     if (req == NULL)
         goto end;
     if ((pktmp = X509_REQ_get0_pubkey(req)) == NULL) {
@@ -1380,7 +1442,9 @@ static int certify(X509 **xret, const char *infile, int informat,
                    "Certificate request and CA private key do not match\n");
         goto end;
     }
-    i = do_X509_REQ_verify(req, pktmp, vfyopts);
+    /* Failures are verified again here to report their errors in order */
+    i = pre != NULL && pre->verified ? 1
+        : do_X509_REQ_verify(req, pktmp, vfyopts);
     if (i < 0) {
         BIO_printf(bio_err, "Signature verification problems...\n");
         goto end;
@@ -1403,6 +1467,145 @@ static int certify(X509 **xret, const char *infile, int informat,
     return ok;
 }
 
+typedef struct {
+    CA_REQ *reqs;
+    int num, first, step;
+} CA_VERIFY_ARGS;
+
+static void verify_reqs(void *arg)
+{
+    CA_VERIFY_ARGS *args = arg;
+    int i;
+
+    for (i = args->first; i < args->num; i += args->step) {
+        CA_REQ *r = &args->reqs[i];
+        EVP_PKEY *pktmp = X509_REQ_get0_pubkey(r->req);
+
+        r->verified = pktmp != NULL
+            && do_X509_REQ_verify(r->req, pktmp, r->vfyopts) > 0;
+    }
+}
+
+/*
+ * Loads all requests given by |infile| and |argv| and checks their
+ * self-signatures in |threads| threads.  Each request carries its own public
+ * key, so this shares nothing between the threads.
+ */
+static CA_REQ *preverify_reqs(const char *infile, char **argv, int argc,
+                              int informat,
+                              STACK_OF(OPENSSL_STRING) *vfyopts, int threads)
+{
+    int num = (infile != NULL) + argc, i;
+    CA_REQ *reqs;
+    CA_VERIFY_ARGS *args;
+
+    reqs = app_malloc(num * sizeof(*reqs), "requests");
+    memset(reqs, 0, num * sizeof(*reqs));
+    for (i = 0; i < num; i++) {
+        const char *file = infile != NULL ? (i == 0 ? infile : argv[i - 1])
+                                          : argv[i];
+
+        reqs[i].vfyopts = vfyopts;
+        reqs[i].req = load_csr(file, informat, "certificate request");
+        if (reqs[i].req == NULL) {
+            ERR_print_errors(bio_err);
+            free_reqs(reqs, num);
+            return NULL;
+        }
+    }
+
+    if (threads > num)
+        threads = num;
+    args = app_malloc(threads * sizeof(*args), "verify args");
+    for (i = 0; i < threads; i++) {
+        args[i].reqs = reqs;
+        args[i].num = num;
+        args[i].first = i;
+        args[i].step = threads;
+    }
+    /* Requests left unverified by a failed thread are checked later */
+    (void)app_run_threads(threads, verify_reqs, args, sizeof(*args));
+    OPENSSL_free(args);
+    return reqs;
+}
+
+static void free_reqs(CA_REQ *reqs, int num)
+{
+    int i;
+
+    if (reqs == NULL)
+        return;
+    for (i = 0; i < num; i++)
+        X509_REQ_free(reqs[i].req);
+    OPENSSL_free(reqs);
+}
+
+typedef struct {
+    STACK_OF(X509) *certs;
+    int *done;
+    EVP_PKEY *pkey;
+    const EVP_MD *dgst;
+    STACK_OF(OPENSSL_STRING) *sigopts;
+    int first, step;
+} CA_SIGN_ARGS;
+
+static void sign_some(void *arg)
+{
+    CA_SIGN_ARGS *args = arg;
+    int i;
+
+    for (i = args->first; i < sk_X509_num(args->certs); i += args->step)
+        args->done[i] = do_X509_sign_prepared(sk_X509_value(args->certs, i),
+                                              args->pkey, args->dgst,
+                                              args->sigopts);
+}
+
+/*
+ * Signs the certificates that do_body() left unsigned in |threads| threads.
+ * Their serial numbers and database rows were assigned in order already, so
+ * only the CA key is shared, and each signature has its own EVP_MD_CTX.
+ * Certificates left unsigned by a failed thread are signed again here, so
+ * that the errors are printed.
+ */
+static int sign_certs(STACK_OF(X509) *certs, EVP_PKEY *pkey,
+                      const EVP_MD *dgst, STACK_OF(OPENSSL_STRING) *sigopts,
+                      int threads)
+{
+    int num = sk_X509_num(certs), i, ok = 1;
+    int *done;
+    CA_SIGN_ARGS *args;
+
+    if (num <= 0)
+        return 1;
+    done = app_malloc(num * sizeof(*done), "signed flags");
+    memset(done, 0, num * sizeof(*done));
+    if (threads > num)
+        threads = num;
+    args = app_malloc(threads * sizeof(*args), "sign args");
+    for (i = 0; i < threads; i++) {
+        args[i].certs = certs;
+        args[i].done = done;
+        args[i].pkey = pkey;
+        args[i].dgst = dgst;
+        args[i].sigopts = sigopts;
+        args[i].first = i;
+        args[i].step = threads;
+    }
+    (void)app_run_threads(threads, sign_some, args, sizeof(*args));
+    OPENSSL_free(args);
+
+    for (i = 0; ok && i < num; i++) {
+        if (!done[i] && !do_X509_sign_prepared(sk_X509_value(certs, i),
+                                               pkey, dgst, sigopts)) {
+            BIO_printf(bio_err, "Error signing certificate\n");
+            ERR_print_errors(bio_err);
+            ok = 0;
+        }
+    }
+    OPENSSL_free(done);
+    return ok;
+}
+
 static int certify_cert(X509 **xret, const char *infile, int certformat,
                         const char *passin, EVP_PKEY *pkey, X509 *x509,
                         const EVP_MD *dgst,
@@ -1904,8 +2107,13 @@ static int do_body(X509 **xret, EVP_PKEY *pkey, X509 *x509,
         !EVP_PKEY_missing_parameters(pkey))
         EVP_PKEY_copy_parameters(pktmp, pkey);
 
-    if (!do_X509_sign(ret, pkey, dgst, sigopts, &ext_ctx))
+    if (sign_later) {
+        /* The serial number and database row do not depend on the signature */
+        if (!do_X509_sign_prepare(ret, pkey, &ext_ctx))
+            goto end;
+    } else if (!do_X509_sign(ret, pkey, dgst, sigopts, &ext_ctx)) {
         goto end;
+    }
 
     /* We now just add it to the database as DB_TYPE_VAL('V') */
     row[DB_type] = OPENSSL_strdup("V");
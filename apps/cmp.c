@@ -11,6 +11,8 @@
 
 #include <string.h>
 #include <ctype.h>
+#include <errno.h>
+#include <time.h>
 
 #include "apps.h"
 #include "http_server.h"
@@ -18,9 +20,11 @@
 #include "progs.h"
 
 #include "cmp_mock_srv.h"
+#include "internal/o_dir.h"
 
 /* tweaks needed due to missing unistd.h on Windows */
 #ifdef _WIN32
+# include <windows.h>
 # define access _access
 #endif
 #ifndef F_OK
@@ -158,6 +162,9 @@ static int opt_use_mock_srv = 0;
 /* server-side debugging */
 static char *opt_port = NULL;
 static int opt_max_msgs = 0;
+static char *opt_reqdir = NULL;
+static char *opt_rspdir = NULL;
+static int opt_threads = 1;
 
 static char *opt_srv_ref = NULL;
 static char *opt_srv_secret = NULL;
@@ -230,7 +237,7 @@ typedef enum OPTION_choice {
     OPT_REQIN, OPT_REQIN_NEW_TID, OPT_REQOUT, OPT_RSPIN, OPT_RSPOUT,
     OPT_USE_MOCK_SRV,
 
-    OPT_PORT, OPT_MAX_MSGS,
+    OPT_PORT, OPT_MAX_MSGS, OPT_REQDIR, OPT_RSPDIR, OPT_THREADS,
     OPT_SRV_REF, OPT_SRV_SECRET,
     OPT_SRV_CERT, OPT_SRV_KEY, OPT_SRV_KEYPASS,
     OPT_SRV_TRUSTED, OPT_SRV_UNTRUSTED,
@@ -448,6 +455,14 @@ const OPTIONS cmp_options[] = {
     {"port", OPT_PORT, 's', "Act as HTTP mock server listening on given port"},
     {"max_msgs", OPT_MAX_MSGS, 'n',
      "max number of messages handled by HTTP mock server. Default: 0 = unlimited"},
+    {"reqdir", OPT_REQDIR, 's',
+     "Act as offline mock server answering all requests in files of given dir"},
+    {"rspdir", OPT_RSPDIR, 's',
+     "Directory to save the responses to the requests of -reqdir in"},
+#ifdef OPENSSL_THREADS
+    {"threads", OPT_THREADS, 'n',
+     "Number of threads answering the requests of -reqdir. Default 1"},
+#endif
 
     {"srv_ref", OPT_SRV_REF, 's',
      "Reference value to use as senderKID of server in case no -srv_cert is given"},
@@ -554,6 +569,10 @@ static varref cmp_vars[] = { /* must be in same order as enumerated above! */
     {&opt_reqout}, {&opt_rspin}, {&opt_rspout},
 
     {(char **)&opt_use_mock_srv}, {&opt_port}, {(char **)&opt_max_msgs},
+    {&opt_reqdir}, {&opt_rspdir},
+#ifdef OPENSSL_THREADS
+    {(char **)&opt_threads},
+#endif
     {&opt_srv_ref}, {&opt_srv_secret},
     {&opt_srv_cert}, {&opt_srv_key}, {&opt_srv_keypass},
     {&opt_srv_trusted}, {&opt_srv_untrusted},
@@ -1126,7 +1145,6 @@ static OSSL_CMP_SRV_CTX *setup_srv_ctx(ENGINE *engine)
         char *pass_str = get_passwd(opt_srv_secret, "PBMAC secret of server");
 
         if (pass_str != NULL) {
-            cleanse(opt_srv_secret);
             res = OSSL_CMP_CTX_set1_secretValue(ctx, (unsigned char *)pass_str,
                                                 strlen(pass_str));
             clear_free(pass_str);
@@ -1166,7 +1184,6 @@ static OSSL_CMP_SRV_CTX *setup_srv_ctx(ENGINE *engine)
         }
         EVP_PKEY_free(pkey);
     }
-    cleanse(opt_srv_keypass);
 
     if (opt_srv_trusted != NULL) {
         X509_STORE *ts =
@@ -1253,6 +1270,186 @@ static OSSL_CMP_SRV_CTX *setup_srv_ctx(ENGINE *engine)
     return NULL;
 }
 
+/* The share of the requests of -reqdir for one thread to answer */
+typedef struct {
+    OSSL_CMP_SRV_CTX *srv_ctx;
+    STACK_OF(OPENSSL_STRING) *files;
+    int start, step;
+    int errs;
+} REQDIR_ARGS;
+
+static char *reqdir_path(const char *dir, const char *file)
+{
+    size_t len = strlen(dir);
+    const char *sep = len > 0 && dir[len - 1] == '/' ? "" : "/";
+    char *path;
+
+    len += strlen(sep) + strlen(file) + 1;
+    if ((path = OPENSSL_malloc(len)) != NULL)
+        BIO_snprintf(path, len, "%s%s%s", dir, sep, file);
+    return path;
+}
+
+/*
+ * Answer the request in |file| of -reqdir, saving the response in -rspdir.
+ * The request is handled as if it started a transaction of its own,
+ * such that it does not matter which thread gets which request.
+ * Returns 1 on success, 0 on error
+ */
+static int answer_req(OSSL_CMP_SRV_CTX *srv_ctx, const char *file)
+{
+    OSSL_CMP_CTX *ctx = OSSL_CMP_SRV_CTX_get0_cmp_ctx(srv_ctx);
+    char *in = reqdir_path(opt_reqdir, file);
+    char *out = reqdir_path(opt_rspdir, file);
+    OSSL_CMP_MSG *req = NULL, *rsp = NULL;
+    uint64_t start, usec;
+    int ret = 0;
+
+    if (in == NULL || out == NULL)
+        goto err;
+    if ((req = OSSL_CMP_MSG_read(in)) == NULL) {
+        CMP_err1("cannot read CMP request from file %s", in);
+        goto err;
+    }
+    if (!OSSL_CMP_CTX_set1_transactionID(ctx, NULL)
+            || !OSSL_CMP_CTX_set1_senderNonce(ctx, NULL))
+        goto err;
+    start = app_monotonic_ns();
+    rsp = OSSL_CMP_SRV_process_request(srv_ctx, req);
+    usec = (app_monotonic_ns() - start) / 1000;
+    if (rsp == NULL) {
+        CMP_err1("cannot answer CMP request in file %s", in);
+        goto err;
+    }
+    if (OSSL_CMP_MSG_write(out, rsp) < 0) {
+        CMP_err1("cannot write CMP response to file %s", out);
+        goto err;
+    }
+    BIO_printf(bio_out, "%s: %llu us\n", file, (unsigned long long)usec);
+    ret = 1;
+
+ err:
+    if (ret == 0)
+        OSSL_CMP_CTX_print_errors(ctx);
+    OSSL_CMP_MSG_free(req);
+    OSSL_CMP_MSG_free(rsp);
+    OPENSSL_free(in);
+    OPENSSL_free(out);
+    return ret;
+}
+
+/* Answer every |step|th request of -reqdir, beginning with the |start|th */
+static void answer_reqs(void *arg)
+{
+    REQDIR_ARGS *args = arg;
+    int i;
+
+    for (i = args->start; i < sk_OPENSSL_STRING_num(args->files);
+         i += args->step)
+        if (!answer_req(args->srv_ctx, sk_OPENSSL_STRING_value(args->files, i)))
+            args->errs++;
+}
+
+static int str_cmp(const char *const *a, const char *const *b)
+{
+    return strcmp(*a, *b);
+}
+
+static void str_free(char *s)
+{
+    OPENSSL_free(s);
+}
+
+/*
+ * Act as offline mock server answering the requests in all files of -reqdir,
+ * saving each response in -rspdir under the name of the request file.
+ * Returns 1 if all requests have been answered, else 0
+ */
+static int answer_reqdir(ENGINE *engine)
+{
+    STACK_OF(OPENSSL_STRING) *files = NULL;
+    OPENSSL_DIR_CTX *d = NULL;
+    REQDIR_ARGS *args = NULL;
+    OSSL_CMP_CTX *ctx;
+    const char *filename;
+    char *copy;
+    uint64_t start, usec;
+    int i, num, threads = 0, errs = 0, ret = 0;
+
+    if (opt_rspdir == NULL) {
+        CMP_err("must give -rspdir for -reqdir");
+        goto err;
+    }
+    if (opt_threads < 1) {
+        CMP_err("-threads must be positive");
+        goto err;
+    }
+    if ((files = sk_OPENSSL_STRING_new(str_cmp)) == NULL)
+        goto err;
+    while ((filename = OPENSSL_DIR_read(&d, opt_reqdir)) != NULL) {
+        if (filename[0] == '.') /* "." and ".." as well as hidden files */
+            continue;
+        if ((copy = OPENSSL_strdup(filename)) == NULL
+                || sk_OPENSSL_STRING_push(files, copy) == 0) {
+            OPENSSL_free(copy);
+            OPENSSL_DIR_end(&d);
+            goto err;
+        }
+    }
+    if (errno != 0) {
+        CMP_err1("cannot read directory %s", opt_reqdir);
+        OPENSSL_DIR_end(&d);
+        goto err;
+    }
+    OPENSSL_DIR_end(&d);
+    sk_OPENSSL_STRING_sort(files);
+    num = sk_OPENSSL_STRING_num(files);
+
+    /* one server context per thread, keeping their transactions apart */
+    threads = num < opt_threads ? (num > 0 ? num : 1) : opt_threads;
+    args = app_malloc(sizeof(*args) * threads, "thread arguments");
+    memset(args, 0, sizeof(*args) * threads);
+    for (i = 0; i < threads; i++) {
+        if ((args[i].srv_ctx = setup_srv_ctx(engine)) == NULL)
+            goto err;
+        ctx = OSSL_CMP_SRV_CTX_get0_cmp_ctx(args[i].srv_ctx);
+        if (!OSSL_CMP_CTX_set_log_cb(ctx, print_to_bio_out)) {
+            CMP_err1("cannot set up error reporting and logging for %s", prog);
+            goto err;
+        }
+        args[i].files = files;
+        args[i].start = i;
+        args[i].step = threads;
+    }
+    cleanse(opt_srv_keypass);
+    cleanse(opt_srv_secret);
+
+    start = app_monotonic_ns();
+    if (!app_run_threads(threads, answer_reqs, args, sizeof(*args)))
+        goto err;
+    usec = (app_monotonic_ns() - start) / 1000;
+    for (i = 0; i < threads; i++)
+        errs += args[i].errs;
+    BIO_printf(bio_out,
+               "answered %d of %d requests in %.3f s using %d thread%s",
+               num - errs, num, usec / 1e6, threads, threads == 1 ? "" : "s");
+    if (usec > 0 && num > errs)
+        BIO_printf(bio_out, ", %.1f requests/s", (num - errs) * 1e6 / usec);
+    BIO_printf(bio_out, "\n");
+    ret = errs == 0;
+
+ err:
+    /* in case we ended up here on error before the cleansing above */
+    cleanse(opt_srv_keypass);
+    cleanse(opt_srv_secret);
+    if (args != NULL)
+        for (i = 0; i < threads; i++)
+            ossl_cmp_mock_srv_free(args[i].srv_ctx);
+    OPENSSL_free(args);
+    sk_OPENSSL_STRING_pop_free(files, str_free);
+    return ret;
+}
+
 /*
  * set up verification aspects of OSSL_CMP_CTX w.r.t. opts from config file/CLI.
  * Returns pointer on success, NULL on error
@@ -2599,6 +2796,16 @@ static int get_opts(int argc, char **argv)
             if ((opt_max_msgs = opt_nat()) < 0)
                 goto opthelp;
             break;
+        case OPT_REQDIR:
+            opt_reqdir = opt_str("reqdir");
+            break;
+        case OPT_RSPDIR:
+            opt_rspdir = opt_str("rspdir");
+            break;
+        case OPT_THREADS:
+            if ((opt_threads = opt_nat()) < 1)
+                goto opthelp;
+            break;
         case OPT_SRV_REF:
             opt_srv_ref = opt_str("srv_ref");
             break;
@@ -2777,6 +2984,16 @@ int cmp_main(int argc, char **argv)
             goto err;
         }
     }
+    if (opt_reqdir != NULL) {
+        if (opt_port != NULL || opt_use_mock_srv) {
+            CMP_err("cannot use -reqdir together with -port or -use_mock_srv");
+            goto err;
+        }
+        if (opt_server != NULL) {
+            CMP_err("cannot use both -reqdir and -server options");
+            goto err;
+        }
+    }
 
     cmp_ctx = OSSL_CMP_CTX_new(app_get0_libctx(), app_get0_propq());
     if (cmp_ctx == NULL)
@@ -2786,10 +3003,17 @@ int cmp_main(int argc, char **argv)
         CMP_err1("cannot set up error reporting and logging for %s", prog);
         goto err;
     }
+    if (opt_reqdir != NULL) { /* act as offline CMP server */
+        ret = answer_reqdir(engine);
+        goto err;
+    }
     if ((opt_use_mock_srv || opt_port != NULL)) {
         OSSL_CMP_SRV_CTX *srv_ctx;
 
-        if ((srv_ctx = setup_srv_ctx(engine)) == NULL)
+        srv_ctx = setup_srv_ctx(engine);
+        cleanse(opt_srv_keypass);
+        cleanse(opt_srv_secret);
+        if (srv_ctx == NULL)
             goto err;
         OSSL_CMP_CTX_set_transfer_cb_arg(cmp_ctx, srv_ctx);
         if (!OSSL_CMP_CTX_set_log_cb(OSSL_CMP_SRV_CTX_get0_cmp_ctx(srv_ctx),
@@ -2817,7 +3041,9 @@ int cmp_main(int argc, char **argv)
 
             ret = http_server_get_asn1_req(ASN1_ITEM_rptr(OSSL_CMP_MSG),
                                            (ASN1_VALUE **)&req, &path,
-                                           &cbio, acbio, prog, 0, 0);
+                                           &cbio, acbio,
+                                           NULL /* no keep-alive */,
+                                           prog, 0, 0);
             if (ret == 0)
                 continue;
             if (ret++ == -1)
@@ -2842,7 +3068,8 @@ int cmp_main(int argc, char **argv)
                                                   500, "Internal Server Error");
                     break; /* treated as fatal error */
                 }
-                ret = http_server_send_asn1_resp(cbio, "application/pkixcmp",
+                ret = http_server_send_asn1_resp(cbio, 0 /* no keep-alive */,
+                                                 "application/pkixcmp",
                                                  ASN1_ITEM_rptr(OSSL_CMP_MSG),
                                                  (const ASN1_VALUE *)resp);
                 OSSL_CMP_MSG_free(resp);
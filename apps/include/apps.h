@@ -213,6 +213,10 @@ int rand_serial(BIGNUM *b, ASN1_INTEGER *ai);
 CA_DB *load_index(const char *dbfile, DB_ATTR *dbattr);
 int index_index(CA_DB *db);
 int save_index(const char *dbfile, const char *suffix, CA_DB *db);
+int append_index(CA_DB *db, int first);
+# ifndef OPENSSL_NO_POSIX_IO
+int load_index_tail(CA_DB *db);
+# endif
 int rotate_index(const char *dbfile, const char *new_suffix,
                  const char *old_suffix);
 void free_index(CA_DB *db);
@@ -234,6 +238,9 @@ int init_gen_str(EVP_PKEY_CTX **pctx,
                  OSSL_LIB_CTX *libctx, const char *propq);
 int do_X509_sign(X509 *x, EVP_PKEY *pkey, const EVP_MD *md,
                  STACK_OF(OPENSSL_STRING) *sigopts, X509V3_CTX *ext_ctx);
+int do_X509_sign_prepare(X509 *x, EVP_PKEY *pkey, X509V3_CTX *ext_ctx);
+int do_X509_sign_prepared(X509 *x, EVP_PKEY *pkey, const EVP_MD *md,
+                          STACK_OF(OPENSSL_STRING) *sigopts);
 int do_X509_verify(X509 *x, EVP_PKEY *pkey, STACK_OF(OPENSSL_STRING) *vfyopts);
 int do_X509_REQ_sign(X509_REQ *x, EVP_PKEY *pkey, const EVP_MD *md,
                      STACK_OF(OPENSSL_STRING) *sigopts);
@@ -302,6 +309,15 @@ int raw_write_stdout(const void *, int);
 # define TM_START        0
 # define TM_STOP         1
 double app_tminterval(int stop, int usertime);
+/* Returns a monotonic time in nanoseconds, for measuring short intervals */
+uint64_t app_monotonic_ns(void);
+
+/*
+ * Calls |fn| on each of the |num| elements of the array |args|, whose
+ * elements are |size| bytes each, every call in a thread of its own, and
+ * waits for all of them.  Returns 0 if not all threads could be started.
+ */
+int app_run_threads(int num, void (*fn)(void *), void *args, size_t size);
 
 void make_uppercase(char *string);
 
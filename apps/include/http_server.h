@@ -68,11 +68,21 @@ BIO *http_server_init_bio(const char *prog, const char *port);
  * pcbio: pointer to variable where to place the BIO for sending the response to
  * ppath: pointer to variable where to place the request path, or NULL
  * acbio: the listening bio (typically as returned by http_server_init_bio())
+ *        unless *pcbio is not NULL; then the request is read from the
+ *        connection *pcbio, which the caller has accepted itself or kept alive
+ * found_keep_alive: pointer to variable where to place whether the client
+ *        wants to keep the connection alive, or NULL to not allow this;
+ *        on entry, nonzero if *pcbio has been kept alive from the previous
+ *        request.  It is always 0 after an invalid request.
  * prog: the name of the current app
  * accept_get: whether to accept GET requests (in addition to POST requests)
- * timeout: connection timeout (in seconds), or 0 for none/infinite
+ * timeout: connection timeout (in seconds), or 0 for none/infinite;
+ *        this uses alarm() and the global acfd, so it must be 0 when
+ *        called from more than one thread
  * returns 0 in case caller should retry, then *preq == *ppath == *pcbio == NULL
  * returns -1 on fatal error; also then holds *preq == *ppath == *pcbio == NULL
+ * If *pcbio was kept alive and the client has closed it, it is freed and
+ * 0 is returned.
  * returns 1 otherwise. In this case it is guaranteed that *pcbio != NULL while
  * *ppath == NULL and *preq == NULL if and only if the request is invalid,
  * On return value 1 the caller is responsible for sending an HTTP response,
@@ -81,19 +91,22 @@ BIO *http_server_init_bio(const char *prog, const char *port);
  */
 int http_server_get_asn1_req(const ASN1_ITEM *it, ASN1_VALUE **preq,
                              char **ppath, BIO **pcbio, BIO *acbio,
+                             int *found_keep_alive,
                              const char *prog, int accept_get, int timeout);
 
 /*-
  * Send an ASN.1-formatted HTTP response
  * cbio: destination BIO (typically as returned by http_server_get_asn1_req())
  *       note: cbio should not do an encoding that changes the output length
+ * keep_alive: whether to tell the client that the connection is kept alive
  * content_type: string identifying the type of the response
  * it: the response ASN.1 type
  * valit: the response ASN.1 type
  * resp: the response to send
  * returns 1 on success, 0 on failure
  */
-int http_server_send_asn1_resp(BIO *cbio, const char *content_type,
+int http_server_send_asn1_resp(BIO *cbio, int keep_alive,
+                               const char *content_type,
                                const ASN1_ITEM *it, const ASN1_VALUE *resp);
 
 /*-
@@ -8,13 +8,14 @@
  */
 
 #include <openssl/crypto.h>
+#include <openssl/metrics.h>
 #include "apps.h"
 #include "progs.h"
 
 typedef enum OPTION_choice {
     OPT_ERR = -1, OPT_EOF = 0, OPT_HELP,
     OPT_CONFIGDIR, OPT_ENGINESDIR, OPT_MODULESDIR, OPT_DSOEXT, OPT_DIRNAMESEP,
-    OPT_LISTSEP, OPT_SEEDS, OPT_CPUSETTINGS
+    OPT_LISTSEP, OPT_SEEDS, OPT_CPUSETTINGS, OPT_METRICS
 } OPTION_CHOICE;
 
 const OPTIONS info_options[] = {
@@ -32,6 +33,7 @@ const OPTIONS info_options[] = {
     {"listsep", OPT_LISTSEP, '-', "List separator character"},
     {"seeds", OPT_SEEDS, '-', "Seed sources"},
     {"cpusettings", OPT_CPUSETTINGS, '-', "CPU settings info"},
+    {"metrics", OPT_METRICS, '-', "Metrics of the library context"},
     {NULL}
 };
 
@@ -84,6 +86,10 @@ opthelp:
             type = OPENSSL_INFO_CPU_SETTINGS;
             dirty++;
             break;
+        case OPT_METRICS:
+            type = -1;
+            dirty++;
+            break;
         }
     }
     if (opt_num_rest() != 0)
@@ -97,7 +103,12 @@ opthelp:
         goto opthelp;
     }
 
-    BIO_printf(bio_out, "%s\n", OPENSSL_info(type));
+    if (type == -1) {
+        if (!OSSL_METRIC_print(bio_out, app_get0_libctx()))
+            goto end;
+    } else {
+        BIO_printf(bio_out, "%s\n", OPENSSL_info(type));
+    }
     ret = 0;
  end:
     return ret;
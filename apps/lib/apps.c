@@ -1492,6 +1492,26 @@ int index_index(CA_DB *db)
     return 0;
 }
 
+/* Write the attributes of |db| to the file |attrfile| */
+static int write_index_attr(const char *attrfile, CA_DB *db)
+{
+    BIO *out = BIO_new_file(attrfile, "w");
+
+    if (out == NULL) {
+        perror(attrfile);
+        BIO_printf(bio_err, "Unable to open '%s'\n", attrfile);
+        return 0;
+    }
+    BIO_printf(out, "unique_subject = %s\n",
+               db->attributes.unique_subject ? "yes" : "no");
+    if (BIO_flush(out) <= 0) {
+        BIO_free(out);
+        return 0;
+    }
+    BIO_free(out);
+    return 1;
+}
+
 int save_index(const char *dbfile, const char *suffix, CA_DB *db)
 {
     char buf[3][BSIZE];
@@ -1523,22 +1543,118 @@ int save_index(const char *dbfile, const char *suffix, CA_DB *db)
     if (j <= 0)
         goto err;
 
-    out = BIO_new_file(buf[1], "w");
+    if (!write_index_attr(buf[1], db))
+        goto err;
+
+    return 1;
+ err:
+    ERR_print_errors(bio_err);
+    return 0;
+}
+
+/*
+ * Appends the rows of |db| from |first| onwards to its file instead of
+ * writing out the whole database again.  The attribute file is small, so
+ * it is rewritten in full, which also creates it for a new database.
+ */
+int append_index(CA_DB *db, int first)
+{
+    TXT_DB tail = *db->db;
+    char attrfile[BSIZE];
+    BIO *out;
+    long n;
+    int i;
+
+#ifndef OPENSSL_SYS_VMS
+    n = BIO_snprintf(attrfile, sizeof(attrfile), "%s.attr", db->dbfname);
+#else
+    n = BIO_snprintf(attrfile, sizeof(attrfile), "%s-attr", db->dbfname);
+#endif
+    if (n < 0 || n >= (long)sizeof(attrfile)) {
+        BIO_printf(bio_err, "File name too long\n");
+        return 0;
+    }
+
+    if ((tail.data = sk_OPENSSL_PSTRING_new_null()) == NULL)
+        goto err;
+    for (i = first; i < sk_OPENSSL_PSTRING_num(db->db->data); i++)
+        if (!sk_OPENSSL_PSTRING_push(tail.data,
+                                     sk_OPENSSL_PSTRING_value(db->db->data, i)))
+            goto err;
+
+    out = BIO_new_file(db->dbfname, "a");
     if (out == NULL) {
-        perror(buf[2]);
-        BIO_printf(bio_err, "Unable to open '%s'\n", buf[2]);
+        perror(db->dbfname);
+        BIO_printf(bio_err, "Unable to open '%s'\n", db->dbfname);
         goto err;
     }
-    BIO_printf(out, "unique_subject = %s\n",
-               db->attributes.unique_subject ? "yes" : "no");
+    n = TXT_DB_write(out, &tail);
+    if (BIO_flush(out) <= 0)
+        n = -1;
     BIO_free(out);
+    if (n < 0 || !write_index_attr(attrfile, db))
+        goto err;
 
+    sk_OPENSSL_PSTRING_free(tail.data);
     return 1;
  err:
+    sk_OPENSSL_PSTRING_free(tail.data);
     ERR_print_errors(bio_err);
     return 0;
 }
 
+#ifndef OPENSSL_NO_POSIX_IO
+/*
+ * Brings |db| up to date with its file, assuming that rows have only been
+ * appended to it since it was loaded, as done by append_index().
+ * Returns 1 on success, or 0 if the file needs to be loaded again in full.
+ */
+int load_index_tail(CA_DB *db)
+{
+    TXT_DB *tail = NULL;
+    OPENSSL_STRING *row;
+    BIO *in;
+    FILE *dbfp;
+    struct stat dbst;
+    char c;
+    int ret = 0;
+
+    in = BIO_new_file(db->dbfname, "r");
+    if (in == NULL)
+        goto end;
+
+    BIO_get_fp(in, &dbfp);
+    if (fstat(fileno(dbfp), &dbst) == -1
+            || dbst.st_dev != db->dbst.st_dev
+            || dbst.st_ino != db->dbst.st_ino
+            || dbst.st_size < db->dbst.st_size)
+        goto end;
+
+    /* What was read before must still end with a complete line */
+    if (db->dbst.st_size > 0
+            && (BIO_seek(in, db->dbst.st_size - 1) < 0
+                || BIO_read(in, &c, 1) != 1 || c != '\n'))
+        goto end;
+
+    if ((tail = TXT_DB_read(in, db->db->num_fields)) == NULL)
+        goto end;
+    while ((row = sk_OPENSSL_PSTRING_shift(tail->data)) != NULL) {
+        if (!TXT_DB_insert(db->db, row)) {
+            OPENSSL_free(row);
+            goto end;
+        }
+    }
+    db->dbst = dbst;
+    ret = 1;
+
+ end:
+    ERR_clear_error();
+    TXT_DB_free(tail);
+    BIO_free_all(in);
+    return ret;
+}
+#endif
+
 int rotate_index(const char *dbfile, const char *new_suffix,
                  const char *old_suffix)
 {
@@ -2024,19 +2140,16 @@ static int adapt_keyid_ext(X509 *cert, X509V3_CTX *ext_ctx,
     return rv;
 }
 
-/* Ensure RFC 5280 compliance, adapt keyIDs as needed, and sign the cert info */
-int do_X509_sign(X509 *cert, EVP_PKEY *pkey, const EVP_MD *md,
-                 STACK_OF(OPENSSL_STRING) *sigopts, X509V3_CTX *ext_ctx)
+/* Ensure RFC 5280 compliance and adapt keyIDs as needed before signing */
+int do_X509_sign_prepare(X509 *cert, EVP_PKEY *pkey, X509V3_CTX *ext_ctx)
 {
     const STACK_OF(X509_EXTENSION) *exts = X509_get0_extensions(cert);
-    EVP_MD_CTX *mctx = EVP_MD_CTX_new();
     int self_sign;
-    int rv = 0;
 
     if (sk_X509_EXTENSION_num(exts /* may be NULL */) > 0) {
         /* Prevent X509_V_ERR_EXTENSIONS_REQUIRE_VERSION_3 */
         if (!X509_set_version(cert, 2)) /* Make sure cert is X509 v3 */
-            goto end;
+            return 0;
 
         /*
          * Add default SKID before such that default AKID can make use of it
@@ -2044,25 +2157,45 @@ int do_X509_sign(X509 *cert, EVP_PKEY *pkey, const EVP_MD *md,
          */
         /* Prevent X509_V_ERR_MISSING_SUBJECT_KEY_IDENTIFIER */
         if (!adapt_keyid_ext(cert, ext_ctx, "subjectKeyIdentifier", "hash", 1))
-            goto end;
+            return 0;
         /* Prevent X509_V_ERR_MISSING_AUTHORITY_KEY_IDENTIFIER */
         ERR_set_mark();
         self_sign = X509_check_private_key(cert, pkey);
         ERR_pop_to_mark();
         if (!adapt_keyid_ext(cert, ext_ctx, "authorityKeyIdentifier",
                              "keyid, issuer", !self_sign))
-            goto end;
+            return 0;
 
         /* TODO any further measures for ensuring default RFC 5280 compliance */
     }
+    return 1;
+}
+
+/*
+ * Sign the cert info prepared by do_X509_sign_prepare().  This uses its own
+ * EVP_MD_CTX, so several certificates may be signed with the same |pkey| in
+ * different threads.
+ */
+int do_X509_sign_prepared(X509 *cert, EVP_PKEY *pkey, const EVP_MD *md,
+                          STACK_OF(OPENSSL_STRING) *sigopts)
+{
+    EVP_MD_CTX *mctx = EVP_MD_CTX_new();
+    int rv = 0;
 
     if (mctx != NULL && do_sign_init(mctx, pkey, md, sigopts) > 0)
         rv = (X509_sign_ctx(cert, mctx) > 0);
- end:
     EVP_MD_CTX_free(mctx);
     return rv;
 }
 
+/* Ensure RFC 5280 compliance, adapt keyIDs as needed, and sign the cert info */
+int do_X509_sign(X509 *cert, EVP_PKEY *pkey, const EVP_MD *md,
+                 STACK_OF(OPENSSL_STRING) *sigopts, X509V3_CTX *ext_ctx)
+{
+    return do_X509_sign_prepare(cert, pkey, ext_ctx)
+        && do_X509_sign_prepared(cert, pkey, md, sigopts);
+}
+
 /* Sign the certificate request info */
 int do_X509_REQ_sign(X509_REQ *x, EVP_PKEY *pkey, const EVP_MD *md,
                      STACK_OF(OPENSSL_STRING) *sigopts)
@@ -2520,6 +2653,135 @@ double app_tminterval(int stop, int usertime)
 }
 #endif
 
+/* app_monotonic_ns section */
+#if defined(_WIN32)
+uint64_t app_monotonic_ns(void)
+{
+    LARGE_INTEGER freq, now;
+
+    /*
+     * The frequency is fixed at boot and cheap to query.  Asking every time
+     * avoids a static that threads would initialise concurrently.
+     */
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&now);
+    return (uint64_t)(now.QuadPart / freq.QuadPart) * 1000000000
+        + (uint64_t)(now.QuadPart % freq.QuadPart) * 1000000000
+          / freq.QuadPart;
+}
+#else
+# include <time.h>
+
+uint64_t app_monotonic_ns(void)
+{
+# ifdef CLOCK_MONOTONIC
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+# else
+    return (uint64_t)time(NULL) * 1000000000;
+# endif
+}
+#endif
+
+/* app_run_threads section */
+#if defined(OPENSSL_THREADS) && !defined(CRYPTO_TDEBUG)
+
+typedef struct {
+    void (*fn)(void *);
+    void *arg;
+} APP_THREAD_ARGS;
+
+# if defined(OPENSSL_SYS_WINDOWS)
+typedef HANDLE app_thread_t;
+
+static DWORD WINAPI app_thread_run(LPVOID arg)
+{
+    APP_THREAD_ARGS *t = arg;
+
+    t->fn(t->arg);
+    OPENSSL_thread_stop();
+    return 0;
+}
+
+static int app_thread_start(app_thread_t *thread, APP_THREAD_ARGS *t)
+{
+    *thread = CreateThread(NULL, 0, app_thread_run, t, 0, NULL);
+    return *thread != NULL;
+}
+
+static void app_thread_wait(app_thread_t thread)
+{
+    WaitForSingleObject(thread, INFINITE);
+    CloseHandle(thread);
+}
+# else
+#  include <pthread.h>
+
+typedef pthread_t app_thread_t;
+
+static void *app_thread_run(void *arg)
+{
+    APP_THREAD_ARGS *t = arg;
+
+    t->fn(t->arg);
+    OPENSSL_thread_stop();
+    return NULL;
+}
+
+static int app_thread_start(app_thread_t *thread, APP_THREAD_ARGS *t)
+{
+    return pthread_create(thread, NULL, app_thread_run, t) == 0;
+}
+
+static void app_thread_wait(app_thread_t thread)
+{
+    pthread_join(thread, NULL);
+}
+# endif
+
+int app_run_threads(int num, void (*fn)(void *), void *args, size_t size)
+{
+    app_thread_t *threads;
+    APP_THREAD_ARGS *targs;
+    int i, started;
+
+    if (num == 1) {
+        fn(args);
+        return 1;
+    }
+    threads = app_malloc(num * sizeof(*threads), "threads");
+    targs = app_malloc(num * sizeof(*targs), "thread args");
+    for (started = 0; started < num; started++) {
+        targs[started].fn = fn;
+        targs[started].arg = (char *)args + started * size;
+        if (!app_thread_start(&threads[started], &targs[started])) {
+            BIO_printf(bio_err, "Unable to start thread %d\n", started);
+            break;
+        }
+    }
+    for (i = 0; i < started; i++)
+        app_thread_wait(threads[i]);
+    OPENSSL_free(threads);
+    OPENSSL_free(targs);
+    return started == num;
+}
+
+#else
+
+int app_run_threads(int num, void (*fn)(void *), void *args, size_t size)
+{
+    if (num != 1) {
+        BIO_printf(bio_err, "Threads are not supported by this build\n");
+        return 0;
+    }
+    fn(args);
+    return 1;
+}
+
+#endif
+
 int app_access(const char* name, int flag)
 {
 #ifdef _WIN32
@@ -259,30 +259,35 @@ static int urldecode(char *p)
 
 int http_server_get_asn1_req(const ASN1_ITEM *it, ASN1_VALUE **preq,
                              char **ppath, BIO **pcbio, BIO *acbio,
+                             int *found_keep_alive,
                              const char *prog, int accept_get, int timeout)
 {
-    BIO *cbio = NULL, *getbio = NULL, *b64 = NULL;
-    int len;
+    BIO *cbio = *pcbio, *getbio = NULL, *b64 = NULL;
+    int len, reused = cbio != NULL && found_keep_alive != NULL
+        && *found_keep_alive;
     char reqbuf[2048], inbuf[2048];
-    char *meth, *url, *end;
+    char *meth, *url, *end, *value;
     ASN1_VALUE *req;
     int ret = 1;
 
     *preq = NULL;
     if (ppath != NULL)
         *ppath = NULL;
-    *pcbio = NULL;
-
-    /* Connection loss before accept() is routine, ignore silently */
-    if (BIO_do_accept(acbio) <= 0)
-        return 0;
+    if (found_keep_alive != NULL)
+        *found_keep_alive = 0;
 
-    cbio = BIO_pop(acbio);
-    *pcbio = cbio;
     if (cbio == NULL) {
-        /* Cannot call http_server_send_status(cbio, ...) */
-        ret = -1;
-        goto out;
+        /* Connection loss before accept() is routine, ignore silently */
+        if (BIO_do_accept(acbio) <= 0)
+            return 0;
+
+        cbio = BIO_pop(acbio);
+        *pcbio = cbio;
+        if (cbio == NULL) {
+            /* Cannot call http_server_send_status(cbio, ...) */
+            ret = -1;
+            goto out;
+        }
     }
 
 # ifdef HTTP_DAEMON
@@ -294,6 +299,13 @@ int http_server_get_asn1_req(const ASN1_ITEM *it, ASN1_VALUE **preq,
 
     /* Read the request line. */
     len = BIO_gets(cbio, reqbuf, sizeof(reqbuf));
+    if (len <= 0 && reused) {
+        /* The client has closed the kept-alive connection, or timed out */
+        BIO_free_all(cbio);
+        *pcbio = NULL;
+        ret = 0;
+        goto out;
+    }
     if (len <= 0) {
         log_message(prog, LOG_INFO,
                     "Request line read error or empty request");
@@ -329,6 +341,9 @@ int http_server_get_asn1_req(const ASN1_ITEM *it, ASN1_VALUE **preq,
             (void)http_server_send_status(cbio, 400, "Bad Request");
             goto out;
         }
+        /* HTTP/1.1 connections are persistent by default */
+        if (found_keep_alive != NULL)
+            *found_keep_alive = end[8] == '1';
         *end = '\0';
 
         /*-
@@ -386,12 +401,24 @@ int http_server_get_asn1_req(const ASN1_ITEM *it, ASN1_VALUE **preq,
         }
         if ((inbuf[0] == '\r') || (inbuf[0] == '\n'))
             break;
+        if (found_keep_alive != NULL
+                && strncasecmp(inbuf, "Connection:", 11) == 0) {
+            for (value = inbuf + 11; *value == ' ' || *value == '\t'; value++)
+                continue;
+            if (strncasecmp(value, "keep-alive", 10) == 0)
+                *found_keep_alive = 1;
+            else if (strncasecmp(value, "close", 5) == 0)
+                *found_keep_alive = 0;
+        }
     }
 
 # ifdef HTTP_DAEMON
     /* Clear alarm before we close the client socket */
-    alarm(0);
-    timeout = 0;
+    if (timeout > 0) {
+        alarm(0);
+        acfd = (int)INVALID_SOCKET;
+        timeout = 0;
+    }
 # endif
 
     /* Try to read and parse request */
@@ -409,10 +436,15 @@ int http_server_get_asn1_req(const ASN1_ITEM *it, ASN1_VALUE **preq,
 
  out:
     BIO_free_all(getbio);
+    /* After a bad request, the rest of the stream cannot be trusted */
+    if (*preq == NULL && found_keep_alive != NULL)
+        *found_keep_alive = 0;
 # ifdef HTTP_DAEMON
-    if (timeout > 0)
+    /* Only the caller using the alarm, so a single thread, sets acfd */
+    if (timeout > 0) {
         alarm(0);
-    acfd = (int)INVALID_SOCKET;
+        acfd = (int)INVALID_SOCKET;
+    }
 # endif
     return ret;
 
@@ -429,12 +461,14 @@ int http_server_get_asn1_req(const ASN1_ITEM *it, ASN1_VALUE **preq,
 }
 
 /* assumes that cbio does not do an encoding that changes the output length */
-int http_server_send_asn1_resp(BIO *cbio, const char *content_type,
+int http_server_send_asn1_resp(BIO *cbio, int keep_alive,
+                               const char *content_type,
                                const ASN1_ITEM *it, const ASN1_VALUE *resp)
 {
-    int ret = BIO_printf(cbio, "HTTP/1.0 200 OK\r\nContent-type: %s\r\n"
-                         "Content-Length: %d\r\n\r\n", content_type,
-                         ASN1_item_i2d(resp, NULL, it)) > 0
+    int ret = BIO_printf(cbio, "HTTP/1.0 200 OK\r\n%sContent-type: %s\r\n"
+                         "Content-Length: %d\r\n\r\n",
+                         keep_alive ? "Connection: keep-alive\r\n" : "",
+                         content_type, ASN1_item_i2d(resp, NULL, it)) > 0
             && ASN1_item_i2d_bio(it, cbio, resp) > 0;
 
     (void)BIO_flush(cbio);
@@ -56,6 +56,54 @@ pid_t fork(void)
 /* Maximum leeway in validity period: default 5 minutes */
 #define MAX_VALIDITY_PERIOD    (5 * 60)
 
+#if defined(HTTP_DAEMON) && defined(OPENSSL_THREADS)
+# define OCSP_THREADS
+/* How long a kept-alive connection may stay idle if there is no -timeout */
+# define KEEP_ALIVE_TIMEOUT    10
+#endif
+
+/* Number of responses that -resp_cache keeps at most */
+#define RESP_CACHE_SLOTS       4096
+
+typedef struct {
+    unsigned char *id;          /* DER of the OCSP_CERTID asked for */
+    int id_len;
+    unsigned char *der;         /* DER of the signed OCSP_RESPONSE */
+    int der_len;
+    time_t expires;
+} RESP_CACHE_SLOT;
+
+/*
+ * Everything needed to answer requests.  With -threads, this is shared by
+ * all threads, which only read it apart from reloading the index.
+ */
+typedef struct {
+    CA_DB *rdb;
+    const char *ridx_filename;
+    CRYPTO_RWLOCK *db_lock;     /* taken for writing to change rdb */
+    STACK_OF(X509) *ca;
+    X509 *rcert;
+    EVP_PKEY *rkey;
+    const EVP_MD *rmd;
+    STACK_OF(OPENSSL_STRING) *sigopts;
+    STACK_OF(X509) *rother;
+    unsigned long flags;
+    int nmin, ndays, badsig;
+    const EVP_MD *resp_md;
+    RESP_CACHE_SLOT *cache;     /* NULL without -resp_cache */
+    int cache_secs;
+    CRYPTO_RWLOCK *cache_lock;
+#ifdef OCSP_THREADS
+    BIO *acbio;
+    int acfd;                   /* the listening socket */
+    CRYPTO_RWLOCK *accept_lock; /* only one thread accepts at a time */
+    CRYPTO_RWLOCK *count_lock;
+    int accept_count;           /* requests left, or -1 for unlimited */
+    int timeout;
+    uint64_t done;              /* accessed atomically, under count_lock */
+#endif
+} OCSP_RESPONDER;
+
 static int add_ocsp_cert(OCSP_REQUEST **req, X509 *cert,
                          const EVP_MD *cert_id_md, X509 *issuer,
                          STACK_OF(OCSP_CERTID) *ids);
@@ -72,16 +120,24 @@ static void make_ocsp_response(BIO *err, OCSP_RESPONSE **resp, OCSP_REQUEST *req
                               STACK_OF(OPENSSL_STRING) *sigopts,
                               STACK_OF(X509) *rother, unsigned long flags,
                               int nmin, int ndays, int badsig,
-                              const EVP_MD *resp_md);
+                              const EVP_MD *resp_md, EVP_MD_CTX *mctx);
+static OCSP_RESPONSE *respond(OCSP_RESPONDER *rsp, OCSP_REQUEST *req,
+                              EVP_MD_CTX *mctx);
+static void resp_cache_flush(OCSP_RESPONDER *rsp);
 
 static char **lookup_serial(CA_DB *db, ASN1_INTEGER *ser);
 static int do_responder(OCSP_REQUEST **preq, BIO **pcbio, BIO *acbio,
-                        int timeout);
-static int send_ocsp_response(BIO *cbio, const OCSP_RESPONSE *resp);
+                        int *keep_alive, int timeout);
+static int send_ocsp_response(BIO *cbio, int keep_alive,
+                              const OCSP_RESPONSE *resp);
 static char *prog;
 
 #ifdef HTTP_DAEMON
 static int index_changed(CA_DB *);
+static void reload_index(OCSP_RESPONDER *rsp);
+#endif
+#ifdef OCSP_THREADS
+static void responder_thread(void *arg);
 #endif
 
 typedef enum OPTION_choice {
@@ -103,7 +159,7 @@ typedef enum OPTION_choice {
     OPT_RCID,
     OPT_V_ENUM,
     OPT_MD,
-    OPT_MULTI, OPT_PROV_ENUM
+    OPT_MULTI, OPT_THREADS, OPT_RESP_CACHE, OPT_PROV_ENUM
 } OPTION_CHOICE;
 
 const OPTIONS ocsp_options[] = {
@@ -129,6 +185,12 @@ const OPTIONS ocsp_options[] = {
 #ifdef HTTP_DAEMON
     {"multi", OPT_MULTI, 'p', "run multiple responder processes"},
 #endif
+#ifdef OCSP_THREADS
+    {"threads", OPT_THREADS, 'p',
+     "run multiple responder threads, keeping connections alive"},
+#endif
+    {"resp_cache", OPT_RESP_CACHE, 'p',
+     "Reuse responses to requests without nonce for this many seconds"},
     {"no_certs", OPT_NO_CERTS, '-',
      "Don't include any certificates in signed request"},
     {"badsig", OPT_BADSIG, '-',
@@ -206,7 +268,8 @@ int ocsp_main(int argc, char **argv)
     const EVP_MD *cert_id_md = NULL, *rsign_md = NULL;
     STACK_OF(OPENSSL_STRING) *rsign_sigopts = NULL;
     int trailing_md = 0;
-    CA_DB *rdb = NULL;
+    OCSP_RESPONDER rsp;
+    EVP_MD_CTX *rmctx = NULL;
     EVP_PKEY *key = NULL, *rkey = NULL;
     OCSP_BASICRESP *bs = NULL;
     OCSP_REQUEST *req = NULL;
@@ -236,11 +299,16 @@ int ocsp_main(int argc, char **argv)
     int accept_count = -1, add_nonce = 1, noverify = 0, use_ssl = -1;
     int vpmtouched = 0, badsig = 0, i, ignore_err = 0, nmin = 0, ndays = -1;
     int req_text = 0, resp_text = 0, res, ret = 1;
-    int req_timeout = -1;
+    int req_timeout = -1, resp_cache_secs = 0;
+#ifdef OCSP_THREADS
+    int threads = 0;
+    OCSP_RESPONDER **targs = NULL;
+#endif
     long nsec = MAX_VALIDITY_PERIOD, maxage = -1;
     unsigned long sign_flags = 0, verify_flags = 0, rflags = 0;
     OPTION_CHOICE o;
 
+    memset(&rsp, 0, sizeof(rsp));
     reqnames = sk_OPENSSL_STRING_new_null();
     if (reqnames == NULL)
         goto end;
@@ -508,6 +576,14 @@ int ocsp_main(int argc, char **argv)
             multi = atoi(opt_arg());
 #endif
             break;
+        case OPT_THREADS:
+#ifdef OCSP_THREADS
+            threads = atoi(opt_arg());
+#endif
+            break;
+        case OPT_RESP_CACHE:
+            resp_cache_secs = atoi(opt_arg());
+            break;
         case OPT_PROV_CASES:
             if (!opt_provider(o))
                 goto end;
@@ -599,16 +675,59 @@ int ocsp_main(int argc, char **argv)
     }
 
     if (ridx_filename != NULL) {
-        rdb = load_index(ridx_filename, NULL);
-        if (rdb == NULL || index_index(rdb) <= 0) {
+        rsp.rdb = load_index(ridx_filename, NULL);
+        if (rsp.rdb == NULL || index_index(rsp.rdb) <= 0) {
             ret = 1;
             goto end;
         }
+        rsp.ridx_filename = ridx_filename;
+        rsp.ca = rca_cert;
+        rsp.rcert = rsigner;
+        rsp.rkey = rkey;
+        rsp.rmd = rsign_md;
+        rsp.sigopts = rsign_sigopts;
+        rsp.rother = rother;
+        rsp.flags = rflags;
+        rsp.nmin = nmin;
+        rsp.ndays = ndays;
+        rsp.badsig = badsig;
+        rsp.resp_md = resp_certid_md;
+        if ((rsp.db_lock = CRYPTO_THREAD_lock_new()) == NULL
+            || (rmctx = EVP_MD_CTX_new()) == NULL)
+            goto end;
+        if (resp_cache_secs > 0) {
+            rsp.cache = app_malloc(RESP_CACHE_SLOTS * sizeof(*rsp.cache),
+                                   "OCSP response cache");
+            memset(rsp.cache, 0, RESP_CACHE_SLOTS * sizeof(*rsp.cache));
+            rsp.cache_secs = resp_cache_secs;
+            if ((rsp.cache_lock = CRYPTO_THREAD_lock_new()) == NULL)
+                goto end;
+        }
     }
 
 #ifdef HTTP_DAEMON
     if (multi && acbio != NULL)
         spawn_loop(prog);
+# ifdef OCSP_THREADS
+    if (threads > 0 && acbio != NULL && rsp.rdb != NULL) {
+        rsp.acbio = acbio;
+        rsp.accept_count = accept_count;
+        rsp.timeout = req_timeout > 0 ? req_timeout : KEEP_ALIVE_TIMEOUT;
+        if (BIO_get_fd(acbio, &rsp.acfd) < 0
+            || (rsp.accept_lock = CRYPTO_THREAD_lock_new()) == NULL
+            || (rsp.count_lock = CRYPTO_THREAD_lock_new()) == NULL)
+            goto end;
+        targs = app_malloc(threads * sizeof(*targs), "responder threads");
+        for (i = 0; i < threads; i++)
+            targs[i] = &rsp;
+        log_message(prog, LOG_INFO,
+                    "waiting for OCSP client connections in %d threads...",
+                    threads);
+        if (app_run_threads(threads, responder_thread, targs, sizeof(*targs)))
+            ret = 0;
+        goto end;
+    }
+# endif
     if (acbio != NULL && req_timeout > 0)
         signal(SIGALRM, socket_timeout);
 #endif
@@ -619,23 +738,8 @@ int ocsp_main(int argc, char **argv)
 redo_accept:
 
     if (acbio != NULL) {
-#ifdef HTTP_DAEMON
-        if (index_changed(rdb)) {
-            CA_DB *newrdb = load_index(ridx_filename, NULL);
-
-            if (newrdb != NULL && index_index(newrdb) > 0) {
-                free_index(rdb);
-                rdb = newrdb;
-            } else {
-                free_index(newrdb);
-                log_message(prog, LOG_ERR, "error reloading updated index: %s",
-                            ridx_filename);
-            }
-        }
-#endif
-
         req = NULL;
-        res = do_responder(&req, &cbio, acbio, req_timeout);
+        res = do_responder(&req, &cbio, acbio, NULL, req_timeout);
         if (res == 0)
             goto redo_accept;
 
@@ -644,7 +748,7 @@ redo_accept:
                 resp =
                     OCSP_response_create(OCSP_RESPONSE_STATUS_MALFORMEDREQUEST,
                                          NULL);
-                send_ocsp_response(cbio, resp);
+                send_ocsp_response(cbio, 0, resp);
             }
             goto done_resp;
         }
@@ -698,12 +802,10 @@ redo_accept:
         BIO_free(derbio);
     }
 
-    if (rdb != NULL) {
-        make_ocsp_response(bio_err, &resp, req, rdb, rca_cert, rsigner, rkey,
-                           rsign_md, rsign_sigopts, rother, rflags, nmin, ndays, badsig,
-                           resp_certid_md);
+    if (rsp.rdb != NULL) {
+        resp = respond(&rsp, req, rmctx);
         if (cbio != NULL)
-            send_ocsp_response(cbio, resp);
+            send_ocsp_response(cbio, 0, resp);
     } else if (host != NULL) {
 #ifndef OPENSSL_NO_SOCK
         resp = process_responder(req, host, path,
@@ -834,7 +936,17 @@ redo_accept:
     sk_X509_pop_free(issuers, X509_free);
     X509_free(rsigner);
     sk_X509_pop_free(rca_cert, X509_free);
-    free_index(rdb);
+    resp_cache_flush(&rsp);
+    OPENSSL_free(rsp.cache);
+    CRYPTO_THREAD_lock_free(rsp.cache_lock);
+    CRYPTO_THREAD_lock_free(rsp.db_lock);
+#ifdef OCSP_THREADS
+    CRYPTO_THREAD_lock_free(rsp.accept_lock);
+    CRYPTO_THREAD_lock_free(rsp.count_lock);
+    OPENSSL_free(targs);
+#endif
+    EVP_MD_CTX_free(rmctx);
+    free_index(rsp.rdb);
     BIO_free_all(cbio);
     BIO_free_all(acbio);
     BIO_free_all(out);
@@ -863,14 +975,151 @@ static int index_changed(CA_DB *rdb)
         if (rdb->dbst.st_mtime != sb.st_mtime
             || rdb->dbst.st_ctime != sb.st_ctime
             || rdb->dbst.st_ino != sb.st_ino
-            || rdb->dbst.st_dev != sb.st_dev) {
-            syslog(LOG_INFO, "index file changed, reloading");
+            || rdb->dbst.st_dev != sb.st_dev)
             return 1;
+    }
+    return 0;
+}
+
+/*
+ * Reads what has been appended to the index, or else all of it again, if it
+ * has changed.  Responses cached so far may be out of date then.
+ */
+static void reload_index(OCSP_RESPONDER *rsp)
+{
+    CA_DB *newrdb;
+    int changed;
+
+    if (!CRYPTO_THREAD_read_lock(rsp->db_lock))
+        return;
+    changed = index_changed(rsp->rdb);
+    CRYPTO_THREAD_unlock(rsp->db_lock);
+    if (!changed || !CRYPTO_THREAD_write_lock(rsp->db_lock))
+        return;
+    /* Another thread may have reloaded it meanwhile */
+    if (!index_changed(rsp->rdb)) {
+        CRYPTO_THREAD_unlock(rsp->db_lock);
+        return;
+    }
+    syslog(LOG_INFO, "index file changed, reloading");
+    if (!load_index_tail(rsp->rdb)) {
+        newrdb = load_index(rsp->ridx_filename, NULL);
+        if (newrdb != NULL && index_index(newrdb) > 0) {
+            free_index(rsp->rdb);
+            rsp->rdb = newrdb;
+        } else {
+            free_index(newrdb);
+            log_message(prog, LOG_ERR, "error reloading updated index: %s",
+                        rsp->ridx_filename);
         }
     }
+    resp_cache_flush(rsp);
+    CRYPTO_THREAD_unlock(rsp->db_lock);
+}
+
+#endif
+
+#ifdef OCSP_THREADS
+
+static int is_done(OCSP_RESPONDER *rsp)
+{
+    uint64_t done = 1;
+
+    (void)CRYPTO_atomic_load(&rsp->done, &done, rsp->count_lock);
+    return done != 0;
+}
+
+/*
+ * Counts a request against -nrequest.  After the last one, stops all threads
+ * and returns 0, interrupting the one waiting in accept().
+ */
+static int count_request(OCSP_RESPONDER *rsp)
+{
+    uint64_t done;
+    int left;
+
+    if (rsp->accept_count == -1)
+        return 1;
+    if (CRYPTO_atomic_add(&rsp->accept_count, -1, &left, rsp->count_lock)
+        && left > 0)
+        return 1;
+    (void)CRYPTO_atomic_or(&rsp->done, 1, &done, rsp->count_lock);
+    (void)shutdown(rsp->acfd, SHUT_RD);
     return 0;
 }
 
+/* Waits for a new connection */
+static BIO *accept_connection(OCSP_RESPONDER *rsp)
+{
+    BIO *cbio = NULL;
+    struct timeval tv;
+    int fd;
+
+    if (!CRYPTO_THREAD_write_lock(rsp->accept_lock))
+        return NULL;
+    if (!is_done(rsp)) {
+        /* Connection loss before accept() is routine, ignore silently */
+        if (BIO_do_accept(rsp->acbio) > 0)
+            cbio = BIO_pop(rsp->acbio);
+    }
+    CRYPTO_THREAD_unlock(rsp->accept_lock);
+
+    /* The alarm() of -timeout would not work per thread */
+    if (cbio != NULL && BIO_get_fd(cbio, &fd) >= 0) {
+        tv.tv_sec = rsp->timeout;
+        tv.tv_usec = 0;
+        (void)setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, (void *)&tv, sizeof(tv));
+    }
+    return cbio;
+}
+
+/*
+ * Serves connections until -nrequest is reached, each with its own signing
+ * context.  Connections are kept alive as long as the clients want.
+ */
+static void responder_thread(void *arg)
+{
+    OCSP_RESPONDER *rsp = *(OCSP_RESPONDER **)arg;
+    EVP_MD_CTX *mctx = EVP_MD_CTX_new();
+    OCSP_REQUEST *req;
+    OCSP_RESPONSE *resp;
+    BIO *cbio = NULL;
+    int keep_alive = 0;
+
+    if (mctx == NULL) {
+        log_message(prog, LOG_ERR, "out of memory");
+        return;
+    }
+    while (!is_done(rsp)) {
+        if (cbio == NULL) {
+            if ((cbio = accept_connection(rsp)) == NULL)
+                continue;
+            keep_alive = 0; /* a new connection, not a kept-alive one */
+        }
+        if (do_responder(&req, &cbio, NULL, &keep_alive, 0) <= 0)
+            continue;
+        if (req == NULL)
+            resp = OCSP_response_create(OCSP_RESPONSE_STATUS_MALFORMEDREQUEST,
+                                        NULL);
+        else
+            resp = respond(rsp, req, mctx);
+        if (resp == NULL
+            || !send_ocsp_response(cbio, keep_alive && !is_done(rsp), resp))
+            keep_alive = 0;
+        if (!count_request(rsp))
+            keep_alive = 0;
+        OCSP_REQUEST_free(req);
+        OCSP_RESPONSE_free(resp);
+        ERR_clear_error();
+        if (!keep_alive) {
+            BIO_free_all(cbio);
+            cbio = NULL;
+        }
+    }
+    BIO_free_all(cbio);
+    EVP_MD_CTX_free(mctx);
+}
+
 #endif
 
 static int add_ocsp_cert(OCSP_REQUEST **req, X509 *cert,
@@ -1004,13 +1253,12 @@ static void make_ocsp_response(BIO *err, OCSP_RESPONSE **resp, OCSP_REQUEST *req
                               STACK_OF(OPENSSL_STRING) *sigopts,
                               STACK_OF(X509) *rother, unsigned long flags,
                               int nmin, int ndays, int badsig,
-                              const EVP_MD *resp_md)
+                              const EVP_MD *resp_md, EVP_MD_CTX *mctx)
 {
     ASN1_TIME *thisupd = NULL, *nextupd = NULL;
     OCSP_CERTID *cid;
     OCSP_BASICRESP *bs = NULL;
     int i, id_count;
-    EVP_MD_CTX *mctx = NULL;
     EVP_PKEY_CTX *pkctx = NULL;
 
     id_count = OCSP_request_onereq_count(req);
@@ -1106,8 +1354,8 @@ static void make_ocsp_response(BIO *err, OCSP_RESPONSE **resp, OCSP_REQUEST *req
 
     OCSP_copy_nonce(bs, req);
 
-    mctx = EVP_MD_CTX_new();
-    if ( mctx == NULL || !EVP_DigestSignInit(mctx, &pkctx, rmd, NULL, rkey)) {
+    /* |mctx| is reused from response to response, saving the setup of |rkey| */
+    if (!EVP_DigestSignInit(mctx, &pkctx, rmd, NULL, rkey)) {
         *resp = OCSP_response_create(OCSP_RESPONSE_STATUS_INTERNALERROR, NULL);
         goto end;
     }
@@ -1135,12 +1383,137 @@ static void make_ocsp_response(BIO *err, OCSP_RESPONSE **resp, OCSP_REQUEST *req
     *resp = OCSP_response_create(OCSP_RESPONSE_STATUS_SUCCESSFUL, bs);
 
  end:
-    EVP_MD_CTX_free(mctx);
     ASN1_TIME_free(thisupd);
     ASN1_TIME_free(nextupd);
     OCSP_BASICRESP_free(bs);
 }
 
+/*
+ * Returns the DER of the only certificate ID in |req|, or NULL if there is
+ * no cache or the response to |req| cannot be cached because of a nonce.
+ */
+static unsigned char *resp_cache_key(OCSP_RESPONDER *rsp, OCSP_REQUEST *req,
+                                     int *len)
+{
+    unsigned char *id = NULL;
+
+    if (rsp->cache == NULL || OCSP_request_onereq_count(req) != 1
+        || OCSP_REQUEST_get_ext_by_NID(req, NID_id_pkix_OCSP_Nonce, -1) >= 0)
+        return NULL;
+    *len = i2d_OCSP_CERTID(OCSP_onereq_get0_id(OCSP_request_onereq_get0(req,
+                                                                        0)),
+                           &id);
+    return *len > 0 ? id : NULL;
+}
+
+/* The cache is direct mapped, so its size is bounded */
+static RESP_CACHE_SLOT *resp_cache_slot(OCSP_RESPONDER *rsp,
+                                        const unsigned char *id, int len)
+{
+    unsigned long hash = 5381;
+    int i;
+
+    for (i = 0; i < len; i++)
+        hash = hash * 33 + id[i];
+    return &rsp->cache[hash % RESP_CACHE_SLOTS];
+}
+
+static OCSP_RESPONSE *resp_cache_get(OCSP_RESPONDER *rsp,
+                                     const unsigned char *id, int len)
+{
+    RESP_CACHE_SLOT *slot = resp_cache_slot(rsp, id, len);
+    OCSP_RESPONSE *resp = NULL;
+    const unsigned char *p;
+
+    if (!CRYPTO_THREAD_read_lock(rsp->cache_lock))
+        return NULL;
+    if (slot->id_len == len && memcmp(slot->id, id, len) == 0
+        && slot->expires > time(NULL)) {
+        p = slot->der;
+        resp = d2i_OCSP_RESPONSE(NULL, &p, slot->der_len);
+    }
+    CRYPTO_THREAD_unlock(rsp->cache_lock);
+    return resp;
+}
+
+/* Takes ownership of |id| */
+static void resp_cache_put(OCSP_RESPONDER *rsp, unsigned char *id, int len,
+                           OCSP_RESPONSE *resp)
+{
+    RESP_CACHE_SLOT *slot = resp_cache_slot(rsp, id, len);
+    unsigned char *der = NULL;
+    int der_len;
+
+    if (OCSP_response_status(resp) != OCSP_RESPONSE_STATUS_SUCCESSFUL
+        || (der_len = i2d_OCSP_RESPONSE(resp, &der)) <= 0
+        || !CRYPTO_THREAD_write_lock(rsp->cache_lock)) {
+        OPENSSL_free(id);
+        OPENSSL_free(der);
+        return;
+    }
+    OPENSSL_free(slot->id);
+    OPENSSL_free(slot->der);
+    slot->id = id;
+    slot->id_len = len;
+    slot->der = der;
+    slot->der_len = der_len;
+    slot->expires = time(NULL) + rsp->cache_secs;
+    CRYPTO_THREAD_unlock(rsp->cache_lock);
+}
+
+static void resp_cache_flush(OCSP_RESPONDER *rsp)
+{
+    size_t i;
+
+    if (rsp->cache == NULL || !CRYPTO_THREAD_write_lock(rsp->cache_lock))
+        return;
+    for (i = 0; i < RESP_CACHE_SLOTS; i++) {
+        OPENSSL_free(rsp->cache[i].id);
+        OPENSSL_free(rsp->cache[i].der);
+        memset(&rsp->cache[i], 0, sizeof(rsp->cache[i]));
+    }
+    CRYPTO_THREAD_unlock(rsp->cache_lock);
+}
+
+/*
+ * Answers |req| from the cache if possible, else signs a new response with
+ * |mctx|, which must not be used by other threads at the same time.
+ */
+static OCSP_RESPONSE *respond(OCSP_RESPONDER *rsp, OCSP_REQUEST *req,
+                              EVP_MD_CTX *mctx)
+{
+    OCSP_RESPONSE *resp = NULL;
+    unsigned char *id;
+    int id_len;
+
+#ifdef HTTP_DAEMON
+    /*
+     * Look at the index as it is now.  Checking before waiting for a
+     * connection would answer from an index that may since have changed.
+     */
+    if (rsp->ridx_filename != NULL)
+        reload_index(rsp);
+#endif
+    if ((id = resp_cache_key(rsp, req, &id_len)) != NULL
+        && (resp = resp_cache_get(rsp, id, id_len)) != NULL) {
+        OPENSSL_free(id);
+        return resp;
+    }
+    if (!CRYPTO_THREAD_read_lock(rsp->db_lock)) {
+        OPENSSL_free(id);
+        return OCSP_response_create(OCSP_RESPONSE_STATUS_INTERNALERROR, NULL);
+    }
+    make_ocsp_response(bio_err, &resp, req, rsp->rdb, rsp->ca, rsp->rcert,
+                       rsp->rkey, rsp->rmd, rsp->sigopts, rsp->rother,
+                       rsp->flags, rsp->nmin, rsp->ndays, rsp->badsig,
+                       rsp->resp_md, mctx);
+    /* Still under the lock, so that nothing out of date gets cached */
+    if (id != NULL)
+        resp_cache_put(rsp, id, id_len, resp);
+    CRYPTO_THREAD_unlock(rsp->db_lock);
+    return resp;
+}
+
 static char **lookup_serial(CA_DB *db, ASN1_INTEGER *ser)
 {
     int i;
@@ -1163,12 +1536,13 @@ static char **lookup_serial(CA_DB *db, ASN1_INTEGER *ser)
 }
 
 static int do_responder(OCSP_REQUEST **preq, BIO **pcbio, BIO *acbio,
-                        int timeout)
+                        int *keep_alive, int timeout)
 {
 #ifndef OPENSSL_NO_SOCK
-    return http_server_get_asn1_req(ASN1_ITEM_rptr(OCSP_RESPONSE),
+    return http_server_get_asn1_req(ASN1_ITEM_rptr(OCSP_REQUEST),
                                     (ASN1_VALUE **)preq, NULL, pcbio, acbio,
-                                    prog, 1 /* accept_get */, timeout);
+                                    keep_alive, prog, 1 /* accept_get */,
+                                    timeout);
 #else
     BIO_printf(bio_err,
                "Error getting OCSP request - sockets not supported\n");
@@ -1177,10 +1551,12 @@ static int do_responder(OCSP_REQUEST **preq, BIO **pcbio, BIO *acbio,
 #endif
 }
 
-static int send_ocsp_response(BIO *cbio, const OCSP_RESPONSE *resp)
+static int send_ocsp_response(BIO *cbio, int keep_alive,
+                              const OCSP_RESPONSE *resp)
 {
 #ifndef OPENSSL_NO_SOCK
-    return http_server_send_asn1_resp(cbio, "application/ocsp-response",
+    return http_server_send_asn1_resp(cbio, keep_alive,
+                                      "application/ocsp-response",
                                       ASN1_ITEM_rptr(OCSP_RESPONSE),
                                       (const ASN1_VALUE *)resp);
 #else
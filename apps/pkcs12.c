@@ -54,6 +54,31 @@ static int alg_print(const X509_ALGOR *alg);
 int cert_load(BIO *in, STACK_OF(X509) *sk);
 static int set_pbe(int *ppbe, const char *str);
 
+/*
+ * With -threads, all safes and shrouded key bags are decrypted ahead of time,
+ * and the results are taken from here while dumping.  Anything that failed
+ * is simply done again, so that its errors end up in the right queue.
+ */
+typedef struct {
+    int type;           /* The NID of |from| */
+    const void *from;   /* The PKCS7 or PKCS12_SAFEBAG */
+    void *result;       /* STACK_OF(PKCS12_SAFEBAG) or PKCS8_PRIV_KEY_INFO */
+} DECRYPTED;
+
+/* The share of the decryptions for one thread */
+typedef struct {
+    DECRYPTED *todo;
+    int num, start, step;
+    const char *pass;
+    int passlen;
+} DECRYPT_ARGS;
+
+static int threads = 1;
+static DECRYPTED *safes = NULL;     /* By position in the authsafes */
+static int num_safes = 0;
+static DECRYPTED *keys = NULL;      /* The shrouded key bags in dump order */
+static int num_keys = 0, next_key = 0;
+
 typedef enum OPTION_choice {
     OPT_ERR = -1, OPT_EOF = 0, OPT_HELP,
     OPT_CIPHER, OPT_NOKEYS, OPT_KEYEX, OPT_KEYSIG, OPT_NOCERTS, OPT_CLCERTS,
@@ -64,7 +89,7 @@ typedef enum OPTION_choice {
     OPT_NAME, OPT_CSP, OPT_CANAME,
     OPT_IN, OPT_OUT, OPT_PASSIN, OPT_PASSOUT, OPT_PASSWORD, OPT_CAPATH,
     OPT_CAFILE, OPT_CASTORE, OPT_NOCAPATH, OPT_NOCAFILE, OPT_NOCASTORE, OPT_ENGINE,
-    OPT_R_ENUM, OPT_PROV_ENUM, OPT_LEGACY_ALG
+    OPT_R_ENUM, OPT_PROV_ENUM, OPT_LEGACY_ALG, OPT_THREADS
 } OPTION_CHOICE;
 
 const OPTIONS pkcs12_options[] = {
@@ -100,6 +125,10 @@ const OPTIONS pkcs12_options[] = {
     {"", OPT_CIPHER, '-', "Any supported cipher for output encryption"},
     {"noenc", OPT_NOENC, '-', "Don't encrypt private keys"},
     {"nodes", OPT_NODES, '-', "Don't encrypt private keys; deprecated"},
+#ifdef OPENSSL_THREADS
+    {"threads", OPT_THREADS, 'p',
+     "Decrypt keys and certificates in this many threads"},
+#endif
 
     OPT_SECTION("PKCS#12 output (export)"),
     {"export", OPT_EXPORT, '-', "Create PKCS12 file"},
@@ -213,6 +242,10 @@ int pkcs12_main(int argc, char **argv)
         case OPT_NOMACVER:
             macver = 0;
             break;
+        case OPT_THREADS:
+            if (!opt_int(opt_arg(), &threads) || threads < 1)
+                goto opthelp;
+            break;
         case OPT_DESCERT:
             cert_pbe = NID_pbe_WithSHA1And3_Key_TripleDES_CBC;
             break;
@@ -779,6 +812,150 @@ int pkcs12_main(int argc, char **argv)
     return ret;
 }
 
+static void *take_decrypted(DECRYPTED *d)
+{
+    void *result = d->result;
+
+    d->result = NULL;
+    return result;
+}
+
+/* Take the decrypted safe at position |i| of the authenticated safes */
+static void *take_safe(int i, const PKCS7 *p7)
+{
+    if (i >= num_safes || safes[i].from != p7)
+        return NULL;
+    return take_decrypted(&safes[i]);
+}
+
+/*
+ * The shrouded key bags are dumped in the order in which they were
+ * collected, so only the next one needs to be looked at.  Those in safes
+ * that were not decrypted ahead of time were not collected.
+ */
+static void *take_key(const PKCS12_SAFEBAG *bag)
+{
+    if (next_key >= num_keys || keys[next_key].from != bag)
+        return NULL;
+    return take_decrypted(&keys[next_key++]);
+}
+
+static void free_decrypted(void)
+{
+    int i;
+
+    for (i = 0; i < num_safes; i++)
+        sk_PKCS12_SAFEBAG_pop_free(safes[i].result, PKCS12_SAFEBAG_free);
+    for (i = 0; i < num_keys; i++)
+        PKCS8_PRIV_KEY_INFO_free(keys[i].result);
+    OPENSSL_free(safes);
+    OPENSSL_free(keys);
+    safes = keys = NULL;
+    num_safes = num_keys = next_key = 0;
+}
+
+static int count_shrouded(const STACK_OF(PKCS12_SAFEBAG) *bags)
+{
+    const PKCS12_SAFEBAG *bag;
+    int i, n = 0;
+
+    for (i = 0; i < sk_PKCS12_SAFEBAG_num(bags); i++) {
+        bag = sk_PKCS12_SAFEBAG_value(bags, i);
+        if (PKCS12_SAFEBAG_get_nid(bag) == NID_pkcs8ShroudedKeyBag)
+            n++;
+        else if (PKCS12_SAFEBAG_get_nid(bag) == NID_safeContentsBag)
+            n += count_shrouded(PKCS12_SAFEBAG_get0_safes(bag));
+    }
+    return n;
+}
+
+static void collect_shrouded(const STACK_OF(PKCS12_SAFEBAG) *bags)
+{
+    const PKCS12_SAFEBAG *bag;
+    int i;
+
+    for (i = 0; i < sk_PKCS12_SAFEBAG_num(bags); i++) {
+        bag = sk_PKCS12_SAFEBAG_value(bags, i);
+        if (PKCS12_SAFEBAG_get_nid(bag) == NID_pkcs8ShroudedKeyBag) {
+            keys[num_keys].type = NID_pkcs8ShroudedKeyBag;
+            keys[num_keys++].from = bag;
+        } else if (PKCS12_SAFEBAG_get_nid(bag) == NID_safeContentsBag) {
+            collect_shrouded(PKCS12_SAFEBAG_get0_safes(bag));
+        }
+    }
+}
+
+static void decrypt_some(void *arg)
+{
+    DECRYPT_ARGS *args = arg;
+    DECRYPTED *d;
+    int i;
+
+    for (i = args->start; i < args->num; i += args->step) {
+        d = &args->todo[i];
+        if (d->type == NID_pkcs7_encrypted)
+            d->result = PKCS12_unpack_p7encdata((PKCS7 *)d->from,
+                                                args->pass, args->passlen);
+        else if (d->type == NID_pkcs8ShroudedKeyBag)
+            d->result = PKCS12_decrypt_skey(d->from,
+                                            args->pass, args->passlen);
+    }
+}
+
+/* Decrypt the |n| entries of |todo| in as many threads as make sense */
+static void decrypt_in_threads(DECRYPTED *todo, int n, const char *pass,
+                               int passlen)
+{
+    DECRYPT_ARGS *args;
+    int num = threads < n ? threads : n, i;
+
+    if (num < 2)
+        return;
+    args = app_malloc(num * sizeof(*args), "thread arguments");
+    for (i = 0; i < num; i++) {
+        args[i].todo = todo;
+        args[i].num = n;
+        args[i].start = i;
+        args[i].step = num;
+        args[i].pass = pass;
+        args[i].passlen = passlen;
+    }
+    (void)app_run_threads(num, decrypt_some, args, sizeof(*args));
+    OPENSSL_free(args);
+}
+
+/*
+ * The safes need to be decrypted first, as the shrouded key bags may be
+ * inside them.
+ */
+static void decrypt_ahead(const STACK_OF(PKCS7) *asafes, const char *pass,
+                          int passlen, int options)
+{
+    PKCS7 *p7;
+    int i, n = sk_PKCS7_num(asafes);
+
+    if (n <= 0 || (safes = OPENSSL_zalloc(n * sizeof(*safes))) == NULL)
+        return; /* It will be done while dumping */
+    for (num_safes = 0; num_safes < n; num_safes++) {
+        p7 = sk_PKCS7_value(asafes, num_safes);
+        safes[num_safes].type = OBJ_obj2nid(p7->type);
+        safes[num_safes].from = p7;
+        if (safes[num_safes].type == NID_pkcs7_data)
+            safes[num_safes].result = PKCS12_unpack_p7data(p7);
+    }
+    decrypt_in_threads(safes, num_safes, pass, passlen);
+    if ((options & NOKEYS) != 0)
+        return;
+
+    for (n = 0, i = 0; i < num_safes; i++)
+        n += count_shrouded(safes[i].result);
+    if (n <= 0 || (keys = OPENSSL_zalloc(n * sizeof(*keys))) == NULL)
+        return;
+    for (i = 0; i < num_safes; i++)
+        collect_shrouded(safes[i].result);
+    decrypt_in_threads(keys, num_keys, pass, passlen);
+}
+
 int dump_certs_keys_p12(BIO *out, const PKCS12 *p12, const char *pass,
                         int passlen, int options, char *pempass,
                         const EVP_CIPHER *enc)
@@ -791,11 +968,14 @@ int dump_certs_keys_p12(BIO *out, const PKCS12 *p12, const char *pass,
 
     if ((asafes = PKCS12_unpack_authsafes(p12)) == NULL)
         return 0;
+    if (threads > 1)
+        decrypt_ahead(asafes, pass, passlen, options);
     for (i = 0; i < sk_PKCS7_num(asafes); i++) {
         p7 = sk_PKCS7_value(asafes, i);
         bagnid = OBJ_obj2nid(p7->type);
         if (bagnid == NID_pkcs7_data) {
-            bags = PKCS12_unpack_p7data(p7);
+            if ((bags = take_safe(i, p7)) == NULL)
+                bags = PKCS12_unpack_p7data(p7);
             if (options & INFO)
                 BIO_printf(bio_err, "PKCS7 Data\n");
         } else if (bagnid == NID_pkcs7_encrypted) {
@@ -803,7 +983,8 @@ int dump_certs_keys_p12(BIO *out, const PKCS12 *p12, const char *pass,
                 BIO_printf(bio_err, "PKCS7 Encrypted data: ");
                 alg_print(p7->d.encrypted->enc_data->algorithm);
             }
-            bags = PKCS12_unpack_p7encdata(p7, pass, passlen);
+            if ((bags = take_safe(i, p7)) == NULL)
+                bags = PKCS12_unpack_p7encdata(p7, pass, passlen);
         } else {
             continue;
         }
@@ -820,6 +1001,7 @@ int dump_certs_keys_p12(BIO *out, const PKCS12 *p12, const char *pass,
     ret = 1;
 
  err:
+    free_decrypted();
     sk_PKCS7_pop_free(asafes, PKCS7_free);
     return ret;
 }
@@ -879,7 +1061,8 @@ int dump_certs_pkeys_bag(BIO *out, const PKCS12_SAFEBAG *bag,
         if (options & NOKEYS)
             return 1;
         print_attribs(out, attrs, "Bag Attributes");
-        if ((p8 = PKCS12_decrypt_skey(bag, pass, passlen)) == NULL)
+        if ((p8 = take_key(bag)) == NULL
+                && (p8 = PKCS12_decrypt_skey(bag, pass, passlen)) == NULL)
             return 0;
         if ((pkey = EVP_PKCS82PKEY(p8)) == NULL) {
             PKCS8_PRIV_KEY_INFO_free(p8);
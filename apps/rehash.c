@@ -49,6 +49,8 @@
 #  define NAME_MAX 255
 # endif
 # define MAX_COLLISIONS  256
+/* Kept in every directory processed with -incremental */
+# define MANIFEST        ".rehash_manifest"
 
 # if defined(OPENSSL_SYS_VXWORKS)
 /*
@@ -95,11 +97,35 @@ enum Hash {
     HASH_OLD, HASH_NEW, HASH_BOTH
 };
 
+/*
+ * What a file in the directory holds, either read from it or taken from the
+ * manifest if the file has not changed since.
+ */
+typedef struct finfo_st {
+    const char *filename;
+    char *fullpath;
+    time_t mtime;
+    off_t size;
+    int type;                   /* enum Type, or -1 for nothing to link */
+    int errs;
+    unsigned long hash_new, hash_old;
+    int hash_new_ok;            /* hash_new could be calculated */
+    unsigned char digest[EVP_MAX_MD_SIZE];
+} FINFO;
+
+/* The share of the files for one thread to read, see -threads */
+typedef struct {
+    FINFO **todo;
+    int num, start, step;
+} PARSE_ARGS;
+
 
 static int evpmdsize;
 static const EVP_MD *evpmd;
 static int remove_links = 1;
 static int verbose = 0;
+static int incremental = 0;
+static int threads = 1;
 static BUCKET *hash_table[257];
 
 static const char *suffixes[] = { "", "r" };
@@ -226,31 +252,38 @@ static int handle_symlink(const char *filename, const char *fullpath)
 }
 
 /*
- * process a file, return number of errors.
+ * Does it end with a recognized extension?
  */
-static int do_file(const char *filename, const char *fullpath, enum Hash h)
+static int has_extension(const char *filename)
 {
-    STACK_OF (X509_INFO) *inf = NULL;
-    X509_INFO *x;
-    const X509_NAME *name = NULL;
-    BIO *b;
     const char *ext;
-    unsigned char digest[EVP_MAX_MD_SIZE];
-    int type, errs = 0;
     size_t i;
 
-    /* Does it end with a recognized extension? */
     if ((ext = strrchr(filename, '.')) == NULL)
-        goto end;
+        return 0;
     for (i = 0; i < OSSL_NELEM(extensions); i++) {
         if (strcasecmp(extensions[i], ext + 1) == 0)
-            break;
+            return 1;
     }
-    if (i >= OSSL_NELEM(extensions))
-        goto end;
+    return 0;
+}
 
+/*
+ * Read a file into |fi|, return number of errors.  Several threads may run
+ * this at once, on different files.
+ */
+static int parse_file(FINFO *fi)
+{
+    STACK_OF (X509_INFO) *inf = NULL;
+    X509_INFO *x;
+    const X509_NAME *name = NULL;
+    BIO *b;
+    const char *filename = fi->filename;
+    int ok, errs = 0;
+
+    fi->type = -1;
     /* Does it have X.509 data in it? */
-    if ((b = BIO_new_file(fullpath, "r")) == NULL) {
+    if ((b = BIO_new_file(fi->fullpath, "r")) == NULL) {
         BIO_printf(bio_err, "%s: error: skipping %s, cannot open file\n",
                    opt_getprog(), filename);
         errs++;
@@ -271,17 +304,17 @@ static int do_file(const char *filename, const char *fullpath, enum Hash h)
     }
     x = sk_X509_INFO_value(inf, 0);
     if (x->x509 != NULL) {
-        type = TYPE_CERT;
+        fi->type = TYPE_CERT;
         name = X509_get_subject_name(x->x509);
-        if (!X509_digest(x->x509, evpmd, digest, NULL)) {
+        if (!X509_digest(x->x509, evpmd, fi->digest, NULL)) {
             BIO_printf(bio_err, "out of memory\n");
             ++errs;
             goto end;
         }
     } else if (x->crl != NULL) {
-        type = TYPE_CRL;
+        fi->type = TYPE_CRL;
         name = X509_CRL_get_issuer(x->crl);
-        if (!X509_CRL_digest(x->crl, evpmd, digest, NULL)) {
+        if (!X509_CRL_digest(x->crl, evpmd, fi->digest, NULL)) {
             BIO_printf(bio_err, "out of memory\n");
             ++errs;
             goto end;
@@ -290,31 +323,180 @@ static int do_file(const char *filename, const char *fullpath, enum Hash h)
         ++errs;
         goto end;
     }
-    if (name != NULL) {
-        if (h == HASH_NEW || h == HASH_BOTH) {
-            int ok;
-            unsigned long hash_value =
-                X509_NAME_hash_ex(name,
-                                  app_get0_libctx(), app_get0_propq(), &ok);
-
-            if (ok) {
-                errs += add_entry(type, hash_value, filename, digest, 1, ~0);
-            } else {
-                BIO_printf(bio_err, "%s: error calculating SHA1 hash value\n",
-                           opt_getprog());
-                errs++;
-            }
-        }
-        if ((h == HASH_OLD) || (h == HASH_BOTH))
-            errs += add_entry(type, X509_NAME_hash_old(name),
-                              filename, digest, 1, ~0);
-    }
+    /*
+     * Both hashes are kept, so that the manifest serves any of them.  A
+     * failing new-style hash is only an error if it is needed, see add_file.
+     */
+    fi->hash_new = X509_NAME_hash_ex(name, app_get0_libctx(),
+                                     app_get0_propq(), &ok);
+    fi->hash_new_ok = ok;
+    fi->hash_old = X509_NAME_hash_old(name);
 
 end:
+    if (errs > 0)
+        fi->type = -1;
     sk_X509_INFO_pop_free(inf, X509_INFO_free);
+    return fi->errs = errs;
+}
+
+static void parse_files(void *arg)
+{
+    PARSE_ARGS *pa = arg;
+    int i;
+
+    for (i = pa->start; i < pa->num; i += pa->step)
+        parse_file(pa->todo[i]);
+}
+
+/*
+ * Add the links a file needs, return number of errors.
+ */
+static int add_file(const FINFO *fi, enum Hash h)
+{
+    int errs = 0;
+
+    if (fi->type < 0)
+        return 0;
+    if ((h == HASH_NEW || h == HASH_BOTH) && !fi->hash_new_ok) {
+        BIO_printf(bio_err, "%s: error calculating SHA1 hash value\n",
+                   opt_getprog());
+        errs++;
+    } else if (h == HASH_NEW || h == HASH_BOTH) {
+        errs += add_entry(fi->type, fi->hash_new, fi->filename, fi->digest,
+                          1, ~0);
+    }
+    if (h == HASH_OLD || h == HASH_BOTH)
+        errs += add_entry(fi->type, fi->hash_old, fi->filename, fi->digest,
+                          1, ~0);
     return errs;
 }
 
+/* Compares manifest lines, and file names, up to the first tab */
+static int manifest_cmp(const char *const *a, const char *const *b)
+{
+    const char *p = *a, *q = *b;
+
+    for (; *p == *q && *p != '\0' && *p != '\t'; p++, q++)
+        continue;
+    if ((*p == '\0' || *p == '\t') && (*q == '\0' || *q == '\t'))
+        return 0;
+    return (unsigned char)*p - (unsigned char)*q;
+}
+
+/*
+ * Read the manifest of a directory, one line per file:
+ * name, mtime, size, type and, for certificates and CRLs,
+ * new hash, old hash and digest.
+ */
+static STACK_OF(OPENSSL_STRING) *load_manifest(const char *path)
+{
+    STACK_OF(OPENSSL_STRING) *lines = sk_OPENSSL_STRING_new(manifest_cmp);
+    BIO *in = NULL;
+    char buf[NAME_MAX + 256], *line, *nl;
+
+    if (lines == NULL)
+        return NULL;
+    /* A missing manifest is fine, then all files are read */
+    if ((in = BIO_new_file(path, "r")) == NULL) {
+        ERR_clear_error();
+        return lines;
+    }
+    while (BIO_gets(in, buf, sizeof(buf)) > 0) {
+        if ((nl = strchr(buf, '\n')) == NULL)
+            continue;
+        *nl = '\0';
+        if ((line = OPENSSL_strdup(buf)) == NULL
+                || sk_OPENSSL_STRING_push(lines, line) == 0) {
+            OPENSSL_free(line);
+            break;
+        }
+    }
+    BIO_free(in);
+    sk_OPENSSL_STRING_sort(lines);
+    return lines;
+}
+
+/*
+ * Fill |fi| from the manifest if the file is listed there with the same
+ * time and size, return 1 if so.
+ */
+static int from_manifest(STACK_OF(OPENSSL_STRING) *manifest, FINFO *fi)
+{
+    const char *line, *p;
+    long long mtime, size;
+    int type, i, n;
+
+    if (manifest == NULL
+        || (i = sk_OPENSSL_STRING_find(manifest, (char *)fi->filename)) < 0)
+        return 0;
+    line = sk_OPENSSL_STRING_value(manifest, i);
+    p = line + strlen(fi->filename);
+    if (sscanf(p, "%lld %lld %d%n", &mtime, &size, &type, &n) != 3
+            || mtime != (long long)fi->mtime || size != (long long)fi->size)
+        return 0;
+    fi->type = type;
+    if (type < 0)
+        return 1;
+    p += n;
+    if (sscanf(p, "%lx %lx%n", &fi->hash_new, &fi->hash_old, &n) != 2)
+        return 0;
+    fi->hash_new_ok = 1;
+    p += n;
+    while (*p == '\t' || *p == ' ')
+        p++;
+    for (i = 0; i < evpmdsize; i++, p += 2) {
+        if (!isxdigit(_UC(p[0])) || !isxdigit(_UC(p[1])))
+            return 0;
+        fi->digest[i] = (OPENSSL_hexchar2int(p[0]) << 4)
+            | OPENSSL_hexchar2int(p[1]);
+    }
+    return 1;
+}
+
+/*
+ * Write the manifest to a temporary file first, and rename it, so that it is
+ * never seen half written.  Files that had errors, or lack a hash, are left
+ * out of it.
+ */
+static int save_manifest(const char *path, const char *tmp,
+                         FINFO *finfo, int num)
+{
+    BIO *out;
+    int i, j, ok = 1;
+
+    if ((out = BIO_new_file(tmp, "w")) == NULL) {
+        BIO_printf(bio_err, "%s: Can't write %s\n", opt_getprog(), tmp);
+        return 0;
+    }
+    for (i = 0; i < num && ok; i++) {
+        const FINFO *fi = &finfo[i];
+
+        if (fi->errs > 0 || (fi->type >= 0 && !fi->hash_new_ok)
+                || strpbrk(fi->filename, "\t\n") != NULL)
+            continue;
+        ok = BIO_printf(out, "%s\t%lld\t%lld\t%d", fi->filename,
+                        (long long)fi->mtime, (long long)fi->size,
+                        fi->type) > 0;
+        if (ok && fi->type >= 0) {
+            ok = BIO_printf(out, "\t%08lx\t%08lx\t",
+                            fi->hash_new, fi->hash_old) > 0;
+            for (j = 0; ok && j < evpmdsize; j++)
+                ok = BIO_printf(out, "%02x", fi->digest[j]) > 0;
+        }
+        ok = ok && BIO_puts(out, "\n") > 0;
+    }
+    if (BIO_flush(out) <= 0)
+        ok = 0;
+    BIO_free(out);
+    if (!ok || rename(tmp, path) < 0) {
+        BIO_printf(bio_err, "%s: Can't write %s, %s\n",
+                   opt_getprog(), path, strerror(errno));
+        (void)unlink(tmp);
+        return 0;
+    }
+    return 1;
+}
+
 static void str_free(char *s)
 {
     OPENSSL_free(s);
@@ -344,12 +526,14 @@ static int do_dir(const char *dirname, enum Hash h)
     OPENSSL_DIR_CTX *d = NULL;
     struct stat st;
     unsigned char idmask[MAX_COLLISIONS / 8];
-    int n, numfiles, nextid, buflen, errs = 0;
+    int n, numfiles, numinfo = 0, numtodo = 0, nextid, buflen, errs = 0;
     size_t i;
     const char *pathsep;
     const char *filename;
-    char *buf, *copy = NULL;
-    STACK_OF(OPENSSL_STRING) *files = NULL;
+    char *buf, *tmp, *copy = NULL;
+    STACK_OF(OPENSSL_STRING) *files = NULL, *manifest = NULL;
+    FINFO *finfo = NULL, *fi, **todo = NULL;
+    PARSE_ARGS *pargs = NULL;
 
     if (app_access(dirname, W_OK) < 0) {
         BIO_printf(bio_err, "Skipping %s, can't write\n", dirname);
@@ -359,6 +543,9 @@ static int do_dir(const char *dirname, enum Hash h)
     pathsep = (buflen && !ends_with_dirsep(dirname)) ? "/": "";
     buflen += NAME_MAX + 1 + 1;
     buf = app_malloc(buflen, "filename buffer");
+    tmp = app_malloc(buflen, "filename buffer");
+    /* Where new links and the manifest are made before renaming them */
+    BIO_snprintf(tmp, buflen, "%s%s.rehash_tmp", dirname, pathsep);
 
     if (verbose)
         BIO_printf(bio_out, "Doing %s\n", dirname);
@@ -380,7 +567,19 @@ static int do_dir(const char *dirname, enum Hash h)
     OPENSSL_DIR_end(&d);
     sk_OPENSSL_STRING_sort(files);
 
+    if (incremental) {
+        BIO_snprintf(buf, buflen, "%s%s%s", dirname, pathsep, MANIFEST);
+        if ((manifest = load_manifest(buf)) == NULL) {
+            BIO_puts(bio_err, "out of memory\n");
+            errs = 1;
+            goto err;
+        }
+    }
+
+    /* Only files that are new or have changed need to be read */
     numfiles = sk_OPENSSL_STRING_num(files);
+    finfo = app_malloc(sizeof(*finfo) * (numfiles + 1), "file info");
+    todo = app_malloc(sizeof(*todo) * (numfiles + 1), "file info");
     for (n = 0; n < numfiles; ++n) {
         filename = sk_OPENSSL_STRING_value(files, n);
         if (BIO_snprintf(buf, buflen, "%s%s%s",
@@ -390,8 +589,45 @@ static int do_dir(const char *dirname, enum Hash h)
             continue;
         if (S_ISLNK(st.st_mode) && handle_symlink(filename, buf) == 0)
             continue;
-        errs += do_file(filename, buf, h);
+        if (!has_extension(filename))
+            continue;
+        fi = &finfo[numinfo++];
+        memset(fi, 0, sizeof(*fi));
+        fi->filename = filename;
+        fi->mtime = st.st_mtime;
+        fi->size = st.st_size;
+        if (from_manifest(manifest, fi))
+            continue;
+        fi->fullpath = OPENSSL_strdup(buf);
+        if (fi->fullpath == NULL) {
+            BIO_puts(bio_err, "out of memory\n");
+            errs = 1;
+            numinfo--;
+            goto err;
+        }
+        todo[numtodo++] = fi;
+    }
+    if (verbose && incremental)
+        BIO_printf(bio_out, "Reading %d of %d files\n", numtodo, numinfo);
+
+    if (threads > 1 && numtodo > 1) {
+        pargs = app_malloc(sizeof(*pargs) * threads, "thread arguments");
+        for (n = 0; n < threads; n++) {
+            pargs[n].todo = todo;
+            pargs[n].num = numtodo;
+            pargs[n].start = n;
+            pargs[n].step = threads;
+        }
+        if (!app_run_threads(threads, parse_files, pargs, sizeof(*pargs))) {
+            errs = 1;
+            goto err;
+        }
+    } else {
+        for (n = 0; n < numtodo; n++)
+            parse_file(todo[n]);
     }
+    for (n = 0; n < numinfo; n++)
+        errs += finfo[n].errs + add_file(&finfo[n], h);
 
     for (i = 0; i < OSSL_NELEM(hash_table); i++) {
         for (bp = hash_table[i]; bp; bp = nextbp) {
@@ -422,18 +658,28 @@ static int do_dir(const char *dirname, enum Hash h)
                     if (verbose)
                         BIO_printf(bio_out, "link %s -> %s\n",
                                    ep->filename, &buf[n]);
-                    if (unlink(buf) < 0 && errno != ENOENT) {
+                    /*
+                     * Replace any old link at once, so that lookups in the
+                     * directory never miss it
+                     */
+                    if (unlink(tmp) < 0 && errno != ENOENT) {
                         BIO_printf(bio_err,
                                    "%s: Can't unlink %s, %s\n",
-                                   opt_getprog(), buf, strerror(errno));
+                                   opt_getprog(), tmp, strerror(errno));
                         errs++;
                     }
-                    if (symlink(ep->filename, buf) < 0) {
+                    if (symlink(ep->filename, tmp) < 0) {
                         BIO_printf(bio_err,
                                    "%s: Can't symlink %s, %s\n",
                                    opt_getprog(), ep->filename,
                                    strerror(errno));
                         errs++;
+                    } else if (rename(tmp, buf) < 0) {
+                        BIO_printf(bio_err,
+                                   "%s: Can't rename %s to %s, %s\n",
+                                   opt_getprog(), tmp, buf, strerror(errno));
+                        (void)unlink(tmp);
+                        errs++;
                     }
                     bit_set(idmask, nextid);
                 } else if (remove_links) {
@@ -459,15 +705,28 @@ static int do_dir(const char *dirname, enum Hash h)
         hash_table[i] = NULL;
     }
 
+    if (incremental) {
+        BIO_snprintf(buf, buflen, "%s%s%s", dirname, pathsep, MANIFEST);
+        if (!save_manifest(buf, tmp, finfo, numinfo))
+            errs++;
+    }
+
  err:
+    for (n = 0; n < numinfo; n++)
+        OPENSSL_free(finfo[n].fullpath);
+    OPENSSL_free(finfo);
+    OPENSSL_free(todo);
+    OPENSSL_free(pargs);
+    sk_OPENSSL_STRING_pop_free(manifest, str_free);
     sk_OPENSSL_STRING_pop_free(files, str_free);
     OPENSSL_free(buf);
+    OPENSSL_free(tmp);
     return errs;
 }
 
 typedef enum OPTION_choice {
     OPT_ERR = -1, OPT_EOF = 0, OPT_HELP,
-    OPT_COMPAT, OPT_OLD, OPT_N, OPT_VERBOSE,
+    OPT_COMPAT, OPT_OLD, OPT_N, OPT_VERBOSE, OPT_INCREMENTAL, OPT_THREADS,
     OPT_PROV_ENUM
 } OPTION_CHOICE;
 
@@ -480,6 +739,11 @@ const OPTIONS rehash_options[] = {
     {"compat", OPT_COMPAT, '-', "Create both new- and old-style hash links"},
     {"old", OPT_OLD, '-', "Use old-style hash to generate links"},
     {"n", OPT_N, '-', "Do not remove existing links"},
+    {"incremental", OPT_INCREMENTAL, '-',
+     "Only read files that changed since the last run with this option"},
+#ifdef OPENSSL_THREADS
+    {"threads", OPT_THREADS, 'p', "Read files in this many threads"},
+#endif
 
     OPT_SECTION("Output"),
     {"v", OPT_VERBOSE, '-', "Verbose output"},
@@ -522,6 +786,15 @@ int rehash_main(int argc, char **argv)
         case OPT_VERBOSE:
             verbose = 1;
             break;
+        case OPT_INCREMENTAL:
+            incremental = 1;
+            break;
+        case OPT_THREADS:
+            if (!opt_int(opt_arg(), &threads) || threads < 1) {
+                BIO_printf(bio_err, "%s: Use -help for summary.\n", prog);
+                goto end;
+            }
+            break;
         case OPT_PROV_CASES:
             if (!opt_provider(o))
                 goto end;
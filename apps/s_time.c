@@ -34,6 +34,21 @@
 
 static SSL *doConnection(SSL *scon, const char *host, SSL_CTX *ctx);
 
+/* What every thread needs to make its connections, and what it counts */
+typedef struct {
+    SSL_CTX *ctx;
+    SSL *scon;                  /* to reuse its session, or NULL */
+    const char *host;
+    const char *www_path;
+    long finishtime;
+    int nConn;
+    long bytes_read;
+    int ok;
+} TIME_ARGS;
+
+static void time_connections(void *arg);
+static void close_connection(SSL *scon);
+
 /*
  * Define a HTTP get command globally.
  * Also define the size of the command, this is two bytes less than
@@ -48,7 +63,7 @@ typedef enum OPTION_choice {
     OPT_CAPATH, OPT_CAFILE, OPT_CASTORE,
     OPT_NOCAPATH, OPT_NOCAFILE, OPT_NOCASTORE,
     OPT_NEW, OPT_REUSE, OPT_BUGS, OPT_VERIFY, OPT_TIME, OPT_SSL3,
-    OPT_WWW, OPT_TLS1, OPT_TLS1_1, OPT_TLS1_2, OPT_TLS1_3,
+    OPT_WWW, OPT_TLS1, OPT_TLS1_1, OPT_TLS1_2, OPT_TLS1_3, OPT_THREADS,
     OPT_PROV_ENUM
 } OPTION_CHOICE;
 
@@ -84,6 +99,10 @@ const OPTIONS s_time_options[] = {
      "Turn on peer certificate verification, set depth"},
     {"time", OPT_TIME, 'p', "Seconds to collect data, default " SECONDSSTR},
     {"www", OPT_WWW, 's', "Fetch specified page from the site"},
+#ifdef OPENSSL_THREADS
+    {"threads", OPT_THREADS, 'p',
+     "Make connections from this many threads sharing one SSL_CTX"},
+#endif
 
     OPT_SECTION("Certificate"),
     {"nameopt", OPT_NAMEOPT, 's', "Certificate subject/issuer name printing options"},
@@ -115,8 +134,8 @@ static double tm_Time_F(int s)
 int s_time_main(int argc, char **argv)
 {
     char buf[1024 * 8];
-    SSL *scon = NULL;
     SSL_CTX *ctx = NULL;
+    TIME_ARGS *targs = NULL;
     const SSL_METHOD *meth = NULL;
     char *CApath = NULL, *CAfile = NULL, *CAstore = NULL;
     char *cipher = NULL, *ciphersuites = NULL;
@@ -125,9 +144,10 @@ int s_time_main(int argc, char **argv)
     double totalTime = 0.0;
     int noCApath = 0, noCAfile = 0, noCAstore = 0;
     int maxtime = SECONDS, nConn = 0, perform = 3, ret = 1, i, st_bugs = 0;
+    int threads = 1;
     long bytes_read = 0, finishtime = 0;
     OPTION_CHOICE o;
-    int min_version = 0, max_version = 0, ver, buf_len;
+    int min_version = 0, max_version = 0, buf_len;
     size_t buf_size;
 
     meth = TLS_client_method();
@@ -228,6 +248,10 @@ int s_time_main(int argc, char **argv)
             min_version = TLS1_3_VERSION;
             max_version = TLS1_3_VERSION;
             break;
+        case OPT_THREADS:
+            if (!opt_int(opt_arg(), &threads) || threads < 1)
+                goto opthelp;
+            break;
         case OPT_PROV_CASES:
             if (!opt_provider(o))
                 goto end;
@@ -267,52 +291,37 @@ int s_time_main(int argc, char **argv)
         ERR_print_errors(bio_err);
         goto end;
     }
+    targs = app_malloc(threads * sizeof(*targs), "thread arguments");
+    memset(targs, 0, threads * sizeof(*targs));
+    for (i = 0; i < threads; i++) {
+        targs[i].ctx = ctx;
+        targs[i].host = host;
+        targs[i].www_path = www_path;
+    }
+
     if (!(perform & 1))
         goto next;
     printf("Collecting connection statistics for %d seconds\n", maxtime);
+    if (threads > 1)
+        printf("Using %d threads\n", threads);
 
     /* Loop and time how long it takes to make connections */
 
-    bytes_read = 0;
     finishtime = (long)time(NULL) + maxtime;
+    for (i = 0; i < threads; i++)
+        targs[i].finishtime = finishtime;
     tm_Time_F(START);
-    for (;;) {
-        if (finishtime < (long)time(NULL))
-            break;
+    if (!app_run_threads(threads, time_connections, targs, sizeof(*targs)))
+        goto end;
+    totalTime += tm_Time_F(STOP); /* Add the time for this iteration */
 
-        if ((scon = doConnection(NULL, host, ctx)) == NULL)
+    bytes_read = 0;
+    for (i = 0; i < threads; i++) {
+        if (!targs[i].ok)
             goto end;
-
-        if (www_path != NULL) {
-            buf_len = BIO_snprintf(buf, sizeof(buf), fmt_http_get_cmd,
-                                   www_path);
-            if (buf_len <= 0 || SSL_write(scon, buf, buf_len) <= 0)
-                goto end;
-            while ((i = SSL_read(scon, buf, sizeof(buf))) > 0)
-                bytes_read += i;
-        }
-        SSL_set_shutdown(scon, SSL_SENT_SHUTDOWN | SSL_RECEIVED_SHUTDOWN);
-        BIO_closesocket(SSL_get_fd(scon));
-
-        nConn += 1;
-        if (SSL_session_reused(scon)) {
-            ver = 'r';
-        } else {
-            ver = SSL_version(scon);
-            if (ver == TLS1_VERSION)
-                ver = 't';
-            else if (ver == SSL3_VERSION)
-                ver = '3';
-            else
-                ver = '*';
-        }
-        fputc(ver, stdout);
-        fflush(stdout);
-
-        SSL_free(scon);
-        scon = NULL;
+        nConn += targs[i].nConn;
+        bytes_read += targs[i].bytes_read;
     }
-    totalTime += tm_Time_F(STOP); /* Add the time for this iteration */
 
     i = (int)((long)time(NULL) - finishtime + maxtime);
     printf
@@ -331,50 +340,101 @@ int s_time_main(int argc, char **argv)
         goto end;
     printf("\n\nNow timing with session id reuse.\n");
 
-    /* Get an SSL object so we can reuse the session id */
-    if ((scon = doConnection(NULL, host, ctx)) == NULL) {
-        BIO_printf(bio_err, "Unable to get connection\n");
-        goto end;
-    }
+    /* Get an SSL object per thread so we can reuse the session id */
+    for (i = 0; i < threads; i++) {
+        SSL *scon = doConnection(NULL, host, ctx);
 
-    if (www_path != NULL) {
-        buf_len = BIO_snprintf(buf, sizeof(buf), fmt_http_get_cmd, www_path);
-        if (buf_len <= 0 || SSL_write(scon, buf, buf_len) <= 0)
+        if ((targs[i].scon = scon) == NULL) {
+            BIO_printf(bio_err, "Unable to get connection\n");
             goto end;
-        while ((i = SSL_read(scon, buf, sizeof(buf))) > 0)
-            continue;
+        }
+
+        if (www_path != NULL) {
+            buf_len = BIO_snprintf(buf, sizeof(buf), fmt_http_get_cmd,
+                                   www_path);
+            if (buf_len <= 0 || SSL_write(scon, buf, buf_len) <= 0)
+                goto end;
+            while (SSL_read(scon, buf, sizeof(buf)) > 0)
+                continue;
+        }
+        close_connection(scon);
+        targs[i].nConn = 0;
+        targs[i].bytes_read = 0;
+        targs[i].ok = 0;
     }
-    SSL_set_shutdown(scon, SSL_SENT_SHUTDOWN | SSL_RECEIVED_SHUTDOWN);
-    BIO_closesocket(SSL_get_fd(scon));
 
     nConn = 0;
     totalTime = 0.0;
 
     finishtime = (long)time(NULL) + maxtime;
+    for (i = 0; i < threads; i++)
+        targs[i].finishtime = finishtime;
 
     printf("starting\n");
     bytes_read = 0;
     tm_Time_F(START);
+    if (!app_run_threads(threads, time_connections, targs, sizeof(*targs)))
+        goto end;
+    totalTime += tm_Time_F(STOP); /* Add the time for this iteration */
+
+    for (i = 0; i < threads; i++) {
+        if (!targs[i].ok)
+            goto end;
+        nConn += targs[i].nConn;
+        bytes_read += targs[i].bytes_read;
+    }
+
+    printf
+        ("\n\n%d connections in %.2fs; %.2f connections/user sec, bytes read %ld\n",
+         nConn, totalTime, ((double)nConn / totalTime), bytes_read);
+    printf
+        ("%d connections in %ld real seconds, %ld bytes read per connection\n",
+         nConn, (long)time(NULL) - finishtime + maxtime, bytes_read / nConn);
+
+    ret = 0;
+
+ end:
+    if (targs != NULL) {
+        for (i = 0; i < threads; i++)
+            SSL_free(targs[i].scon);
+        OPENSSL_free(targs);
+    }
+    SSL_CTX_free(ctx);
+    return ret;
+}
+
+/*
+ * Makes connections until the time is up, each with a new SSL object or
+ * with the session of t->scon.  Several threads may run this at once.
+ */
+static void time_connections(void *arg)
+{
+    TIME_ARGS *t = arg;
+    char buf[1024 * 8];
+    SSL *scon;
+    int i, ver, buf_len;
 
     for (;;) {
-        if (finishtime < (long)time(NULL))
+        if (t->finishtime < (long)time(NULL))
             break;
 
-        if ((doConnection(scon, host, ctx)) == NULL)
-            goto end;
+        if ((scon = doConnection(t->scon, t->host, t->ctx)) == NULL)
+            return;
 
-        if (www_path != NULL) {
+        if (t->www_path != NULL) {
             buf_len = BIO_snprintf(buf, sizeof(buf), fmt_http_get_cmd,
-                                   www_path);
-            if (buf_len <= 0 || SSL_write(scon, buf, buf_len) <= 0)
-                goto end;
+                                   t->www_path);
+            if (buf_len <= 0 || SSL_write(scon, buf, buf_len) <= 0) {
+                if (scon != t->scon)
+                    SSL_free(scon);
+                return;
+            }
             while ((i = SSL_read(scon, buf, sizeof(buf))) > 0)
-                bytes_read += i;
+                t->bytes_read += i;
         }
-        SSL_set_shutdown(scon, SSL_SENT_SHUTDOWN | SSL_RECEIVED_SHUTDOWN);
-        BIO_closesocket(SSL_get_fd(scon));
+        close_connection(scon);
 
-        nConn += 1;
+        t->nConn += 1;
         if (SSL_session_reused(scon)) {
             ver = 'r';
         } else {
@@ -388,22 +448,22 @@ int s_time_main(int argc, char **argv)
         }
         fputc(ver, stdout);
         fflush(stdout);
-    }
-    totalTime += tm_Time_F(STOP); /* Add the time for this iteration */
-
-    printf
-        ("\n\n%d connections in %.2fs; %.2f connections/user sec, bytes read %ld\n",
-         nConn, totalTime, ((double)nConn / totalTime), bytes_read);
-    printf
-        ("%d connections in %ld real seconds, %ld bytes read per connection\n",
-         nConn, (long)time(NULL) - finishtime + maxtime, bytes_read / nConn);
 
-    ret = 0;
+        if (scon != t->scon)
+            SSL_free(scon);
+    }
+    t->ok = 1;
+}
 
- end:
-    SSL_free(scon);
-    SSL_CTX_free(ctx);
-    return ret;
+/*
+ * Closes the socket right away.  The BIO must not close it again when it is
+ * freed, as by then another thread may have got the same descriptor.
+ */
+static void close_connection(SSL *scon)
+{
+    SSL_set_shutdown(scon, SSL_SENT_SHUTDOWN | SSL_RECEIVED_SHUTDOWN);
+    (void)BIO_set_close(SSL_get_rbio(scon), BIO_NOCLOSE);
+    BIO_closesocket(SSL_get_fd(scon));
 }
 
 /*-
@@ -19,6 +19,7 @@
 #define EdDSA_SECONDS   PKEY_SECONDS
 #define SM2_SECONDS     PKEY_SECONDS
 #define FFDH_SECONDS    PKEY_SECONDS
+#define OP_SECONDS      PKEY_SECONDS
 
 /* We need to use some deprecated APIs */
 #define OPENSSL_SUPPRESS_DEPRECATED
@@ -27,6 +28,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
+#include <time.h>
 #include "apps.h"
 #include "progs.h"
 #include <openssl/crypto.h>
@@ -50,6 +52,15 @@
 # include <windows.h>
 #endif
 
+#if defined(__linux__)
+# include <sys/ioctl.h>
+# include <sys/syscall.h>
+# include <linux/perf_event.h>
+# ifdef __NR_perf_event_open
+#  define LAT_PERF
+# endif
+#endif
+
 #include <openssl/bn.h>
 #include <openssl/rsa.h>
 #include "./testrsa.h"
@@ -57,9 +68,17 @@
 # include <openssl/dh.h>
 #endif
 #include <openssl/x509.h>
+#include <openssl/x509v3.h>
+#include <openssl/pem.h>
+#include <openssl/decoder.h>
+#include <openssl/ssl.h>
 #include <openssl/dsa.h>
 #include "./testdsa.h"
 #include <openssl/modes.h>
+#ifndef OPENSSL_NO_CMP
+# include <openssl/cmp.h>
+# include "cmp_mock_srv.h"
+#endif
 
 #ifndef HAVE_FORK
 # if defined(OPENSSL_SYS_VMS) || defined(OPENSSL_SYS_WINDOWS) || defined(OPENSSL_SYS_VXWORKS)
@@ -93,17 +112,21 @@ typedef struct openssl_speed_sec_st {
     int eddsa;
     int sm2;
     int ffdh;
+    int op;
 } openssl_speed_sec_t;
 
 static volatile int run = 0;
 
 static int mr = 0;  /* machine-readeable output format to merge fork results */
 static int usertime = 1;
+static int threads = 0; /* with -threads, one loopargs_t per thread */
 
 static double Time_F(int s);
+static void lat_end(double time);
 static void print_message(const char *s, long num, int length, int tm);
 static void pkey_print_message(const char *str, const char *str2,
                                long num, unsigned int bits, int sec);
+static void op_print_message(const char *name, long num, int tm);
 static void print_result(int alg, int run_no, int count, double time_used);
 #ifndef NO_FORK
 static int do_multi(int multi, int size_num);
@@ -133,8 +156,10 @@ static void alarmed(int sig)
 static double Time_F(int s)
 {
     double ret = app_tminterval(s, usertime);
-    if (s == STOP)
+    if (s == STOP) {
         alarm(0);
+        lat_end(ret);
+    }
     return ret;
 }
 
@@ -180,6 +205,7 @@ static double Time_F(int s)
         if (run)
             TerminateThread(thr, 0);
         CloseHandle(thr);
+        lat_end(ret);
     }
 
     return ret;
@@ -210,7 +236,9 @@ typedef enum OPTION_choice {
     OPT_ERR = -1, OPT_EOF = 0, OPT_HELP,
     OPT_ELAPSED, OPT_EVP, OPT_HMAC, OPT_DECRYPT, OPT_ENGINE, OPT_MULTI,
     OPT_MR, OPT_MB, OPT_MISALIGN, OPT_ASYNCJOBS, OPT_R_ENUM, OPT_PROV_ENUM,
-    OPT_PRIMES, OPT_SECONDS, OPT_BYTES, OPT_AEAD, OPT_CMAC
+    OPT_PRIMES, OPT_SECONDS, OPT_BYTES, OPT_AEAD, OPT_CMAC, OPT_LATENCY,
+    OPT_JSON, OPT_THREADS, OPT_TLS_GROUPS, OPT_TLS_CERT, OPT_TLS_RESUME,
+    OPT_TLS_MTLS
 } OPTION_CHOICE;
 
 const OPTIONS speed_options[] = {
@@ -224,6 +252,10 @@ const OPTIONS speed_options[] = {
 #ifndef NO_FORK
     {"multi", OPT_MULTI, 'p', "Run benchmarks in parallel"},
 #endif
+#ifdef OPENSSL_THREADS
+    {"threads", OPT_THREADS, 'p',
+     "Run benchmarks in parallel threads sharing one library context"},
+#endif
 #ifndef OPENSSL_NO_ASYNC
     {"async_jobs", OPT_ASYNCJOBS, 'p',
      "Enable async mode and start specified number of jobs"},
@@ -251,6 +283,19 @@ const OPTIONS speed_options[] = {
      "Run [non-PKI] benchmarks on custom-sized buffer"},
     {"misalign", OPT_MISALIGN, 'p',
      "Use specified offset to mis-align buffers"},
+    {"latency", OPT_LATENCY, '-',
+     "Also report latency percentiles and CPU cycles per operation"},
+    {"json", OPT_JSON, '>',
+     "Write the latency results as JSON to the given file (implies -latency)"},
+
+    OPT_SECTION("TLS handshakes"),
+    {"tls_groups", OPT_TLS_GROUPS, 's',
+     "Groups to offer in the TLS handshakes"},
+    {"tls_cert", OPT_TLS_CERT, 's',
+     "Type of the TLS server key: ecdsa (default), rsa or ed25519"},
+    {"tls_resume", OPT_TLS_RESUME, '-',
+     "Resume the TLS session of the first handshake"},
+    {"tls_mtls", OPT_TLS_MTLS, '-', "Also authenticate the TLS client"},
 
     OPT_R_OPTIONS,
     OPT_PROV_OPTIONS,
@@ -451,7 +496,259 @@ static const OPT_PAIR sm2_choices[SM2_NUM] = {
 static double sm2_results[SM2_NUM][2];    /* 2 ops: sign then verify */
 #endif /* OPENSSL_NO_SM2 */
 
-#define COND(unused_cond) (run && count < 0x7fffffff)
+/* Operations above the level of single primitives */
+enum {
+    R_OP_FETCH, R_OP_X509_D2I, R_OP_X509_I2D, R_OP_DECODE_PEM,
+    R_OP_DECODE_DER, R_OP_X509_VERIFY, R_OP_TLS12, R_OP_TLS13, R_OP_CMP_PBM,
+    R_OP_CMP_SIG, OP_NUM
+};
+static const OPT_PAIR op_choices[OP_NUM] = {
+    {"fetch", R_OP_FETCH},
+    {"x509d2i", R_OP_X509_D2I},
+    {"x509i2d", R_OP_X509_I2D},
+    {"decodepem", R_OP_DECODE_PEM},
+    {"decodeder", R_OP_DECODE_DER},
+    {"x509verify", R_OP_X509_VERIFY},
+    {"tls12handshake", R_OP_TLS12},
+    {"tls13handshake", R_OP_TLS13},
+    {"cmppbm", R_OP_CMP_PBM},
+    {"cmpsig", R_OP_CMP_SIG}
+};
+
+static double op_results[OP_NUM][1];  /* 1 op */
+
+/*
+ * Per-operation latencies, recorded with -latency.  Every evaluation of
+ * COND() in a benchmark loop ends one operation, so the loops themselves
+ * need no changes.  The histogram has LAT_SUB linear sub-buckets for every
+ * power of two nanoseconds, which keeps the percentiles within about 6%.
+ */
+#define LAT_SUB_BITS    4
+#define LAT_SUB         (1 << LAT_SUB_BITS)
+#define LAT_BUCKETS     ((64 - LAT_SUB_BITS + 1) * LAT_SUB)
+
+typedef struct {
+    char name[64];
+    int child;                  /* 1-based with -multi, otherwise 0 */
+    uint64_t ops;               /* operations that were timed */
+    double time;
+    uint64_t p50, p99, p999, max; /* in nanoseconds */
+    double cycles;              /* per operation, negative if unknown */
+} LAT_RESULT;
+
+static int latency = 0;
+static int lat_active = 0;
+static char lat_name[64];
+static uint64_t lat_hist[LAT_BUCKETS], lat_last, lat_max;
+static LAT_RESULT *lat_results = NULL;
+static size_t lat_num = 0;
+#ifdef LAT_PERF
+static int lat_perf_fd = -2;    /* -2: not yet tried, -1: not available */
+#endif
+
+static size_t lat_bucket(uint64_t ns)
+{
+    int shift = 0;
+
+    while ((ns >> shift) >= 2 * LAT_SUB)
+        shift++;
+    return shift == 0 ? (size_t)ns
+                      : (size_t)(shift + 1) * LAT_SUB + (ns >> shift) - LAT_SUB;
+}
+
+/* The largest value that falls into bucket |i| */
+static uint64_t lat_bucket_max(size_t i)
+{
+    int shift = (int)(i / LAT_SUB) - 1;
+
+    if (shift <= 0)
+        return i;
+    return ((uint64_t)(i % LAT_SUB + LAT_SUB + 1) << shift) - 1;
+}
+
+/* Called once per loop iteration by COND(), never fails */
+static int lat_tick(int count)
+{
+    uint64_t now = app_monotonic_ns();
+
+    if (lat_active && count > 0) {
+        uint64_t ns = now - lat_last;
+
+        lat_hist[lat_bucket(ns)]++;
+        if (ns > lat_max)
+            lat_max = ns;
+    }
+    lat_last = now;
+    return 1;
+}
+
+/* Counting user space CPU cycles needs perf_event_open(2) */
+static void lat_cycles_start(void)
+{
+#ifdef LAT_PERF
+    if (lat_perf_fd == -2) {
+        struct perf_event_attr attr;
+
+        memset(&attr, 0, sizeof(attr));
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.size = sizeof(attr);
+        attr.config = PERF_COUNT_HW_CPU_CYCLES;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        lat_perf_fd = (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+        if (lat_perf_fd < 0)
+            lat_perf_fd = -1;
+    }
+    if (lat_perf_fd >= 0) {
+        ioctl(lat_perf_fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(lat_perf_fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+#endif
+}
+
+static double lat_cycles_stop(void)
+{
+#ifdef LAT_PERF
+    uint64_t cycles;
+
+    if (lat_perf_fd >= 0) {
+        ioctl(lat_perf_fd, PERF_EVENT_IOC_DISABLE, 0);
+        if (read(lat_perf_fd, &cycles, sizeof(cycles)) == sizeof(cycles))
+            return (double)cycles;
+    }
+#endif
+    return -1;
+}
+
+static void lat_add(const LAT_RESULT *res)
+{
+    LAT_RESULT *tmp;
+
+    tmp = OPENSSL_realloc(lat_results, (lat_num + 1) * sizeof(*lat_results));
+    if (tmp == NULL)
+        return;
+    lat_results = tmp;
+    lat_results[lat_num++] = *res;
+}
+
+/* Called by the *print_message() functions when a benchmark starts */
+static void lat_begin(const char *name)
+{
+    if (!latency)
+        return;
+    OPENSSL_strlcpy(lat_name, name, sizeof(lat_name));
+    memset(lat_hist, 0, sizeof(lat_hist));
+    lat_max = 0;
+    lat_active = 1;
+    lat_cycles_start();
+}
+
+/* Called by Time_F(STOP) when a benchmark ends */
+static void lat_end(double time)
+{
+    LAT_RESULT res;
+    uint64_t sum = 0, p50, p99, p999;
+    double cycles;
+    size_t i;
+
+    if (!lat_active)
+        return;
+    lat_active = 0;
+    cycles = lat_cycles_stop();
+    memset(&res, 0, sizeof(res));
+    OPENSSL_strlcpy(res.name, lat_name, sizeof(res.name));
+    res.time = time;
+    res.max = lat_max;
+    for (i = 0; i < LAT_BUCKETS; i++)
+        res.ops += lat_hist[i];
+    /* Operations below which 50%, 99% and 99.9% of all of them lie */
+    p50 = res.ops - res.ops / 2;
+    p99 = res.ops - res.ops / 100;
+    p999 = res.ops - res.ops / 1000;
+    for (i = 0; i < LAT_BUCKETS && sum < p999; i++) {
+        sum += lat_hist[i];
+        if (res.p50 == 0 && sum >= p50)
+            res.p50 = lat_bucket_max(i);
+        if (res.p99 == 0 && sum >= p99)
+            res.p99 = lat_bucket_max(i);
+        if (sum >= p999)
+            res.p999 = lat_bucket_max(i);
+    }
+    if (res.p50 > res.max)
+        res.p50 = res.max;
+    if (res.p99 > res.max)
+        res.p99 = res.max;
+    if (res.p999 > res.max)
+        res.p999 = res.max;
+    res.cycles = cycles >= 0 && res.ops > 0 ? cycles / res.ops : -1;
+    lat_add(&res);
+}
+
+static void lat_print(void)
+{
+    size_t i;
+
+    for (i = 0; i < lat_num; i++) {
+        const LAT_RESULT *r = &lat_results[i];
+
+        if (mr) {
+            printf("+L:%d:%s:%llu:%f:%llu:%llu:%llu:%llu:%f\n",
+                   r->child, r->name, (unsigned long long)r->ops, r->time,
+                   (unsigned long long)r->p50, (unsigned long long)r->p99,
+                   (unsigned long long)r->p999, (unsigned long long)r->max,
+                   r->cycles);
+            continue;
+        }
+        if (i == 0)
+            printf("%-32s %10s %9s %9s %9s %9s %10s\n", "latency in ns",
+                   "ops/s", "p50", "p99", "p99.9", "max", "cycles/op");
+        if (r->child > 0)
+            printf("[%d] %-28s", r->child, r->name);
+        else
+            printf("%-32s", r->name);
+        printf(" %10.1f %9llu %9llu %9llu %9llu",
+               r->time > 0 ? r->ops / r->time : 0,
+               (unsigned long long)r->p50, (unsigned long long)r->p99,
+               (unsigned long long)r->p999, (unsigned long long)r->max);
+        if (r->cycles >= 0)
+            printf(" %10.1f\n", r->cycles);
+        else
+            printf(" %10s\n", "n/a");
+    }
+}
+
+static int lat_print_json(const char *file)
+{
+    BIO *out = bio_open_default(file, 'w', FORMAT_TEXT);
+    size_t i;
+
+    if (out == NULL)
+        return 0;
+    BIO_printf(out, "[");
+    for (i = 0; i < lat_num; i++) {
+        const LAT_RESULT *r = &lat_results[i];
+
+        BIO_printf(out, "%s\n  {\"name\": \"%s\", \"process\": %d, "
+                   "\"ops\": %llu, \"seconds\": %f, "
+                   "\"p50_ns\": %llu, \"p99_ns\": %llu, \"p999_ns\": %llu, "
+                   "\"max_ns\": %llu, ",
+                   i == 0 ? "" : ",", r->name, r->child,
+                   (unsigned long long)r->ops, r->time,
+                   (unsigned long long)r->p50, (unsigned long long)r->p99,
+                   (unsigned long long)r->p999, (unsigned long long)r->max);
+        if (r->cycles >= 0)
+            BIO_printf(out, "\"cycles_per_op\": %.1f}", r->cycles);
+        else
+            BIO_printf(out, "\"cycles_per_op\": null}");
+    }
+    BIO_printf(out, "\n]\n");
+    BIO_free_all(out);
+    return 1;
+}
+
+#define COND(unused_cond) \
+    (run && count < 0x7fffffff && (!latency || lat_tick(count)))
 #define COUNT(d) (count)
 
 typedef struct loopargs_st {
@@ -487,6 +784,11 @@ typedef struct loopargs_st {
 #endif
     EVP_CIPHER_CTX *ctx;
     EVP_MAC_CTX *mctx;
+#ifndef OPENSSL_NO_CMP
+    OSSL_CMP_CTX *cmp_ctx[2]; /* PBM, signature */
+#endif
+    SSL_SESSION *tls_sess[2]; /* for -tls_resume */
+    uint64_t tls_ns[2]; /* time spent in the TLS client and server */
 } loopargs_t;
 static int run_benchmark(int async_jobs, int (*loop_function) (void *),
                          loopargs_t * loopargs);
@@ -1133,6 +1435,45 @@ static int SM2_verify_loop(void *args)
 }
 #endif                         /* OPENSSL_NO_SM2 */
 
+typedef struct {
+    int (*loop_function)(void *);
+    loopargs_t *looparg_item;
+    int count;
+} speed_thread_t;
+
+static void speed_thread(void *arg)
+{
+    speed_thread_t *t = arg;
+
+    t->count = t->loop_function((void *)&t->looparg_item);
+}
+
+/*
+ * Runs |loop_function| in |threads| threads at once, each with its own
+ * loopargs_t, but all sharing the library context.
+ */
+static int run_threads(int (*loop_function)(void *), loopargs_t *loopargs)
+{
+    speed_thread_t *t = app_malloc(threads * sizeof(*t), "speed threads");
+    int i, total = 0;
+
+    for (i = 0; i < threads; i++) {
+        t[i].loop_function = loop_function;
+        t[i].looparg_item = loopargs + i;
+        t[i].count = 0;
+    }
+    if (!app_run_threads(threads, speed_thread, t, sizeof(*t)))
+        total = -1;
+    for (i = 0; total >= 0 && i < threads; i++) {
+        if (t[i].count < 0)
+            total = -1;
+        else
+            total += t[i].count;
+    }
+    OPENSSL_free(t);
+    return total;
+}
+
 static int run_benchmark(int async_jobs,
                          int (*loop_function) (void *), loopargs_t * loopargs)
 {
@@ -1143,6 +1484,8 @@ static int run_benchmark(int async_jobs,
     OSSL_ASYNC_FD job_fd = 0;
     size_t num_job_fds = 0;
 
+    if (threads > 0)
+        return run_threads(loop_function, loopargs);
     if (async_jobs == 0) {
         return loop_function((void *)&loopargs);
     }
@@ -1364,6 +1707,559 @@ static EVP_PKEY *get_ecdsa(const EC_CURVE *curve)
     return key;
 }
 
+/*
+ * State of the "ops" benchmarks, which measure operations above the level of
+ * single primitives.  It is set up once by setup_ops() and then shared by
+ * all the loops.
+ */
+typedef struct {
+    EVP_PKEY *cakey, *eekey, *tlskey;
+    X509 *cacert, *eecert, *tlscert;
+    X509_STORE *store;
+    unsigned char *eeder, *keypem, *keyder;
+    size_t eeder_len, keypem_len, keyder_len;
+    SSL_CTX *sctx[2], *cctx[2]; /* TLS 1.2, TLS 1.3 */
+} OPS_STATE;
+
+static OPS_STATE ops;
+static long op_c[OP_NUM][1];
+
+/* Settings of the TLS handshake benchmarks */
+enum { TLS_CERT_ECDSA, TLS_CERT_RSA, TLS_CERT_ED25519 };
+static const OPT_PAIR tls_cert_choices[] = {
+    {"ecdsa", TLS_CERT_ECDSA},
+    {"rsa", TLS_CERT_RSA},
+    {"ed25519", TLS_CERT_ED25519}
+};
+static int tls_cert = TLS_CERT_ECDSA;
+static const char *tls_groups = NULL;
+static int tls_resume = 0;
+static int tls_mtls = 0;
+
+static X509 *make_op_cert(const char *cn, EVP_PKEY *key,
+                          X509 *issuer, EVP_PKEY *signkey)
+{
+    X509 *cert = X509_new();
+    X509_NAME *name = X509_NAME_new();
+    X509_EXTENSION *ext = NULL;
+    X509V3_CTX v3ctx;
+
+    if (cert == NULL || name == NULL
+        || !X509_set_version(cert, 2)
+        || !ASN1_INTEGER_set(X509_get_serialNumber(cert),
+                             issuer == NULL ? 1 : 2)
+        || !X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC,
+                                       (const unsigned char *)cn, -1, -1, 0)
+        || !X509_set_subject_name(cert, name)
+        || !X509_set_issuer_name(cert, issuer == NULL
+                                       ? name : X509_get_subject_name(issuer))
+        || X509_gmtime_adj(X509_getm_notBefore(cert), 0) == NULL
+        || X509_time_adj_ex(X509_getm_notAfter(cert), 1, 0, NULL) == NULL
+        || !X509_set_pubkey(cert, key))
+        goto err;
+    if (issuer == NULL) {
+        X509V3_set_ctx(&v3ctx, cert, cert, NULL, NULL, 0);
+        if ((ext = X509V3_EXT_conf_nid(NULL, &v3ctx, NID_basic_constraints,
+                                       "critical,CA:TRUE")) == NULL
+            || !X509_add_ext(cert, ext, -1))
+            goto err;
+    }
+    if (!X509_sign(cert, signkey, EVP_sha256()))
+        goto err;
+    X509_EXTENSION_free(ext);
+    X509_NAME_free(name);
+    return cert;
+
+ err:
+    X509_EXTENSION_free(ext);
+    X509_NAME_free(name);
+    X509_free(cert);
+    return NULL;
+}
+
+static unsigned char *bio_to_buf(BIO *bio, size_t *len)
+{
+    char *data;
+    long n = BIO_get_mem_data(bio, &data);
+    unsigned char *buf;
+
+    if (n <= 0)
+        return NULL;
+    buf = app_malloc(n, "ops encoding");
+    memcpy(buf, data, n);
+    *len = (size_t)n;
+    return buf;
+}
+
+#ifndef OPENSSL_NO_CMP
+static void free_op_cmp(OSSL_CMP_CTX *ctx)
+{
+    if (ctx == NULL)
+        return;
+    ossl_cmp_mock_srv_free(OSSL_CMP_CTX_get_transfer_cb_arg(ctx));
+    OSSL_CMP_CTX_free(ctx);
+}
+
+static OSSL_CMP_CTX *setup_op_cmp(OPS_STATE *st, int pbm)
+{
+    static const unsigned char ref[] = "speed";
+    static const unsigned char secret[] = "1234567890";
+    OSSL_CMP_CTX *ctx = OSSL_CMP_CTX_new(NULL, NULL);
+    OSSL_CMP_SRV_CTX *srv_ctx = ossl_cmp_mock_srv_new(NULL, NULL);
+    OSSL_CMP_CTX *sctx;
+
+    if (ctx == NULL || srv_ctx == NULL)
+        goto err;
+    sctx = OSSL_CMP_SRV_CTX_get0_cmp_ctx(srv_ctx);
+    if (!OSSL_CMP_CTX_set_transfer_cb(ctx, OSSL_CMP_CTX_server_perform)
+        || !OSSL_CMP_CTX_set_transfer_cb_arg(ctx, srv_ctx))
+        goto err;
+    srv_ctx = NULL;
+    if (!OSSL_CMP_CTX_set_log_verbosity(ctx, OSSL_CMP_LOG_ERR)
+        || !OSSL_CMP_CTX_set_log_verbosity(sctx, OSSL_CMP_LOG_ERR))
+        goto err;
+    if (pbm) {
+        if (!OSSL_CMP_CTX_set1_referenceValue(ctx, ref, sizeof(ref) - 1)
+            || !OSSL_CMP_CTX_set1_secretValue(ctx, secret, sizeof(secret) - 1)
+            || !OSSL_CMP_CTX_set1_referenceValue(sctx, ref, sizeof(ref) - 1)
+            || !OSSL_CMP_CTX_set1_secretValue(sctx, secret,
+                                              sizeof(secret) - 1))
+            goto err;
+    } else {
+        if (!OSSL_CMP_CTX_set1_cert(ctx, st->eecert)
+            || !OSSL_CMP_CTX_set1_pkey(ctx, st->eekey)
+            || !OSSL_CMP_CTX_set1_srvCert(ctx, st->eecert)
+            || !OSSL_CMP_CTX_set1_cert(sctx, st->eecert)
+            || !OSSL_CMP_CTX_set1_pkey(sctx, st->eekey)
+            || !X509_STORE_up_ref(st->store))
+            goto err;
+        if (!OSSL_CMP_CTX_set0_trustedStore(sctx, st->store)) {
+            X509_STORE_free(st->store);
+            goto err;
+        }
+    }
+    return ctx;
+
+ err:
+    ossl_cmp_mock_srv_free(srv_ctx);
+    free_op_cmp(ctx);
+    return NULL;
+}
+#endif
+
+static EVP_PKEY *gen_tls_key(const EC_CURVE *curve)
+{
+    EVP_PKEY_CTX *kctx;
+    EVP_PKEY *key = NULL;
+
+    if (tls_cert == TLS_CERT_ECDSA)
+        return get_ecdsa(curve);
+    kctx = EVP_PKEY_CTX_new_from_name(NULL, tls_cert == TLS_CERT_RSA
+                                            ? "RSA" : "ED25519", NULL);
+    if (kctx == NULL
+        || EVP_PKEY_keygen_init(kctx) <= 0
+        || (tls_cert == TLS_CERT_RSA
+            && EVP_PKEY_CTX_set_rsa_keygen_bits(kctx, 2048) <= 0)
+        || EVP_PKEY_keygen(kctx, &key) <= 0)
+        key = NULL;
+    EVP_PKEY_CTX_free(kctx);
+    return key;
+}
+
+static int ssl_version_disabled(int version)
+{
+#ifdef OPENSSL_NO_TLS1_2
+    if (version == TLS1_2_VERSION)
+        return 1;
+#endif
+#ifdef OPENSSL_NO_TLS1_3
+    if (version == TLS1_3_VERSION)
+        return 1;
+#endif
+    return 0;
+}
+
+/* The SSL_CTX pair for TLS 1.2 (|i| == 0) or TLS 1.3 (|i| == 1) */
+static int setup_op_tls(OPS_STATE *st, int i)
+{
+    static const unsigned char sid_ctx[] = "speed";
+    int version = i == 0 ? TLS1_2_VERSION : TLS1_3_VERSION;
+    SSL_CTX *sctx, *cctx;
+
+    if (ssl_version_disabled(version))
+        return 1;
+    if ((sctx = st->sctx[i] = SSL_CTX_new(TLS_server_method())) == NULL
+        || (cctx = st->cctx[i] = SSL_CTX_new(TLS_client_method())) == NULL
+        || !SSL_CTX_set_min_proto_version(sctx, version)
+        || !SSL_CTX_set_max_proto_version(sctx, version)
+        || !SSL_CTX_set_min_proto_version(cctx, version)
+        || !SSL_CTX_set_max_proto_version(cctx, version)
+        || !SSL_CTX_use_certificate(sctx, st->tlscert)
+        || !SSL_CTX_use_PrivateKey(sctx, st->tlskey)
+        || !SSL_CTX_set_session_id_context(sctx, sid_ctx, sizeof(sid_ctx) - 1)
+        || !SSL_CTX_set_num_tickets(sctx, tls_resume ? 1 : 0)
+        || (tls_groups != NULL
+            && (!SSL_CTX_set1_groups_list(sctx, tls_groups)
+                || !SSL_CTX_set1_groups_list(cctx, tls_groups))))
+        return 0;
+    /* Unless resuming, every handshake should be a full one */
+    if (!tls_resume)
+        SSL_CTX_set_session_cache_mode(sctx, SSL_SESS_CACHE_OFF);
+    /* The client keeps its session itself, see do_handshake() */
+    SSL_CTX_set_session_cache_mode(cctx, SSL_SESS_CACHE_OFF);
+    if (!X509_STORE_up_ref(st->store))
+        return 0;
+    SSL_CTX_set_cert_store(cctx, st->store);
+    SSL_CTX_set_verify(cctx, SSL_VERIFY_PEER, NULL);
+    if (tls_mtls) {
+        if (!SSL_CTX_use_certificate(cctx, st->eecert)
+            || !SSL_CTX_use_PrivateKey(cctx, st->eekey)
+            || !X509_STORE_up_ref(st->store))
+            return 0;
+        SSL_CTX_set_cert_store(sctx, st->store);
+        SSL_CTX_set_verify(sctx,
+                           SSL_VERIFY_PEER | SSL_VERIFY_FAIL_IF_NO_PEER_CERT,
+                           NULL);
+    }
+    return 1;
+}
+
+/*
+ * The CMP contexts cannot be shared, so every loopargs_t gets its own, while
+ * everything else is shared to also show contention between threads.
+ */
+static int setup_ops(OPS_STATE *st, const EC_CURVE *curve,
+                     loopargs_t *loopargs, unsigned int loopargs_len)
+{
+    BIO *mem = NULL;
+    unsigned char *p;
+    unsigned int k;
+    int i, len, ret = 0;
+
+    if ((st->cakey = get_ecdsa(curve)) == NULL
+        || (st->eekey = get_ecdsa(curve)) == NULL
+        || (st->cacert = make_op_cert("speed CA", st->cakey,
+                                      NULL, st->cakey)) == NULL
+        || (st->eecert = make_op_cert("speed EE", st->eekey,
+                                      st->cacert, st->cakey)) == NULL
+        || (st->store = X509_STORE_new()) == NULL
+        || !X509_STORE_add_cert(st->store, st->cacert)
+        || (len = i2d_X509(st->eecert, NULL)) <= 0)
+        goto end;
+    p = st->eeder = app_malloc(len, "ops certificate");
+    st->eeder_len = i2d_X509(st->eecert, &p);
+
+    if ((mem = BIO_new(BIO_s_mem())) == NULL
+        || !PEM_write_bio_PrivateKey(mem, st->eekey, NULL, NULL, 0, NULL, NULL)
+        || (st->keypem = bio_to_buf(mem, &st->keypem_len)) == NULL
+        || BIO_reset(mem) <= 0
+        || !i2d_PKCS8PrivateKey_bio(mem, st->eekey, NULL, NULL, 0, NULL, NULL)
+        || (st->keyder = bio_to_buf(mem, &st->keyder_len)) == NULL)
+        goto end;
+
+    if ((st->tlskey = gen_tls_key(curve)) == NULL
+        || (st->tlscert = make_op_cert("speed TLS", st->tlskey,
+                                       st->cacert, st->cakey)) == NULL)
+        goto end;
+    for (i = 0; i < 2; i++)
+        if (!setup_op_tls(st, i))
+            goto end;
+
+#ifndef OPENSSL_NO_CMP
+    for (k = 0; k < loopargs_len; k++)
+        for (i = 0; i < 2; i++)
+            if ((loopargs[k].cmp_ctx[i] = setup_op_cmp(st, i == 0)) == NULL)
+                goto end;
+#endif
+    ret = 1;
+
+ end:
+    if (!ret) {
+        BIO_printf(bio_err, "Error setting up the ops benchmarks.\n");
+        ERR_print_errors(bio_err);
+    }
+    BIO_free(mem);
+    return ret;
+}
+
+static void free_ops(OPS_STATE *st)
+{
+    int i;
+
+    for (i = 0; i < 2; i++) {
+        SSL_CTX_free(st->sctx[i]);
+        SSL_CTX_free(st->cctx[i]);
+    }
+    OPENSSL_free(st->eeder);
+    OPENSSL_free(st->keypem);
+    OPENSSL_free(st->keyder);
+    X509_STORE_free(st->store);
+    X509_free(st->cacert);
+    X509_free(st->eecert);
+    X509_free(st->tlscert);
+    EVP_PKEY_free(st->cakey);
+    EVP_PKEY_free(st->eekey);
+    EVP_PKEY_free(st->tlskey);
+    memset(st, 0, sizeof(*st));
+}
+
+static int op_failed(void)
+{
+    BIO_printf(bio_err, "%s failure\n", op_choices[testnum].name);
+    ERR_print_errors(bio_err);
+    return -1;
+}
+
+static int FETCH_loop(void *args)
+{
+    EVP_MD *md;
+    int count;
+
+    for (count = 0; COND(op_c[testnum][0]); count++) {
+        if ((md = EVP_MD_fetch(NULL, "SHA2-256", NULL)) == NULL)
+            return op_failed();
+        EVP_MD_free(md);
+    }
+    return count;
+}
+
+static int X509_D2I_loop(void *args)
+{
+    const unsigned char *p;
+    X509 *cert;
+    int count;
+
+    for (count = 0; COND(op_c[testnum][0]); count++) {
+        p = ops.eeder;
+        if ((cert = d2i_X509(NULL, &p, (long)ops.eeder_len)) == NULL)
+            return op_failed();
+        X509_free(cert);
+    }
+    return count;
+}
+
+static int X509_I2D_loop(void *args)
+{
+    unsigned char *der;
+    int count;
+
+    for (count = 0; COND(op_c[testnum][0]); count++) {
+        der = NULL;
+        if (i2d_X509(ops.eecert, &der) <= 0)
+            return op_failed();
+        OPENSSL_free(der);
+    }
+    return count;
+}
+
+static int decode_key(const char *type, const unsigned char *data, size_t len)
+{
+    OSSL_DECODER_CTX *dctx;
+    EVP_PKEY *pkey = NULL;
+
+    dctx = OSSL_DECODER_CTX_new_for_pkey(&pkey, type, NULL, NULL,
+                                         OSSL_KEYMGMT_SELECT_KEYPAIR,
+                                         NULL, NULL);
+    if (dctx == NULL || !OSSL_DECODER_from_data(dctx, &data, &len)) {
+        OSSL_DECODER_CTX_free(dctx);
+        return 0;
+    }
+    OSSL_DECODER_CTX_free(dctx);
+    EVP_PKEY_free(pkey);
+    return 1;
+}
+
+static int DECODE_PEM_loop(void *args)
+{
+    int count;
+
+    for (count = 0; COND(op_c[testnum][0]); count++)
+        if (!decode_key("PEM", ops.keypem, ops.keypem_len))
+            return op_failed();
+    return count;
+}
+
+static int DECODE_DER_loop(void *args)
+{
+    int count;
+
+    for (count = 0; COND(op_c[testnum][0]); count++)
+        if (!decode_key("DER", ops.keyder, ops.keyder_len))
+            return op_failed();
+    return count;
+}
+
+static int X509_VERIFY_loop(void *args)
+{
+    X509_STORE_CTX *ctx;
+    int count, ok;
+
+    for (count = 0; COND(op_c[testnum][0]); count++) {
+        if ((ctx = X509_STORE_CTX_new()) == NULL
+            || !X509_STORE_CTX_init(ctx, ops.store, ops.eecert, NULL)) {
+            X509_STORE_CTX_free(ctx);
+            return op_failed();
+        }
+        ok = X509_verify_cert(ctx);
+        X509_STORE_CTX_free(ctx);
+        if (ok <= 0)
+            return op_failed();
+    }
+    return count;
+}
+
+#if !defined(OPENSSL_NO_TLS1_2) || !defined(OPENSSL_NO_TLS1_3)
+/*
+ * Does a handshake in memory, alternating between client and server, and
+ * adds the time spent in each to tls_ns.  With -tls_resume, the first
+ * handshake gets the session that all later ones resume.
+ */
+static int do_handshake(SSL_CTX *sctx, SSL_CTX *cctx, loopargs_t *la,
+                        SSL_SESSION **sess)
+{
+    SSL *ssl_s = SSL_new(sctx), *ssl_c = SSL_new(cctx);
+    BIO *sbio, *cbio;
+    uint64_t start;
+    unsigned char b;
+    int i, r, sdone = 0, cdone = 0, ok = 0;
+
+    if (ssl_s == NULL || ssl_c == NULL
+            || !BIO_new_bio_pair(&sbio, 0, &cbio, 0))
+        goto end;
+    SSL_set_bio(ssl_s, sbio, sbio);
+    SSL_set_bio(ssl_c, cbio, cbio);
+    SSL_set_accept_state(ssl_s);
+    SSL_set_connect_state(ssl_c);
+    if (*sess != NULL && !SSL_set_session(ssl_c, *sess))
+        goto end;
+    for (i = 0; i < 10 && !(sdone && cdone); i++) {
+        if (!cdone) {
+            start = app_monotonic_ns();
+            r = SSL_do_handshake(ssl_c);
+            la->tls_ns[0] += app_monotonic_ns() - start;
+            if (r == 1)
+                cdone = 1;
+            else if (SSL_get_error(ssl_c, r) != SSL_ERROR_WANT_READ)
+                break;
+        }
+        if (!sdone) {
+            start = app_monotonic_ns();
+            r = SSL_do_handshake(ssl_s);
+            la->tls_ns[1] += app_monotonic_ns() - start;
+            if (r == 1)
+                sdone = 1;
+            else if (SSL_get_error(ssl_s, r) != SSL_ERROR_WANT_READ)
+                break;
+        }
+    }
+    ok = sdone && cdone;
+    if (ok && tls_resume) {
+        if (*sess == NULL) {
+            /* TLS 1.3 tickets arrive only after the handshake */
+            r = SSL_read(ssl_c, &b, sizeof(b));
+            ok = (r > 0 || SSL_get_error(ssl_c, r) == SSL_ERROR_WANT_READ)
+                && (*sess = SSL_get1_session(ssl_c)) != NULL
+                && SSL_SESSION_is_resumable(*sess);
+        } else {
+            ok = SSL_session_reused(ssl_c);
+        }
+    }
+    /* Do not let SSL_free() invalidate the session of a clean handshake */
+    if (ok) {
+        SSL_set_shutdown(ssl_c, SSL_SENT_SHUTDOWN | SSL_RECEIVED_SHUTDOWN);
+        SSL_set_shutdown(ssl_s, SSL_SENT_SHUTDOWN | SSL_RECEIVED_SHUTDOWN);
+    }
+ end:
+    SSL_free(ssl_s);
+    SSL_free(ssl_c);
+    return ok;
+}
+#endif
+
+#ifndef OPENSSL_NO_TLS1_2
+static int TLS12_loop(void *args)
+{
+    loopargs_t *tempargs = *(loopargs_t **) args;
+    int count;
+
+    for (count = 0; COND(op_c[testnum][0]); count++)
+        if (!do_handshake(ops.sctx[0], ops.cctx[0], tempargs,
+                          &tempargs->tls_sess[0]))
+            return op_failed();
+    return count;
+}
+#endif
+
+#ifndef OPENSSL_NO_TLS1_3
+static int TLS13_loop(void *args)
+{
+    loopargs_t *tempargs = *(loopargs_t **) args;
+    int count;
+
+    for (count = 0; COND(op_c[testnum][0]); count++)
+        if (!do_handshake(ops.sctx[1], ops.cctx[1], tempargs,
+                          &tempargs->tls_sess[1]))
+            return op_failed();
+    return count;
+}
+#endif
+
+#ifndef OPENSSL_NO_CMP
+/* A general message transaction: one protected request, one response */
+static int cmp_genm(OSSL_CMP_CTX *ctx)
+{
+    STACK_OF(OSSL_CMP_ITAV) *itavs = OSSL_CMP_exec_GENM_ses(ctx);
+
+    if (itavs == NULL)
+        return 0;
+    sk_OSSL_CMP_ITAV_pop_free(itavs, OSSL_CMP_ITAV_free);
+    return 1;
+}
+
+static int CMP_PBM_loop(void *args)
+{
+    loopargs_t *tempargs = *(loopargs_t **) args;
+    int count;
+
+    for (count = 0; COND(op_c[testnum][0]); count++)
+        if (!cmp_genm(tempargs->cmp_ctx[0]))
+            return op_failed();
+    return count;
+}
+
+static int CMP_SIG_loop(void *args)
+{
+    loopargs_t *tempargs = *(loopargs_t **) args;
+    int count;
+
+    for (count = 0; COND(op_c[testnum][0]); count++)
+        if (!cmp_genm(tempargs->cmp_ctx[1]))
+            return op_failed();
+    return count;
+}
+#endif
+
+/* NULL where the operation is not available in this build */
+static int (*const op_loops[OP_NUM])(void *) = {
+    FETCH_loop, X509_D2I_loop, X509_I2D_loop, DECODE_PEM_loop,
+    DECODE_DER_loop, X509_VERIFY_loop,
+#ifndef OPENSSL_NO_TLS1_2
+    TLS12_loop,
+#else
+    NULL,
+#endif
+#ifndef OPENSSL_NO_TLS1_3
+    TLS13_loop,
+#else
+    NULL,
+#endif
+#ifndef OPENSSL_NO_CMP
+    CMP_PBM_loop, CMP_SIG_loop
+#else
+    NULL, NULL
+#endif
+};
+
 #define stop_it(do_it, test_num)\
     memset(do_it + test_num, 0, OSSL_NELEM(do_it) - test_num);
 
@@ -1394,7 +2290,7 @@ int speed_main(int argc, char **argv)
     openssl_speed_sec_t seconds = { SECONDS, RSA_SECONDS, DSA_SECONDS,
                                     ECDSA_SECONDS, ECDH_SECONDS,
                                     EdDSA_SECONDS, SM2_SECONDS,
-                                    FFDH_SECONDS };
+                                    FFDH_SECONDS, OP_SECONDS };
 
     static const unsigned char key32[32] = {
         0x12, 0x34, 0x56, 0x78, 0x9a, 0xbc, 0xde, 0xf0,
@@ -1493,6 +2389,9 @@ int speed_main(int argc, char **argv)
     uint8_t ecdsa_doit[ECDSA_NUM] = { 0 };
     uint8_t ecdh_doit[EC_NUM] = { 0 };
     uint8_t eddsa_doit[EdDSA_NUM] = { 0 };
+    uint8_t op_doit[OP_NUM] = { 0 };
+    const char *json_file = NULL;
+    int ops_ready = 0;
 
     /* checks declarated curves against choices list. */
     OPENSSL_assert(ed_curves[EdDSA_NUM - 1].nid == NID_ED448);
@@ -1576,6 +2475,13 @@ int speed_main(int argc, char **argv)
             multi = atoi(opt_arg());
 #endif
             break;
+        case OPT_THREADS:
+            threads = atoi(opt_arg());
+            if (threads < 1 || threads > 1024) {
+                BIO_printf(bio_err, "%s: invalid number of threads\n", prog);
+                goto opterr;
+            }
+            break;
         case OPT_ASYNCJOBS:
 #ifndef OPENSSL_NO_ASYNC
             async_jobs = atoi(opt_arg());
@@ -1603,6 +2509,26 @@ int speed_main(int argc, char **argv)
         case OPT_MR:
             mr = 1;
             break;
+        case OPT_LATENCY:
+            latency = 1;
+            break;
+        case OPT_JSON:
+            latency = 1;
+            json_file = opt_arg();
+            break;
+        case OPT_TLS_GROUPS:
+            tls_groups = opt_arg();
+            break;
+        case OPT_TLS_CERT:
+            if (!opt_pair(opt_arg(), tls_cert_choices, &tls_cert))
+                goto opterr;
+            break;
+        case OPT_TLS_RESUME:
+            tls_resume = 1;
+            break;
+        case OPT_TLS_MTLS:
+            tls_mtls = 1;
+            break;
         case OPT_MB:
             multiblock = 1;
 #ifdef OPENSSL_NO_MULTIBLOCK
@@ -1627,7 +2553,8 @@ int speed_main(int argc, char **argv)
         case OPT_SECONDS:
             seconds.sym = seconds.rsa = seconds.dsa = seconds.ecdsa
                         = seconds.ecdh = seconds.eddsa
-                        = seconds.sm2 = seconds.ffdh = atoi(opt_arg());
+                        = seconds.sm2 = seconds.ffdh = seconds.op
+                        = atoi(opt_arg());
             break;
         case OPT_BYTES:
             lengths_single = atoi(opt_arg());
@@ -1742,6 +2669,20 @@ int speed_main(int argc, char **argv)
             continue;
         }
 #endif
+        if (strcmp(algo, "ops") == 0) {
+            for (i = 0; i < OP_NUM; i++)
+                op_doit[i] = op_loops[i] != NULL;
+            continue;
+        }
+        if (opt_found(algo, op_choices, &i)) {
+            if (op_loops[i] == NULL) {
+                BIO_printf(bio_err, "%s: %s is not supported by this build\n",
+                           prog, algo);
+                goto end;
+            }
+            op_doit[i] = 2;
+            continue;
+        }
         BIO_printf(bio_err, "%s: Unknown algorithm %s\n", prog, algo);
         goto end;
     }
@@ -1771,7 +2712,27 @@ int speed_main(int argc, char **argv)
         } else if (async_jobs > 0) {
             BIO_printf(bio_err, "Async mode is not supported with -mb");
             goto end;
+        } else if (threads > 0) {
+            BIO_printf(bio_err, "-threads is not supported with -mb\n");
+            goto end;
+        }
+    }
+    if (threads > 0) {
+        if (async_jobs > 0) {
+            BIO_printf(bio_err, "-threads cannot be used with -async_jobs\n");
+            goto end;
+        }
+        if (latency) {
+            BIO_printf(bio_err, "-threads cannot be used with -latency\n");
+            goto end;
         }
+        /* CPU time would add up over all threads */
+        usertime = 0;
+    }
+    if (latency && async_jobs > 0) {
+        /* Interleaved jobs would be timed from one completion to the next */
+        BIO_printf(bio_err, "-async_jobs cannot be used with -latency\n");
+        goto end;
     }
 
     /* Initialize the job pool if async mode is enabled */
@@ -1783,7 +2744,10 @@ int speed_main(int argc, char **argv)
         }
     }
 
-    loopargs_len = (async_jobs == 0 ? 1 : async_jobs);
+    if (threads > 0)
+        loopargs_len = threads;
+    else
+        loopargs_len = (async_jobs == 0 ? 1 : async_jobs);
     loopargs =
         app_malloc(loopargs_len * sizeof(loopargs_t), "array of loopargs");
     memset(loopargs, 0, loopargs_len * sizeof(loopargs_t));
@@ -1818,8 +2782,11 @@ int speed_main(int argc, char **argv)
     }
 
 #ifndef NO_FORK
-    if (multi && do_multi(multi, size_num))
-        goto show_res;
+    if (multi) {
+        if (do_multi(multi, size_num))
+            goto show_res;
+        json_file = NULL; /* this is a child, the parent writes the file */
+    }
 #endif
 
     /* Initialize the engine after the fork */
@@ -3116,6 +4083,48 @@ int speed_main(int argc, char **argv)
         }
     }
 #endif  /* OPENSSL_NO_DH */
+
+    for (testnum = 0; testnum < OP_NUM; testnum++) {
+        if (!op_doit[testnum])
+            continue;
+        if (!ops_ready) {
+            if (!setup_ops(&ops, &ec_curves[R_EC_P256],
+                           loopargs, loopargs_len)) {
+                memset(op_doit, 0, sizeof(op_doit));
+                break;
+            }
+            ops_ready = 1;
+        }
+        for (i = 0; i < loopargs_len; i++)
+            loopargs[i].tls_ns[0] = loopargs[i].tls_ns[1] = 0;
+        op_print_message(op_choices[testnum].name, op_c[testnum][0],
+                         seconds.op);
+        Time_F(START);
+        count = run_benchmark(async_jobs, op_loops[testnum], loopargs);
+        d = Time_F(STOP);
+        if (count < 0) {
+            op_doit[testnum] = 0;
+            continue;
+        }
+        BIO_printf(bio_err,
+                   mr ? "+R13:%ld:%s:%.2f\n" : "%ld %s ops in %.2fs\n",
+                   count, op_choices[testnum].name, d);
+        op_results[testnum][0] = (double)count / d;
+        if ((testnum == R_OP_TLS12 || testnum == R_OP_TLS13) && count > 0) {
+            uint64_t cns = 0, sns = 0;
+
+            for (i = 0; i < loopargs_len; i++) {
+                cns += loopargs[i].tls_ns[0];
+                sns += loopargs[i].tls_ns[1];
+            }
+            BIO_printf(bio_err,
+                       mr ? "+R14:%s:%.1f:%.1f\n"
+                          : "%s: %.1fus in the client and %.1fus in the"
+                            " server per handshake\n",
+                       op_choices[testnum].name, cns / 1e3 / count,
+                       sns / 1e3 / count);
+        }
+    }
 #ifndef NO_FORK
  show_res:
 #endif
@@ -3287,6 +4296,27 @@ int speed_main(int argc, char **argv)
                    1.0 / ffdh_results[k][0], ffdh_results[k][0]);
     }
 #endif /* OPENSSL_NO_DH */
+    testnum = 1;
+    for (k = 0; k < OP_NUM; k++) {
+        if (!op_doit[k])
+            continue;
+        if (testnum && !mr) {
+            printf("%23sop        op/s\n", " ");
+            testnum = 0;
+        }
+        if (mr)
+            printf("+F9:%u:%s:%f:%f\n",
+                   k, op_choices[k].name,
+                   op_results[k][0], 1.0 / op_results[k][0]);
+        else
+            printf("%-14s %10.6fs %10.1f\n", op_choices[k].name,
+                   1.0 / op_results[k][0], op_results[k][0]);
+    }
+    if (latency) {
+        lat_print();
+        if (json_file != NULL && !lat_print_json(json_file))
+            goto end;
+    }
 
     ret = 0;
 
@@ -3340,9 +4370,21 @@ int speed_main(int argc, char **argv)
             EVP_PKEY_free(loopargs[i].sm2_pkey[k]);
         }
 #endif
+#ifndef OPENSSL_NO_CMP
+        for (k = 0; k < 2; k++)
+            free_op_cmp(loopargs[i].cmp_ctx[k]);
+#endif
+        for (k = 0; k < 2; k++)
+            SSL_SESSION_free(loopargs[i].tls_sess[k]);
         OPENSSL_free(loopargs[i].secret_a);
         OPENSSL_free(loopargs[i].secret_b);
     }
+    free_ops(&ops);
+    OPENSSL_free(lat_results);
+#ifdef LAT_PERF
+    if (lat_perf_fd >= 0)
+        close(lat_perf_fd);
+#endif
     OPENSSL_free(evp_hmac_name);
     OPENSSL_free(evp_cmac_name);
 
@@ -3364,6 +4406,10 @@ int speed_main(int argc, char **argv)
 
 static void print_message(const char *s, long num, int length, int tm)
 {
+    char name[64];
+
+    BIO_snprintf(name, sizeof(name), "%s/%d", s, length);
+    lat_begin(name);
     BIO_printf(bio_err,
                mr ? "+DT:%s:%d:%d\n"
                : "Doing %s for %ds on %d size blocks: ", s, tm, length);
@@ -3375,6 +4421,11 @@ static void print_message(const char *s, long num, int length, int tm)
 static void pkey_print_message(const char *str, const char *str2, long num,
                                unsigned int bits, int tm)
 {
+    char name[64];
+
+    BIO_snprintf(name, sizeof(name), "%u bits %s%s%s",
+                 bits, str2, *str == '\0' ? "" : " ", str);
+    lat_begin(name);
     BIO_printf(bio_err,
                mr ? "+DTP:%d:%s:%s:%d\n"
                : "Doing %u bits %s %s's for %ds: ", bits, str, str2, tm);
@@ -3383,6 +4434,17 @@ static void pkey_print_message(const char *str, const char *str2, long num,
     alarm(tm);
 }
 
+static void op_print_message(const char *name, long num, int tm)
+{
+    lat_begin(name);
+    BIO_printf(bio_err,
+               mr ? "+DTO:%s:%d\n"
+               : "Doing %s ops for %ds: ", name, tm);
+    (void)BIO_flush(bio_err);
+    run = 1;
+    alarm(tm);
+}
+
 static void print_result(int alg, int run_no, int count, double time_used)
 {
     if (count == -1) {
@@ -3576,6 +4638,32 @@ static int do_multi(int multi, int size_num)
                 d = atof(sstrsep(&p, sep));
                 ffdh_results[k][0] += d;
 # endif /* OPENSSL_NO_DH */
+            } else if (strncmp(buf, "+F9:", 4) == 0) {
+                int k;
+                double d;
+
+                p = buf + 4;
+                k = atoi(sstrsep(&p, sep));
+                sstrsep(&p, sep);
+
+                d = atof(sstrsep(&p, sep));
+                op_results[k][0] += d;
+            } else if (strncmp(buf, "+L:", 3) == 0) {
+                LAT_RESULT res;
+
+                memset(&res, 0, sizeof(res));
+                p = buf + 3;
+                sstrsep(&p, sep);
+                res.child = n + 1;
+                OPENSSL_strlcpy(res.name, sstrsep(&p, sep), sizeof(res.name));
+                res.ops = (uint64_t)atof(sstrsep(&p, sep));
+                res.time = atof(sstrsep(&p, sep));
+                res.p50 = (uint64_t)atof(sstrsep(&p, sep));
+                res.p99 = (uint64_t)atof(sstrsep(&p, sep));
+                res.p999 = (uint64_t)atof(sstrsep(&p, sep));
+                res.max = (uint64_t)atof(sstrsep(&p, sep));
+                res.cycles = atof(sstrsep(&p, sep));
+                lat_add(&res);
             } else if (strncmp(buf, "+H:", 3) == 0) {
                 ;
             } else {
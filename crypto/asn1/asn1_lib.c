@@ -10,6 +10,7 @@
 #include <stdio.h>
 #include <limits.h>
 #include "internal/cryptlib.h"
+#include "internal/mem_pool.h"
 #include <openssl/asn1.h>
 #include "asn1_local.h"
 
@@ -331,7 +332,7 @@ ASN1_STRING *ASN1_STRING_type_new(int type)
 {
     ASN1_STRING *ret;
 
-    ret = OPENSSL_zalloc(sizeof(*ret));
+    ret = ossl_pool_zalloc(OSSL_POOL_ASN1_STRING, sizeof(*ret));
     if (ret == NULL) {
         ERR_raise(ERR_LIB_ASN1, ERR_R_MALLOC_FAILURE);
         return NULL;
@@ -347,7 +348,7 @@ void asn1_string_embed_free(ASN1_STRING *a, int embed)
     if (!(a->flags & ASN1_STRING_FLAG_NDEF))
         OPENSSL_free(a->data);
     if (embed == 0)
-        OPENSSL_free(a);
+        ossl_pool_free(OSSL_POOL_ASN1_STRING, a);
 }
 
 void ASN1_STRING_free(ASN1_STRING *a)
@@ -95,7 +95,7 @@ static ASYNC_JOB *async_job_new(void)
 static void async_job_free(ASYNC_JOB *job)
 {
     if (job != NULL) {
-        OPENSSL_free(job->funcargs);
+        OPENSSL_free(job->argbuf);
         async_fibre_free(&job->fibrectx);
         OPENSSL_free(job);
     }
@@ -138,7 +138,6 @@ static void async_release_job(ASYNC_JOB *job) {
     async_pool *pool;
 
     pool = (async_pool *)CRYPTO_THREAD_get_local(&poolkey);
-    OPENSSL_free(job->funcargs);
     job->funcargs = NULL;
     sk_ASYNC_JOB_push(pool->jobs, job);
 }
@@ -237,13 +236,20 @@ int ASYNC_start_job(ASYNC_JOB **job, ASYNC_WAIT_CTX *wctx, int *ret,
             return ASYNC_NO_JOBS;
 
         if (args != NULL) {
-            ctx->currjob->funcargs = OPENSSL_malloc(size);
-            if (ctx->currjob->funcargs == NULL) {
-                ERR_raise(ERR_LIB_ASYNC, ERR_R_MALLOC_FAILURE);
-                async_release_job(ctx->currjob);
-                ctx->currjob = NULL;
-                return ASYNC_ERR;
+            /* Reuse the argument buffer of the pooled job if it is big enough */
+            if (ctx->currjob->argbuf_size < size) {
+                OPENSSL_free(ctx->currjob->argbuf);
+                ctx->currjob->argbuf_size = 0;
+                ctx->currjob->argbuf = OPENSSL_malloc(size);
+                if (ctx->currjob->argbuf == NULL) {
+                    ERR_raise(ERR_LIB_ASYNC, ERR_R_MALLOC_FAILURE);
+                    async_release_job(ctx->currjob);
+                    ctx->currjob = NULL;
+                    return ASYNC_ERR;
+                }
+                ctx->currjob->argbuf_size = size;
             }
+            ctx->currjob->funcargs = ctx->currjob->argbuf;
             memcpy(ctx->currjob->funcargs, args, size);
         } else {
             ctx->currjob->funcargs = NULL;
@@ -40,6 +40,9 @@ struct async_job_st {
     async_fibre fibrectx;
     int (*func) (void *);
     void *funcargs;
+    /* Kept while the job is in the pool, so starting a job needn't malloc */
+    void *argbuf;
+    size_t argbuf_size;
     int ret;
     int status;
     ASYNC_WAIT_CTX *waitctx;
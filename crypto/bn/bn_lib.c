@@ -11,6 +11,7 @@
 #include <limits.h>
 #include "internal/cryptlib.h"
 #include "internal/endian.h"
+#include "internal/mem_pool.h"
 #include "bn_local.h"
 #include <openssl/opensslconf.h>
 #include "internal/constant_time.h"
@@ -218,7 +219,7 @@ void BN_clear_free(BIGNUM *a)
         bn_free_d(a, 1);
     if (BN_get_flags(a, BN_FLG_MALLOCED)) {
         OPENSSL_cleanse(a, sizeof(*a));
-        OPENSSL_free(a);
+        ossl_pool_free(OSSL_POOL_BIGNUM, a);
     }
 }
 
@@ -229,7 +230,7 @@ void BN_free(BIGNUM *a)
     if (!BN_get_flags(a, BN_FLG_STATIC_DATA))
         bn_free_d(a, 0);
     if (a->flags & BN_FLG_MALLOCED)
-        OPENSSL_free(a);
+        ossl_pool_free(OSSL_POOL_BIGNUM, a);
 }
 
 void bn_init(BIGNUM *a)
@@ -244,7 +245,7 @@ BIGNUM *BN_new(void)
 {
     BIGNUM *ret;
 
-    if ((ret = OPENSSL_zalloc(sizeof(*ret))) == NULL) {
+    if ((ret = ossl_pool_zalloc(OSSL_POOL_BIGNUM, sizeof(*ret))) == NULL) {
         ERR_raise(ERR_LIB_BN, ERR_R_MALLOC_FAILURE);
         return NULL;
     }
@@ -11,6 +11,7 @@
 
 #include "cmp_local.h"
 #include "internal/cryptlib.h"
+#include "internal/metrics.h"
 
 /* explicit #includes not strictly needed since implied by the above: */
 #include <openssl/bio.h>
@@ -139,6 +140,7 @@ static int send_receive_check(OSSL_CMP_CTX *ctx, const OSSL_CMP_MSG *req,
     int bt;
     time_t now = time(NULL);
     int time_left;
+    uint64_t start;
     OSSL_CMP_transfer_cb_t transfer_cb = ctx->transfer_cb;
 
     if (transfer_cb == NULL)
@@ -166,10 +168,14 @@ static int send_receive_check(OSSL_CMP_CTX *ctx, const OSSL_CMP_MSG *req,
 
     ossl_cmp_log1(INFO, ctx, "sending %s", req_type_str);
 
+    ossl_metric_count(ctx->libctx, OSSL_METRIC_CMP_MSG_SENT);
+    start = ossl_metric_now();
     *rep = (*transfer_cb)(ctx, req);
     ctx->msg_timeout = msg_timeout; /* restore original value */
+    ossl_metric_time(ctx->libctx, OSSL_METRIC_CMP_TRANSFER, start);
 
     if (*rep == NULL) {
+        ossl_metric_count(ctx->libctx, OSSL_METRIC_CMP_TRANSFER_FAIL);
         ERR_raise_data(ERR_LIB_CMP,
                        ctx->total_timeout > 0 && time(NULL) >= ctx->end_time ?
                        CMP_R_TOTAL_TIMEOUT : CMP_R_TRANSFER_ERROR,
@@ -178,6 +184,7 @@ static int send_receive_check(OSSL_CMP_CTX *ctx, const OSSL_CMP_MSG *req,
         return 0;
     }
 
+    ossl_metric_count(ctx->libctx, OSSL_METRIC_CMP_MSG_RECEIVED);
     bt = ossl_cmp_msg_get_bodytype(*rep);
     /*
      * The body type in the 'bt' variable is not yet verified.
@@ -895,3 +902,65 @@ STACK_OF(OSSL_CMP_ITAV) *OSSL_CMP_exec_GENM_ses(OSSL_CMP_CTX *ctx)
 
     return rcvd_itavs; /* recv_itavs == NULL indicates an error */
 }
+
+STACK_OF(OSSL_CMP_MSG) *
+OSSL_CMP_exec_nested(OSSL_CMP_CTX *ctx, const STACK_OF(OSSL_CMP_MSG) *reqs)
+{
+    OSSL_CMP_MSG *nested = NULL;
+    OSSL_CMP_MSG *rep = NULL;
+    OSSL_CMP_MSGS *rcvd;
+    STACK_OF(OSSL_CMP_MSG) *rsps = NULL;
+    int i, j, num;
+
+    if (ctx == NULL || (num = sk_OSSL_CMP_MSG_num(reqs)) <= 0) {
+        ERR_raise(ERR_LIB_CMP, CMP_R_INVALID_ARGS);
+        return NULL;
+    }
+    ctx->status = -1;
+
+    /* each batch is a transaction of its own, separate from the inner ones */
+    if (!OSSL_CMP_CTX_set1_transactionID(ctx, NULL)
+            || !OSSL_CMP_CTX_set1_senderNonce(ctx, NULL)
+            || !ossl_cmp_ctx_set1_recipNonce(ctx, NULL))
+        return NULL;
+
+    if ((nested = ossl_cmp_nested_new(ctx, reqs)) == NULL)
+        goto err;
+
+    if (!send_receive_check(ctx, nested, &rep, OSSL_CMP_PKIBODY_NESTED))
+        goto err;
+
+    /*
+     * The responses may come in any order, so they are matched to the
+     * requests by their transactionID.  Unanswered requests get NULL.
+     */
+    if ((rsps = sk_OSSL_CMP_MSG_new_reserve(NULL, num)) == NULL)
+        goto err;
+    rcvd = rep->body->value.nested;
+    for (i = 0; i < num; i++) {
+        const ASN1_OCTET_STRING *tid =
+            sk_OSSL_CMP_MSG_value(reqs, i)->header->transactionID;
+        OSSL_CMP_MSG *rsp = NULL;
+
+        for (j = 0; tid != NULL && j < sk_OSSL_CMP_MSG_num(rcvd); j++) {
+            OSSL_CMP_MSG *msg = sk_OSSL_CMP_MSG_value(rcvd, j);
+
+            if (msg != NULL && msg->header->transactionID != NULL
+                    && ASN1_OCTET_STRING_cmp(tid,
+                                             msg->header->transactionID) == 0) {
+                rsp = msg;
+                (void)sk_OSSL_CMP_MSG_set(rcvd, j, NULL);
+                break;
+            }
+        }
+        if (rsp == NULL)
+            ossl_cmp_log1(WARN, ctx,
+                          "no response to nested request #%d received", i);
+        (void)sk_OSSL_CMP_MSG_push(rsps, rsp); /* space has been reserved */
+    }
+
+ err:
+    OSSL_CMP_MSG_free(nested);
+    OSSL_CMP_MSG_free(rep);
+    return rsps; /* rsps == NULL indicates an error */
+}
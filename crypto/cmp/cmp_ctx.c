@@ -12,6 +12,7 @@
 #include <openssl/trace.h>
 #include <openssl/bio.h>
 #include <openssl/ocsp.h> /* for OCSP_REVOKED_STATUS_* */
+#include "internal/nelem.h"
 
 #include "cmp_local.h"
 
@@ -140,6 +141,116 @@ OSSL_CMP_CTX *OSSL_CMP_CTX_new(OSSL_LIB_CTX *libctx, const char *propq)
     return NULL;
 }
 
+/*
+ * The octet strings and certificate stacks of the per-transaction fields are
+ * not freed when the fields are cleared, e.g., by OSSL_CMP_CTX_reinit(),
+ * but kept as spares, which are then overwritten in place when the fields are
+ * set again.  So a context used for many transactions in a row does not need
+ * to allocate memory for them each time.
+ */
+static void retire_octets(OSSL_CMP_CTX *ctx, ASN1_OCTET_STRING **field)
+{
+    size_t i;
+
+    if (*field == NULL)
+        return;
+    for (i = 0; i < OSSL_NELEM(ctx->spareOctets); i++) {
+        if (ctx->spareOctets[i] == NULL) {
+            ctx->spareOctets[i] = *field;
+            *field = NULL;
+            return;
+        }
+    }
+    ASN1_OCTET_STRING_free(*field);
+    *field = NULL;
+}
+
+static ASN1_OCTET_STRING *take_spare_octets(OSSL_CMP_CTX *ctx)
+{
+    ASN1_OCTET_STRING *os;
+    size_t i;
+
+    for (i = 0; i < OSSL_NELEM(ctx->spareOctets); i++) {
+        if ((os = ctx->spareOctets[i]) != NULL) {
+            ctx->spareOctets[i] = NULL;
+            return os;
+        }
+    }
+    return ASN1_OCTET_STRING_new();
+}
+
+/* Sets *tgt to a copy of the given bytes, reusing any storage in place */
+int ossl_cmp_ctx_set1_octets(OSSL_CMP_CTX *ctx, ASN1_OCTET_STRING **tgt,
+                             const unsigned char *bytes, int len)
+{
+    ASN1_OCTET_STRING *os;
+
+    if (!ossl_assert(ctx != NULL && tgt != NULL))
+        return 0;
+
+    if ((os = *tgt) == NULL && (os = take_spare_octets(ctx)) == NULL)
+        return 0;
+    if (len > 0 && os->length == len) {
+        if (os->data != bytes)
+            memcpy(os->data, bytes, len);
+    } else if (!ASN1_OCTET_STRING_set(os, bytes, len)) {
+        if (*tgt == NULL)
+            retire_octets(ctx, &os);
+        return 0;
+    }
+    *tgt = os;
+    return 1;
+}
+
+static int ctx_set1_octets(OSSL_CMP_CTX *ctx, ASN1_OCTET_STRING **tgt,
+                           const ASN1_OCTET_STRING *src)
+{
+    if (*tgt == src) /* self-assignment */
+        return 1;
+    if (src == NULL) {
+        retire_octets(ctx, tgt);
+        return 1;
+    }
+    return ossl_cmp_ctx_set1_octets(ctx, tgt, src->data, src->length);
+}
+
+/* Replaces the certs in *tgt by the given ones, which may be NULL */
+static int ctx_set1_certs(OSSL_CMP_CTX *ctx, STACK_OF(X509) **tgt,
+                          STACK_OF(X509) *certs)
+{
+    STACK_OF(X509) *sk = *tgt;
+    size_t i;
+
+    if (sk != NULL) {
+        while (sk_X509_num(sk) > 0)
+            X509_free(sk_X509_pop(sk));
+        for (i = 0; i < OSSL_NELEM(ctx->spareCerts); i++) {
+            if (ctx->spareCerts[i] == NULL) {
+                ctx->spareCerts[i] = sk;
+                sk = NULL;
+                break;
+            }
+        }
+        sk_X509_free(sk);
+        *tgt = NULL;
+    }
+    if (certs == NULL)
+        return 1;
+
+    for (sk = NULL, i = 0; sk == NULL && i < OSSL_NELEM(ctx->spareCerts); i++) {
+        sk = ctx->spareCerts[i];
+        ctx->spareCerts[i] = NULL;
+    }
+    if (sk == NULL && (sk = sk_X509_new_null()) == NULL)
+        return 0;
+    if (!X509_add_certs(sk, certs, X509_ADD_FLAG_UP_REF)) {
+        sk_X509_pop_free(sk, X509_free);
+        return 0;
+    }
+    *tgt = sk;
+    return 1;
+}
+
 /* Prepare the OSSL_CMP_CTX for next use, partly re-initializing OSSL_CMP_CTX */
 int OSSL_CMP_CTX_reinit(OSSL_CMP_CTX *ctx)
 {
@@ -165,6 +276,8 @@ int OSSL_CMP_CTX_reinit(OSSL_CMP_CTX *ctx)
 /* Frees OSSL_CMP_CTX variables allocated in OSSL_CMP_CTX_new() */
 void OSSL_CMP_CTX_free(OSSL_CMP_CTX *ctx)
 {
+    size_t i;
+
     if (ctx == NULL)
         return;
 
@@ -213,6 +326,11 @@ void OSSL_CMP_CTX_free(OSSL_CMP_CTX *ctx)
     sk_X509_pop_free(ctx->caPubs, X509_free);
     sk_X509_pop_free(ctx->extraCertsIn, X509_free);
 
+    for (i = 0; i < OSSL_NELEM(ctx->spareOctets); i++)
+        ASN1_OCTET_STRING_free(ctx->spareOctets[i]);
+    for (i = 0; i < OSSL_NELEM(ctx->spareCerts); i++)
+        sk_X509_free(ctx->spareCerts[i]);
+
     OPENSSL_free(ctx);
 }
 
@@ -472,10 +590,7 @@ int ossl_cmp_ctx_set1_newChain(OSSL_CMP_CTX *ctx, STACK_OF(X509) *newChain)
     if (!ossl_assert(ctx != NULL))
         return 0;
 
-    sk_X509_pop_free(ctx->newChain, X509_free);
-    ctx->newChain = NULL;
-    return newChain == NULL ||
-        (ctx->newChain = X509_chain_up_ref(newChain)) != NULL;
+    return ctx_set1_certs(ctx, &ctx->newChain, newChain);
 }
 
 /* Returns the stack of extraCerts received in CertRepMessage, NULL on error */
@@ -498,10 +613,7 @@ int ossl_cmp_ctx_set1_extraCertsIn(OSSL_CMP_CTX *ctx,
     if (!ossl_assert(ctx != NULL))
         return 0;
 
-    sk_X509_pop_free(ctx->extraCertsIn, X509_free);
-    ctx->extraCertsIn = NULL;
-    return extraCertsIn == NULL
-        || (ctx->extraCertsIn = X509_chain_up_ref(extraCertsIn)) != NULL;
+    return ctx_set1_certs(ctx, &ctx->extraCertsIn, extraCertsIn);
 }
 
 /*
@@ -583,9 +695,7 @@ int ossl_cmp_ctx_set1_caPubs(OSSL_CMP_CTX *ctx, STACK_OF(X509) *caPubs)
     if (!ossl_assert(ctx != NULL))
         return 0;
 
-    sk_X509_pop_free(ctx->caPubs, X509_free);
-    ctx->caPubs = NULL;
-    return caPubs == NULL || (ctx->caPubs = X509_chain_up_ref(caPubs)) != NULL;
+    return ctx_set1_certs(ctx, &ctx->caPubs, caPubs);
 }
 
 #define char_dup OPENSSL_strdup
@@ -823,7 +933,7 @@ int OSSL_CMP_CTX_set1_transactionID(OSSL_CMP_CTX *ctx,
         ERR_raise(ERR_LIB_CMP, CMP_R_NULL_ARGUMENT);
         return 0;
     }
-    return ossl_cmp_asn1_octet_string_set1(&ctx->transactionID, id);
+    return ctx_set1_octets(ctx, &ctx->transactionID, id);
 }
 
 /* Set the nonce to be used for the recipNonce in the message created next */
@@ -832,7 +942,7 @@ int ossl_cmp_ctx_set1_recipNonce(OSSL_CMP_CTX *ctx,
 {
     if (!ossl_assert(ctx != NULL))
         return 0;
-    return ossl_cmp_asn1_octet_string_set1(&ctx->recipNonce, nonce);
+    return ctx_set1_octets(ctx, &ctx->recipNonce, nonce);
 }
 
 /* Stores the given nonce as the last senderNonce sent out */
@@ -843,7 +953,7 @@ int OSSL_CMP_CTX_set1_senderNonce(OSSL_CMP_CTX *ctx,
         ERR_raise(ERR_LIB_CMP, CMP_R_NULL_ARGUMENT);
         return 0;
     }
-    return ossl_cmp_asn1_octet_string_set1(&ctx->senderNonce, nonce);
+    return ctx_set1_octets(ctx, &ctx->senderNonce, nonce);
 }
 
 /* Set the proxy server to use for HTTP(S) connections */
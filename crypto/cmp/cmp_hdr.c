@@ -136,18 +136,14 @@ int ossl_cmp_hdr_update_messageTime(OSSL_CMP_PKIHEADER *hdr)
     return ASN1_GENERALIZEDTIME_set(hdr->messageTime, time(NULL)) != NULL;
 }
 
-/* assign to *tgt a random byte array of given length */
-static int set_random(ASN1_OCTET_STRING **tgt, OSSL_CMP_CTX *ctx, size_t len)
+/* fill the given buffer with random bytes */
+static int get_random(unsigned char *bytes, OSSL_CMP_CTX *ctx, size_t len)
 {
-    unsigned char *bytes = OPENSSL_malloc(len);
-    int res = 0;
-
-    if (bytes == NULL || RAND_bytes_ex(ctx->libctx, bytes, len) <= 0)
+    if (RAND_bytes_ex(ctx->libctx, bytes, len) <= 0) {
         ERR_raise(ERR_LIB_CMP, CMP_R_FAILURE_OBTAINING_RANDOM);
-    else
-        res = ossl_cmp_asn1_octet_string_set1_bytes(tgt, bytes, len);
-    OPENSSL_free(bytes);
-    return res;
+        return 0;
+    }
+    return 1;
 }
 
 int ossl_cmp_hdr_set1_senderKID(OSSL_CMP_PKIHEADER *hdr,
@@ -270,10 +266,13 @@ int ossl_cmp_hdr_has_implicitConfirm(const OSSL_CMP_PKIHEADER *hdr)
 int ossl_cmp_hdr_set_transactionID(OSSL_CMP_CTX *ctx, OSSL_CMP_PKIHEADER *hdr)
 {
     if (ctx->transactionID == NULL) {
+        unsigned char id[OSSL_CMP_TRANSACTIONID_LENGTH];
         char *tid;
 
-        if (!set_random(&ctx->transactionID, ctx,
-                        OSSL_CMP_TRANSACTIONID_LENGTH))
+        /* storage kept by OSSL_CMP_CTX_reinit() is reused */
+        if (!get_random(id, ctx, sizeof(id))
+                || !ossl_cmp_ctx_set1_octets(ctx, &ctx->transactionID,
+                                             id, sizeof(id)))
             return 0;
         tid = OPENSSL_buf2hexstr(ctx->transactionID->data,
                                  ctx->transactionID->length);
@@ -283,9 +282,6 @@ int ossl_cmp_hdr_set_transactionID(OSSL_CMP_CTX *ctx, OSSL_CMP_PKIHEADER *hdr)
         OPENSSL_free(tid);
     }
 
-    if (ctx->transactionID == NULL
-        && !set_random(&ctx->transactionID, ctx, OSSL_CMP_TRANSACTIONID_LENGTH))
-        return 0;
     return ossl_cmp_asn1_octet_string_set1(&hdr->transactionID,
                                            ctx->transactionID);
 }
@@ -295,6 +291,7 @@ int ossl_cmp_hdr_init(OSSL_CMP_CTX *ctx, OSSL_CMP_PKIHEADER *hdr)
 {
     const X509_NAME *sender;
     const X509_NAME *rcp = NULL;
+    unsigned char nonce[OSSL_CMP_SENDERNONCE_LENGTH];
 
     if (!ossl_assert(ctx != NULL && hdr != NULL))
         return 0;
@@ -351,7 +348,9 @@ int ossl_cmp_hdr_init(OSSL_CMP_CTX *ctx, OSSL_CMP_PKIHEADER *hdr)
      * is copied from the senderNonce of the previous message in the
      * transaction.
      */
-    if (!set_random(&hdr->senderNonce, ctx, OSSL_CMP_SENDERNONCE_LENGTH))
+    if (!get_random(nonce, ctx, sizeof(nonce))
+            || !ossl_cmp_asn1_octet_string_set1_bytes(&hdr->senderNonce,
+                                                      nonce, sizeof(nonce)))
         return 0;
 
     /* store senderNonce - for cmp with recipNonce in next outgoing msg */
@@ -131,6 +131,10 @@ struct ossl_cmp_ctx_st {
     /* certificate confirmation */
     OSSL_CMP_certConf_cb_t certConf_cb; /* callback for app checking new cert */
     void *certConf_cb_arg; /* allows to store an argument individual to cb */
+
+    /* storage of per-transaction fields kept by OSSL_CMP_CTX_reinit() */
+    ASN1_OCTET_STRING *spareOctets[3]; /* transactionID and nonces */
+    STACK_OF(X509) *spareCerts[3]; /* newChain, caPubs, and extraCertsIn */
 } /* OSSL_CMP_CTX */;
 
 /*
@@ -793,6 +797,8 @@ int ossl_cmp_ctx_set1_extraCertsIn(OSSL_CMP_CTX *ctx,
                                    STACK_OF(X509) *extraCertsIn);
 int ossl_cmp_ctx_set1_recipNonce(OSSL_CMP_CTX *ctx,
                                  const ASN1_OCTET_STRING *nonce);
+int ossl_cmp_ctx_set1_octets(OSSL_CMP_CTX *ctx, ASN1_OCTET_STRING **tgt,
+                             const unsigned char *bytes, int len);
 
 /* from cmp_status.c */
 int ossl_cmp_pkisi_get_status(const OSSL_CMP_PKISI *si);
@@ -885,6 +891,8 @@ OSSL_CMP_MSG *ossl_cmp_genp_new(OSSL_CMP_CTX *ctx,
 OSSL_CMP_MSG *ossl_cmp_error_new(OSSL_CMP_CTX *ctx, OSSL_CMP_PKISI *si,
                                  int errorCode,
                                  const char *details, int unprotected);
+OSSL_CMP_MSG *ossl_cmp_nested_new(OSSL_CMP_CTX *ctx,
+                                  const STACK_OF(OSSL_CMP_MSG) *msgs);
 int ossl_cmp_certstatus_set0_certHash(OSSL_CMP_CERTSTATUS *certStatus,
                                       ASN1_OCTET_STRING *hash);
 OSSL_CMP_MSG *ossl_cmp_certConf_new(OSSL_CMP_CTX *ctx, int fail_info,
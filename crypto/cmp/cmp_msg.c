@@ -199,6 +199,11 @@ OSSL_CMP_MSG *ossl_cmp_msg_create(OSSL_CMP_CTX *ctx, int bodytype)
             goto err;
         return msg;
 
+    case OSSL_CMP_PKIBODY_NESTED:
+        if ((msg->body->value.nested = sk_OSSL_CMP_MSG_new_null()) == NULL)
+            goto err;
+        return msg;
+
     default:
         ERR_raise(ERR_LIB_CMP, CMP_R_UNEXPECTED_PKIBODY);
         goto err;
@@ -734,6 +739,43 @@ OSSL_CMP_MSG *ossl_cmp_error_new(OSSL_CMP_CTX *ctx, OSSL_CMP_PKISI *si,
     return NULL;
 }
 
+/*
+ * Creates a nested message containing copies of the given messages,
+ * protected with the credentials in ctx.
+ * returns a pointer to the PKIMessage on success, NULL on error
+ */
+OSSL_CMP_MSG *ossl_cmp_nested_new(OSSL_CMP_CTX *ctx,
+                                  const STACK_OF(OSSL_CMP_MSG) *msgs)
+{
+    OSSL_CMP_MSG *msg;
+    int i;
+
+    if (!ossl_assert(ctx != NULL && msgs != NULL))
+        return NULL;
+
+    if ((msg = ossl_cmp_msg_create(ctx, OSSL_CMP_PKIBODY_NESTED)) == NULL)
+        return NULL;
+
+    for (i = 0; i < sk_OSSL_CMP_MSG_num(msgs); i++) {
+        OSSL_CMP_MSG *dup = OSSL_CMP_MSG_dup(sk_OSSL_CMP_MSG_value(msgs, i));
+
+        if (dup == NULL
+                || !sk_OSSL_CMP_MSG_push(msg->body->value.nested, dup)) {
+            OSSL_CMP_MSG_free(dup);
+            goto err;
+        }
+    }
+
+    if (!ossl_cmp_msg_protect(ctx, msg))
+        goto err;
+
+    return msg;
+
+ err:
+    OSSL_CMP_MSG_free(msg);
+    return NULL;
+}
+
 /*
  * Set the certHash field of a OSSL_CMP_CERTSTATUS structure.
  * This is used in the certConf message, for example,
@@ -11,14 +11,42 @@
 
 /* general CMP server functions */
 
+#include <string.h>
 #include <openssl/asn1t.h>
+#include <openssl/sha.h>
 
 #include "cmp_local.h"
+#include "internal/metrics.h"
 
 /* explicit #includes not strictly needed since implied by the above: */
 #include <openssl/cmp.h>
 #include <openssl/err.h>
 
+/*
+ * Number of senderNonces of validated requests remembered for detecting
+ * replays.  The table is direct-mapped, so a nonce is forgotten when a later
+ * one falls into the same slot.  Must be a power of 2.
+ */
+#define REPLAY_TABLE_SIZE 1024
+
+typedef struct {
+    int len; /* 0 for an empty slot */
+    unsigned char data[OSSL_CMP_SENDERNONCE_LENGTH];
+} REPLAY_SLOT;
+
+/*
+ * Number of certificate request messages with verified POPO remembered such
+ * that retrying one of them does not require verifying it again.
+ * Direct-mapped like the replay table.  Must be a power of 2.
+ */
+#define POPO_CACHE_SIZE 64
+
+typedef struct {
+    int used;
+    int raVerified; /* acceptRAVerified was set when verifying */
+    unsigned char md[SHA256_DIGEST_LENGTH]; /* of the OSSL_CRMF_MSG */
+} POPO_SLOT;
+
 /* the context for the generic CMP server */
 struct ossl_cmp_srv_ctx_st
 {
@@ -36,7 +64,11 @@ struct ossl_cmp_srv_ctx_st
     int acceptUnprotected;     /* Accept requests with no/invalid prot. */
     int acceptRAVerified;      /* Accept ir/cr/kur with POPO RAVerified */
     int grantImplicitConfirm;  /* Grant implicit confirmation if requested */
+    int maxMsgAge;             /* Max secs messageTime may differ from now */
 
+    REPLAY_SLOT *replayTable;  /* senderNonces seen, allocated on first use */
+    POPO_SLOT *popoCache;      /* verified requests, allocated on first use */
+    EVP_MD *popoMd;            /* SHA-256 for popoCache, fetched with it */
 }; /* OSSL_CMP_SRV_CTX */
 
 void OSSL_CMP_SRV_CTX_free(OSSL_CMP_SRV_CTX *srv_ctx)
@@ -45,6 +77,9 @@ void OSSL_CMP_SRV_CTX_free(OSSL_CMP_SRV_CTX *srv_ctx)
         return;
 
     OSSL_CMP_CTX_free(srv_ctx->ctx);
+    OPENSSL_free(srv_ctx->replayTable);
+    OPENSSL_free(srv_ctx->popoCache);
+    EVP_MD_free(srv_ctx->popoMd);
     OPENSSL_free(srv_ctx);
 }
 
@@ -147,6 +182,73 @@ int OSSL_CMP_SRV_CTX_set_grant_implicit_confirm(OSSL_CMP_SRV_CTX *srv_ctx,
     return 1;
 }
 
+int OSSL_CMP_SRV_CTX_set_max_msg_age(OSSL_CMP_SRV_CTX *srv_ctx, int sec)
+{
+    if (srv_ctx == NULL) {
+        ERR_raise(ERR_LIB_CMP, CMP_R_NULL_ARGUMENT);
+        return 0;
+    }
+    if (sec < 0) {
+        ERR_raise(ERR_LIB_CMP, CMP_R_VALUE_TOO_SMALL);
+        return 0;
+    }
+    srv_ctx->maxMsgAge = sec;
+    return 1;
+}
+
+/*
+ * The certReq part of a received crm is not encoded again but taken from its
+ * cached encoding, see OSSL_CRMF_MSGS_verify_popo()
+ */
+static int popo_digest(OSSL_CMP_SRV_CTX *srv_ctx, const OSSL_CRMF_MSG *crm,
+                       unsigned char *md)
+{
+    OSSL_CMP_CTX *ctx = srv_ctx->ctx;
+    unsigned char *der = NULL;
+    int len, ret = 0;
+
+    if (srv_ctx->popoMd == NULL)
+        srv_ctx->popoMd = EVP_MD_fetch(ctx->libctx, "SHA256", ctx->propq);
+    if (srv_ctx->popoMd != NULL && (len = i2d_OSSL_CRMF_MSG(crm, &der)) > 0)
+        ret = EVP_Digest(der, len, md, NULL, srv_ctx->popoMd, NULL);
+    OPENSSL_free(der);
+    return ret;
+}
+
+/*
+ * Verifies the POPO of req unless that of the same crm has been verified
+ * before, which happens when a client retries a request, e.g., after polling.
+ * Failure to use the cache is not fatal, so no error is reported for it.
+ */
+static int verify_popo(OSSL_CMP_SRV_CTX *srv_ctx, const OSSL_CMP_MSG *req,
+                       const OSSL_CRMF_MSG *crm)
+{
+    OSSL_CMP_CTX *ctx = srv_ctx->ctx;
+    unsigned char md[SHA256_DIGEST_LENGTH];
+    POPO_SLOT *slot = NULL;
+
+    if (crm != NULL && popo_digest(srv_ctx, crm, md)) {
+        if (srv_ctx->popoCache == NULL)
+            srv_ctx->popoCache =
+                OPENSSL_zalloc(POPO_CACHE_SIZE * sizeof(POPO_SLOT));
+        if (srv_ctx->popoCache != NULL)
+            slot = &srv_ctx->popoCache[md[0] & (POPO_CACHE_SIZE - 1)];
+    }
+    if (slot != NULL && slot->used && memcmp(slot->md, md, sizeof(md)) == 0
+            && (!slot->raVerified || srv_ctx->acceptRAVerified)) {
+        ossl_metric_count(ctx->libctx, OSSL_METRIC_CMP_SRV_POPO_CACHED);
+        return 1;
+    }
+    if (!ossl_cmp_verify_popo(ctx, req, srv_ctx->acceptRAVerified))
+        return 0;
+    if (slot != NULL) {
+        slot->used = 1;
+        slot->raVerified = srv_ctx->acceptRAVerified;
+        memcpy(slot->md, md, sizeof(md));
+    }
+    return 1;
+}
+
 /*
  * Processes an ir/cr/p10cr/kur and returns a certification response.
  * Only handles the first certification request contained in req
@@ -201,7 +303,7 @@ static OSSL_CMP_MSG *process_cert_request(OSSL_CMP_SRV_CTX *srv_ctx,
         certReqId = OSSL_CRMF_MSG_get_certReqId(crm);
     }
 
-    if (!ossl_cmp_verify_popo(srv_ctx->ctx, req, srv_ctx->acceptRAVerified)) {
+    if (!verify_popo(srv_ctx, req, crm)) {
         /* Proof of possession could not be verified */
         si = OSSL_CMP_STATUSINFO_new(OSSL_CMP_PKISTATUS_rejection,
                                      1 << OSSL_CMP_PKIFAILUREINFO_badPOP,
@@ -415,6 +517,239 @@ static OSSL_CMP_MSG *process_pollReq(OSSL_CMP_SRV_CTX *srv_ctx,
     return msg;
 }
 
+/*
+ * Processes the messages contained in a nested request one by one, each as
+ * a transaction of its own, and wraps their responses into a nested response.
+ * The inner messages are validated with the given secret, such that they can
+ * be protected with PBM even if the outer message is signed.
+ * An inner message must not be nested again, as that would let a peer make
+ * the server recurse as deep as the ASN.1 decoder allows.
+ */
+static OSSL_CMP_MSG *process_nested(OSSL_CMP_SRV_CTX *srv_ctx,
+                                    const OSSL_CMP_MSG *req,
+                                    ASN1_OCTET_STRING *secret)
+{
+    OSSL_CMP_CTX *ctx;
+    OSSL_CMP_PKIHEADER *hdr;
+    OSSL_CMP_MSGS *reqs;
+    STACK_OF(OSSL_CMP_MSG) *rsps;
+    ASN1_OCTET_STRING *outer_secret;
+    OSSL_CMP_MSG *msg = NULL;
+    int i, num;
+
+    if (!ossl_assert(srv_ctx != NULL && srv_ctx->ctx != NULL && req != NULL))
+        return NULL;
+
+    ctx = srv_ctx->ctx;
+    hdr = OSSL_CMP_MSG_get0_header(req);
+    reqs = req->body->value.nested;
+    num = sk_OSSL_CMP_MSG_num(reqs);
+    if (num <= 0) {
+        ERR_raise(ERR_LIB_CMP, CMP_R_PKIBODY_ERROR);
+        return NULL;
+    }
+    if ((rsps = sk_OSSL_CMP_MSG_new_reserve(NULL, num)) == NULL)
+        return NULL;
+
+    outer_secret = ctx->secretValue;
+    ctx->secretValue = secret;
+    /* the outer transaction must not be taken for an aborted inner one */
+    (void)OSSL_CMP_CTX_set1_transactionID(ctx, NULL);
+    for (i = 0; i < num; i++) {
+        const OSSL_CMP_MSG *inner = sk_OSSL_CMP_MSG_value(reqs, i);
+        OSSL_CMP_MSG *rsp;
+
+        if (ossl_cmp_msg_get_bodytype(inner) == OSSL_CMP_PKIBODY_NESTED) {
+            ERR_raise_data(ERR_LIB_CMP, CMP_R_UNEXPECTED_PKIBODY,
+                           "nested message inside nested message");
+            break;
+        }
+        if ((rsp = OSSL_CMP_SRV_process_request(srv_ctx, inner)) == NULL)
+            break;
+        (void)sk_OSSL_CMP_MSG_push(rsps, rsp); /* space has been reserved */
+    }
+    ctx->secretValue = outer_secret;
+
+    /* restore the state of the outer transaction for protecting the response */
+    if (i == num
+            && OSSL_CMP_CTX_set1_recipient(ctx, hdr->sender->d.directoryName)
+            && OSSL_CMP_CTX_set1_transactionID(ctx, hdr->transactionID)
+            && ossl_cmp_ctx_set1_recipNonce(ctx, hdr->senderNonce))
+        msg = ossl_cmp_nested_new(ctx, rsps);
+    sk_OSSL_CMP_MSG_pop_free(rsps, OSSL_CMP_MSG_free);
+    return msg;
+}
+
+static REPLAY_SLOT *replay_slot(OSSL_CMP_SRV_CTX *srv_ctx,
+                                const ASN1_OCTET_STRING *nonce)
+{
+    uint32_t h = 2166136261U; /* FNV-1a */
+    int i;
+
+    for (i = 0; i < nonce->length; i++)
+        h = (h ^ nonce->data[i]) * 16777619U;
+    return &srv_ctx->replayTable[h & (REPLAY_TABLE_SIZE - 1)];
+}
+
+/* Longer nonces are compared by their length and first bytes only */
+static int replay_seen(OSSL_CMP_SRV_CTX *srv_ctx,
+                       const ASN1_OCTET_STRING *nonce)
+{
+    REPLAY_SLOT *slot;
+    size_t len;
+
+    if (srv_ctx->replayTable == NULL || nonce == NULL || nonce->length <= 0)
+        return 0;
+    slot = replay_slot(srv_ctx, nonce);
+    len = nonce->length < OSSL_CMP_SENDERNONCE_LENGTH
+        ? (size_t)nonce->length : OSSL_CMP_SENDERNONCE_LENGTH;
+    return slot->len == nonce->length
+        && memcmp(slot->data, nonce->data, len) == 0;
+}
+
+/* Failure to remember a nonce is not fatal, so no error is reported */
+static void replay_add(OSSL_CMP_SRV_CTX *srv_ctx,
+                       const ASN1_OCTET_STRING *nonce)
+{
+    REPLAY_SLOT *slot;
+    size_t len;
+
+    if (nonce == NULL || nonce->length <= 0)
+        return;
+    if (srv_ctx->replayTable == NULL
+            && (srv_ctx->replayTable =
+                OPENSSL_zalloc(REPLAY_TABLE_SIZE * sizeof(REPLAY_SLOT))) == NULL)
+        return;
+    slot = replay_slot(srv_ctx, nonce);
+    len = nonce->length < OSSL_CMP_SENDERNONCE_LENGTH
+        ? (size_t)nonce->length : OSSL_CMP_SENDERNONCE_LENGTH;
+    slot->len = nonce->length;
+    memcpy(slot->data, nonce->data, len);
+}
+
+static int starts_transaction(int req_type)
+{
+    switch (req_type) {
+    case OSSL_CMP_PKIBODY_IR:
+    case OSSL_CMP_PKIBODY_CR:
+    case OSSL_CMP_PKIBODY_P10CR:
+    case OSSL_CMP_PKIBODY_KUR:
+    case OSSL_CMP_PKIBODY_RR:
+    case OSSL_CMP_PKIBODY_GENM:
+    case OSSL_CMP_PKIBODY_ERROR:
+    case OSSL_CMP_PKIBODY_NESTED:
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+/*
+ * Does the checks on a request that are cheap compared to validating its
+ * protection, such that malformed, misdirected, stale, or replayed requests
+ * are rejected early.  They are done in order of increasing cost, and the
+ * rejections are counted separately for each stage.
+ * Returns 1 on success, 0 on error.
+ */
+static int prevalidate(OSSL_CMP_SRV_CTX *srv_ctx, const OSSL_CMP_MSG *req,
+                       int req_type)
+{
+    OSSL_CMP_CTX *ctx = srv_ctx->ctx;
+    OSSL_CMP_PKIHEADER *hdr = OSSL_CMP_MSG_get0_header(req);
+    int supported, reason;
+
+    /* stage 1: message type and protocol version */
+    switch (req_type) {
+    case OSSL_CMP_PKIBODY_IR:
+    case OSSL_CMP_PKIBODY_CR:
+    case OSSL_CMP_PKIBODY_P10CR:
+    case OSSL_CMP_PKIBODY_KUR:
+        supported = srv_ctx->process_cert_request != NULL;
+        break;
+    case OSSL_CMP_PKIBODY_RR:
+        supported = srv_ctx->process_rr != NULL;
+        break;
+    case OSSL_CMP_PKIBODY_GENM:
+        supported = srv_ctx->process_genm != NULL;
+        break;
+    case OSSL_CMP_PKIBODY_ERROR:
+        supported = srv_ctx->process_error != NULL;
+        break;
+    case OSSL_CMP_PKIBODY_CERTCONF:
+        supported = srv_ctx->process_certConf != NULL;
+        break;
+    case OSSL_CMP_PKIBODY_POLLREQ:
+        supported = srv_ctx->process_pollReq != NULL;
+        break;
+    case OSSL_CMP_PKIBODY_NESTED:
+        supported = 1;
+        break;
+    default:
+        supported = 0;
+        break;
+    }
+    if (!supported) {
+        reason = CMP_R_UNEXPECTED_PKIBODY;
+        goto syntax_err;
+    }
+    if (ossl_cmp_hdr_get_pvno(hdr) != OSSL_CMP_PVNO) {
+        reason = CMP_R_UNEXPECTED_PVNO;
+        goto syntax_err;
+    }
+
+    /* stage 2: header fields, in particular the transaction state */
+    if (!starts_transaction(req_type)) {
+        if (ctx->transactionID == NULL) {
+            reason = CMP_R_UNEXPECTED_PKIBODY;
+            goto header_err;
+        }
+        if (hdr->transactionID == NULL
+                || ASN1_OCTET_STRING_cmp(ctx->transactionID,
+                                         hdr->transactionID) != 0) {
+            reason = CMP_R_TRANSACTIONID_UNMATCHED;
+            goto header_err;
+        }
+        if (ctx->senderNonce != NULL
+                && (hdr->recipNonce == NULL
+                    || ASN1_OCTET_STRING_cmp(ctx->senderNonce,
+                                             hdr->recipNonce) != 0)) {
+            reason = CMP_R_RECIPNONCE_UNMATCHED;
+            goto header_err;
+        }
+    }
+    if (srv_ctx->maxMsgAge > 0 && hdr->messageTime != NULL) {
+        int days, secs;
+        int64_t age;
+
+        if (!ASN1_TIME_diff(&days, &secs, hdr->messageTime, NULL)) {
+            reason = CMP_R_MESSAGETIME_OUT_OF_RANGE;
+            goto header_err;
+        }
+        age = (int64_t)days * 86400 + secs;
+        if (age > srv_ctx->maxMsgAge || age < -srv_ctx->maxMsgAge) {
+            reason = CMP_R_MESSAGETIME_OUT_OF_RANGE;
+            goto header_err;
+        }
+    }
+
+    /* stage 3: replay of a request already seen */
+    if (replay_seen(srv_ctx, hdr->senderNonce)) {
+        ossl_metric_count(ctx->libctx, OSSL_METRIC_CMP_SRV_REJECT_REPLAY);
+        ERR_raise(ERR_LIB_CMP, CMP_R_REPLAYED_MESSAGE);
+        return 0;
+    }
+    return 1;
+
+ syntax_err:
+    ossl_metric_count(ctx->libctx, OSSL_METRIC_CMP_SRV_REJECT_SYNTAX);
+    ERR_raise(ERR_LIB_CMP, reason);
+    return 0;
+ header_err:
+    ossl_metric_count(ctx->libctx, OSSL_METRIC_CMP_SRV_REJECT_HEADER);
+    ERR_raise(ERR_LIB_CMP, reason);
+    return 0;
+}
+
 /*
  * Determine whether missing/invalid protection of request message is allowed.
  * Return 1 on acceptance, 0 on rejection, or -1 on (internal) error.
@@ -474,14 +809,13 @@ OSSL_CMP_MSG *OSSL_CMP_SRV_process_request(OSSL_CMP_SRV_CTX *srv_ctx,
         goto err;
 
     req_type = ossl_cmp_msg_get_bodytype(req);
-    switch (req_type) {
-    case OSSL_CMP_PKIBODY_IR:
-    case OSSL_CMP_PKIBODY_CR:
-    case OSSL_CMP_PKIBODY_P10CR:
-    case OSSL_CMP_PKIBODY_KUR:
-    case OSSL_CMP_PKIBODY_RR:
-    case OSSL_CMP_PKIBODY_GENM:
-    case OSSL_CMP_PKIBODY_ERROR:
+    ossl_metric_count(ctx->libctx, OSSL_METRIC_CMP_SRV_REQUEST);
+#ifndef FUZZING_BUILD_MODE_UNSAFE_FOR_PRODUCTION
+    if (!prevalidate(srv_ctx, req, req_type))
+        goto err;
+#endif
+
+    if (starts_transaction(req_type)) {
         if (ctx->transactionID != NULL) {
             char *tid;
 
@@ -497,15 +831,6 @@ OSSL_CMP_MSG *OSSL_CMP_SRV_process_request(OSSL_CMP_SRV_CTX *srv_ctx,
         if (!OSSL_CMP_CTX_set1_transactionID(ctx, NULL)
                 || !OSSL_CMP_CTX_set1_senderNonce(ctx, NULL))
             goto err;
-        break;
-    default:
-        /* transactionID should be already initialized */
-        if (ctx->transactionID == NULL) {
-#ifndef FUZZING_BUILD_MODE_UNSAFE_FOR_PRODUCTION
-            ERR_raise(ERR_LIB_CMP, CMP_R_UNEXPECTED_PKIBODY);
-            goto err;
-#endif
-        }
     }
 
     res = ossl_cmp_msg_check_update(ctx, req, unprotected_exception,
@@ -513,8 +838,11 @@ OSSL_CMP_MSG *OSSL_CMP_SRV_process_request(OSSL_CMP_SRV_CTX *srv_ctx,
     if (ctx->secretValue != NULL && ctx->pkey != NULL
             && ossl_cmp_hdr_get_protection_nid(hdr) != NID_id_PasswordBasedMAC)
         ctx->secretValue = NULL; /* use MSG_SIG_ALG when protecting rsp */
-    if (!res)
+    if (!res) {
+        ossl_metric_count(ctx->libctx, OSSL_METRIC_CMP_SRV_REJECT_VERIFY);
         goto err;
+    }
+    replay_add(srv_ctx, hdr->senderNonce);
 
     switch (req_type) {
     case OSSL_CMP_PKIBODY_IR:
@@ -556,6 +884,9 @@ OSSL_CMP_MSG *OSSL_CMP_SRV_process_request(OSSL_CMP_SRV_CTX *srv_ctx,
         else
             rsp = process_pollReq(srv_ctx, req);
         break;
+    case OSSL_CMP_PKIBODY_NESTED:
+        rsp = process_nested(srv_ctx, req, backup_secret);
+        break;
     default:
         /* TODO possibly support further request message types */
         ERR_raise(ERR_LIB_CMP, CMP_R_UNEXPECTED_PKIBODY);
@@ -605,6 +936,7 @@ OSSL_CMP_MSG *OSSL_CMP_SRV_process_request(OSSL_CMP_SRV_CTX *srv_ctx,
     case OSSL_CMP_PKIBODY_PKICONF:
     case OSSL_CMP_PKIBODY_GENP:
     case OSSL_CMP_PKIBODY_ERROR:
+    case OSSL_CMP_PKIBODY_NESTED:
         /* TODO possibly support further terminating response message types */
         /* prepare for next transaction, ignoring any errors here: */
         (void)OSSL_CMP_CTX_set1_transactionID(ctx, NULL);
@@ -1,5 +1,5 @@
 /*
- * Copyright 2007-2020 The OpenSSL Project Authors. All Rights Reserved.
+ * Copyright 2007-2021 The OpenSSL Project Authors. All Rights Reserved.
  * Copyright Nokia 2007-2020
  * Copyright Siemens AG 2015-2020
  *
@@ -12,6 +12,7 @@
 /* CMP functions for PKIMessage checking */
 
 #include "cmp_local.h"
+#include "internal/err.h"
 #include <openssl/cmp_util.h>
 
 /* explicit #includes not strictly needed since implied by the above: */
@@ -473,7 +474,13 @@ static int check_msg_find_cert(OSSL_CMP_CTX *ctx, const OSSL_CMP_MSG *msg)
      * for validating this and any further msgs where extraCerts may be left out
      */
     if (scrt != NULL) {
-        if (check_msg_given_cert(ctx, scrt, msg)) {
+        int ok;
+
+        /* on failure the check is re-done below for diagnostics */
+        (void)ossl_err_set_suppressed_mark();
+        ok = check_msg_given_cert(ctx, scrt, msg);
+        (void)ossl_err_pop_to_suppressed_mark();
+        if (ok) {
             ctx->log_cb = backup_log_cb;
             (void)ERR_pop_to_mark();
             return 1;
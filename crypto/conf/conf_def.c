@@ -20,6 +20,7 @@
 #include <openssl/conf.h>
 #include <openssl/conf_api.h>
 #include "conf_def.h"
+#include "conf_local.h"
 #include <openssl/buffer.h>
 #include <openssl/err.h>
 #ifndef OPENSSL_NO_POSIX_IO
@@ -45,7 +46,8 @@ static char *eat_ws(CONF *conf, char *p);
 static void trim_ws(CONF *conf, char *start);
 static char *eat_alpha_numeric(CONF *conf, char *p);
 static void clear_comments(CONF *conf, char *p);
-static int str_copy(CONF *conf, char *section, char **to, char *from);
+static int str_copy(CONF *conf, char *section, char **to, char *from,
+                    int *external);
 static char *scan_quote(CONF *conf, char *p);
 static char *scan_dquote(CONF *conf, char *p);
 #define scan_esc(conf,p)        (((IS_EOF((conf),(p)[1]))?((p)+1):((p)+2)))
@@ -64,6 +66,7 @@ static int def_destroy(CONF *conf);
 static int def_destroy_data(CONF *conf);
 static int def_load(CONF *conf, const char *name, long *eline);
 static int def_load_bio(CONF *conf, BIO *bp, long *eline);
+static int def_load_bio_int(CONF *conf, BIO *in, long *line, int *external);
 static int def_dump(const CONF *conf, BIO *bp);
 static int def_is_number(const CONF *conf, char c);
 static int def_to_int(const CONF *conf, char c);
@@ -163,6 +166,16 @@ static int def_destroy_data(CONF *conf)
 }
 
 static int def_load(CONF *conf, const char *name, long *line)
+{
+    return ossl_conf_def_load_file(conf, name, line, NULL);
+}
+
+/*
+ * Like def_load(), but also sets |*external| if the result depends on more
+ * than the file itself, i.e. on included files or environment variables.
+ */
+int ossl_conf_def_load_file(CONF *conf, const char *name, long *line,
+                            int *external)
 {
     int ret;
     BIO *in = NULL;
@@ -180,13 +193,18 @@ static int def_load(CONF *conf, const char *name, long *line)
         return 0;
     }
 
-    ret = def_load_bio(conf, in, line);
+    ret = def_load_bio_int(conf, in, line, external);
     BIO_free(in);
 
     return ret;
 }
 
 static int def_load_bio(CONF *conf, BIO *in, long *line)
+{
+    return def_load_bio_int(conf, in, line, NULL);
+}
+
+static int def_load_bio_int(CONF *conf, BIO *in, long *line, int *external)
 {
 /* The macro BUFSIZE conflicts with a system macro in VxWorks */
 #define CONFBUFSIZE     512
@@ -348,7 +366,7 @@ static int def_load_bio(CONF *conf, BIO *in, long *line)
                 goto err;
             }
             *end = '\0';
-            if (!str_copy(conf, NULL, &section, start))
+            if (!str_copy(conf, NULL, &section, start, external))
                 goto err;
             if ((sv = _CONF_get_section(conf, section)) == NULL)
                 sv = _CONF_new_section(conf, section);
@@ -424,8 +442,10 @@ static int def_load_bio(CONF *conf, BIO *in, long *line)
                     p = eat_ws(conf, p);
                 }
                 trim_ws(conf, p);
-                if (!str_copy(conf, psection, &include, p))
+                if (!str_copy(conf, psection, &include, p, external))
                     goto err;
+                if (external != NULL)
+                    *external = 1;
 
                 if (include_dir != NULL && !ossl_is_absolute_path(include)) {
                     size_t newlen = strlen(include_dir) + strlen(include) + 2;
@@ -496,7 +516,7 @@ static int def_load_bio(CONF *conf, BIO *in, long *line)
                 ERR_raise(ERR_LIB_CONF, ERR_R_MALLOC_FAILURE);
                 goto err;
             }
-            if (!str_copy(conf, psection, &(v->value), start))
+            if (!str_copy(conf, psection, &(v->value), start, external))
                 goto err;
 
             if (strcmp(psection, section) != 0) {
@@ -597,7 +617,8 @@ static void clear_comments(CONF *conf, char *p)
     }
 }
 
-static int str_copy(CONF *conf, char *section, char **pto, char *from)
+static int str_copy(CONF *conf, char *section, char **pto, char *from,
+                    int *external)
 {
     int q, r, rr = 0, to = 0, len = 0;
     char *s, *e, *rp, *p, *rrp, *np, *cp, v;
@@ -709,6 +730,8 @@ static int str_copy(CONF *conf, char *section, char **pto, char *from)
              * r and rr are the chars replaced by the '\0'
              * rp and rrp is where 'r' and 'rr' came from.
              */
+            if (external != NULL && cp != NULL && strcmp(cp, "ENV") == 0)
+                *external = 1;
             p = _CONF_get_string(conf, cp, np);
             if (rrp != NULL)
                 *rrp = rr;
@@ -8,4 +8,6 @@
  */
 
 void conf_add_ssl_module(void);
+int ossl_conf_def_load_file(CONF *conf, const char *name, long *eline,
+                            int *external);
 
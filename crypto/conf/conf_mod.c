@@ -13,6 +13,7 @@
 #include "internal/cryptlib.h"
 #include <stdio.h>
 #include <ctype.h>
+#include <time.h>
 #include <openssl/crypto.h>
 #include "internal/conf.h"
 #include "openssl/conf_api.h"
@@ -21,6 +22,14 @@
 #include <openssl/x509.h>
 #include <openssl/trace.h>
 #include <openssl/engine.h>
+#include "conf_local.h"
+#ifndef OPENSSL_NO_POSIX_IO
+# include <sys/stat.h>
+# ifdef _WIN32
+#  define stat    _stat
+# endif
+# define CONF_CACHE
+#endif
 
 DEFINE_STACK_OF(CONF_MODULE)
 DEFINE_STACK_OF(CONF_IMODULE)
@@ -65,6 +74,37 @@ static STACK_OF(CONF_MODULE) *supported_modules = NULL;
 static STACK_OF(CONF_IMODULE) *initialized_modules = NULL;
 
 static CRYPTO_ONCE load_builtin_modules = CRYPTO_ONCE_STATIC_INIT;
+#ifndef OPENSSL_NO_ENGINE
+static CRYPTO_ONCE load_builtin_engines = CRYPTO_ONCE_STATIC_INIT;
+#endif
+
+#ifdef CONF_CACHE
+/*
+ * The last configuration file loaded by CONF_modules_load_file_ex(), kept
+ * parsed so that loading it again, typically into another library context,
+ * does not need to parse it again.  It is only reused while the time and
+ * size of the file are unchanged, and only if its contents did not depend
+ * on anything else, like included files or environment variables.
+ */
+typedef struct {
+    char *filename;
+    time_t mtime;
+    uint64_t size;
+    CONF *conf;
+    int refs;
+} CONF_CACHE_ENTRY;
+
+static CONF_CACHE_ENTRY *conf_cache = NULL;
+static CRYPTO_RWLOCK *conf_cache_lock = NULL;
+static CRYPTO_ONCE conf_cache_init = CRYPTO_ONCE_STATIC_INIT;
+
+static CONF_CACHE_ENTRY *conf_cache_get(const char *filename, struct stat *st);
+static CONF_CACHE_ENTRY *conf_cache_add(const char *filename,
+                                        const struct stat *st, CONF *conf,
+                                        int external);
+static void conf_cache_release(CONF_CACHE_ENTRY *ent);
+static void conf_cache_free(void);
+#endif
 
 static void module_free(CONF_MODULE *md);
 static void module_finish(CONF_IMODULE *imod);
@@ -153,8 +193,13 @@ int CONF_modules_load_file_ex(OSSL_LIB_CTX *libctx, const char *filename,
                               const char *appname, unsigned long flags)
 {
     char *file = NULL;
-    CONF *conf = NULL;
-    int ret = 0, diagnostics = 0;
+    CONF *conf = NULL, *use;
+    int ret = 0, diagnostics = 0, external = 0;
+#ifdef CONF_CACHE
+    CONF_CACHE_ENTRY *ent = NULL;
+    CONF shared;
+    struct stat st;
+#endif
 
     if (filename == NULL) {
         file = CONF_get1_default_config_file();
@@ -165,25 +210,48 @@ int CONF_modules_load_file_ex(OSSL_LIB_CTX *libctx, const char *filename,
     }
 
     ERR_set_mark();
-    conf = NCONF_new_ex(libctx, NULL);
-    if (conf == NULL)
-        goto err;
+#ifdef CONF_CACHE
+    ent = conf_cache_get(file, &st);
+    if (ent == NULL) {
+#endif
+        conf = NCONF_new_ex(libctx, NULL);
+        if (conf == NULL)
+            goto err;
 
-    if (NCONF_load(conf, file, NULL) <= 0) {
-        if ((flags & CONF_MFLAGS_IGNORE_MISSING_FILE) &&
-            (ERR_GET_REASON(ERR_peek_last_error()) == CONF_R_NO_SUCH_FILE)) {
-            ret = 1;
+        /* This is NCONF_load(), also telling whether the file may be cached */
+        if (ossl_conf_def_load_file(conf, file, NULL, &external) <= 0) {
+            if ((flags & CONF_MFLAGS_IGNORE_MISSING_FILE) &&
+                (ERR_GET_REASON(ERR_peek_last_error()) == CONF_R_NO_SUCH_FILE)) {
+                ret = 1;
+            }
+            goto err;
         }
-        goto err;
+#ifdef CONF_CACHE
+        /* If it gets cached, the cache owns it */
+        if ((ent = conf_cache_add(file, &st, conf, external)) != NULL)
+            conf = NULL;
     }
+#endif
+    use = conf;
+#ifdef CONF_CACHE
+    if (ent != NULL) {
+        /* The cached CONF is shared, only the library context differs */
+        shared = *ent->conf;
+        shared.libctx = libctx;
+        use = &shared;
+    }
+#endif
 
-    ret = CONF_modules_load(conf, appname, flags);
-    diagnostics = conf_diagnostics(conf);
+    ret = CONF_modules_load(use, appname, flags);
+    diagnostics = conf_diagnostics(use);
 
  err:
     if (filename == NULL)
         OPENSSL_free(file);
     NCONF_free(conf);
+#ifdef CONF_CACHE
+    conf_cache_release(ent);
+#endif
 
     if ((flags & CONF_MFLAGS_IGNORE_RETURN_CODES) != 0 && !diagnostics)
         ret = 1;
@@ -202,15 +270,128 @@ int CONF_modules_load_file(const char *filename,
     return CONF_modules_load_file_ex(NULL, filename, appname, flags);
 }
 
+#ifdef CONF_CACHE
+DEFINE_RUN_ONCE_STATIC(do_conf_cache_init)
+{
+    conf_cache_lock = CRYPTO_THREAD_lock_new();
+    return conf_cache_lock != NULL;
+}
+
+/*
+ * Returns the cached entry for |filename| with an added reference, if there
+ * is a usable one.  Otherwise, |st| is filled in for conf_cache_add().
+ */
+static CONF_CACHE_ENTRY *conf_cache_get(const char *filename, struct stat *st)
+{
+    CONF_CACHE_ENTRY *ent = NULL;
+
+    /* A zero time marks the file as not cacheable */
+    st->st_mtime = 0;
+    if (!RUN_ONCE(&conf_cache_init, do_conf_cache_init)
+            || stat(filename, st) < 0)
+        return NULL;
+
+    if (!CRYPTO_THREAD_write_lock(conf_cache_lock))
+        return NULL;
+    if (conf_cache != NULL && strcmp(conf_cache->filename, filename) == 0
+            && conf_cache->mtime == st->st_mtime
+            && conf_cache->size == (uint64_t)st->st_size) {
+        ent = conf_cache;
+        ent->refs++;
+    }
+    CRYPTO_THREAD_unlock(conf_cache_lock);
+    return ent;
+}
+
+/*
+ * Puts |conf|, which was loaded from |filename| as described by |st|, in the
+ * cache, replacing whatever was there.  Returns the new entry with a
+ * reference for the caller, or NULL if |conf| may not be cached, in which
+ * case it still belongs to the caller.  |external| is set if the file
+ * included other files or referred to environment variables.
+ */
+static CONF_CACHE_ENTRY *conf_cache_add(const char *filename,
+                                        const struct stat *st, CONF *conf,
+                                        int external)
+{
+    CONF_CACHE_ENTRY *ent, *old;
+
+    /*
+     * A file modified within the last second may be modified again without
+     * its time changing, so it is not trusted to stay the same
+     */
+    if (external || st->st_mtime == 0 || st->st_mtime >= time(NULL) - 1)
+        return NULL;
+
+    if ((ent = OPENSSL_zalloc(sizeof(*ent))) == NULL)
+        return NULL;
+    if ((ent->filename = OPENSSL_strdup(filename)) == NULL) {
+        OPENSSL_free(ent);
+        return NULL;
+    }
+    ent->mtime = st->st_mtime;
+    ent->size = (uint64_t)st->st_size;
+    ent->conf = conf;
+    ent->refs = 2;
+    conf->libctx = NULL;
+
+    if (!CRYPTO_THREAD_write_lock(conf_cache_lock)) {
+        OPENSSL_free(ent->filename);
+        OPENSSL_free(ent);
+        return NULL;
+    }
+    old = conf_cache;
+    conf_cache = ent;
+    CRYPTO_THREAD_unlock(conf_cache_lock);
+    conf_cache_release(old);
+    return ent;
+}
+
+static void conf_cache_release(CONF_CACHE_ENTRY *ent)
+{
+    int refs;
+
+    if (ent == NULL || !CRYPTO_THREAD_write_lock(conf_cache_lock))
+        return;
+    refs = --ent->refs;
+    CRYPTO_THREAD_unlock(conf_cache_lock);
+    if (refs > 0)
+        return;
+    NCONF_free(ent->conf);
+    OPENSSL_free(ent->filename);
+    OPENSSL_free(ent);
+}
+
+static void conf_cache_free(void)
+{
+    CONF_CACHE_ENTRY *ent = conf_cache;
+
+    if (conf_cache_lock == NULL)
+        return;
+    conf_cache = NULL;
+    conf_cache_release(ent);
+    CRYPTO_THREAD_lock_free(conf_cache_lock);
+    conf_cache_lock = NULL;
+}
+#endif
+
 DEFINE_RUN_ONCE_STATIC(do_load_builtin_modules)
 {
     OPENSSL_load_builtin_modules();
+    return 1;
+}
+
 #ifndef OPENSSL_NO_ENGINE
-    /* Need to load ENGINEs */
+/*
+ * Loading the builtin ENGINEs is slow, and only the engines module needs
+ * them, so this is only done when a configuration actually uses it
+ */
+DEFINE_RUN_ONCE_STATIC(do_load_builtin_engines)
+{
     ENGINE_load_builtin_engines();
-#endif
     return 1;
 }
+#endif
 
 static int module_run(const CONF *cnf, const char *name, const char *value,
                       unsigned long flags)
@@ -223,6 +404,12 @@ static int module_run(const CONF *cnf, const char *name, const char *value,
 
     md = module_find(name);
 
+#ifndef OPENSSL_NO_ENGINE
+    if (md != NULL && strcmp(md->name, "engines") == 0
+            && !RUN_ONCE(&load_builtin_engines, do_load_builtin_engines))
+        return -1;
+#endif
+
     /* Module not found: try to load DSO */
     if (!md && !(flags & CONF_MFLAGS_NO_DSO))
         md = module_load_dso(cnf, name, value);
@@ -489,6 +676,9 @@ void conf_modules_free_int(void)
 {
     CONF_modules_finish();
     CONF_modules_unload(1);
+#ifdef CONF_CACHE
+    conf_cache_free();
+#endif
 }
 
 /* Utility functions */
@@ -11,6 +11,7 @@
 #include <openssl/conf.h>
 #include "internal/thread_once.h"
 #include "internal/property.h"
+#include "internal/metrics.h"
 
 struct ossl_lib_ctx_onfree_list_st {
     ossl_lib_ctx_onfree_fn *fn;
@@ -37,6 +38,11 @@ struct ossl_lib_ctx_st {
     int run_once_done[OSSL_LIB_CTX_MAX_RUN_ONCE];
     int run_once_ret[OSSL_LIB_CTX_MAX_RUN_ONCE];
     struct ossl_lib_ctx_onfree_list_st *onfreelist;
+
+#ifndef FIPS_MODULE
+    /* Kept here directly, so that recording them takes no locks */
+    OSSL_METRICS metrics;
+#endif
 };
 
 static int context_init(OSSL_LIB_CTX *ctx)
@@ -205,6 +211,14 @@ OSSL_LIB_CTX *ossl_lib_ctx_get_concrete(OSSL_LIB_CTX *ctx)
     return ctx;
 }
 
+#ifndef FIPS_MODULE
+OSSL_METRICS *ossl_lib_ctx_get_metrics(OSSL_LIB_CTX *ctx)
+{
+    ctx = ossl_lib_ctx_get_concrete(ctx);
+    return ctx != NULL ? &ctx->metrics : NULL;
+}
+#endif
+
 int ossl_lib_ctx_is_default(OSSL_LIB_CTX *ctx)
 {
 #ifndef FIPS_MODULE
@@ -1,5 +1,5 @@
 /*
- * Copyright 2019-2020 The OpenSSL Project Authors. All Rights Reserved.
+ * Copyright 2019-2021 The OpenSSL Project Authors. All Rights Reserved.
  *
  * Licensed under the Apache License 2.0 (the "License").  You may not use
  * this file except in compliance with the License.  You can obtain a copy
@@ -11,6 +11,8 @@
 #include "internal/namemap.h"
 #include <openssl/lhash.h>
 #include "crypto/lhash.h"      /* openssl_lh_strcasehash */
+#include "crypto/hashtable.h"
+#include "crypto/sparse_array.h"
 #include "internal/tsan_assist.h"
 
 /*-
@@ -20,9 +22,10 @@
 typedef struct {
     char *name;
     int number;
+    TSAN_QUALIFIER int primary;        /* If 1, it's listed first */
 } NAMENUM_ENTRY;
 
-DEFINE_LHASH_OF(NAMENUM_ENTRY);
+DEFINE_SPARSE_ARRAY_OF(NAMENUM_ENTRY);
 
 /*-
  * The namemap itself
@@ -33,8 +36,10 @@ struct ossl_namemap_st {
     /* Flags */
     unsigned int stored:1; /* If 1, it's stored in a library context */
 
-    CRYPTO_RWLOCK *lock;
-    LHASH_OF(NAMENUM_ENTRY) *namenum;  /* Name->number mapping */
+    CRYPTO_RWLOCK *lock;               /* Serialises additions */
+    OSSL_HT *namenum;                  /* Name->number mapping */
+    /* Number->primary entry mapping, only used with the lock held */
+    SPARSE_ARRAY_OF(NAMENUM_ENTRY) *primaries;
 
 #ifdef tsan_ld_acq
     TSAN_QUALIFIER int max_number;     /* Current max number TSAN version */
@@ -43,20 +48,26 @@ struct ossl_namemap_st {
 #endif
 };
 
-/* LHASH callbacks */
+/* Hash table callbacks */
 
-static unsigned long namenum_hash(const NAMENUM_ENTRY *n)
+static unsigned long namenum_hash(const void *v)
 {
+    const NAMENUM_ENTRY *n = v;
+
     return openssl_lh_strcasehash(n->name);
 }
 
-static int namenum_cmp(const NAMENUM_ENTRY *a, const NAMENUM_ENTRY *b)
+static int namenum_cmp(const void *va, const void *vb)
 {
+    const NAMENUM_ENTRY *a = va, *b = vb;
+
     return strcasecmp(a->name, b->name);
 }
 
-static void namenum_free(NAMENUM_ENTRY *n)
+static void namenum_free(void *vn)
 {
+    NAMENUM_ENTRY *n = vn;
+
     if (n != NULL)
         OPENSSL_free(n->name);
     OPENSSL_free(n);
@@ -118,16 +129,25 @@ typedef struct doall_names_data_st {
     int number;
     const char **names;
     int found;
+    size_t max;
 } DOALL_NAMES_DATA;
 
-static void do_name(const NAMENUM_ENTRY *namenum, DOALL_NAMES_DATA *data)
+static void do_name(void *vnamenum, void *vdata)
 {
-    if (namenum->number == data->number)
+    const NAMENUM_ENTRY *namenum = vnamenum;
+    DOALL_NAMES_DATA *data = vdata;
+
+    /* Names added since the array was sized are skipped */
+    if (namenum->number != data->number || (size_t)data->found >= data->max)
+        return;
+    if (tsan_load(&namenum->primary) && data->found > 0) {
+        data->names[data->found++] = data->names[0];
+        data->names[0] = namenum->name;
+    } else {
         data->names[data->found++] = namenum->name;
+    }
 }
 
-IMPLEMENT_LHASH_DOALL_ARG_CONST(NAMENUM_ENTRY, DOALL_NAMES_DATA);
-
 /*
  * Call the callback for all names in the namemap with the given number.
  * A return value 1 means that the callback was called for all names. A
@@ -138,32 +158,32 @@ int ossl_namemap_doall_names(const OSSL_NAMEMAP *namemap, int number,
                              void *data)
 {
     DOALL_NAMES_DATA cbdata;
-    size_t num_names;
     int i;
 
     cbdata.number = number;
     cbdata.found = 0;
 
     /*
-     * We collect all the names first under a read lock. Subsequently we call
-     * the user function, so that we're not holding the read lock when in user
-     * code. This could lead to deadlocks.
+     * We collect all the names first in a read section. Subsequently we call
+     * the user function, so that we're not in the read section when in user
+     * code. This could lead to deadlocks.  Names are never removed, so the
+     * collected pointers stay valid after the read section.
      */
-    CRYPTO_THREAD_read_lock(namemap->lock);
-    num_names = lh_NAMENUM_ENTRY_num_items(namemap->namenum);
+    if (!ossl_ht_read_lock(namemap->namenum))
+        return 0;
+    cbdata.max = ossl_ht_num(namemap->namenum);
 
-    if (num_names == 0) {
-        CRYPTO_THREAD_unlock(namemap->lock);
+    if (cbdata.max == 0) {
+        ossl_ht_read_unlock(namemap->namenum);
         return 0;
     }
-    cbdata.names = OPENSSL_malloc(sizeof(*cbdata.names) * num_names);
+    cbdata.names = OPENSSL_malloc(sizeof(*cbdata.names) * cbdata.max);
     if (cbdata.names == NULL) {
-        CRYPTO_THREAD_unlock(namemap->lock);
+        ossl_ht_read_unlock(namemap->namenum);
         return 0;
     }
-    lh_NAMENUM_ENTRY_doall_DOALL_NAMES_DATA(namemap->namenum, do_name,
-                                            &cbdata);
-    CRYPTO_THREAD_unlock(namemap->lock);
+    ossl_ht_doall(namemap->namenum, do_name, &cbdata);
+    ossl_ht_read_unlock(namemap->namenum);
 
     for (i = 0; i < cbdata.found; i++)
         fn(cbdata.names[i], data);
@@ -176,21 +196,25 @@ static int namemap_name2num_n(const OSSL_NAMEMAP *namemap,
                               const char *name, size_t name_len)
 {
     NAMENUM_ENTRY *namenum_entry, namenum_tmpl;
+    int number;
 
     if ((namenum_tmpl.name = OPENSSL_strndup(name, name_len)) == NULL)
         return 0;
     namenum_tmpl.number = 0;
-    namenum_entry =
-        lh_NAMENUM_ENTRY_retrieve(namemap->namenum, &namenum_tmpl);
+    if (!ossl_ht_read_lock(namemap->namenum)) {
+        OPENSSL_free(namenum_tmpl.name);
+        return 0;
+    }
+    namenum_entry = ossl_ht_get(namemap->namenum, &namenum_tmpl);
+    number = namenum_entry != NULL ? namenum_entry->number : 0;
+    ossl_ht_read_unlock(namemap->namenum);
     OPENSSL_free(namenum_tmpl.name);
-    return namenum_entry != NULL ? namenum_entry->number : 0;
+    return number;
 }
 
 int ossl_namemap_name2num_n(const OSSL_NAMEMAP *namemap,
                             const char *name, size_t name_len)
 {
-    int number;
-
 #ifndef FIPS_MODULE
     if (namemap == NULL)
         namemap = ossl_namemap_stored(NULL);
@@ -199,11 +223,7 @@ int ossl_namemap_name2num_n(const OSSL_NAMEMAP *namemap,
     if (namemap == NULL)
         return 0;
 
-    CRYPTO_THREAD_read_lock(namemap->lock);
-    number = namemap_name2num_n(namemap, name, name_len);
-    CRYPTO_THREAD_unlock(namemap->lock);
-
-    return number;
+    return namemap_name2num_n(namemap, name, name_len);
 }
 
 int ossl_namemap_name2num(const OSSL_NAMEMAP *namemap, const char *name)
@@ -257,9 +277,7 @@ static int namemap_add_name_n(OSSL_NAMEMAP *namemap, int number,
 
     namenum->number =
         number != 0 ? number : 1 + tsan_counter(&namemap->max_number);
-    (void)lh_NAMENUM_ENTRY_insert(namemap->namenum, namenum);
-
-    if (lh_NAMENUM_ENTRY_error(namemap->namenum))
+    if (!ossl_ht_insert(namemap->namenum, namenum))
         goto err;
     return namenum->number;
 
@@ -295,6 +313,32 @@ int ossl_namemap_add_name(OSSL_NAMEMAP *namemap, int number, const char *name)
     return ossl_namemap_add_name_n(namemap, number, name, strlen(name));
 }
 
+/*
+ * The first name given for a number, usually by the first provider that
+ * implements the algorithm, is the one that ossl_namemap_num2name() returns
+ * for index 0.  Must be called with the namemap lock held.
+ */
+static void namemap_set_primary(OSSL_NAMEMAP *namemap, int number,
+                                const char *name, size_t name_len)
+{
+    NAMENUM_ENTRY *namenum, tmpl;
+
+    if (ossl_sa_NAMENUM_ENTRY_get(namemap->primaries, number) != NULL)
+        return;
+    if ((tmpl.name = OPENSSL_strndup(name, name_len)) == NULL)
+        return;
+    if (ossl_ht_read_lock(namemap->namenum)) {
+        namenum = ossl_ht_get(namemap->namenum, &tmpl);
+        /* Names are never removed, so the entry outlives the read section */
+        if (namenum != NULL && namenum->number == number
+                && ossl_sa_NAMENUM_ENTRY_set(namemap->primaries, number,
+                                             namenum))
+            tsan_store(&namenum->primary, 1);
+        ossl_ht_read_unlock(namemap->namenum);
+    }
+    OPENSSL_free(tmpl.name);
+}
+
 int ossl_namemap_add_names(OSSL_NAMEMAP *namemap, int number,
                            const char *names, const char separator)
 {
@@ -356,6 +400,12 @@ int ossl_namemap_add_names(OSSL_NAMEMAP *namemap, int number,
         }
     }
 
+    if ((q = strchr(names, separator)) == NULL)
+        l = strlen(names);
+    else
+        l = q - names;
+    namemap_set_primary(namemap, number, names, l);
+
     CRYPTO_THREAD_unlock(namemap->lock);
     return number;
 
@@ -449,7 +499,8 @@ OSSL_NAMEMAP *ossl_namemap_new(void)
     if ((namemap = OPENSSL_zalloc(sizeof(*namemap))) != NULL
         && (namemap->lock = CRYPTO_THREAD_lock_new()) != NULL
         && (namemap->namenum =
-            lh_NAMENUM_ENTRY_new(namenum_hash, namenum_cmp)) != NULL)
+            ossl_ht_new(namenum_hash, namenum_cmp, namenum_free)) != NULL
+        && (namemap->primaries = ossl_sa_NAMENUM_ENTRY_new()) != NULL)
         return namemap;
 
     ossl_namemap_free(namemap);
@@ -461,8 +512,8 @@ void ossl_namemap_free(OSSL_NAMEMAP *namemap)
     if (namemap == NULL || namemap->stored)
         return;
 
-    lh_NAMENUM_ENTRY_doall(namemap->namenum, namenum_free);
-    lh_NAMENUM_ENTRY_free(namemap->namenum);
+    ossl_sa_NAMENUM_ENTRY_free(namemap->primaries);
+    ossl_ht_free(namemap->namenum);
 
     CRYPTO_THREAD_lock_free(namemap->lock);
     OPENSSL_free(namemap);
@@ -213,12 +213,26 @@ ASN1_SEQUENCE(OSSL_CRMF_CERTTEMPLATE) = {
 IMPLEMENT_ASN1_FUNCTIONS(OSSL_CRMF_CERTTEMPLATE)
 
 
-ASN1_SEQUENCE(OSSL_CRMF_CERTREQUEST) = {
+/*
+ * Lets the template of a decoded CertRequest invalidate the cached encoding
+ * when it is changed through OSSL_CRMF_CERTTEMPLATE_fill().
+ */
+static int certreq_cb(int operation, ASN1_VALUE **pval, const ASN1_ITEM *it,
+                      void *exarg)
+{
+    OSSL_CRMF_CERTREQUEST *cr = (OSSL_CRMF_CERTREQUEST *)*pval;
+
+    if (operation == ASN1_OP_D2I_POST)
+        cr->certTemplate->owner_enc = &cr->enc;
+    return 1;
+}
+
+ASN1_SEQUENCE_enc(OSSL_CRMF_CERTREQUEST, enc, certreq_cb) = {
     ASN1_SIMPLE(OSSL_CRMF_CERTREQUEST, certReqId, ASN1_INTEGER),
     ASN1_SIMPLE(OSSL_CRMF_CERTREQUEST, certTemplate, OSSL_CRMF_CERTTEMPLATE),
     ASN1_SEQUENCE_OF_OPT(OSSL_CRMF_CERTREQUEST, controls,
                          OSSL_CRMF_ATTRIBUTETYPEANDVALUE)
-} ASN1_SEQUENCE_END(OSSL_CRMF_CERTREQUEST)
+} ASN1_SEQUENCE_END_enc(OSSL_CRMF_CERTREQUEST, OSSL_CRMF_CERTREQUEST)
 IMPLEMENT_ASN1_FUNCTIONS(OSSL_CRMF_CERTREQUEST)
 IMPLEMENT_ASN1_DUP_FUNCTION(OSSL_CRMF_CERTREQUEST)
 
@@ -87,7 +87,7 @@ static int OSSL_CRMF_MSG_push0_regCtrl(OSSL_CRMF_MSG *crm,
     }
     if (!sk_OSSL_CRMF_ATTRIBUTETYPEANDVALUE_push(crm->certReq->controls, ctrl))
         goto err;
-
+    crm->certReq->enc.modified = 1;
     return 1;
  err:
     if (new != 0) {
@@ -254,6 +254,7 @@ int OSSL_CRMF_MSG_set0_validity(OSSL_CRMF_MSG *crm,
     vld->notBefore = notBefore;
     vld->notAfter = notAfter;
     tmpl->validity = vld;
+    crm->certReq->enc.modified = 1;
     return 1;
 }
 
@@ -265,6 +266,7 @@ int OSSL_CRMF_MSG_set_certReqId(OSSL_CRMF_MSG *crm, int rid)
         return 0;
     }
 
+    crm->certReq->enc.modified = 1;
     return ASN1_INTEGER_set(crm->certReq->certReqId, rid);
 }
 
@@ -315,6 +317,7 @@ int OSSL_CRMF_MSG_set0_extensions(OSSL_CRMF_MSG *crm,
 
     sk_X509_EXTENSION_pop_free(tmpl->extensions, X509_EXTENSION_free);
     tmpl->extensions = exts;
+    crm->certReq->enc.modified = 1;
     return 1;
 }
 
@@ -338,6 +341,7 @@ int OSSL_CRMF_MSG_push0_extension(OSSL_CRMF_MSG *crm,
 
     if (!sk_X509_EXTENSION_push(tmpl->extensions, ext))
         goto err;
+    crm->certReq->enc.modified = 1;
     return 1;
  err:
     if (new != 0) {
@@ -348,7 +352,7 @@ int OSSL_CRMF_MSG_push0_extension(OSSL_CRMF_MSG *crm,
 }
 
 static int create_popo_signature(OSSL_CRMF_POPOSIGNINGKEY *ps,
-                                 const OSSL_CRMF_CERTREQUEST *cr,
+                                 OSSL_CRMF_CERTREQUEST *cr,
                                  EVP_PKEY *pkey, const EVP_MD *digest,
                                  OSSL_LIB_CTX *libctx, const char *propq)
 {
@@ -362,6 +366,7 @@ static int create_popo_signature(OSSL_CRMF_POPOSIGNINGKEY *ps,
         return 0;
     }
 
+    cr->enc.modified = 1;
     return ASN1_item_sign_ex(ASN1_ITEM_rptr(OSSL_CRMF_CERTREQUEST),
                              ps->algorithmIdentifier, NULL, ps->signature, cr,
                              NULL, pkey, digest, libctx, propq);
@@ -434,7 +439,11 @@ int OSSL_CRMF_MSG_create_popo(int meth, OSSL_CRMF_MSG *crm,
     return 0;
 }
 
-/* verifies the Proof-of-Possession of the request with the given rid in reqs */
+/*
+ * verifies the Proof-of-Possession of the request with the given rid in reqs.
+ * The signature of a received request is checked on its original encoding.
+ * As reqs is not modified, several threads may verify its requests at once.
+ */
 int OSSL_CRMF_MSGS_verify_popo(const OSSL_CRMF_MSGS *reqs,
                                int rid, int acceptRAVerified,
                                OSSL_LIB_CTX *libctx, const char *propq)
@@ -558,6 +567,9 @@ int OSSL_CRMF_CERTTEMPLATE_fill(OSSL_CRMF_CERTTEMPLATE *tmpl,
         ERR_raise(ERR_LIB_CRMF, CRMF_R_NULL_ARGUMENT);
         return 0;
     }
+    /* the CertRequest holding tmpl must no longer use its received DER */
+    if (tmpl->owner_enc != NULL)
+        tmpl->owner_enc->modified = 1;
     if (subject != NULL && !X509_NAME_set((X509_NAME **)&tmpl->subject, subject))
         return 0;
     if (issuer != NULL && !X509_NAME_set((X509_NAME **)&tmpl->issuer, issuer))
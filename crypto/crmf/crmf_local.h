@@ -323,6 +323,8 @@ struct ossl_crmf_certtemplate_st {
     ASN1_BIT_STRING *subjectUID; /* deprecated in version 2 */
     /* Could be X509_EXTENSION*S*, but that's only cosmetic */
     STACK_OF(X509_EXTENSION) *extensions;
+    /* not encoded: cached encoding of the decoded CertRequest holding this */
+    ASN1_ENCODING *owner_enc;
 } /* OSSL_CRMF_CERTTEMPLATE */;
 
 /*-
@@ -333,6 +335,7 @@ struct ossl_crmf_certtemplate_st {
  * }
  */
 struct ossl_crmf_certrequest_st {
+    ASN1_ENCODING enc; /* cached encoding, signed by POPO */
     ASN1_INTEGER *certReqId;
     OSSL_CRMF_CERTTEMPLATE *certTemplate;
     /* TODO: make OSSL_CRMF_CONTROLS out of that - but only cosmetical */
@@ -1,5 +1,5 @@
 /*
- * Copyright 2020 The OpenSSL Project Authors. All Rights Reserved.
+ * Copyright 2020-2021 The OpenSSL Project Authors. All Rights Reserved.
  *
  * Licensed under the Apache License 2.0 (the "License").  You may not use
  * this file except in compliance with the License.  You can obtain a copy
@@ -17,6 +17,9 @@
 #include <openssl/x509err.h>
 #include <openssl/trace.h>
 #include "internal/passphrase.h"
+#include "internal/err.h"
+#include "internal/metrics.h"
+#include "internal/provider.h"
 #include "crypto/decoder.h"
 #include "encoder_local.h"
 #include "e_os.h"
@@ -337,9 +340,9 @@ int OSSL_DECODER_CTX_add_extra(OSSL_DECODER_CTX *ctx,
                 && strcasecmp(ctx->start_input_type, input_type) == 0)
                 continue;
 
-            ERR_set_mark();
+            ossl_err_set_suppressed_mark();
             decoder = OSSL_DECODER_fetch(libctx, input_type, propq);
-            ERR_pop_to_mark();
+            ossl_err_pop_to_suppressed_mark();
 
             if (decoder != NULL) {
                 size_t j;
@@ -510,6 +513,7 @@ static int decoder_process(const OSSL_PARAM params[], void *arg)
     OSSL_DECODER_INSTANCE *decoder_inst = NULL;
     OSSL_DECODER *decoder = NULL;
     BIO *bio = data->bio;
+    OSSL_LIB_CTX *libctx;
     long loc;
     size_t i;
     int err, lib, reason, ok = 0;
@@ -729,11 +733,15 @@ static int decoder_process(const OSSL_PARAM params[], void *arg)
         } OSSL_TRACE_END(DECODER);
 
         new_data.current_decoder_inst_index = i;
+        libctx = ossl_provider_libctx(OSSL_DECODER_provider(new_decoder));
+        ossl_metric_count(libctx, OSSL_METRIC_DECODER_ATTEMPT);
         ok = new_decoder->decode(new_decoderctx, (OSSL_CORE_BIO *)bio,
                                  new_data.ctx->selection,
                                  decoder_process, &new_data,
                                  ossl_pw_passphrase_callback_dec,
                                  &new_data.ctx->pwdata);
+        if (ok)
+            ossl_metric_count(libctx, OSSL_METRIC_DECODER_SUCCESS);
 
         OSSL_TRACE_BEGIN(DECODER) {
             BIO_printf(trc_out,
@@ -134,6 +134,21 @@ static CRYPTO_ONCE err_init = CRYPTO_ONCE_STATIC_INIT;
 static int set_err_thread_local;
 static CRYPTO_THREAD_LOCAL err_thread_local;
 
+/*
+ * Where the compiler supports it, the thread's error state is also cached in
+ * a native thread local variable.  Every ERR_raise() fetches the state three
+ * times, this spares it the library initialisation checks and the lookup of
+ * the thread local key.
+ */
+#ifdef OSSL_THREAD_LOCAL
+static OSSL_THREAD_LOCAL ERR_STATE *err_state_cache;
+/* Cleared by err_cleanup(), which invalidates the cache of all threads */
+static int err_state_cache_valid;
+# define err_cache_state(state) (err_state_cache = (state))
+#else
+# define err_cache_state(state)
+#endif
+
 static CRYPTO_ONCE err_string_init = CRYPTO_ONCE_STATIC_INIT;
 static CRYPTO_RWLOCK *err_string_lock;
 
@@ -216,6 +231,10 @@ void err_cleanup(void)
 {
     if (set_err_thread_local != 0)
         CRYPTO_THREAD_cleanup_local(&err_thread_local);
+#ifdef OSSL_THREAD_LOCAL
+    err_state_cache_valid = 0;
+#endif
+    err_cache_state(NULL);
     CRYPTO_THREAD_lock_free(err_string_lock);
     err_string_lock = NULL;
     lh_ERR_STRING_DATA_free(int_error_hash);
@@ -436,8 +455,8 @@ static unsigned long get_error_values(ERR_GET_ACTION g,
         }
         i = (es->bottom + 1) % ERR_NUM_ERRORS;
         if (es->err_flags[i] & ERR_FLAG_CLEAR) {
-            es->bottom = i;
-            err_clear(es, es->bottom, 0);
+            err_clear(es, i, 0);
+            err_set_bottom(es, i);
             continue;
         }
         break;
@@ -455,7 +474,7 @@ static unsigned long get_error_values(ERR_GET_ACTION g,
 
     ret = es->err_buffer[i];
     if (g == EV_POP) {
-        es->bottom = i;
+        err_set_bottom(es, i);
         es->err_buffer[i] = 0;
     }
 
@@ -609,6 +628,7 @@ static void err_delete_thread_state(void *unused)
         return;
 
     CRYPTO_THREAD_set_local(&err_thread_local, NULL);
+    err_cache_state(NULL);
     ERR_STATE_free(state);
 }
 
@@ -627,13 +647,23 @@ void ERR_remove_state(unsigned long pid)
 DEFINE_RUN_ONCE_STATIC(err_do_init)
 {
     set_err_thread_local = 1;
+#ifdef OSSL_THREAD_LOCAL
+    err_state_cache_valid = 1;
+#endif
     return CRYPTO_THREAD_init_local(&err_thread_local, NULL);
 }
 
 ERR_STATE *err_get_state_int(void)
 {
     ERR_STATE *state;
-    int saveerrno = get_last_sys_error();
+    int saveerrno;
+
+#ifdef OSSL_THREAD_LOCAL
+    if ((state = err_state_cache) != NULL && err_state_cache_valid)
+        return state;
+#endif
+
+    saveerrno = get_last_sys_error();
 
     if (!OPENSSL_init_crypto(OPENSSL_INIT_BASE_ONLY, NULL))
         return NULL;
@@ -649,7 +679,7 @@ ERR_STATE *err_get_state_int(void)
         if (!CRYPTO_THREAD_set_local(&err_thread_local, (ERR_STATE*)-1))
             return NULL;
 
-        if ((state = OPENSSL_zalloc(sizeof(*state))) == NULL) {
+        if ((state = OPENSSL_zalloc(sizeof(ERR_STATE_INT))) == NULL) {
             CRYPTO_THREAD_set_local(&err_thread_local, NULL);
             return NULL;
         }
@@ -665,6 +695,7 @@ ERR_STATE *err_get_state_int(void)
         OPENSSL_init_crypto(OPENSSL_INIT_LOAD_CRYPTO_STRINGS, NULL);
     }
 
+    err_cache_state(state);
     set_sys_error(saveerrno);
     return state;
 }
@@ -706,6 +737,7 @@ int err_shelve_state(void **state)
     *state = CRYPTO_THREAD_get_local(&err_thread_local);
     if (!CRYPTO_THREAD_set_local(&err_thread_local, (ERR_STATE*)-1))
         return 0;
+    err_cache_state(NULL);
 
     set_sys_error(saveerrno);
     return 1;
@@ -717,8 +749,9 @@ int err_shelve_state(void **state)
  */
 void err_unshelve_state(void* state)
 {
-    if (state != (void*)-1)
-        CRYPTO_THREAD_set_local(&err_thread_local, (ERR_STATE*)state);
+    if (state != (void*)-1
+            && CRYPTO_THREAD_set_local(&err_thread_local, (ERR_STATE*)state))
+        err_cache_state(state);
 }
 
 int ERR_get_next_error_library(void)
@@ -785,7 +818,7 @@ void ERR_add_error_vdata(int num, va_list args)
 
     /* Get the current error data; if an allocated string get it. */
     es = err_get_state_int();
-    if (es == NULL)
+    if (es == NULL || err_is_suppressed(es))
         return;
     i = es->top;
 
@@ -849,7 +882,23 @@ int ERR_set_mark(void)
     return 1;
 }
 
-int ERR_pop_to_mark(void)
+static void err_drop_suppressed_mark(ERR_STATE *es, int i)
+{
+    ERR_STATE_INT *esi = (ERR_STATE_INT *)es;
+
+    if (esi->suppressed_marks[i] > 0) {
+        esi->suppressed_marks[i]--;
+        esi->suppressed--;
+    }
+}
+
+/*
+ * Pops the errors raised since the last mark and removes that mark.  If
+ * |suppressed| is set, the mark is a suppressed mark, which is removed too.
+ * With no mark set, all errors are popped, so a suppressed mark set on an
+ * empty error stack is recorded at the bottom slot.
+ */
+static int err_pop_to_mark(int suppressed)
 {
     ERR_STATE *es;
 
@@ -863,13 +912,20 @@ int ERR_pop_to_mark(void)
         es->top = es->top > 0 ? es->top - 1 : ERR_NUM_ERRORS - 1;
     }
 
+    if (suppressed)
+        err_drop_suppressed_mark(es, es->top);
     if (es->bottom == es->top)
         return 0;
     es->err_marks[es->top]--;
     return 1;
 }
 
-int ERR_clear_last_mark(void)
+int ERR_pop_to_mark(void)
+{
+    return err_pop_to_mark(0);
+}
+
+static int err_clear_last_mark(int suppressed)
 {
     ERR_STATE *es;
     int top;
@@ -884,12 +940,42 @@ int ERR_clear_last_mark(void)
         top = top > 0 ? top - 1 : ERR_NUM_ERRORS - 1;
     }
 
+    if (suppressed)
+        err_drop_suppressed_mark(es, top);
     if (es->bottom == top)
         return 0;
     es->err_marks[top]--;
     return 1;
 }
 
+int ERR_clear_last_mark(void)
+{
+    return err_clear_last_mark(0);
+}
+
+int ossl_err_set_suppressed_mark(void)
+{
+    ERR_STATE_INT *esi;
+
+    esi = (ERR_STATE_INT *)err_get_state_int();
+    if (esi == NULL)
+        return 0;
+
+    esi->suppressed_marks[esi->es.top]++;
+    esi->suppressed++;
+    return ERR_set_mark();
+}
+
+int ossl_err_pop_to_suppressed_mark(void)
+{
+    return err_pop_to_mark(1);
+}
+
+int ossl_err_clear_last_suppressed_mark(void)
+{
+    return err_clear_last_mark(1);
+}
+
 void err_clear_last_constant_time(int clear)
 {
     ERR_STATE *es;
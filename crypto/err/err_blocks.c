@@ -1,5 +1,5 @@
 /*
- * Copyright 2019 The OpenSSL Project Authors. All Rights Reserved.
+ * Copyright 2019-2021 The OpenSSL Project Authors. All Rights Reserved.
  *
  * Licensed under the Apache License 2.0 (the "License").  You may not use
  * this file except in compliance with the License.  You can obtain a copy
@@ -32,7 +32,7 @@ void ERR_set_debug(const char *file, int line, const char *func)
     ERR_STATE *es;
 
     es = err_get_state_int();
-    if (es == NULL)
+    if (es == NULL || err_is_suppressed(es))
         return;
 
     err_set_debug(es, es->top, file, line, func);
@@ -60,6 +60,10 @@ void ERR_vset_error(int lib, int reason, const char *fmt, va_list args)
         return;
     i = es->top;
 
+    /* Within a suppressed mark only the error code is of interest */
+    if (err_is_suppressed(es))
+        fmt = NULL;
+
     if (fmt != NULL) {
         int printed_len = 0;
         char *rbuf = NULL;
@@ -95,15 +99,10 @@ void ERR_vset_error(int lib, int reason, const char *fmt, va_list args)
         buf[printed_len] = '\0';
 
         /*
-         * Try to reduce the size, but only if we maximized above.  If that
-         * fails, we keep what we have.
-         * (According to documentation, realloc leaves the old buffer untouched
-         * if it fails)
+         * The buffer is deliberately not shrunk again.  It stays with the
+         * slot and is reused by the next error raised in it, so that raising
+         * errors with data doesn't cost an allocation every time.
          */
-        if ((rbuf = OPENSSL_realloc(buf, printed_len + 1)) != NULL) {
-            buf = rbuf;
-            buf_size = printed_len + 1;
-        }
 
         if (buf != NULL)
             flags = ERR_TXT_MALLOCED | ERR_TXT_STRING;
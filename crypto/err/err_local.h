@@ -10,11 +10,49 @@
 #include <openssl/err.h>
 #include <openssl/e_os2.h>
 
+/*
+ * The thread's error state as allocated by err_get_state_int().  The public
+ * ERR_STATE comes first, followed by what only the error module uses.
+ */
+typedef struct err_state_int_st {
+    ERR_STATE es;
+    /* How many of the marks at each slot are suppressed marks */
+    int suppressed_marks[ERR_NUM_ERRORS];
+    /* Total of suppressed_marks[], errors are suppressed while non-zero */
+    int suppressed;
+} ERR_STATE_INT;
+
+static ossl_inline int err_is_suppressed(ERR_STATE *es)
+{
+    return ((ERR_STATE_INT *)es)->suppressed != 0;
+}
+
+static ossl_inline void err_clear_suppressed(ERR_STATE *es, size_t i)
+{
+    ERR_STATE_INT *esi = (ERR_STATE_INT *)es;
+
+    esi->suppressed -= esi->suppressed_marks[i];
+    esi->suppressed_marks[i] = 0;
+}
+
+/*
+ * Errors are popped from the bottom by moving it up.  Suppressed marks set
+ * on an empty stack are kept at the bottom slot and move up with it.
+ */
+static ossl_inline void err_set_bottom(ERR_STATE *es, int i)
+{
+    ERR_STATE_INT *esi = (ERR_STATE_INT *)es;
+
+    esi->suppressed_marks[i] += esi->suppressed_marks[es->bottom];
+    esi->suppressed_marks[es->bottom] = 0;
+    es->bottom = i;
+}
+
 static ossl_inline void err_get_slot(ERR_STATE *es)
 {
     es->top = (es->top + 1) % ERR_NUM_ERRORS;
     if (es->top == es->bottom)
-        es->bottom = (es->bottom + 1) % ERR_NUM_ERRORS;
+        err_set_bottom(es, (es->bottom + 1) % ERR_NUM_ERRORS);
 }
 
 static ossl_inline void err_clear_data(ERR_STATE *es, size_t i, int deall)
@@ -77,6 +115,7 @@ static ossl_inline void err_clear(ERR_STATE *es, size_t i, int deall)
 {
     err_clear_data(es, i, (deall));
     es->err_marks[i] = 0;
+    err_clear_suppressed(es, i);
     es->err_flags[i] = 0;
     es->err_buffer[i] = 0;
     es->err_line[i] = -1;
@@ -20,6 +20,7 @@
 #include "internal/cryptlib.h"
 #include "crypto/evp.h"
 #include "internal/provider.h"
+#include "internal/mem_pool.h"
 #include "evp_local.h"
 
 
@@ -110,7 +111,7 @@ EVP_MD_CTX *evp_md_ctx_new_ex(EVP_PKEY *pkey, const ASN1_OCTET_STRING *id,
 
 EVP_MD_CTX *EVP_MD_CTX_new(void)
 {
-    return OPENSSL_zalloc(sizeof(EVP_MD_CTX));
+    return ossl_pool_zalloc(OSSL_POOL_EVP_MD_CTX, sizeof(EVP_MD_CTX));
 }
 
 void EVP_MD_CTX_free(EVP_MD_CTX *ctx)
@@ -120,7 +121,7 @@ void EVP_MD_CTX_free(EVP_MD_CTX *ctx)
 
     EVP_MD_CTX_reset(ctx);
 
-    OPENSSL_free(ctx);
+    ossl_pool_free(OSSL_POOL_EVP_MD_CTX, ctx);
     return;
 }
 
@@ -130,6 +131,36 @@ int EVP_DigestInit(EVP_MD_CTX *ctx, const EVP_MD *type)
     return EVP_DigestInit_ex(ctx, type, NULL);
 }
 
+/*
+ * Re-initialising a context with the digest it already has, as iterated
+ * hashing does all the time, can simply reuse the provider side context,
+ * unless that would differ from a fresh one.
+ */
+static int md_ctx_can_reinit(const EVP_MD_CTX *ctx, const EVP_MD *type,
+                             const ENGINE *impl)
+{
+    if (ctx->provctx == NULL || ctx->digest == NULL
+            || ctx->digest->dinit == NULL || ctx->provctx_params_set
+            || (type != NULL && type != ctx->digest && type != ctx->reqdigest)
+            || impl != NULL
+            || (ctx->flags & EVP_MD_CTX_FLAG_NO_INIT) != 0)
+        return 0;
+#if !defined(OPENSSL_NO_ENGINE) && !defined(FIPS_MODULE)
+    {
+        ENGINE *e;
+
+        if (ctx->engine != NULL)
+            return 0;
+        /* An ENGINE may have been registered for the digest meanwhile */
+        if ((e = ENGINE_get_digest_engine(ctx->digest->type)) != NULL) {
+            ENGINE_finish(e);
+            return 0;
+        }
+    }
+#endif
+    return 1;
+}
+
 int EVP_DigestInit_ex(EVP_MD_CTX *ctx, const EVP_MD *type, ENGINE *impl)
 {
 #if !defined(OPENSSL_NO_ENGINE) && !defined(FIPS_MODULE)
@@ -157,6 +188,9 @@ int EVP_DigestInit_ex(EVP_MD_CTX *ctx, const EVP_MD *type, ENGINE *impl)
 
     EVP_MD_CTX_clear_flags(ctx, EVP_MD_CTX_FLAG_CLEANED);
 
+    if (md_ctx_can_reinit(ctx, type, impl))
+        return ctx->digest->dinit(ctx->provctx);
+
     if (ctx->provctx != NULL) {
         if (!ossl_assert(ctx->digest != NULL)) {
             ERR_raise(ERR_LIB_EVP, EVP_R_INITIALIZATION_ERROR);
@@ -265,6 +299,7 @@ int EVP_DigestInit_ex(EVP_MD_CTX *ctx, const EVP_MD *type, ENGINE *impl)
             ERR_raise(ERR_LIB_EVP, EVP_R_INITIALIZATION_ERROR);
             return 0;
         }
+        ctx->provctx_params_set = 0;
     }
 
     if (ctx->digest->dinit == NULL) {
@@ -648,8 +683,10 @@ int EVP_MD_CTX_set_params(EVP_MD_CTX *ctx, const OSSL_PARAM params[])
         return pctx->op.sig.signature->set_ctx_md_params(pctx->op.sig.sigprovctx,
                                                          params);
 
-    if (ctx->digest != NULL && ctx->digest->set_ctx_params != NULL)
+    if (ctx->digest != NULL && ctx->digest->set_ctx_params != NULL) {
+        ctx->provctx_params_set = 1;
         return ctx->digest->set_ctx_params(ctx->provctx, params);
+    }
 
     return 0;
 }
@@ -30,6 +30,8 @@ struct evp_md_ctx_st {
     /* Provider ctx */
     void *provctx;
     EVP_MD *fetched_digest;
+    /* Set if params were set on provctx, which a fresh one would not have */
+    int provctx_params_set;
 } /* EVP_MD_CTX */ ;
 
 struct evp_cipher_ctx_st {
@@ -9,6 +9,7 @@
 
 #include "crypto/cryptlib.h"
 #include "internal/thread_once.h"
+#include "internal/tsan_assist.h"
 
 int do_ex_data_init(OSSL_LIB_CTX *ctx)
 {
@@ -23,7 +24,7 @@ int do_ex_data_init(OSSL_LIB_CTX *ctx)
 
 /*
  * Return the EX_CALLBACKS from the |ex_data| array that corresponds to
- * a given class.  On success, *holds the lock.*
+ * a given class.  On success, *holds the write lock.*
  * The |global| parameter is assumed to be non null (checked by the caller).
  */
 static EX_CALLBACKS *get_and_lock(OSSL_EX_DATA_GLOBAL *global, int class_index)
@@ -43,11 +44,81 @@ static EX_CALLBACKS *get_and_lock(OSSL_EX_DATA_GLOBAL *global, int class_index)
          return NULL;
     }
 
-    CRYPTO_THREAD_write_lock(global->ex_data_lock);
+    if (!CRYPTO_THREAD_write_lock(global->ex_data_lock))
+        return NULL;
     ip = &global->ex_data[class_index];
     return ip;
 }
 
+/*
+ * Get the current callbacks of a class.  Snapshots stay valid until the
+ * library context is freed, so once the pointer has been read, no lock is
+ * needed.  It is read without taking the lock, where the compiler supports
+ * that.  A class that no index was ever registered for has no snapshot, in
+ * which case |*snap| is set to NULL.
+ */
+static int get_snapshot(OSSL_EX_DATA_GLOBAL *global, int class_index,
+                        const EX_SNAPSHOT **snap)
+{
+    if (class_index < 0 || class_index >= CRYPTO_EX_INDEX__COUNT) {
+        ERR_raise(ERR_LIB_CRYPTO, ERR_R_PASSED_INVALID_ARGUMENT);
+        return 0;
+    }
+    if (global->ex_data_lock == NULL)
+        return 0;
+#ifdef tsan_ld_acq
+    /* Pairs with the release store in publish_snapshot() */
+    *snap = tsan_ld_acq((EX_SNAPSHOT *TSAN_QUALIFIER *)
+                        &global->ex_data[class_index].snapshot);
+#else
+    if (!CRYPTO_THREAD_read_lock(global->ex_data_lock))
+        return 0;
+    *snap = global->ex_data[class_index].snapshot;
+    CRYPTO_THREAD_unlock(global->ex_data_lock);
+#endif
+    return 1;
+}
+
+/*
+ * Replace the snapshot of |ip| with a copy of its current callbacks.  Must be
+ * called with the write lock held, which serialises the writers.  The new
+ * snapshot is published with a release store, so that readers that see it
+ * also see its contents.  The old snapshot may still be in use, so it is
+ * only retired.
+ */
+static int publish_snapshot(OSSL_EX_DATA_GLOBAL *global, EX_CALLBACKS *ip)
+{
+    EX_SNAPSHOT *snap, *old = ip->snapshot;
+    EX_CALLBACK *f;
+    int i, num = sk_EX_CALLBACK_num(ip->meth);
+
+    snap = OPENSSL_zalloc(sizeof(*snap) + sizeof(*snap->meth) * num);
+    if (snap == NULL) {
+        ERR_raise(ERR_LIB_CRYPTO, ERR_R_MALLOC_FAILURE);
+        return 0;
+    }
+    snap->num = num;
+    snap->meth = (EX_CALLBACK *)(snap + 1);
+    for (i = 0; i < num; i++) {
+        if ((f = sk_EX_CALLBACK_value(ip->meth, i)) == NULL)
+            continue;
+        snap->meth[i] = *f;
+        snap->has_new |= f->new_func != NULL;
+        snap->has_dup |= f->dup_func != NULL;
+        snap->has_free |= f->free_func != NULL;
+    }
+#ifdef tsan_st_rel
+    tsan_st_rel((EX_SNAPSHOT *TSAN_QUALIFIER *)&ip->snapshot, snap);
+#else
+    ip->snapshot = snap;
+#endif
+    if (old != NULL) {
+        old->retired = global->retired;
+        global->retired = old;
+    }
+    return 1;
+}
+
 static void cleanup_cb(EX_CALLBACK *funcs)
 {
     OPENSSL_free(funcs);
@@ -62,6 +133,7 @@ static void cleanup_cb(EX_CALLBACK *funcs)
 void crypto_cleanup_all_ex_data_int(OSSL_LIB_CTX *ctx)
 {
     int i;
+    EX_SNAPSHOT *snap;
     OSSL_EX_DATA_GLOBAL *global = ossl_lib_ctx_get_ex_data_global(ctx);
 
     if (global == NULL)
@@ -72,6 +144,12 @@ void crypto_cleanup_all_ex_data_int(OSSL_LIB_CTX *ctx)
 
         sk_EX_CALLBACK_pop_free(ip->meth, cleanup_cb);
         ip->meth = NULL;
+        OPENSSL_free(ip->snapshot);
+        ip->snapshot = NULL;
+    }
+    while ((snap = global->retired) != NULL) {
+        global->retired = snap->retired;
+        OPENSSL_free(snap);
     }
 
     CRYPTO_THREAD_lock_free(global->ex_data_lock);
@@ -103,7 +181,7 @@ static int dummy_dup(CRYPTO_EX_DATA *to, const CRYPTO_EX_DATA *from,
 int crypto_free_ex_index_ex(OSSL_LIB_CTX *ctx, int class_index, int idx)
 {
     EX_CALLBACKS *ip;
-    EX_CALLBACK *a;
+    EX_CALLBACK *a, old;
     int toret = 0;
     OSSL_EX_DATA_GLOBAL *global = ossl_lib_ctx_get_ex_data_global(ctx);
 
@@ -119,9 +197,14 @@ int crypto_free_ex_index_ex(OSSL_LIB_CTX *ctx, int class_index, int idx)
     a = sk_EX_CALLBACK_value(ip->meth, idx);
     if (a == NULL)
         goto err;
+    old = *a;
     a->new_func = dummy_new;
     a->dup_func = dummy_dup;
     a->free_func = dummy_free;
+    if (!publish_snapshot(global, ip)) {
+        *a = old;
+        goto err;
+    }
     toret = 1;
 err:
     CRYPTO_THREAD_unlock(global->ex_data_lock);
@@ -175,13 +258,17 @@ int crypto_get_ex_new_index_ex(OSSL_LIB_CTX *ctx, int class_index, long argl,
     a->dup_func = dup_func;
     a->free_func = free_func;
 
-    if (!sk_EX_CALLBACK_push(ip->meth, NULL)) {
+    if (!sk_EX_CALLBACK_push(ip->meth, a)) {
         ERR_raise(ERR_LIB_CRYPTO, ERR_R_MALLOC_FAILURE);
         OPENSSL_free(a);
         goto err;
     }
+    if (!publish_snapshot(global, ip)) {
+        (void)sk_EX_CALLBACK_pop(ip->meth);
+        OPENSSL_free(a);
+        goto err;
+    }
     toret = sk_EX_CALLBACK_num(ip->meth) - 1;
-    (void)sk_EX_CALLBACK_set(ip->meth, toret, a);
 
  err:
     CRYPTO_THREAD_unlock(global->ex_data_lock);
@@ -196,57 +283,64 @@ int CRYPTO_get_ex_new_index(int class_index, long argl, void *argp,
                                       dup_func, free_func);
 }
 
+/* Make room for at least |num| items in |ad|, in a single allocation */
+static int ex_data_reserve(CRYPTO_EX_DATA *ad, int num)
+{
+    int i;
+
+    if (ad->sk == NULL)
+        ad->sk = sk_void_new_reserve(NULL, num);
+    else if (sk_void_num(ad->sk) < num)
+        (void)sk_void_reserve(ad->sk, num - sk_void_num(ad->sk));
+    if (ad->sk == NULL) {
+        ERR_raise(ERR_LIB_CRYPTO, ERR_R_MALLOC_FAILURE);
+        return 0;
+    }
+    for (i = sk_void_num(ad->sk); i < num; ++i) {
+        if (!sk_void_push(ad->sk, NULL)) {
+            ERR_raise(ERR_LIB_CRYPTO, ERR_R_MALLOC_FAILURE);
+            return 0;
+        }
+    }
+    return 1;
+}
+
 /*
  * Initialise a new CRYPTO_EX_DATA for use in a particular class - including
  * calling new() callbacks for each index in the class used by this variable
- * Thread-safe by copying a class's array of "EX_CALLBACK" entries
- * in the lock, then using them outside the lock. Note this only applies
- * to the global "ex_data" state (ie. class definitions), not 'ad' itself.
+ * The callbacks are taken from the class's current snapshot, so no lock is
+ * held while they are called.  Note this only applies to the global
+ * "ex_data" state (ie. class definitions), not 'ad' itself.
  */
 int crypto_new_ex_data_ex(OSSL_LIB_CTX *ctx, int class_index, void *obj,
                           CRYPTO_EX_DATA *ad)
 {
-    int mx, i;
-    void *ptr;
-    EX_CALLBACK **storage = NULL;
-    EX_CALLBACK *stack[10];
-    EX_CALLBACKS *ip;
+    int i;
+    const EX_SNAPSHOT *snap;
+    const EX_CALLBACK *f;
     OSSL_EX_DATA_GLOBAL *global = ossl_lib_ctx_get_ex_data_global(ctx);
 
     if (global == NULL)
         return 0;
 
-    ip = get_and_lock(global, class_index);
-    if (ip == NULL)
-        return 0;
-
     ad->ctx = ctx;
     ad->sk = NULL;
-    mx = sk_EX_CALLBACK_num(ip->meth);
-    if (mx > 0) {
-        if (mx < (int)OSSL_NELEM(stack))
-            storage = stack;
-        else
-            storage = OPENSSL_malloc(sizeof(*storage) * mx);
-        if (storage != NULL)
-            for (i = 0; i < mx; i++)
-                storage[i] = sk_EX_CALLBACK_value(ip->meth, i);
-    }
-    CRYPTO_THREAD_unlock(global->ex_data_lock);
+    if (!get_snapshot(global, class_index, &snap))
+        return 0;
 
-    if (mx > 0 && storage == NULL) {
-        ERR_raise(ERR_LIB_CRYPTO, ERR_R_MALLOC_FAILURE);
+    /* Nothing to do for the classes that nobody uses */
+    if (snap == NULL || !snap->has_new)
+        return 1;
+
+    /* The new() callbacks are going to fill in their items */
+    if (!ex_data_reserve(ad, snap->num))
         return 0;
+    for (i = 0; i < snap->num; i++) {
+        f = &snap->meth[i];
+        if (f->new_func != NULL)
+            f->new_func(obj, sk_void_value(ad->sk, i), ad, i,
+                        f->argl, f->argp);
     }
-    for (i = 0; i < mx; i++) {
-        if (storage[i] != NULL && storage[i]->new_func != NULL) {
-            ptr = CRYPTO_get_ex_data(ad, i);
-            storage[i]->new_func(obj, ptr, ad, i,
-                                 storage[i]->argl, storage[i]->argp);
-        }
-    }
-    if (storage != stack)
-        OPENSSL_free(storage);
     return 1;
 }
 
@@ -264,10 +358,8 @@ int CRYPTO_dup_ex_data(int class_index, CRYPTO_EX_DATA *to,
 {
     int mx, j, i;
     void *ptr;
-    EX_CALLBACK *stack[10];
-    EX_CALLBACK **storage = NULL;
-    EX_CALLBACKS *ip;
-    int toret = 0;
+    const EX_SNAPSHOT *snap;
+    const EX_CALLBACK *f;
     OSSL_EX_DATA_GLOBAL *global;
 
     to->ctx = from->ctx;
@@ -279,54 +371,29 @@ int CRYPTO_dup_ex_data(int class_index, CRYPTO_EX_DATA *to,
     if (global == NULL)
         return 0;
 
-    ip = get_and_lock(global, class_index);
-    if (ip == NULL)
+    if (!get_snapshot(global, class_index, &snap))
         return 0;
+    if (snap == NULL)
+        return 1;
 
-    mx = sk_EX_CALLBACK_num(ip->meth);
+    mx = snap->num;
     j = sk_void_num(from->sk);
     if (j < mx)
         mx = j;
-    if (mx > 0) {
-        if (mx < (int)OSSL_NELEM(stack))
-            storage = stack;
-        else
-            storage = OPENSSL_malloc(sizeof(*storage) * mx);
-        if (storage != NULL)
-            for (i = 0; i < mx; i++)
-                storage[i] = sk_EX_CALLBACK_value(ip->meth, i);
-    }
-    CRYPTO_THREAD_unlock(global->ex_data_lock);
-
     if (mx == 0)
         return 1;
-    if (storage == NULL) {
-        ERR_raise(ERR_LIB_CRYPTO, ERR_R_MALLOC_FAILURE);
+    if (!ex_data_reserve(to, mx))
         return 0;
-    }
-    /*
-     * Make sure the ex_data stack is at least |mx| elements long to avoid
-     * issues in the for loop that follows; so go get the |mx|'th element
-     * (if it does not exist CRYPTO_get_ex_data() returns NULL), and assign
-     * to itself. This is normally a no-op; but ensures the stack is the
-     * proper size
-     */
-    if (!CRYPTO_set_ex_data(to, mx - 1, CRYPTO_get_ex_data(to, mx - 1)))
-        goto err;
 
     for (i = 0; i < mx; i++) {
-        ptr = CRYPTO_get_ex_data(from, i);
-        if (storage[i] != NULL && storage[i]->dup_func != NULL)
-            if (!storage[i]->dup_func(to, from, &ptr, i,
-                                      storage[i]->argl, storage[i]->argp))
-                goto err;
-        CRYPTO_set_ex_data(to, i, ptr);
+        ptr = sk_void_value(from->sk, i);
+        f = &snap->meth[i];
+        if (f->dup_func != NULL)
+            if (!f->dup_func(to, from, &ptr, i, f->argl, f->argp))
+                return 0;
+        (void)sk_void_set(to->sk, i, ptr);
     }
-    toret = 1;
- err:
-    if (storage != stack)
-        OPENSSL_free(storage);
-    return toret;
+    return 1;
 }
 
 
@@ -336,49 +403,23 @@ int CRYPTO_dup_ex_data(int class_index, CRYPTO_EX_DATA *to,
  */
 void CRYPTO_free_ex_data(int class_index, void *obj, CRYPTO_EX_DATA *ad)
 {
-    int mx, i;
-    EX_CALLBACKS *ip;
-    void *ptr;
-    EX_CALLBACK *f;
-    EX_CALLBACK *stack[10];
-    EX_CALLBACK **storage = NULL;
+    int i;
+    const EX_SNAPSHOT *snap;
+    const EX_CALLBACK *f;
     OSSL_EX_DATA_GLOBAL *global = ossl_lib_ctx_get_ex_data_global(ad->ctx);
 
-    if (global == NULL)
+    if (global == NULL || !get_snapshot(global, class_index, &snap))
         goto err;
 
-    ip = get_and_lock(global, class_index);
-    if (ip == NULL)
-        goto err;
-
-    mx = sk_EX_CALLBACK_num(ip->meth);
-    if (mx > 0) {
-        if (mx < (int)OSSL_NELEM(stack))
-            storage = stack;
-        else
-            storage = OPENSSL_malloc(sizeof(*storage) * mx);
-        if (storage != NULL)
-            for (i = 0; i < mx; i++)
-                storage[i] = sk_EX_CALLBACK_value(ip->meth, i);
-    }
-    CRYPTO_THREAD_unlock(global->ex_data_lock);
-
-    for (i = 0; i < mx; i++) {
-        if (storage != NULL)
-            f = storage[i];
-        else {
-            CRYPTO_THREAD_write_lock(global->ex_data_lock);
-            f = sk_EX_CALLBACK_value(ip->meth, i);
-            CRYPTO_THREAD_unlock(global->ex_data_lock);
-        }
-        if (f != NULL && f->free_func != NULL) {
-            ptr = CRYPTO_get_ex_data(ad, i);
-            f->free_func(obj, ptr, ad, i, f->argl, f->argp);
+    if (snap != NULL && snap->has_free) {
+        for (i = 0; i < snap->num; i++) {
+            f = &snap->meth[i];
+            if (f->free_func != NULL)
+                f->free_func(obj, CRYPTO_get_ex_data(ad, i), ad, i,
+                             f->argl, f->argp);
         }
     }
 
-    if (storage != stack)
-        OPENSSL_free(storage);
  err:
     sk_void_free(ad->sk);
     ad->sk = NULL;
@@ -405,19 +446,18 @@ int CRYPTO_alloc_ex_data(int class_index, void *obj, CRYPTO_EX_DATA *ad,
 int ossl_crypto_alloc_ex_data_intern(int class_index, void *obj,
                                      CRYPTO_EX_DATA *ad, int idx)
 {
-    EX_CALLBACK *f;
-    EX_CALLBACKS *ip;
+    const EX_SNAPSHOT *snap;
+    const EX_CALLBACK *f;
     OSSL_EX_DATA_GLOBAL *global;
 
     global = ossl_lib_ctx_get_ex_data_global(ad->ctx);
     if (global == NULL)
         return 0;
 
-    ip = get_and_lock(global, class_index);
-    if (ip == NULL)
+    if (!get_snapshot(global, class_index, &snap)
+            || snap == NULL || idx < 0 || idx >= snap->num)
         return 0;
-    f = sk_EX_CALLBACK_value(ip->meth, idx);
-    CRYPTO_THREAD_unlock(global->ex_data_lock);
+    f = &snap->meth[idx];
 
     /*
      * This should end up calling CRYPTO_set_ex_data(), which allocates
@@ -437,26 +477,13 @@ int ossl_crypto_alloc_ex_data_intern(int class_index, void *obj,
  */
 int CRYPTO_set_ex_data(CRYPTO_EX_DATA *ad, int idx, void *val)
 {
-    int i;
-
-    if (ad->sk == NULL) {
-        if ((ad->sk = sk_void_new_null()) == NULL) {
-            ERR_raise(ERR_LIB_CRYPTO, ERR_R_MALLOC_FAILURE);
-            return 0;
-        }
-    }
-
-    for (i = sk_void_num(ad->sk); i <= idx; ++i) {
-        if (!sk_void_push(ad->sk, NULL)) {
-            ERR_raise(ERR_LIB_CRYPTO, ERR_R_MALLOC_FAILURE);
-            return 0;
-        }
-    }
-    if (sk_void_set(ad->sk, idx, val) != val) {
-        /* Probably the index is out of bounds */
+    if (idx < 0) {
         ERR_raise(ERR_LIB_CRYPTO, ERR_R_PASSED_INVALID_ARGUMENT);
         return 0;
     }
+    if (!ex_data_reserve(ad, idx + 1))
+        return 0;
+    (void)sk_void_set(ad->sk, idx, val);
     return 1;
 }
 
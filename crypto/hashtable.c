@@ -0,0 +1,320 @@
+/*
+ * Copyright 2021 The OpenSSL Project Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License 2.0 (the "License").  You may not use
+ * this file except in compliance with the License.  You can obtain a copy
+ * in the file LICENSE in the source distribution or at
+ * https://www.openssl.org/source/license.html
+ */
+
+#include <string.h>
+#include <openssl/crypto.h>
+#include "internal/rcu.h"
+#include "crypto/hashtable.h"
+
+/*
+ * The table is an array of singly linked chains.  Readers walk the chains
+ * inside an RCU read section, so writers only ever change the structure by
+ * publishing a single pointer: new entries are pushed at the head of a
+ * chain, deleted ones are unlinked by their predecessor and replaced data
+ * is swapped in place.  Growing the table builds a complete copy which is
+ * then published in one go.  Unlinked memory is freed after a grace period,
+ * except that the copy replaced by growing is left to ossl_rcu_call(): it
+ * goes with the next grace period on the table, at the latest when the table
+ * is freed.
+ */
+
+#define HT_MIN_BUCKETS      16
+#define HT_MAX_LOAD         2       /* items per bucket before growing */
+
+typedef struct ht_node_st HT_NODE;
+
+struct ht_node_st {
+    HT_NODE *next;
+    HT_NODE *retired;           /* writer only: list of nodes to free */
+    unsigned long hash;
+    void *data;
+};
+
+typedef struct {
+    size_t mask;
+    HT_NODE *b[1];
+} HT_BUCKETS;
+
+struct ossl_ht_st {
+    HT_BUCKETS *buckets;
+    OSSL_HT_HASHFUNC hash;
+    OSSL_HT_COMPFUNC comp;
+    OSSL_HT_FREEFUNC free_fn;
+    size_t num_items;
+    CRYPTO_RCU_LOCK *lock;
+};
+
+static HT_BUCKETS *ht_buckets_new(size_t n)
+{
+    HT_BUCKETS *b = OPENSSL_zalloc(sizeof(*b) + (n - 1) * sizeof(b->b[0]));
+
+    if (b != NULL)
+        b->mask = n - 1;
+    return b;
+}
+
+static ossl_inline size_t ht_bucket(unsigned long hash, size_t mask)
+{
+    return (hash ^ (hash >> 16)) & mask;
+}
+
+OSSL_HT *ossl_ht_new(OSSL_HT_HASHFUNC hash, OSSL_HT_COMPFUNC comp,
+                     OSSL_HT_FREEFUNC free_fn)
+{
+    OSSL_HT *ht;
+
+    if (hash == NULL || comp == NULL
+            || (ht = OPENSSL_zalloc(sizeof(*ht))) == NULL)
+        return NULL;
+    ht->hash = hash;
+    ht->comp = comp;
+    ht->free_fn = free_fn;
+    if ((ht->buckets = ht_buckets_new(HT_MIN_BUCKETS)) == NULL
+            || (ht->lock = ossl_rcu_lock_new()) == NULL) {
+        OPENSSL_free(ht->buckets);
+        OPENSSL_free(ht);
+        return NULL;
+    }
+    return ht;
+}
+
+/*
+ * Free the nodes of |b| and the bucket array itself.  The data is only freed
+ * if |free_data| is set, it is still referenced after a resize.
+ */
+static void ht_buckets_free(OSSL_HT *ht, HT_BUCKETS *b, int free_data)
+{
+    HT_NODE *n, *nn;
+    size_t i;
+
+    for (i = 0; i <= b->mask; i++)
+        for (n = b->b[i]; n != NULL; n = nn) {
+            nn = n->next;
+            if (free_data && ht->free_fn != NULL)
+                ht->free_fn(n->data);
+            OPENSSL_free(n);
+        }
+    OPENSSL_free(b);
+}
+
+void ossl_ht_free(OSSL_HT *ht)
+{
+    if (ht == NULL)
+        return;
+
+    ht_buckets_free(ht, ht->buckets, 1);
+    ossl_rcu_lock_free(ht->lock);
+    OPENSSL_free(ht);
+}
+
+int ossl_ht_read_lock(OSSL_HT *ht)
+{
+    return ossl_rcu_read_lock(ht->lock);
+}
+
+void ossl_ht_read_unlock(OSSL_HT *ht)
+{
+    ossl_rcu_read_unlock(ht->lock);
+}
+
+/* Free a bucket array that was replaced by ht_grow() */
+static void ht_buckets_retire(void *b)
+{
+    ht_buckets_free(NULL, b, 0);
+}
+
+static void ht_free_retired(OSSL_HT *ht, HT_NODE *retired)
+{
+    HT_NODE *n;
+
+    if (retired == NULL)
+        return;
+    ossl_synchronize_rcu(ht->lock);
+    while ((n = retired) != NULL) {
+        retired = n->retired;
+        if (ht->free_fn != NULL)
+            ht->free_fn(n->data);
+        OPENSSL_free(n);
+    }
+}
+
+static HT_NODE *ht_find(HT_NODE *n, OSSL_HT_COMPFUNC comp,
+                        unsigned long hash, const void *key)
+{
+    for (; n != NULL; n = ossl_rcu_deref(&n->next))
+        if (n->hash == hash && comp(ossl_rcu_deref(&n->data), key) == 0)
+            return n;
+    return NULL;
+}
+
+void *ossl_ht_get(OSSL_HT *ht, const void *key)
+{
+    HT_BUCKETS *b = ossl_rcu_deref(&ht->buckets);
+    unsigned long hash = ht->hash(key);
+    HT_NODE *n = ht_find(ossl_rcu_deref(&b->b[ht_bucket(hash, b->mask)]),
+                         ht->comp, hash, key);
+
+    return n != NULL ? ossl_rcu_deref(&n->data) : NULL;
+}
+
+void ossl_ht_doall(OSSL_HT *ht, OSSL_HT_DOALLFUNC fn, void *arg)
+{
+    HT_BUCKETS *b = ossl_rcu_deref(&ht->buckets);
+    HT_NODE *n;
+    size_t i;
+
+    for (i = 0; i <= b->mask; i++)
+        for (n = ossl_rcu_deref(&b->b[i]); n != NULL;
+             n = ossl_rcu_deref(&n->next))
+            fn(ossl_rcu_deref(&n->data), arg);
+}
+
+size_t ossl_ht_num(const OSSL_HT *ht)
+{
+    return ht->num_items;
+}
+
+/*
+ * Build a copy of the table with twice as many buckets.  The old nodes can
+ * still be in use by readers, so they are not reused.
+ */
+static void ht_grow(OSSL_HT *ht)
+{
+    HT_BUCKETS *ob = ht->buckets, *nb;
+    HT_NODE *n, *nn;
+    size_t i, j;
+
+    if ((nb = ht_buckets_new(2 * (ob->mask + 1))) == NULL)
+        return;
+    for (i = 0; i <= ob->mask; i++)
+        for (n = ob->b[i]; n != NULL; n = n->next) {
+            if ((nn = OPENSSL_malloc(sizeof(*nn))) == NULL) {
+                ht_buckets_free(ht, nb, 0);
+                return;
+            }
+            j = ht_bucket(n->hash, nb->mask);
+            nn->hash = n->hash;
+            nn->data = n->data;
+            nn->next = nb->b[j];
+            nb->b[j] = nn;
+        }
+    ossl_rcu_assign_ptr(&ht->buckets, nb);
+    /* Inserting must not wait for readers, so free the old copy later */
+    if (!ossl_rcu_call(ht->lock, ht_buckets_retire, ob)) {
+        ossl_synchronize_rcu(ht->lock);
+        ht_buckets_free(ht, ob, 0);
+    }
+}
+
+int ossl_ht_insert(OSSL_HT *ht, void *data)
+{
+    unsigned long hash = ht->hash(data);
+    HT_BUCKETS *b;
+    HT_NODE *n, **head;
+    void *old;
+
+    if (!ossl_rcu_write_lock(ht->lock))
+        return 0;
+    b = ht->buckets;
+    head = &b->b[ht_bucket(hash, b->mask)];
+    if ((n = ht_find(*head, ht->comp, hash, data)) != NULL) {
+        old = n->data;
+        ossl_rcu_assign_ptr(&n->data, data);
+        if (ht->free_fn != NULL) {
+            ossl_synchronize_rcu(ht->lock);
+            ht->free_fn(old);
+        }
+        ossl_rcu_write_unlock(ht->lock);
+        return 1;
+    }
+
+    if ((n = OPENSSL_malloc(sizeof(*n))) == NULL) {
+        ossl_rcu_write_unlock(ht->lock);
+        return 0;
+    }
+    n->hash = hash;
+    n->data = data;
+    n->next = *head;
+    ossl_rcu_assign_ptr(head, n);
+    if (++ht->num_items > HT_MAX_LOAD * (b->mask + 1))
+        ht_grow(ht);
+    ossl_rcu_write_unlock(ht->lock);
+    return 1;
+}
+
+int ossl_ht_delete(OSSL_HT *ht, const void *key)
+{
+    unsigned long hash = ht->hash(key);
+    HT_BUCKETS *b;
+    HT_NODE *n, **pn;
+
+    if (!ossl_rcu_write_lock(ht->lock))
+        return 0;
+    b = ht->buckets;
+    for (pn = &b->b[ht_bucket(hash, b->mask)]; (n = *pn) != NULL;
+         pn = &n->next)
+        if (n->hash == hash && ht->comp(n->data, key) == 0)
+            break;
+    if (n != NULL) {
+        ossl_rcu_assign_ptr(pn, n->next);
+        ht->num_items--;
+        n->retired = NULL;
+        ht_free_retired(ht, n);
+    }
+    ossl_rcu_write_unlock(ht->lock);
+    return n != NULL;
+}
+
+/*
+ * Remove all entries for which |keep| returns 0.  The callback is called with
+ * the write lock held and must not access the table.  Returns the number of
+ * entries removed.
+ */
+size_t ossl_ht_filter(OSSL_HT *ht, OSSL_HT_FILTERFUNC keep, void *arg)
+{
+    HT_BUCKETS *b;
+    HT_NODE *n, **pn, *retired = NULL;
+    size_t i, removed = 0;
+
+    if (!ossl_rcu_write_lock(ht->lock))
+        return 0;
+    b = ht->buckets;
+    for (i = 0; i <= b->mask; i++)
+        for (pn = &b->b[i]; (n = *pn) != NULL;) {
+            if (keep(n->data, arg)) {
+                pn = &n->next;
+                continue;
+            }
+            ossl_rcu_assign_ptr(pn, n->next);
+            n->retired = retired;
+            retired = n;
+            removed++;
+        }
+    ht->num_items -= removed;
+    ht_free_retired(ht, retired);
+    ossl_rcu_write_unlock(ht->lock);
+    return removed;
+}
+
+void ossl_ht_flush(OSSL_HT *ht)
+{
+    HT_BUCKETS *ob, *nb;
+
+    if ((nb = ht_buckets_new(HT_MIN_BUCKETS)) == NULL
+            || !ossl_rcu_write_lock(ht->lock)) {
+        OPENSSL_free(nb);
+        return;
+    }
+    ob = ht->buckets;
+    ossl_rcu_assign_ptr(&ht->buckets, nb);
+    ht->num_items = 0;
+    ossl_synchronize_rcu(ht->lock);
+    ht_buckets_free(ht, ob, 1);
+    ossl_rcu_write_unlock(ht->lock);
+}
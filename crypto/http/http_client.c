@@ -22,6 +22,7 @@
 #include <openssl/http.h>
 #include "internal/sockets.h"
 #include "internal/cryptlib.h" /* for ossl_assert() */
+#include "internal/metrics.h"
 
 #include "http_local.h"
 
@@ -747,6 +748,7 @@ static ASN1_VALUE *BIO_mem_d2i(BIO *mem, const ASN1_ITEM *it)
 
 static BIO *OSSL_HTTP_REQ_CTX_transfer(OSSL_HTTP_REQ_CTX *rctx)
 {
+    uint64_t start = ossl_metric_now();
     int rv;
 
     if (rctx == NULL) {
@@ -761,9 +763,16 @@ static BIO *OSSL_HTTP_REQ_CTX_transfer(OSSL_HTTP_REQ_CTX *rctx)
         /* BIO_should_retry was true */
         /* will not actually wait if rctx->max_time == 0 */
         if (BIO_wait(rctx->rbio, rctx->max_time, 100 /* milliseconds */) <= 0)
-            return NULL;
+            break;
     }
 
+    /* There is no library context for HTTP, so use the default one */
+    ossl_metric_time(NULL, OSSL_METRIC_HTTP_TRANSFER, start);
+    if (rv != 1)
+        ossl_metric_count(NULL, OSSL_METRIC_HTTP_TRANSFER_FAIL);
+    if (rv == -1)
+        return NULL;
+
     if (rv == 0) {
         if (rctx->redirection_url == NULL) { /* an error occurred */
             if (rctx->len_to_send > 0)
@@ -27,6 +27,8 @@
 #include <stdlib.h>
 #include <assert.h>
 #include "internal/thread_once.h"
+#include "internal/mem_pool.h"
+#include "internal/rcu.h"
 #include "crypto/dso_conf.h"
 #include "internal/dso.h"
 #include "crypto/store.h"
@@ -444,9 +446,15 @@ void OPENSSL_cleanup(void)
     OSSL_TRACE(INIT, "OPENSSL_cleanup: err_int()\n");
     err_cleanup();
 
+    OSSL_TRACE(INIT, "OPENSSL_cleanup: ossl_pool_cleanup()\n");
+    ossl_pool_cleanup();
+
     OSSL_TRACE(INIT, "OPENSSL_cleanup: CRYPTO_secure_malloc_done()\n");
     CRYPTO_secure_malloc_done();
 
+    OSSL_TRACE(INIT, "OPENSSL_cleanup: ossl_rcu_cleanup()\n");
+    ossl_rcu_cleanup();
+
 #ifndef OPENSSL_NO_CMP
     OSSL_TRACE(INIT, "OPENSSL_cleanup: OSSL_CMP_log_close()\n");
     OSSL_CMP_log_close();
@@ -1,5 +1,5 @@
 /*
- * Copyright 1995-2017 The OpenSSL Project Authors. All Rights Reserved.
+ * Copyright 1995-2021 The OpenSSL Project Authors. All Rights Reserved.
  *
  * Licensed under the Apache License 2.0 (the "License").  You may not use
  * this file except in compliance with the License.  You can obtain a copy
@@ -63,7 +63,7 @@ void OPENSSL_LH_stats_bio(const OPENSSL_LHASH *lh, BIO *out)
 {
     BIO_printf(out, "num_items             = %lu\n", lh->num_items);
     BIO_printf(out, "num_nodes             = %u\n",  lh->num_nodes);
-    BIO_printf(out, "num_alloc_nodes       = %u\n",  lh->num_alloc_nodes);
+    BIO_printf(out, "growth_left           = %u\n",  lh->growth_left);
     BIO_printf(out, "num_expands           = %lu\n", lh->num_expands);
     BIO_printf(out, "num_expand_reallocs   = %lu\n", lh->num_expand_reallocs);
     BIO_printf(out, "num_contracts         = %lu\n", lh->num_contracts);
@@ -79,39 +79,47 @@ void OPENSSL_LH_stats_bio(const OPENSSL_LHASH *lh, BIO *out)
     BIO_printf(out, "num_hash_comps        = %lu\n", lh->num_hash_comps);
 }
 
-void OPENSSL_LH_node_stats_bio(const OPENSSL_LHASH *lh, BIO *out)
+/*
+ * The table has no chains, so these report on the groups of LH_GROUP_WIDTH
+ * slots that are probed together.
+ */
+static unsigned int group_items(const OPENSSL_LHASH *lh, unsigned int g)
 {
-    OPENSSL_LH_NODE *n;
-    unsigned int i, num;
+    unsigned int i, num = 0;
 
-    for (i = 0; i < lh->num_nodes; i++) {
-        for (n = lh->b[i], num = 0; n != NULL; n = n->next)
+    for (i = g * LH_GROUP_WIDTH; i < (g + 1) * LH_GROUP_WIDTH; i++)
+        if ((lh->ctrl[i] & 0x80) == 0)
             num++;
-        BIO_printf(out, "node %6u -> %3u\n", i, num);
-    }
+    return num;
+}
+
+void OPENSSL_LH_node_stats_bio(const OPENSSL_LHASH *lh, BIO *out)
+{
+    unsigned int i;
+
+    for (i = 0; i < lh->num_nodes / LH_GROUP_WIDTH; i++)
+        BIO_printf(out, "node %6u -> %3u\n", i, group_items(lh, i));
 }
 
 void OPENSSL_LH_node_usage_stats_bio(const OPENSSL_LHASH *lh, BIO *out)
 {
-    OPENSSL_LH_NODE *n;
     unsigned long num;
-    unsigned int i;
+    unsigned int i, num_groups = lh->num_nodes / LH_GROUP_WIDTH;
     unsigned long total = 0, n_used = 0;
 
-    for (i = 0; i < lh->num_nodes; i++) {
-        for (n = lh->b[i], num = 0; n != NULL; n = n->next)
-            num++;
+    for (i = 0; i < num_groups; i++) {
+        num = group_items(lh, i);
         if (num != 0) {
             n_used++;
             total += num;
         }
     }
-    BIO_printf(out, "%lu nodes used out of %u\n", n_used, lh->num_nodes);
+    BIO_printf(out, "%lu nodes used out of %u\n", n_used, num_groups);
     BIO_printf(out, "%lu items\n", total);
     if (n_used == 0)
         return;
     BIO_printf(out, "load %d.%02d  actual load %d.%02d\n",
-               (int)(total / lh->num_nodes),
-               (int)((total % lh->num_nodes) * 100 / lh->num_nodes),
+               (int)(total / num_groups),
+               (int)((total % num_groups) * 100 / num_groups),
                (int)(total / n_used), (int)((total % n_used) * 100 / n_used));
 }
@@ -1,5 +1,5 @@
 /*
- * Copyright 1995-2020 The OpenSSL Project Authors. All Rights Reserved.
+ * Copyright 1995-2021 The OpenSSL Project Authors. All Rights Reserved.
  *
  * Licensed under the Apache License 2.0 (the "License").  You may not use
  * this file except in compliance with the License.  You can obtain a copy
@@ -10,39 +10,133 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <limits.h>
 #include <openssl/crypto.h>
 #include <openssl/lhash.h>
 #include <openssl/err.h>
 #include "crypto/ctype.h"
 #include "crypto/lhash.h"
+#include "internal/endian.h"
 #include "lhash_local.h"
 
 /*
- * A hashing implementation that appears to be based on the linear hashing
- * algorithm:
- * https://en.wikipedia.org/wiki/Linear_hashing
+ * An open addressing hash table in the style of the "Swiss tables" described
+ * by Google (https://abseil.io/about/design/swisstables).
  *
- * Litwin, Witold (1980), "Linear hashing: A new tool for file and table
- * addressing", Proc. 6th Conference on Very Large Databases: 212-223
- * https://hackthology.com/pdfs/Litwin-1980-Linear_Hashing.pdf
+ * Items are stored directly in an array of slots together with their full
+ * hash value, so no per item allocation is necessary.  Next to the slots
+ * there is an array of control bytes, one per slot, which hold either
+ * LH_CTRL_EMPTY, LH_CTRL_DELETED or, for a slot in use, the seven top bits
+ * of the mixed hash.  The slots are organised in groups of LH_GROUP_WIDTH
+ * entries and a lookup examines all the control bytes of a group at once
+ * using 64-bit word operations, only calling the comparison function for
+ * slots that have a matching control byte and a matching cached hash.
  *
- * From the Wikipedia article "Linear hashing is used in the BDB Berkeley
- * database system, which in turn is used by many software systems such as
- * OpenLDAP, using a C implementation derived from the CACM article and first
- * published on the Usenet in 1988 by Esmond Pitt."
+ * Groups are probed using triangular numbers, which visits every group
+ * because the number of groups is always a power of two.  A lookup stops at
+ * the first group that contains an empty slot.
  *
- * The CACM paper is available here:
- * https://pdfs.semanticscholar.org/ff4d/1c5deca6269cc316bfd952172284dbf610ee.pdf
+ * The table is only ever resized by OPENSSL_LH_insert(), so entries never
+ * move during a doall and it is safe to delete from within a doall callback.
  */
 
 #undef MIN_NODES
 #define MIN_NODES       16
-#define UP_LOAD         (2*LH_LOAD_MULT) /* load times 256 (default 2) */
-#define DOWN_LOAD       (LH_LOAD_MULT) /* load times 256 (default 1) */
+#define DOWN_LOAD       (LH_LOAD_MULT / 8) /* load times 256 (default 1/8) */
 
-static int expand(OPENSSL_LHASH *lh);
-static void contract(OPENSSL_LHASH *lh);
-static OPENSSL_LH_NODE **getrn(OPENSSL_LHASH *lh, const void *data, unsigned long *rhash);
+#define LH_CTRL_EMPTY   0x80
+#define LH_CTRL_DELETED 0xFE
+#define LH_CTRL_FULL(c) (((c) & 0x80) == 0)
+
+#define LH_LSBS         (~(uint64_t)0 / 0xFF)
+#define LH_MSBS         (LH_LSBS << 7)
+#define LH_MULTIPLIER   (((uint64_t)0x9E3779B9 << 32) | 0x7F4A7C15)
+
+static int resize(OPENSSL_LHASH *lh, unsigned int num_nodes);
+static OPENSSL_LH_NODE *getrn(OPENSSL_LHASH *lh, const void *data,
+                              unsigned long hash);
+
+/* At most 7/8 of the slots may be in use or deleted */
+static ossl_inline unsigned int max_load(unsigned int num_nodes)
+{
+    return num_nodes - num_nodes / 8;
+}
+
+static ossl_inline size_t num_groups_mask(const OPENSSL_LHASH *lh)
+{
+    return lh->num_nodes / LH_GROUP_WIDTH - 1;
+}
+
+/*
+ * Spread the (often poor) application hash over the starting group and the
+ * tag that is stored in the control byte.
+ */
+static ossl_inline size_t hash_split(unsigned long hash, size_t mask,
+                                     unsigned char *tag)
+{
+    uint64_t h = (uint64_t)hash * LH_MULTIPLIER;
+
+    *tag = (unsigned char)((h >> 25) & 0x7F);
+    return (size_t)(h >> 32) & mask;
+}
+
+static ossl_inline uint64_t group_load(const unsigned char *ctrl)
+{
+    uint64_t g;
+
+    memcpy(&g, ctrl, sizeof(g));
+    return g;
+}
+
+/*
+ * Return a mask with the top bit set in each byte of |g| that equals |tag|.
+ * There may be false positives, but only on slots that are in use, and these
+ * are eliminated by the cached hash comparison.
+ */
+static ossl_inline uint64_t group_match(uint64_t g, unsigned char tag)
+{
+    uint64_t x = g ^ (LH_LSBS * tag);
+
+    return (x - LH_LSBS) & ~x & LH_MSBS;
+}
+
+static ossl_inline uint64_t group_match_empty(uint64_t g)
+{
+    return g & (~g << 6) & LH_MSBS;
+}
+
+static ossl_inline uint64_t group_match_empty_or_deleted(uint64_t g)
+{
+    return g & ~(g << 7) & LH_MSBS;
+}
+
+/* Return the slot offset within a group of the lowest bit set in |m| */
+static ossl_inline unsigned int group_first(uint64_t m)
+{
+    DECLARE_IS_ENDIAN;
+    unsigned int i;
+
+#if defined(__GNUC__) && __GNUC__ >= 4
+    i = (unsigned int)__builtin_ctzll(m) / 8;
+#else
+    for (i = 0; (m & ((uint64_t)0x80 << (8 * i))) == 0; i++)
+        continue;
+#endif
+    return IS_LITTLE_ENDIAN ? i : LH_GROUP_WIDTH - 1 - i;
+}
+
+static size_t find_free(const OPENSSL_LHASH *lh, unsigned long hash,
+                        unsigned char *tag)
+{
+    size_t mask = num_groups_mask(lh), step = 0, g;
+    uint64_t m;
+
+    g = hash_split(hash, mask, tag);
+    while ((m = group_match_empty_or_deleted(
+                    group_load(lh->ctrl + g * LH_GROUP_WIDTH))) == 0)
+        g = (g + ++step) & mask;
+    return g * LH_GROUP_WIDTH + group_first(m);
+}
 
 OPENSSL_LHASH *OPENSSL_LH_new(OPENSSL_LH_HASHFUNC h, OPENSSL_LH_COMPFUNC c)
 {
@@ -56,19 +150,14 @@ OPENSSL_LHASH *OPENSSL_LH_new(OPENSSL_LH_HASHFUNC h, OPENSSL_LH_COMPFUNC c)
          */
         return NULL;
     }
-    if ((ret->b = OPENSSL_zalloc(sizeof(*ret->b) * MIN_NODES)) == NULL)
+    if (!resize(ret, MIN_NODES))
         goto err;
     ret->comp = ((c == NULL) ? (OPENSSL_LH_COMPFUNC)strcmp : c);
     ret->hash = ((h == NULL) ? (OPENSSL_LH_HASHFUNC)OPENSSL_LH_strhash : h);
-    ret->num_nodes = MIN_NODES / 2;
-    ret->num_alloc_nodes = MIN_NODES;
-    ret->pmax = MIN_NODES / 2;
-    ret->up_load = UP_LOAD;
     ret->down_load = DOWN_LOAD;
     return ret;
 
 err:
-    OPENSSL_free(ret->b);
     OPENSSL_free(ret);
     return NULL;
 }
@@ -78,135 +167,146 @@ void OPENSSL_LH_free(OPENSSL_LHASH *lh)
     if (lh == NULL)
         return;
 
-    OPENSSL_LH_flush(lh);
+    OPENSSL_free(lh->ctrl);
     OPENSSL_free(lh->b);
     OPENSSL_free(lh);
 }
 
 void OPENSSL_LH_flush(OPENSSL_LHASH *lh)
 {
-    unsigned int i;
-    OPENSSL_LH_NODE *n, *nn;
-
     if (lh == NULL)
         return;
 
-    for (i = 0; i < lh->num_nodes; i++) {
-        n = lh->b[i];
-        while (n != NULL) {
-            nn = n->next;
-            OPENSSL_free(n);
-            n = nn;
-        }
-        lh->b[i] = NULL;
-    }
+    memset(lh->ctrl, LH_CTRL_EMPTY, lh->num_nodes);
+    lh->num_items = 0;
+    lh->growth_left = max_load(lh->num_nodes);
 }
 
 void *OPENSSL_LH_insert(OPENSSL_LHASH *lh, void *data)
 {
     unsigned long hash;
-    OPENSSL_LH_NODE *nn, **rn;
+    OPENSSL_LH_NODE *nn;
+    size_t i;
+    unsigned char tag;
     void *ret;
 
     lh->error = 0;
-    if ((lh->up_load <= (lh->num_items * LH_LOAD_MULT / lh->num_nodes)) && !expand(lh))
-        return NULL;        /* 'lh->error++' already done in 'expand' */
+    hash = (*(lh->hash)) (data);
+    tsan_counter(&lh->num_hash_calls);
 
-    rn = getrn(lh, data, &hash);
+    if ((nn = getrn(lh, data, hash)) != NULL) { /* replace same key */
+        ret = nn->data;
+        nn->data = data;
+        lh->num_replace++;
+        return ret;
+    }
 
-    if (*rn == NULL) {
-        if ((nn = OPENSSL_malloc(sizeof(*nn))) == NULL) {
+    if (lh->num_nodes > MIN_NODES
+            && lh->down_load >= (lh->num_items * LH_LOAD_MULT / lh->num_nodes)
+            && lh->num_items < max_load(lh->num_nodes / 2) / 2) {
+        if (resize(lh, lh->num_nodes / 2)) {
+            lh->num_contracts++;
+            lh->num_contract_reallocs++;
+        } else {
+            lh->error = 0;      /* not fatal, keep using the larger table */
+        }
+    }
+    if (lh->growth_left == 0) {
+        /* Only drop the tombstones if that frees a good part of the table */
+        if (lh->num_items <= max_load(lh->num_nodes) / 2) {
+            if (!resize(lh, lh->num_nodes))
+                return NULL;
+        } else if (lh->num_nodes > UINT_MAX / 2) {
             lh->error++;
             return NULL;
+        } else if (!resize(lh, lh->num_nodes * 2)) {
+            return NULL;
         }
-        nn->data = data;
-        nn->next = NULL;
-        nn->hash = hash;
-        *rn = nn;
-        ret = NULL;
-        lh->num_insert++;
-        lh->num_items++;
-    } else {                    /* replace same key */
-        ret = (*rn)->data;
-        (*rn)->data = data;
-        lh->num_replace++;
+        lh->num_expands++;
+        lh->num_expand_reallocs++;
     }
-    return ret;
+
+    i = find_free(lh, hash, &tag);
+    if (lh->ctrl[i] == LH_CTRL_EMPTY)
+        lh->growth_left--;
+    lh->ctrl[i] = tag;
+    lh->b[i].data = data;
+    lh->b[i].hash = hash;
+    lh->num_insert++;
+    lh->num_items++;
+    return NULL;
 }
 
 void *OPENSSL_LH_delete(OPENSSL_LHASH *lh, const void *data)
 {
     unsigned long hash;
-    OPENSSL_LH_NODE *nn, **rn;
-    void *ret;
+    OPENSSL_LH_NODE *nn;
+    size_t i;
 
     lh->error = 0;
-    rn = getrn(lh, data, &hash);
+    hash = (*(lh->hash)) (data);
+    tsan_counter(&lh->num_hash_calls);
 
-    if (*rn == NULL) {
+    if ((nn = getrn(lh, data, hash)) == NULL) {
         lh->num_no_delete++;
         return NULL;
-    } else {
-        nn = *rn;
-        *rn = nn->next;
-        ret = nn->data;
-        OPENSSL_free(nn);
-        lh->num_delete++;
     }
 
+    /*
+     * A lookup never probes past a group containing an empty slot, so the
+     * slot can be marked empty again if its group still has one.  Otherwise
+     * a tombstone is left so that probe sequences passing here stay intact.
+     */
+    i = nn - lh->b;
+    if (group_match_empty(group_load(lh->ctrl + i - i % LH_GROUP_WIDTH)) != 0) {
+        lh->ctrl[i] = LH_CTRL_EMPTY;
+        lh->growth_left++;
+    } else {
+        lh->ctrl[i] = LH_CTRL_DELETED;
+    }
+    lh->num_delete++;
     lh->num_items--;
-    if ((lh->num_nodes > MIN_NODES) &&
-        (lh->down_load >= (lh->num_items * LH_LOAD_MULT / lh->num_nodes)))
-        contract(lh);
-
-    return ret;
+    return nn->data;
 }
 
 void *OPENSSL_LH_retrieve(OPENSSL_LHASH *lh, const void *data)
 {
     unsigned long hash;
-    OPENSSL_LH_NODE **rn;
-    void *ret;
+    OPENSSL_LH_NODE *nn;
 
     tsan_store((TSAN_QUALIFIER int *)&lh->error, 0);
 
-    rn = getrn(lh, data, &hash);
+    hash = (*(lh->hash)) (data);
+    tsan_counter(&lh->num_hash_calls);
 
-    if (*rn == NULL) {
+    if ((nn = getrn(lh, data, hash)) == NULL) {
         tsan_counter(&lh->num_retrieve_miss);
         return NULL;
-    } else {
-        ret = (*rn)->data;
-        tsan_counter(&lh->num_retrieve);
     }
-
-    return ret;
+    tsan_counter(&lh->num_retrieve);
+    return nn->data;
 }
 
 static void doall_util_fn(OPENSSL_LHASH *lh, int use_arg,
                           OPENSSL_LH_DOALL_FUNC func,
                           OPENSSL_LH_DOALL_FUNCARG func_arg, void *arg)
 {
-    int i;
-    OPENSSL_LH_NODE *a, *n;
+    size_t i;
 
     if (lh == NULL)
         return;
 
     /*
-     * reverse the order so we search from 'top to bottom' We were having
-     * memory leaks otherwise
+     * Deleting entries from the callbacks is fine, the slots of the
+     * remaining entries do not change until the next insert.
      */
-    for (i = lh->num_nodes - 1; i >= 0; i--) {
-        a = lh->b[i];
-        while (a != NULL) {
-            n = a->next;
-            if (use_arg)
-                func_arg(a->data, arg);
-            else
-                func(a->data);
-            a = n;
-        }
+    for (i = lh->num_nodes; i-- > 0;) {
+        if (!LH_CTRL_FULL(lh->ctrl[i]))
+            continue;
+        if (use_arg)
+            func_arg(lh->b[i].data, arg);
+        else
+            func(lh->b[i].data);
     }
 }
 
@@ -220,116 +320,69 @@ void OPENSSL_LH_doall_arg(OPENSSL_LHASH *lh, OPENSSL_LH_DOALL_FUNCARG func, void
     doall_util_fn(lh, 1, (OPENSSL_LH_DOALL_FUNC)0, func, arg);
 }
 
-static int expand(OPENSSL_LHASH *lh)
+/*
+ * Move all entries into freshly allocated arrays of |num_nodes| slots,
+ * dropping any tombstones on the way.
+ */
+static int resize(OPENSSL_LHASH *lh, unsigned int num_nodes)
 {
-    OPENSSL_LH_NODE **n, **n1, **n2, *np;
-    unsigned int p, pmax, nni, j;
-    unsigned long hash;
-
-    nni = lh->num_alloc_nodes;
-    p = lh->p;
-    pmax = lh->pmax;
-    if (p + 1 >= pmax) {
-        j = nni * 2;
-        n = OPENSSL_realloc(lh->b, sizeof(OPENSSL_LH_NODE *) * j);
-        if (n == NULL) {
-            lh->error++;
-            return 0;
-        }
-        lh->b = n;
-        memset(n + nni, 0, sizeof(*n) * (j - nni));
-        lh->pmax = nni;
-        lh->num_alloc_nodes = j;
-        lh->num_expand_reallocs++;
-        lh->p = 0;
-    } else {
-        lh->p++;
+    unsigned char *ctrl, *octrl = lh->ctrl;
+    OPENSSL_LH_NODE *b, *ob = lh->b;
+    unsigned int i, onum_nodes = lh->num_nodes;
+    unsigned char tag;
+    size_t j;
+
+    ctrl = OPENSSL_malloc(num_nodes);
+    b = OPENSSL_malloc(sizeof(*b) * num_nodes);
+    if (ctrl == NULL || b == NULL) {
+        OPENSSL_free(ctrl);
+        OPENSSL_free(b);
+        lh->error++;
+        return 0;
     }
-
-    lh->num_nodes++;
-    lh->num_expands++;
-    n1 = &(lh->b[p]);
-    n2 = &(lh->b[p + pmax]);
-    *n2 = NULL;
-
-    for (np = *n1; np != NULL;) {
-        hash = np->hash;
-        if ((hash % nni) != p) { /* move it */
-            *n1 = (*n1)->next;
-            np->next = *n2;
-            *n2 = np;
-        } else
-            n1 = &((*n1)->next);
-        np = *n1;
+    memset(ctrl, LH_CTRL_EMPTY, num_nodes);
+    lh->ctrl = ctrl;
+    lh->b = b;
+    lh->num_nodes = num_nodes;
+    lh->growth_left = max_load(num_nodes) - lh->num_items;
+
+    for (i = 0; i < onum_nodes; i++) {
+        if (!LH_CTRL_FULL(octrl[i]))
+            continue;
+        j = find_free(lh, ob[i].hash, &tag);
+        ctrl[j] = tag;
+        b[j] = ob[i];
     }
-
+    OPENSSL_free(octrl);
+    OPENSSL_free(ob);
     return 1;
 }
 
-static void contract(OPENSSL_LHASH *lh)
+static OPENSSL_LH_NODE *getrn(OPENSSL_LHASH *lh, const void *data,
+                              unsigned long hash)
 {
-    OPENSSL_LH_NODE **n, *n1, *np;
-
-    np = lh->b[lh->p + lh->pmax - 1];
-    lh->b[lh->p + lh->pmax - 1] = NULL; /* 24/07-92 - eay - weird but :-( */
-    if (lh->p == 0) {
-        n = OPENSSL_realloc(lh->b,
-                            (unsigned int)(sizeof(OPENSSL_LH_NODE *) * lh->pmax));
-        if (n == NULL) {
-            /* fputs("realloc error in lhash",stderr); */
-            lh->error++;
-            return;
-        }
-        lh->num_contract_reallocs++;
-        lh->num_alloc_nodes /= 2;
-        lh->pmax /= 2;
-        lh->p = lh->pmax - 1;
-        lh->b = n;
-    } else
-        lh->p--;
-
-    lh->num_nodes--;
-    lh->num_contracts++;
-
-    n1 = lh->b[(int)lh->p];
-    if (n1 == NULL)
-        lh->b[(int)lh->p] = np;
-    else {
-        while (n1->next != NULL)
-            n1 = n1->next;
-        n1->next = np;
-    }
-}
-
-static OPENSSL_LH_NODE **getrn(OPENSSL_LHASH *lh,
-                               const void *data, unsigned long *rhash)
-{
-    OPENSSL_LH_NODE **ret, *n1;
-    unsigned long hash, nn;
-    OPENSSL_LH_COMPFUNC cf;
-
-    hash = (*(lh->hash)) (data);
-    tsan_counter(&lh->num_hash_calls);
-    *rhash = hash;
-
-    nn = hash % lh->pmax;
-    if (nn < lh->p)
-        nn = hash % lh->num_alloc_nodes;
-
-    cf = lh->comp;
-    ret = &(lh->b[(int)nn]);
-    for (n1 = *ret; n1 != NULL; n1 = n1->next) {
-        tsan_counter(&lh->num_hash_comps);
-        if (n1->hash != hash) {
-            ret = &(n1->next);
-            continue;
+    OPENSSL_LH_NODE *n1;
+    OPENSSL_LH_COMPFUNC cf = lh->comp;
+    size_t mask = num_groups_mask(lh), step = 0, g;
+    unsigned char tag;
+    uint64_t grp, m;
+
+    g = hash_split(hash, mask, &tag);
+    for (;;) {
+        grp = group_load(lh->ctrl + g * LH_GROUP_WIDTH);
+        for (m = group_match(grp, tag); m != 0; m &= m - 1) {
+            n1 = &lh->b[g * LH_GROUP_WIDTH + group_first(m)];
+            tsan_counter(&lh->num_hash_comps);
+            if (n1->hash != hash)
+                continue;
+            tsan_counter(&lh->num_comp_calls);
+            if (cf(n1->data, data) == 0)
+                return n1;
         }
-        tsan_counter(&lh->num_comp_calls);
-        if (cf(n1->data, data) == 0)
-            break;
-        ret = &(n1->next);
+        if (group_match_empty(grp) != 0)
+            return NULL;
+        g = (g + ++step) & mask;
     }
-    return ret;
 }
 
 /*
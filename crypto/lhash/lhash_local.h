@@ -1,5 +1,5 @@
 /*
- * Copyright 1995-2018 The OpenSSL Project Authors. All Rights Reserved.
+ * Copyright 1995-2021 The OpenSSL Project Authors. All Rights Reserved.
  *
  * Licensed under the Apache License 2.0 (the "License").  You may not use
  * this file except in compliance with the License.  You can obtain a copy
@@ -10,21 +10,24 @@
 
 #include "internal/tsan_assist.h"
 
+/*
+ * Slots are grouped into LH_GROUP_WIDTH consecutive entries whose control
+ * bytes are probed together as one 64-bit word.
+ */
+# define LH_GROUP_WIDTH  8
+
 struct lhash_node_st {
     void *data;
-    struct lhash_node_st *next;
     unsigned long hash;
 };
 
 struct lhash_st {
-    OPENSSL_LH_NODE **b;
+    unsigned char *ctrl;        /* one control byte per slot */
+    OPENSSL_LH_NODE *b;         /* the slots */
     OPENSSL_LH_COMPFUNC comp;
     OPENSSL_LH_HASHFUNC hash;
-    unsigned int num_nodes;
-    unsigned int num_alloc_nodes;
-    unsigned int p;
-    unsigned int pmax;
-    unsigned long up_load;      /* load times 256 */
+    unsigned int num_nodes;     /* number of slots, a power of two */
+    unsigned int growth_left;   /* empty slots usable before a resize */
     unsigned long down_load;    /* load times 256 */
     unsigned long num_items;
     unsigned long num_expands;
@@ -0,0 +1,339 @@
+/*
+ * Copyright 2021 The OpenSSL Project Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License 2.0 (the "License").  You may not use
+ * this file except in compliance with the License.  You can obtain a copy
+ * in the file LICENSE in the source distribution or at
+ * https://www.openssl.org/source/license.html
+ */
+
+#include <string.h>
+#include <openssl/crypto.h>
+#include "crypto/cryptlib.h"
+#include "internal/thread_once.h"
+#include "internal/mem_pool.h"
+
+/*
+ * Each thread keeps up to POOL_CACHE_SIZE free objects of every type.  When
+ * its cache runs full, half of it goes to a shared depot for the type, and
+ * an empty cache is refilled from there, so that objects freed by one thread
+ * can be reused by another.  The depot is bounded, anything beyond that is
+ * given back to the system.  Objects in the depot are linked through their
+ * first word.
+ *
+ * The per-thread caches need native thread local variables.  Without them
+ * pooling is never enabled.
+ *
+ * Each thread counts what happens in its caches.  Only the thread itself
+ * updates its counters, so that counting needs no atomic read-modify-write
+ * operations.  The caches of running threads are linked into a list, so
+ * that CRYPTO_get_mem_pool_stats() can add up their counters, together with
+ * those of the threads that have already stopped.
+ */
+
+#if defined(OSSL_THREAD_LOCAL)
+# define POOL_LOCAL OSSL_THREAD_LOCAL
+#elif !defined(OPENSSL_THREADS)
+# define POOL_LOCAL
+#endif
+
+#define POOL_CACHE_SIZE     32
+#define POOL_DEPOT_MAX      4096
+
+/* Other threads may read a counter while its owner updates it */
+#if defined(__GNUC__) && defined(__ATOMIC_RELAXED) \
+    && defined(__GCC_ATOMIC_LLONG_LOCK_FREE) && __GCC_ATOMIC_LLONG_LOCK_FREE >= 2
+# define pool_stat_inc(p) \
+    __atomic_store_n((p), __atomic_load_n((p), __ATOMIC_RELAXED) + 1, \
+                     __ATOMIC_RELAXED)
+# define pool_stat_get(p)   __atomic_load_n((p), __ATOMIC_RELAXED)
+#else
+# define pool_stat_inc(p)   (++*(p))
+# define pool_stat_get(p)   (*(p))
+#endif
+
+typedef struct {
+    int num;
+    void *obj[POOL_CACHE_SIZE];
+    OSSL_POOL_STATS stats;
+} POOL_CACHE;
+
+typedef struct pool_thread_st POOL_THREAD;
+
+struct pool_thread_st {
+    POOL_CACHE cache[OSSL_POOL_NUM];
+    POOL_THREAD *next;
+    POOL_THREAD **pprev;
+};
+
+typedef struct {
+    CRYPTO_RWLOCK *lock;
+    void *head;
+    size_t num;
+    OSSL_POOL_STATS stats;      /* of stopped threads, see pool_threads */
+} POOL_DEPOT;
+
+static POOL_DEPOT depot[OSSL_POOL_NUM];
+
+/* Protects the list of running threads and the counters of stopped ones */
+static CRYPTO_RWLOCK *pool_threads_lock;
+static POOL_THREAD *pool_threads;
+
+/* 0: not yet initialised, 1: enabled, -1: disabled */
+static int pool_state;
+static CRYPTO_ONCE pool_once = CRYPTO_ONCE_STATIC_INIT;
+
+#ifdef POOL_LOCAL
+static POOL_LOCAL POOL_THREAD *pool_thread;
+#endif
+
+DEFINE_RUN_ONCE_STATIC(do_pool_init)
+{
+    const char *env;
+    size_t i;
+#ifdef OPENSSL_NO_MEM_POOL
+    int enable = 0;
+#else
+    int enable = 1;
+#endif
+
+    if ((env = ossl_safe_getenv("OPENSSL_MEM_POOL")) != NULL)
+        enable = atoi(env) != 0;
+#ifndef POOL_LOCAL
+    enable = 0;
+#endif
+    if (!enable || !OPENSSL_init_crypto(OPENSSL_INIT_BASE_ONLY, NULL)
+            || (pool_threads_lock = CRYPTO_THREAD_lock_new()) == NULL) {
+        pool_state = -1;
+        return 1;
+    }
+
+    for (i = 0; i < OSSL_POOL_NUM; i++)
+        if ((depot[i].lock = CRYPTO_THREAD_lock_new()) == NULL) {
+            while (i-- > 0) {
+                CRYPTO_THREAD_lock_free(depot[i].lock);
+                depot[i].lock = NULL;
+            }
+            CRYPTO_THREAD_lock_free(pool_threads_lock);
+            pool_threads_lock = NULL;
+            pool_state = -1;
+            return 1;
+        }
+    pool_state = 1;
+    return 1;
+}
+
+static ossl_inline int pool_enabled(void)
+{
+    if (pool_state == 0)
+        RUN_ONCE(&pool_once, do_pool_init);
+    return pool_state > 0;
+}
+
+static void stats_add(OSSL_POOL_STATS *to, const OSSL_POOL_STATS *from)
+{
+    to->allocs += pool_stat_get(&from->allocs);
+    to->reused += pool_stat_get(&from->reused);
+    to->frees += pool_stat_get(&from->frees);
+    to->released += pool_stat_get(&from->released);
+}
+
+/* Move |n| objects from the end of |c| to the depot, or free them */
+static void pool_drain(OSSL_POOL_ID id, POOL_CACHE *c, int n)
+{
+    POOL_DEPOT *d = &depot[id];
+    void *obj;
+
+    if (!CRYPTO_THREAD_write_lock(d->lock))
+        return;
+    for (; n > 0 && d->num < POOL_DEPOT_MAX; n--, d->num++) {
+        obj = c->obj[--c->num];
+        *(void **)obj = d->head;
+        d->head = obj;
+    }
+    CRYPTO_THREAD_unlock(d->lock);
+
+    for (; n > 0; n--) {
+        OPENSSL_free(c->obj[--c->num]);
+        pool_stat_inc(&c->stats.released);
+    }
+}
+
+static void pool_refill(OSSL_POOL_ID id, POOL_CACHE *c)
+{
+    POOL_DEPOT *d = &depot[id];
+    void *obj;
+
+    if (!CRYPTO_THREAD_write_lock(d->lock))
+        return;
+    while (c->num < POOL_CACHE_SIZE / 2 && (obj = d->head) != NULL) {
+        d->head = *(void **)obj;
+        d->num--;
+        c->obj[c->num++] = obj;
+    }
+    CRYPTO_THREAD_unlock(d->lock);
+}
+
+#ifdef POOL_LOCAL
+static void pool_thread_stop(void *arg)
+{
+    POOL_THREAD *t = pool_thread;
+    size_t i;
+
+    if (t == NULL)
+        return;
+    pool_thread = NULL;
+    if (pool_state <= 0) {
+        for (i = 0; i < OSSL_POOL_NUM; i++)
+            while (t->cache[i].num > 0)
+                OPENSSL_free(t->cache[i].obj[--t->cache[i].num]);
+        OPENSSL_free(t);
+        return;
+    }
+    for (i = 0; i < OSSL_POOL_NUM; i++)
+        pool_drain(i, &t->cache[i], t->cache[i].num);
+    if (CRYPTO_THREAD_write_lock(pool_threads_lock)) {
+        for (i = 0; i < OSSL_POOL_NUM; i++)
+            stats_add(&depot[i].stats, &t->cache[i].stats);
+        *t->pprev = t->next;
+        if (t->next != NULL)
+            t->next->pprev = t->pprev;
+        CRYPTO_THREAD_unlock(pool_threads_lock);
+    }
+    OPENSSL_free(t);
+}
+
+static POOL_THREAD *pool_thread_get(void)
+{
+    POOL_THREAD *t = pool_thread;
+
+    if (t != NULL)
+        return t;
+    if ((t = OPENSSL_zalloc(sizeof(*t))) == NULL)
+        return NULL;
+    if (!CRYPTO_THREAD_write_lock(pool_threads_lock)) {
+        OPENSSL_free(t);
+        return NULL;
+    }
+    if (!ossl_init_thread_start(NULL, NULL, pool_thread_stop)) {
+        CRYPTO_THREAD_unlock(pool_threads_lock);
+        OPENSSL_free(t);
+        return NULL;
+    }
+    t->next = pool_threads;
+    if (t->next != NULL)
+        t->next->pprev = &t->next;
+    t->pprev = &pool_threads;
+    pool_threads = t;
+    CRYPTO_THREAD_unlock(pool_threads_lock);
+    pool_thread = t;
+    return t;
+}
+#endif
+
+void *ossl_pool_zalloc_int(OSSL_POOL_ID id, size_t num,
+                           const char *file, int line)
+{
+#ifdef POOL_LOCAL
+    POOL_THREAD *t;
+    POOL_CACHE *c;
+    void *ret;
+
+    if (!pool_enabled() || (t = pool_thread_get()) == NULL)
+        return CRYPTO_zalloc(num, file, line);
+
+    c = &t->cache[id];
+    pool_stat_inc(&c->stats.allocs);
+    if (c->num == 0)
+        pool_refill(id, c);
+    if (c->num == 0)
+        return CRYPTO_zalloc(num, file, line);
+    pool_stat_inc(&c->stats.reused);
+    ret = c->obj[--c->num];
+    memset(ret, 0, num);
+    return ret;
+#else
+    return CRYPTO_zalloc(num, file, line);
+#endif
+}
+
+void ossl_pool_free_int(OSSL_POOL_ID id, void *addr,
+                        const char *file, int line)
+{
+#ifdef POOL_LOCAL
+    POOL_THREAD *t;
+    POOL_CACHE *c;
+
+    if (addr == NULL)
+        return;
+    /* Only pool objects in threads that have allocated pooled ones */
+    if (pool_state <= 0 || (t = pool_thread) == NULL) {
+        CRYPTO_free(addr, file, line);
+        return;
+    }
+
+    c = &t->cache[id];
+    pool_stat_inc(&c->stats.frees);
+    if (c->num == POOL_CACHE_SIZE)
+        pool_drain(id, c, POOL_CACHE_SIZE / 2);
+    c->obj[c->num++] = addr;
+#else
+    CRYPTO_free(addr, file, line);
+#endif
+}
+
+/*
+ * The statistics cover all threads, running or stopped.  Those of running
+ * threads may be slightly behind.
+ */
+int CRYPTO_get_mem_pool_stats(int pool, uint64_t *allocs, uint64_t *reused,
+                              uint64_t *frees, uint64_t *released)
+{
+    OSSL_POOL_STATS stats;
+    POOL_THREAD *t;
+
+    memset(&stats, 0, sizeof(stats));
+    if (pool < 0 || pool >= OSSL_POOL_NUM || !pool_enabled()
+            || !CRYPTO_THREAD_read_lock(pool_threads_lock))
+        return 0;
+    stats_add(&stats, &depot[pool].stats);
+    for (t = pool_threads; t != NULL; t = t->next)
+        stats_add(&stats, &t->cache[pool].stats);
+    CRYPTO_THREAD_unlock(pool_threads_lock);
+
+    if (allocs != NULL)
+        *allocs = stats.allocs;
+    if (reused != NULL)
+        *reused = stats.reused;
+    if (frees != NULL)
+        *frees = stats.frees;
+    if (released != NULL)
+        *released = stats.released;
+    return 1;
+}
+
+/*
+ * Called by OPENSSL_cleanup() once the calling thread has been stopped.
+ * From then on pooling is disabled.
+ */
+void ossl_pool_cleanup(void)
+{
+    void *obj;
+    size_t i;
+
+    if (pool_state <= 0)
+        return;
+    pool_state = -1;
+    for (i = 0; i < OSSL_POOL_NUM; i++) {
+        while ((obj = depot[i].head) != NULL) {
+            depot[i].head = *(void **)obj;
+            OPENSSL_free(obj);
+        }
+        depot[i].num = 0;
+        CRYPTO_THREAD_lock_free(depot[i].lock);
+        depot[i].lock = NULL;
+    }
+    CRYPTO_THREAD_lock_free(pool_threads_lock);
+    pool_threads_lock = NULL;
+    pool_threads = NULL;
+}
@@ -1,5 +1,5 @@
 /*
- * Copyright 2015-2020 The OpenSSL Project Authors. All Rights Reserved.
+ * Copyright 2015-2021 The OpenSSL Project Authors. All Rights Reserved.
  * Copyright 2004-2014, Akamai Technologies. All Rights Reserved.
  *
  * Licensed under the Apache License 2.0 (the "License").  You may not use
@@ -17,6 +17,8 @@
  */
 #include "e_os.h"
 #include <openssl/crypto.h>
+#include "internal/cryptlib.h"
+#include "crypto/cryptlib.h"
 
 #include <string.h>
 
@@ -60,21 +62,52 @@
 #endif
 
 #ifndef OPENSSL_NO_SECURE_MEMORY
+/*
+ * With atomic arithmetic on the usage counter, the heap can be split into
+ * several arenas that each have their own lock, and threads can keep a few
+ * recently freed chunks for themselves.  Otherwise everything is serialised
+ * by the lock of a single arena.
+ */
+# if defined(__GNUC__) && defined(__ATOMIC_RELAXED)
+#  define SH_ATOMICS
+#  if defined(OSSL_THREAD_LOCAL)
+#   define SH_CACHE
+#  endif
+# endif
+
 static size_t secure_mem_used;
 
 static int secure_mem_initialized;
 
-static CRYPTO_RWLOCK *sec_malloc_lock = NULL;
-
 /*
  * These are the functions that must be implemented by a secure heap (sh).
  */
 static int sh_init(size_t size, size_t minsize);
-static void *sh_malloc(size_t size);
-static void sh_free(void *ptr);
+static void *sh_malloc(size_t size, size_t *actual_size);
+static size_t sh_release(void *ptr);
 static void sh_done(void);
-static size_t sh_actual_size(char *ptr);
+static size_t sh_size(void *ptr);
 static int sh_allocated(const char *ptr);
+static void sh_cache_flush(void);
+static int sh_cache_empty(void);
+
+static ossl_inline void secure_mem_used_add(size_t num)
+{
+# ifdef SH_ATOMICS
+    __atomic_add_fetch(&secure_mem_used, num, __ATOMIC_RELAXED);
+# else
+    secure_mem_used += num;
+# endif
+}
+
+static ossl_inline void secure_mem_used_sub(size_t num)
+{
+# ifdef SH_ATOMICS
+    __atomic_sub_fetch(&secure_mem_used, num, __ATOMIC_RELAXED);
+# else
+    secure_mem_used -= num;
+# endif
+}
 #endif
 
 int CRYPTO_secure_malloc_init(size_t size, size_t minsize)
@@ -83,15 +116,8 @@ int CRYPTO_secure_malloc_init(size_t size, size_t minsize)
     int ret = 0;
 
     if (!secure_mem_initialized) {
-        sec_malloc_lock = CRYPTO_THREAD_lock_new();
-        if (sec_malloc_lock == NULL)
-            return 0;
-        if ((ret = sh_init(size, minsize)) != 0) {
+        if ((ret = sh_init(size, minsize)) != 0)
             secure_mem_initialized = 1;
-        } else {
-            CRYPTO_THREAD_lock_free(sec_malloc_lock);
-            sec_malloc_lock = NULL;
-        }
     }
 
     return ret;
@@ -103,11 +129,10 @@ int CRYPTO_secure_malloc_init(size_t size, size_t minsize)
 int CRYPTO_secure_malloc_done(void)
 {
 #ifndef OPENSSL_NO_SECURE_MEMORY
-    if (secure_mem_used == 0) {
+    sh_cache_flush();
+    if (CRYPTO_secure_used() == 0 && sh_cache_empty()) {
         sh_done();
         secure_mem_initialized = 0;
-        CRYPTO_THREAD_lock_free(sec_malloc_lock);
-        sec_malloc_lock = NULL;
         return 1;
     }
 #endif /* OPENSSL_NO_SECURE_MEMORY */
@@ -132,11 +157,9 @@ void *CRYPTO_secure_malloc(size_t num, const char *file, int line)
     if (!secure_mem_initialized) {
         return CRYPTO_malloc(num, file, line);
     }
-    CRYPTO_THREAD_write_lock(sec_malloc_lock);
-    ret = sh_malloc(num);
-    actual_size = ret ? sh_actual_size(ret) : 0;
-    secure_mem_used += actual_size;
-    CRYPTO_THREAD_unlock(sec_malloc_lock);
+    ret = sh_malloc(num, &actual_size);
+    if (ret != NULL)
+        secure_mem_used_add(actual_size);
     return ret;
 #else
     return CRYPTO_malloc(num, file, line);
@@ -156,20 +179,13 @@ void *CRYPTO_secure_zalloc(size_t num, const char *file, int line)
 void CRYPTO_secure_free(void *ptr, const char *file, int line)
 {
 #ifndef OPENSSL_NO_SECURE_MEMORY
-    size_t actual_size;
-
     if (ptr == NULL)
         return;
     if (!CRYPTO_secure_allocated(ptr)) {
         CRYPTO_free(ptr, file, line);
         return;
     }
-    CRYPTO_THREAD_write_lock(sec_malloc_lock);
-    actual_size = sh_actual_size(ptr);
-    CLEAR(ptr, actual_size);
-    secure_mem_used -= actual_size;
-    sh_free(ptr);
-    CRYPTO_THREAD_unlock(sec_malloc_lock);
+    secure_mem_used_sub(sh_release(ptr));
 #else
     CRYPTO_free(ptr, file, line);
 #endif /* OPENSSL_NO_SECURE_MEMORY */
@@ -179,8 +195,6 @@ void CRYPTO_secure_clear_free(void *ptr, size_t num,
                               const char *file, int line)
 {
 #ifndef OPENSSL_NO_SECURE_MEMORY
-    size_t actual_size;
-
     if (ptr == NULL)
         return;
     if (!CRYPTO_secure_allocated(ptr)) {
@@ -188,12 +202,7 @@ void CRYPTO_secure_clear_free(void *ptr, size_t num,
         CRYPTO_free(ptr, file, line);
         return;
     }
-    CRYPTO_THREAD_write_lock(sec_malloc_lock);
-    actual_size = sh_actual_size(ptr);
-    CLEAR(ptr, actual_size);
-    secure_mem_used -= actual_size;
-    sh_free(ptr);
-    CRYPTO_THREAD_unlock(sec_malloc_lock);
+    secure_mem_used_sub(sh_release(ptr));
 #else
     if (ptr == NULL)
         return;
@@ -205,14 +214,10 @@ void CRYPTO_secure_clear_free(void *ptr, size_t num,
 int CRYPTO_secure_allocated(const void *ptr)
 {
 #ifndef OPENSSL_NO_SECURE_MEMORY
-    int ret;
-
     if (!secure_mem_initialized)
         return 0;
-    CRYPTO_THREAD_write_lock(sec_malloc_lock);
-    ret = sh_allocated(ptr);
-    CRYPTO_THREAD_unlock(sec_malloc_lock);
-    return ret;
+    /* The bounds of the heap don't change while it is initialised */
+    return sh_allocated(ptr);
 #else
     return 0;
 #endif /* OPENSSL_NO_SECURE_MEMORY */
@@ -221,7 +226,11 @@ int CRYPTO_secure_allocated(const void *ptr)
 size_t CRYPTO_secure_used(void)
 {
 #ifndef OPENSSL_NO_SECURE_MEMORY
+# ifdef SH_ATOMICS
+    return __atomic_load_n(&secure_mem_used, __ATOMIC_RELAXED);
+# else
     return secure_mem_used;
+# endif
 #else
     return 0;
 #endif /* OPENSSL_NO_SECURE_MEMORY */
@@ -230,12 +239,7 @@ size_t CRYPTO_secure_used(void)
 size_t CRYPTO_secure_actual_size(void *ptr)
 {
 #ifndef OPENSSL_NO_SECURE_MEMORY
-    size_t actual_size;
-
-    CRYPTO_THREAD_write_lock(sec_malloc_lock);
-    actual_size = sh_actual_size(ptr);
-    CRYPTO_THREAD_unlock(sec_malloc_lock);
-    return actual_size;
+    return sh_size(ptr);
 #else
     return 0;
 #endif
@@ -254,9 +258,19 @@ size_t CRYPTO_secure_actual_size(void *ptr)
  * (or underruns) and an attempt to read data out of the secure heap.
  * Free'd memory is zero'd or otherwise cleansed.
  *
- * This is a pretty standard buddy allocator.  We keep areas in a multiple
- * of "sh.minsize" units.  The freelist and bitmaps are kept separately,
- * so all (and only) data is kept in the mmap'd heap.
+ * The heap is split into up to SH_MAX_ARENAS equally sized arenas of at
+ * least SH_MIN_ARENA_SIZE bytes, each of which is a pretty standard buddy
+ * allocator with its own lock.  Threads are spread over the arenas, and
+ * only turn to the others when their own one is exhausted.  Allocations
+ * larger than an arena take several whole arenas, up to the entire heap.  We keep areas
+ * in a multiple of "minsize" units.  The freelist and bitmaps are kept
+ * separately, so all (and only) data is kept in the mmap'd heap.
+ *
+ * Each thread also holds on to up to SH_CACHE_DEPTH cleansed chunks of each
+ * of the SH_CACHE_CLASSES smallest sizes that it freed, and hands them out
+ * again without taking any lock.  This needs a table that records the size
+ * of every chunk handed out, so that it can be found without looking at the
+ * bitmaps, which is only kept for arenas of at most SH_MAX_UNITS units.
  *
  * This code assumes eight-bit bytes.  The numbers 3 and 7 are all over the
  * place.
@@ -268,11 +282,28 @@ size_t CRYPTO_secure_actual_size(void *ptr)
 # define SETBIT(t, b)   (t[(b) >> 3] |= (ONE << ((b) & 7)))
 # define CLEARBIT(t, b) (t[(b) >> 3] &= (0xFF & ~(ONE << ((b) & 7))))
 
-#define WITHIN_ARENA(p) \
-    ((char*)(p) >= sh.arena && (char*)(p) < &sh.arena[sh.arena_size])
-#define WITHIN_FREELIST(p) \
-    ((char*)(p) >= (char*)sh.freelist && (char*)(p) < (char*)&sh.freelist[sh.freelist_size])
+#define WITHIN_ARENA(a, p) \
+    ((char*)(p) >= (a)->arena && (char*)(p) < &(a)->arena[(a)->arena_size])
+#define WITHIN_FREELIST(a, p) \
+    ((char*)(p) >= (char*)(a)->freelist && (char*)(p) < (char*)&(a)->freelist[(a)->freelist_size])
+
+# define SH_MAX_ARENAS          8
+# define SH_MIN_ARENA_SIZE      (256 * 1024)
+# define SH_CACHE_CLASSES       6
+# define SH_CACHE_DEPTH         8
+# define SH_MAX_UNITS           (ONE << 20)
 
+/*
+ * The chunk lists and spans are written with the arena locked, and read
+ * without it by the owner of the chunk.
+ */
+# ifdef SH_ATOMICS
+#  define SH_LOAD(p)        __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#  define SH_STORE(p, v)    __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+# else
+#  define SH_LOAD(p)        (*(p))
+#  define SH_STORE(p, v)    (*(p) = (v))
+# endif
 
 typedef struct sh_list_st
 {
@@ -280,10 +311,9 @@ typedef struct sh_list_st
     struct sh_list_st **p_next;
 } SH_LIST;
 
-typedef struct sh_st
+typedef struct sh_arena_st
 {
-    char* map_result;
-    size_t map_size;
+    CRYPTO_RWLOCK *lock;
     char *arena;
     size_t arena_size;
     char **freelist;
@@ -292,17 +322,62 @@ typedef struct sh_st
     unsigned char *bittable;
     unsigned char *bitmalloc;
     size_t bittable_size; /* size in bits */
+    unsigned char *chunklist; /* freelist index of each chunk, may be NULL */
+} SH_ARENA;
+
+typedef struct sh_st
+{
+    char* map_result;
+    size_t map_size;
+    char *heap;
+    size_t heap_size;
+    int num_arenas;
+    unsigned int generation; /* Changes whenever the heap is created */
+    SH_ARENA arenas[SH_MAX_ARENAS];
+    /* Number of arenas taken by an allocation starting at each arena */
+    unsigned char span[SH_MAX_ARENAS];
 } SH;
 
 static SH sh;
 
-static size_t sh_getlist(char *ptr)
+# ifdef SH_CACHE
+typedef struct sh_cache_st
+{
+    int registered;         /* 1 with a thread stop handler, -1 on failure */
+    int home;               /* Home arena + 1, or 0 if not yet assigned */
+    unsigned int generation;
+    int num[SH_CACHE_CLASSES];
+    char *chunk[SH_CACHE_CLASSES][SH_CACHE_DEPTH];
+} SH_THREAD_CACHE;
+
+static OSSL_THREAD_LOCAL SH_THREAD_CACHE sh_cache;
+static unsigned int sh_next_home;
+/* Number of chunks in the caches of all threads */
+static size_t sh_cached;
+# endif
+
+static ossl_inline SH_ARENA *sh_arena_of(const char *ptr)
 {
-    ossl_ssize_t list = sh.freelist_size - 1;
-    size_t bit = (sh.arena_size + ptr - sh.arena) / sh.minsize;
+    return &sh.arenas[(ptr - sh.heap) / sh.arenas[0].arena_size];
+}
+
+/* Returns the number of arenas |ptr| spans, or 0 if it is within one */
+static ossl_inline int sh_span_of(const char *ptr)
+{
+    size_t offset = ptr - sh.heap;
+
+    if (offset % sh.arenas[0].arena_size != 0)
+        return 0;
+    return SH_LOAD(&sh.span[offset / sh.arenas[0].arena_size]);
+}
+
+static size_t sh_getlist(SH_ARENA *a, char *ptr)
+{
+    ossl_ssize_t list = a->freelist_size - 1;
+    size_t bit = (a->arena_size + ptr - a->arena) / a->minsize;
 
     for (; bit; bit >>= 1, list--) {
-        if (TESTBIT(sh.bittable, bit))
+        if (TESTBIT(a->bittable, bit))
             break;
         OPENSSL_assert((bit & 1) == 0);
     }
@@ -311,51 +386,51 @@ static size_t sh_getlist(char *ptr)
 }
 
 
-static int sh_testbit(char *ptr, int list, unsigned char *table)
+static int sh_testbit(SH_ARENA *a, char *ptr, int list, unsigned char *table)
 {
     size_t bit;
 
-    OPENSSL_assert(list >= 0 && list < sh.freelist_size);
-    OPENSSL_assert(((ptr - sh.arena) & ((sh.arena_size >> list) - 1)) == 0);
-    bit = (ONE << list) + ((ptr - sh.arena) / (sh.arena_size >> list));
-    OPENSSL_assert(bit > 0 && bit < sh.bittable_size);
+    OPENSSL_assert(list >= 0 && list < a->freelist_size);
+    OPENSSL_assert(((ptr - a->arena) & ((a->arena_size >> list) - 1)) == 0);
+    bit = (ONE << list) + ((ptr - a->arena) / (a->arena_size >> list));
+    OPENSSL_assert(bit > 0 && bit < a->bittable_size);
     return TESTBIT(table, bit);
 }
 
-static void sh_clearbit(char *ptr, int list, unsigned char *table)
+static void sh_clearbit(SH_ARENA *a, char *ptr, int list, unsigned char *table)
 {
     size_t bit;
 
-    OPENSSL_assert(list >= 0 && list < sh.freelist_size);
-    OPENSSL_assert(((ptr - sh.arena) & ((sh.arena_size >> list) - 1)) == 0);
-    bit = (ONE << list) + ((ptr - sh.arena) / (sh.arena_size >> list));
-    OPENSSL_assert(bit > 0 && bit < sh.bittable_size);
+    OPENSSL_assert(list >= 0 && list < a->freelist_size);
+    OPENSSL_assert(((ptr - a->arena) & ((a->arena_size >> list) - 1)) == 0);
+    bit = (ONE << list) + ((ptr - a->arena) / (a->arena_size >> list));
+    OPENSSL_assert(bit > 0 && bit < a->bittable_size);
     OPENSSL_assert(TESTBIT(table, bit));
     CLEARBIT(table, bit);
 }
 
-static void sh_setbit(char *ptr, int list, unsigned char *table)
+static void sh_setbit(SH_ARENA *a, char *ptr, int list, unsigned char *table)
 {
     size_t bit;
 
-    OPENSSL_assert(list >= 0 && list < sh.freelist_size);
-    OPENSSL_assert(((ptr - sh.arena) & ((sh.arena_size >> list) - 1)) == 0);
-    bit = (ONE << list) + ((ptr - sh.arena) / (sh.arena_size >> list));
-    OPENSSL_assert(bit > 0 && bit < sh.bittable_size);
+    OPENSSL_assert(list >= 0 && list < a->freelist_size);
+    OPENSSL_assert(((ptr - a->arena) & ((a->arena_size >> list) - 1)) == 0);
+    bit = (ONE << list) + ((ptr - a->arena) / (a->arena_size >> list));
+    OPENSSL_assert(bit > 0 && bit < a->bittable_size);
     OPENSSL_assert(!TESTBIT(table, bit));
     SETBIT(table, bit);
 }
 
-static void sh_add_to_list(char **list, char *ptr)
+static void sh_add_to_list(SH_ARENA *a, char **list, char *ptr)
 {
     SH_LIST *temp;
 
-    OPENSSL_assert(WITHIN_FREELIST(list));
-    OPENSSL_assert(WITHIN_ARENA(ptr));
+    OPENSSL_assert(WITHIN_FREELIST(a, list));
+    OPENSSL_assert(WITHIN_ARENA(a, ptr));
 
     temp = (SH_LIST *)ptr;
     temp->next = *(SH_LIST **)list;
-    OPENSSL_assert(temp->next == NULL || WITHIN_ARENA(temp->next));
+    OPENSSL_assert(temp->next == NULL || WITHIN_ARENA(a, temp->next));
     temp->p_next = (SH_LIST **)list;
 
     if (temp->next != NULL) {
@@ -366,7 +441,7 @@ static void sh_add_to_list(char **list, char *ptr)
     *list = ptr;
 }
 
-static void sh_remove_from_list(char *ptr)
+static void sh_remove_from_list(SH_ARENA *a, char *ptr)
 {
     SH_LIST *temp, *temp2;
 
@@ -378,22 +453,80 @@ static void sh_remove_from_list(char *ptr)
         return;
 
     temp2 = temp->next;
-    OPENSSL_assert(WITHIN_FREELIST(temp2->p_next) || WITHIN_ARENA(temp2->p_next));
+    OPENSSL_assert(WITHIN_FREELIST(a, temp2->p_next)
+                   || WITHIN_ARENA(a, temp2->p_next));
 }
 
+static void sh_arena_done(SH_ARENA *a)
+{
+    OPENSSL_free(a->freelist);
+    OPENSSL_free(a->bittable);
+    OPENSSL_free(a->bitmalloc);
+    OPENSSL_free(a->chunklist);
+    CRYPTO_THREAD_lock_free(a->lock);
+    memset(a, 0, sizeof(*a));
+}
 
-static int sh_init(size_t size, size_t minsize)
+static int sh_arena_init(SH_ARENA *a, char *arena, size_t size,
+                         size_t minsize)
 {
-    int ret;
     size_t i;
+
+    a->arena = arena;
+    a->arena_size = size;
+    a->minsize = minsize;
+    a->bittable_size = (a->arena_size / a->minsize) * 2;
+
+    /* Prevent allocations of size 0 later on */
+    if (a->bittable_size >> 3 == 0)
+        return 0;
+
+    a->freelist_size = -1;
+    for (i = a->bittable_size; i; i >>= 1)
+        a->freelist_size++;
+
+    a->freelist = OPENSSL_zalloc(a->freelist_size * sizeof(char *));
+    OPENSSL_assert(a->freelist != NULL);
+    if (a->freelist == NULL)
+        return 0;
+
+    a->bittable = OPENSSL_zalloc(a->bittable_size >> 3);
+    OPENSSL_assert(a->bittable != NULL);
+    if (a->bittable == NULL)
+        return 0;
+
+    a->bitmalloc = OPENSSL_zalloc(a->bittable_size >> 3);
+    OPENSSL_assert(a->bitmalloc != NULL);
+    if (a->bitmalloc == NULL)
+        return 0;
+
+# ifdef SH_CACHE
+    /* Without it, chunks are simply not cached */
+    if (a->arena_size / a->minsize <= SH_MAX_UNITS)
+        a->chunklist = OPENSSL_zalloc(a->arena_size / a->minsize);
+# endif
+
+    if ((a->lock = CRYPTO_THREAD_lock_new()) == NULL)
+        return 0;
+
+    sh_setbit(a, a->arena, 0, a->bittable);
+    sh_add_to_list(a, &a->freelist[0], a->arena);
+    return 1;
+}
+
+static int sh_init(size_t size, size_t minsize)
+{
+    int ret, i;
     size_t pgsize;
     size_t aligned;
+    unsigned int generation = sh.generation;
 #if defined(_WIN32)
     DWORD flOldProtect;
     SYSTEM_INFO systemInfo;
 #endif
 
     memset(&sh, 0, sizeof(sh));
+    sh.generation = generation;
 
     /* make sure size is a powers of 2 */
     OPENSSL_assert(size > 0);
@@ -423,32 +556,13 @@ static int sh_init(size_t size, size_t minsize)
               goto err;
     }
 
-    sh.arena_size = size;
-    sh.minsize = minsize;
-    sh.bittable_size = (sh.arena_size / sh.minsize) * 2;
-
-    /* Prevent allocations of size 0 later on */
-    if (sh.bittable_size >> 3 == 0)
-        goto err;
-
-    sh.freelist_size = -1;
-    for (i = sh.bittable_size; i; i >>= 1)
-        sh.freelist_size++;
-
-    sh.freelist = OPENSSL_zalloc(sh.freelist_size * sizeof(char *));
-    OPENSSL_assert(sh.freelist != NULL);
-    if (sh.freelist == NULL)
-        goto err;
-
-    sh.bittable = OPENSSL_zalloc(sh.bittable_size >> 3);
-    OPENSSL_assert(sh.bittable != NULL);
-    if (sh.bittable == NULL)
-        goto err;
-
-    sh.bitmalloc = OPENSSL_zalloc(sh.bittable_size >> 3);
-    OPENSSL_assert(sh.bitmalloc != NULL);
-    if (sh.bitmalloc == NULL)
-        goto err;
+    sh.heap_size = size;
+    sh.num_arenas = 1;
+# ifdef SH_ATOMICS
+    while (sh.num_arenas < SH_MAX_ARENAS
+           && size / (sh.num_arenas * 2) >= SH_MIN_ARENA_SIZE)
+        sh.num_arenas *= 2;
+# endif
 
     /* Allocate space for heap, and two extra pages as guards */
 #if defined(_SC_PAGE_SIZE) || defined (_SC_PAGESIZE)
@@ -469,7 +583,7 @@ static int sh_init(size_t size, size_t minsize)
 #else
     pgsize = PAGE_SIZE;
 #endif
-    sh.map_size = pgsize + sh.arena_size + pgsize;
+    sh.map_size = pgsize + sh.heap_size + pgsize;
 
 #if !defined(_WIN32)
 # ifdef MAP_ANON
@@ -496,9 +610,14 @@ static int sh_init(size_t size, size_t minsize)
             goto err;
 #endif
 
-    sh.arena = (char *)(sh.map_result + pgsize);
-    sh_setbit(sh.arena, 0, sh.bittable);
-    sh_add_to_list(&sh.freelist[0], sh.arena);
+    sh.heap = (char *)(sh.map_result + pgsize);
+    for (i = 0; i < sh.num_arenas; i++) {
+        size_t arena_size = sh.heap_size / sh.num_arenas;
+
+        if (!sh_arena_init(&sh.arenas[i], sh.heap + i * arena_size,
+                           arena_size, minsize))
+            goto err;
+    }
 
     /* Now try to add guard pages and lock into memory. */
     ret = 1;
@@ -513,7 +632,7 @@ static int sh_init(size_t size, size_t minsize)
 #endif
 
     /* Ending guard page - need to round up to page boundary */
-    aligned = (pgsize + sh.arena_size + (pgsize - 1)) & ~(pgsize - 1);
+    aligned = (pgsize + sh.heap_size + (pgsize - 1)) & ~(pgsize - 1);
 #if !defined(_WIN32)
     if (mprotect(sh.map_result + aligned, pgsize, PROT_NONE) < 0)
         ret = 2;
@@ -523,26 +642,28 @@ static int sh_init(size_t size, size_t minsize)
 #endif
 
 #if defined(OPENSSL_SYS_LINUX) && defined(MLOCK_ONFAULT) && defined(SYS_mlock2)
-    if (syscall(SYS_mlock2, sh.arena, sh.arena_size, MLOCK_ONFAULT) < 0) {
+    if (syscall(SYS_mlock2, sh.heap, sh.heap_size, MLOCK_ONFAULT) < 0) {
         if (errno == ENOSYS) {
-            if (mlock(sh.arena, sh.arena_size) < 0)
+            if (mlock(sh.heap, sh.heap_size) < 0)
                 ret = 2;
         } else {
             ret = 2;
         }
     }
 #elif defined(_WIN32)
-    if (VirtualLock(sh.arena, sh.arena_size) == FALSE)
+    if (VirtualLock(sh.heap, sh.heap_size) == FALSE)
         ret = 2;
 #else
-    if (mlock(sh.arena, sh.arena_size) < 0)
+    if (mlock(sh.heap, sh.heap_size) < 0)
         ret = 2;
 #endif
 #ifdef MADV_DONTDUMP
-    if (madvise(sh.arena, sh.arena_size, MADV_DONTDUMP) < 0)
+    if (madvise(sh.heap, sh.heap_size, MADV_DONTDUMP) < 0)
         ret = 2;
 #endif
 
+    /* Invalidates chunks that threads still cache from an earlier heap */
+    sh.generation++;
     return ret;
 
  err:
@@ -552,9 +673,11 @@ static int sh_init(size_t size, size_t minsize)
 
 static void sh_done(void)
 {
-    OPENSSL_free(sh.freelist);
-    OPENSSL_free(sh.bittable);
-    OPENSSL_free(sh.bitmalloc);
+    unsigned int generation = sh.generation;
+    int i;
+
+    for (i = 0; i < SH_MAX_ARENAS; i++)
+        sh_arena_done(&sh.arenas[i]);
 #if !defined(_WIN32)
     if (sh.map_result != MAP_FAILED && sh.map_size)
         munmap(sh.map_result, sh.map_size);
@@ -563,118 +686,117 @@ static void sh_done(void)
         VirtualFree(sh.map_result, 0, MEM_RELEASE);
 #endif
     memset(&sh, 0, sizeof(sh));
+    sh.generation = generation;
 }
 
 static int sh_allocated(const char *ptr)
 {
-    return WITHIN_ARENA(ptr) ? 1 : 0;
+    return ptr >= sh.heap && ptr < sh.heap + sh.heap_size ? 1 : 0;
 }
 
-static char *sh_find_my_buddy(char *ptr, int list)
+static char *sh_find_my_buddy(SH_ARENA *a, char *ptr, int list)
 {
     size_t bit;
     char *chunk = NULL;
 
-    bit = (ONE << list) + (ptr - sh.arena) / (sh.arena_size >> list);
+    bit = (ONE << list) + (ptr - a->arena) / (a->arena_size >> list);
     bit ^= 1;
 
-    if (TESTBIT(sh.bittable, bit) && !TESTBIT(sh.bitmalloc, bit))
-        chunk = sh.arena + ((bit & ((ONE << list) - 1)) * (sh.arena_size >> list));
+    if (TESTBIT(a->bittable, bit) && !TESTBIT(a->bitmalloc, bit))
+        chunk = a->arena + ((bit & ((ONE << list) - 1)) * (a->arena_size >> list));
 
     return chunk;
 }
 
-static void *sh_malloc(size_t size)
+static void *sh_arena_malloc(SH_ARENA *a, ossl_ssize_t list)
 {
-    ossl_ssize_t list, slist;
-    size_t i;
+    ossl_ssize_t slist;
     char *chunk;
 
-    if (size > sh.arena_size)
-        return NULL;
-
-    list = sh.freelist_size - 1;
-    for (i = sh.minsize; i < size; i <<= 1)
-        list--;
-    if (list < 0)
-        return NULL;
-
     /* try to find a larger entry to split */
     for (slist = list; slist >= 0; slist--)
-        if (sh.freelist[slist] != NULL)
+        if (a->freelist[slist] != NULL)
             break;
     if (slist < 0)
         return NULL;
 
     /* split larger entry */
     while (slist != list) {
-        char *temp = sh.freelist[slist];
+        char *temp = a->freelist[slist];
 
         /* remove from bigger list */
-        OPENSSL_assert(!sh_testbit(temp, slist, sh.bitmalloc));
-        sh_clearbit(temp, slist, sh.bittable);
-        sh_remove_from_list(temp);
-        OPENSSL_assert(temp != sh.freelist[slist]);
+        OPENSSL_assert(!sh_testbit(a, temp, slist, a->bitmalloc));
+        sh_clearbit(a, temp, slist, a->bittable);
+        sh_remove_from_list(a, temp);
+        OPENSSL_assert(temp != a->freelist[slist]);
 
         /* done with bigger list */
         slist++;
 
         /* add to smaller list */
-        OPENSSL_assert(!sh_testbit(temp, slist, sh.bitmalloc));
-        sh_setbit(temp, slist, sh.bittable);
-        sh_add_to_list(&sh.freelist[slist], temp);
-        OPENSSL_assert(sh.freelist[slist] == temp);
+        OPENSSL_assert(!sh_testbit(a, temp, slist, a->bitmalloc));
+        sh_setbit(a, temp, slist, a->bittable);
+        sh_add_to_list(a, &a->freelist[slist], temp);
+        OPENSSL_assert(a->freelist[slist] == temp);
 
         /* split in 2 */
-        temp += sh.arena_size >> slist;
-        OPENSSL_assert(!sh_testbit(temp, slist, sh.bitmalloc));
-        sh_setbit(temp, slist, sh.bittable);
-        sh_add_to_list(&sh.freelist[slist], temp);
-        OPENSSL_assert(sh.freelist[slist] == temp);
+        temp += a->arena_size >> slist;
+        OPENSSL_assert(!sh_testbit(a, temp, slist, a->bitmalloc));
+        sh_setbit(a, temp, slist, a->bittable);
+        sh_add_to_list(a, &a->freelist[slist], temp);
+        OPENSSL_assert(a->freelist[slist] == temp);
 
-        OPENSSL_assert(temp-(sh.arena_size >> slist) == sh_find_my_buddy(temp, slist));
+        OPENSSL_assert(temp-(a->arena_size >> slist) == sh_find_my_buddy(a, temp, slist));
     }
 
     /* peel off memory to hand back */
-    chunk = sh.freelist[list];
-    OPENSSL_assert(sh_testbit(chunk, list, sh.bittable));
-    sh_setbit(chunk, list, sh.bitmalloc);
-    sh_remove_from_list(chunk);
+    chunk = a->freelist[list];
+    OPENSSL_assert(sh_testbit(a, chunk, list, a->bittable));
+    sh_setbit(a, chunk, list, a->bitmalloc);
+    sh_remove_from_list(a, chunk);
 
-    OPENSSL_assert(WITHIN_ARENA(chunk));
+    OPENSSL_assert(WITHIN_ARENA(a, chunk));
 
     /* zero the free list header as a precaution against information leakage */
     memset(chunk, 0, sizeof(SH_LIST));
 
+    /*
+     * Only the owner of a chunk ever looks at its entry, so the fast paths
+     * may read it without holding the lock
+     */
+    if (a->chunklist != NULL)
+        SH_STORE(&a->chunklist[(chunk - a->arena) / a->minsize],
+                 (unsigned char)list);
+
     return chunk;
 }
 
-static void sh_free(void *ptr)
+static void sh_arena_free(SH_ARENA *a, void *ptr)
 {
     size_t list;
     void *buddy;
 
     if (ptr == NULL)
         return;
-    OPENSSL_assert(WITHIN_ARENA(ptr));
-    if (!WITHIN_ARENA(ptr))
+    OPENSSL_assert(WITHIN_ARENA(a, ptr));
+    if (!WITHIN_ARENA(a, ptr))
         return;
 
-    list = sh_getlist(ptr);
-    OPENSSL_assert(sh_testbit(ptr, list, sh.bittable));
-    sh_clearbit(ptr, list, sh.bitmalloc);
-    sh_add_to_list(&sh.freelist[list], ptr);
+    list = sh_getlist(a, ptr);
+    OPENSSL_assert(sh_testbit(a, ptr, list, a->bittable));
+    sh_clearbit(a, ptr, list, a->bitmalloc);
+    sh_add_to_list(a, &a->freelist[list], ptr);
 
     /* Try to coalesce two adjacent free areas. */
-    while ((buddy = sh_find_my_buddy(ptr, list)) != NULL) {
-        OPENSSL_assert(ptr == sh_find_my_buddy(buddy, list));
+    while ((buddy = sh_find_my_buddy(a, ptr, list)) != NULL) {
+        OPENSSL_assert(ptr == sh_find_my_buddy(a, buddy, list));
         OPENSSL_assert(ptr != NULL);
-        OPENSSL_assert(!sh_testbit(ptr, list, sh.bitmalloc));
-        sh_clearbit(ptr, list, sh.bittable);
-        sh_remove_from_list(ptr);
-        OPENSSL_assert(!sh_testbit(ptr, list, sh.bitmalloc));
-        sh_clearbit(buddy, list, sh.bittable);
-        sh_remove_from_list(buddy);
+        OPENSSL_assert(!sh_testbit(a, ptr, list, a->bitmalloc));
+        sh_clearbit(a, ptr, list, a->bittable);
+        sh_remove_from_list(a, ptr);
+        OPENSSL_assert(!sh_testbit(a, ptr, list, a->bitmalloc));
+        sh_clearbit(a, buddy, list, a->bittable);
+        sh_remove_from_list(a, buddy);
 
         list--;
 
@@ -683,22 +805,286 @@ static void sh_free(void *ptr)
         if (ptr > buddy)
             ptr = buddy;
 
-        OPENSSL_assert(!sh_testbit(ptr, list, sh.bitmalloc));
-        sh_setbit(ptr, list, sh.bittable);
-        sh_add_to_list(&sh.freelist[list], ptr);
-        OPENSSL_assert(sh.freelist[list] == ptr);
+        OPENSSL_assert(!sh_testbit(a, ptr, list, a->bitmalloc));
+        sh_setbit(a, ptr, list, a->bittable);
+        sh_add_to_list(a, &a->freelist[list], ptr);
+        OPENSSL_assert(a->freelist[list] == ptr);
     }
 }
 
-static size_t sh_actual_size(char *ptr)
+/*
+ * Must be called with the arena locked, unless it keeps a chunk list and
+ * the caller owns |ptr|
+ */
+static int sh_arena_getlist(SH_ARENA *a, char *ptr)
 {
     int list;
 
-    OPENSSL_assert(WITHIN_ARENA(ptr));
-    if (!WITHIN_ARENA(ptr))
+    OPENSSL_assert(WITHIN_ARENA(a, ptr));
+    if (!WITHIN_ARENA(a, ptr))
+        return -1;
+    if (a->chunklist != NULL)
+        return SH_LOAD(&a->chunklist[(ptr - a->arena) / a->minsize]);
+    list = sh_getlist(a, ptr);
+    OPENSSL_assert(sh_testbit(a, ptr, list, a->bittable));
+    return list;
+}
+
+# ifdef SH_CACHE
+static void sh_cache_stop(void *arg)
+{
+    sh_cache_flush();
+    sh_cache.registered = 0;
+}
+
+static SH_THREAD_CACHE *sh_cache_get(void)
+{
+    SH_THREAD_CACHE *c = &sh_cache;
+
+    if (c->registered == 0) {
+        if (OPENSSL_init_crypto(OPENSSL_INIT_BASE_ONLY, NULL)
+                && ossl_init_thread_start(NULL, NULL, sh_cache_stop))
+            c->registered = 1;
+        else
+            c->registered = -1;
+    }
+    if (c->registered < 0)
+        return NULL;
+    if (c->generation != sh.generation) {
+        /* Anything cached belongs to an earlier heap */
+        memset(c->num, 0, sizeof(c->num));
+        c->home = 0;
+        c->generation = sh.generation;
+    }
+    return c;
+}
+# endif
+
+/* Returns every cached chunk of this thread to its arena */
+static void sh_cache_flush(void)
+{
+# ifdef SH_CACHE
+    SH_THREAD_CACHE *c = &sh_cache;
+    SH_ARENA *a;
+    char *ptr;
+    int i;
+
+    if (c->registered <= 0 || c->generation != sh.generation
+            || !secure_mem_initialized)
+        return;
+    for (i = 0; i < SH_CACHE_CLASSES; i++) {
+        while (c->num[i] > 0) {
+            ptr = c->chunk[i][--c->num[i]];
+            __atomic_sub_fetch(&sh_cached, 1, __ATOMIC_RELAXED);
+            a = sh_arena_of(ptr);
+            if (!CRYPTO_THREAD_write_lock(a->lock))
+                continue;
+            sh_arena_free(a, ptr);
+            CRYPTO_THREAD_unlock(a->lock);
+        }
+    }
+# endif
+}
+
+/*
+ * Chunks cached by other threads are only given back when they exit.  Until
+ * then the heap is still in use.
+ */
+static int sh_cache_empty(void)
+{
+# ifdef SH_CACHE
+    return __atomic_load_n(&sh_cached, __ATOMIC_RELAXED) == 0;
+# else
+    return 1;
+# endif
+}
+
+/*
+ * Allocations larger than an arena take a run of whole free arenas, aligned
+ * as a buddy of that size would be.  All arenas are locked meanwhile, always
+ * in ascending order.
+ */
+static void *sh_malloc_span(size_t size, size_t *actual_size)
+{
+    size_t arena_size = sh.arenas[0].arena_size;
+    int span, locked, i, n;
+    char *chunk = NULL;
+
+    for (span = 1; span < sh.num_arenas && span * arena_size < size; span <<= 1)
+        continue;
+    if (span * arena_size < size)
+        return NULL;
+
+    for (locked = 0; locked < sh.num_arenas; locked++)
+        if (!CRYPTO_THREAD_write_lock(sh.arenas[locked].lock))
+            goto end;
+    for (i = 0; i < sh.num_arenas && chunk == NULL; i += span) {
+        /* An arena is all free if its first freelist holds the whole arena */
+        for (n = 0; n < span; n++)
+            if (sh.arenas[i + n].freelist[0] == NULL)
+                break;
+        if (n < span)
+            continue;
+        for (n = 0; n < span; n++)
+            sh_arena_malloc(&sh.arenas[i + n], 0);
+        SH_STORE(&sh.span[i], (unsigned char)span);
+        chunk = sh.arenas[i].arena;
+        *actual_size = span * arena_size;
+    }
+ end:
+    while (locked-- > 0)
+        CRYPTO_THREAD_unlock(sh.arenas[locked].lock);
+    return chunk;
+}
+
+static size_t sh_release_span(char *ptr, int span)
+{
+    size_t actual_size = span * sh.arenas[0].arena_size;
+    int first = (int)((ptr - sh.heap) / sh.arenas[0].arena_size), n, locked;
+
+    CLEAR(ptr, actual_size);
+    for (locked = 0; locked < span; locked++)
+        if (!CRYPTO_THREAD_write_lock(sh.arenas[first + locked].lock))
+            break;
+    if (locked == span) {
+        SH_STORE(&sh.span[first], 0);
+        for (n = 0; n < span; n++)
+            sh_arena_free(&sh.arenas[first + n], sh.arenas[first + n].arena);
+    } else {
+        actual_size = 0;
+    }
+    while (locked-- > 0)
+        CRYPTO_THREAD_unlock(sh.arenas[first + locked].lock);
+    return actual_size;
+}
+
+static void *sh_malloc(size_t size, size_t *actual_size)
+{
+    SH_ARENA *a;
+    ossl_ssize_t list;
+    size_t i;
+    int home = 0, n, retry;
+    void *chunk = NULL;
+# ifdef SH_CACHE
+    SH_THREAD_CACHE *c = NULL;
+    int cl;
+# endif
+
+    if (size > sh.arenas[0].arena_size) {
+        if ((chunk = sh_malloc_span(size, actual_size)) == NULL) {
+            /* Cached chunks may be what's keeping the arenas from being free */
+            sh_cache_flush();
+            chunk = sh_malloc_span(size, actual_size);
+        }
+        return chunk;
+    }
+
+    list = sh.arenas[0].freelist_size - 1;
+    for (i = sh.arenas[0].minsize; i < size; i <<= 1)
+        list--;
+    if (list < 0)
+        return NULL;
+    *actual_size = sh.arenas[0].arena_size >> list;
+
+# ifdef SH_CACHE
+    /* Cached chunks have been cleansed when they were freed */
+    cl = (int)(sh.arenas[0].freelist_size - 1 - list);
+    if (sh.arenas[0].chunklist != NULL && (c = sh_cache_get()) != NULL) {
+        if (cl < SH_CACHE_CLASSES && c->num[cl] > 0) {
+            __atomic_sub_fetch(&sh_cached, 1, __ATOMIC_RELAXED);
+            return c->chunk[cl][--c->num[cl]];
+        }
+        if (c->home == 0)
+            c->home = 1 + (int)(__atomic_fetch_add(&sh_next_home, 1,
+                                                   __ATOMIC_RELAXED)
+                                % sh.num_arenas);
+        home = c->home - 1;
+    }
+# endif
+
+    /* Try our home arena first, then the others */
+    for (retry = 0; retry < 2 && chunk == NULL; retry++) {
+        for (n = 0; n < sh.num_arenas && chunk == NULL; n++) {
+            a = &sh.arenas[(home + n) % sh.num_arenas];
+            if (!CRYPTO_THREAD_write_lock(a->lock))
+                continue;
+            chunk = sh_arena_malloc(a, list);
+            CRYPTO_THREAD_unlock(a->lock);
+        }
+        /* Cached chunks may be what's keeping the allocation from working */
+        if (chunk == NULL)
+            sh_cache_flush();
+    }
+    return chunk;
+}
+
+/* Cleanses and releases |ptr|, and returns its size */
+static size_t sh_release(void *ptr)
+{
+    SH_ARENA *a = sh_arena_of(ptr);
+    size_t actual_size;
+    int list, span;
+# ifdef SH_CACHE
+    SH_THREAD_CACHE *c;
+    int cl;
+# endif
+
+    if ((span = sh_span_of(ptr)) > 1)
+        return sh_release_span(ptr, span);
+# ifdef SH_CACHE
+
+    if (a->chunklist != NULL) {
+        if ((list = sh_arena_getlist(a, ptr)) < 0)
+            return 0;
+        actual_size = a->arena_size >> list;
+        CLEAR(ptr, actual_size);
+        cl = (int)(a->freelist_size - 1 - list);
+        if (cl < SH_CACHE_CLASSES && (c = sh_cache_get()) != NULL
+                && c->num[cl] < SH_CACHE_DEPTH) {
+            c->chunk[cl][c->num[cl]++] = ptr;
+            __atomic_add_fetch(&sh_cached, 1, __ATOMIC_RELAXED);
+            return actual_size;
+        }
+        if (CRYPTO_THREAD_write_lock(a->lock)) {
+            sh_arena_free(a, ptr);
+            CRYPTO_THREAD_unlock(a->lock);
+        }
+        return actual_size;
+    }
+# endif
+
+    if (!CRYPTO_THREAD_write_lock(a->lock))
         return 0;
-    list = sh_getlist(ptr);
-    OPENSSL_assert(sh_testbit(ptr, list, sh.bittable));
-    return sh.arena_size / (ONE << list);
+    if ((list = sh_arena_getlist(a, ptr)) < 0) {
+        CRYPTO_THREAD_unlock(a->lock);
+        return 0;
+    }
+    actual_size = a->arena_size >> list;
+    CLEAR(ptr, actual_size);
+    sh_arena_free(a, ptr);
+    CRYPTO_THREAD_unlock(a->lock);
+    return actual_size;
+}
+
+static size_t sh_size(void *ptr)
+{
+    SH_ARENA *a;
+    int list, span;
+
+    OPENSSL_assert(sh_allocated(ptr));
+    if (!sh_allocated(ptr))
+        return 0;
+    if ((span = sh_span_of(ptr)) > 1)
+        return span * sh.arenas[0].arena_size;
+    a = sh_arena_of(ptr);
+    if (a->chunklist != NULL) {
+        list = sh_arena_getlist(a, ptr);
+    } else {
+        if (!CRYPTO_THREAD_write_lock(a->lock))
+            return 0;
+        list = sh_arena_getlist(a, ptr);
+        CRYPTO_THREAD_unlock(a->lock);
+    }
+    return list < 0 ? 0 : a->arena_size >> list;
 }
 #endif /* OPENSSL_NO_SECURE_MEMORY */
@@ -0,0 +1,289 @@
+/*
+ * Copyright 2021 The OpenSSL Project Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License 2.0 (the "License").  You may not use
+ * this file except in compliance with the License.  You can obtain a copy
+ * in the file LICENSE in the source distribution or at
+ * https://www.openssl.org/source/license.html
+ */
+
+#include "e_os.h"
+#include <string.h>
+#include <time.h>
+#include <openssl/bio.h>
+#include <openssl/metrics.h>
+#include "internal/nelem.h"
+#include "internal/cryptlib.h"
+#include "internal/metrics.h"
+
+#if defined(_WIN32)
+# include <windows.h>
+#elif defined(OPENSSL_SYS_UNIX)
+# include <unistd.h>
+# include <sys/time.h>
+/* See rand_unix.c for why older glibc versions are excluded */
+# if defined(_POSIX_TIMERS) && _POSIX_TIMERS > 0 \
+     && defined(_POSIX_MONOTONIC_CLOCK)
+#  if defined(__GLIBC__)
+#   if defined(__GLIBC_PREREQ)
+#    if __GLIBC_PREREQ(2, 17)
+#     define METRIC_MONOTONIC_CLOCK
+#    endif
+#   endif
+#  else
+#   define METRIC_MONOTONIC_CLOCK
+#  endif
+# endif
+#endif
+
+/*
+ * The counters are updated atomically where the platform can do that for 64
+ * bit integers without a lock.  Elsewhere concurrent updates may get lost,
+ * like with the statistics counters of tsan_assist.h.
+ */
+#if defined(__GNUC__) && defined(__ATOMIC_RELAXED) \
+    && defined(__GCC_ATOMIC_LLONG_LOCK_FREE) && __GCC_ATOMIC_LLONG_LOCK_FREE >= 2
+# define metric_inc(p)      __atomic_fetch_add((p), 1, __ATOMIC_RELAXED)
+# define metric_load(p)     __atomic_load_n((p), __ATOMIC_RELAXED)
+# define metric_store(p, v) __atomic_store_n((p), (v), __ATOMIC_RELAXED)
+#elif defined(_WIN32)
+# define metric_inc(p)      InterlockedIncrement64((LONGLONG volatile *)(p))
+# define metric_load(p)     \
+    (uint64_t)InterlockedCompareExchange64((LONGLONG volatile *)(p), 0, 0)
+# define metric_store(p, v) \
+    InterlockedExchange64((LONGLONG volatile *)(p), (LONGLONG)(v))
+#else
+# define metric_inc(p)      ((*(p))++)
+# define metric_load(p)     (*(p))
+# define metric_store(p, v) (*(p) = (v))
+#endif
+
+/* |hist| is the index of the histogram of a timed metric plus one, else 0 */
+static const struct {
+    const char *name;
+    int hist;
+} metrics[OSSL_METRIC_NUM] = {
+    { "FETCH_CACHE_HIT", 0 },
+    { "FETCH_CACHE_MISS", 0 },
+    { "DECODER_ATTEMPT", 0 },
+    { "DECODER_SUCCESS", 0 },
+    { "X509_VERIFY", 1 },
+    { "X509_VERIFY_FAIL", 0 },
+    { "DRBG_RESEED", 0 },
+    { "SSL_SESS_CACHE_HIT", 0 },
+    { "SSL_SESS_CACHE_MISS", 0 },
+    { "CMP_MSG_SENT", 0 },
+    { "CMP_MSG_RECEIVED", 0 },
+    { "CMP_TRANSFER", 2 },
+    { "CMP_TRANSFER_FAIL", 0 },
+    { "HTTP_TRANSFER", 3 },
+    { "HTTP_TRANSFER_FAIL", 0 },
+    { "CMP_SRV_REQUEST", 0 },
+    { "CMP_SRV_REJECT_SYNTAX", 0 },
+    { "CMP_SRV_REJECT_HEADER", 0 },
+    { "CMP_SRV_REJECT_REPLAY", 0 },
+    { "CMP_SRV_REJECT_VERIFY", 0 },
+    { "CMP_SRV_POPO_CACHED", 0 }
+};
+
+int OSSL_METRIC_get_num(const char *name)
+{
+    int i;
+
+    for (i = 0; i < OSSL_METRIC_NUM; i++)
+        if (strcasecmp(name, metrics[i].name) == 0)
+            return i;
+    return -1; /* not found */
+}
+
+const char *OSSL_METRIC_get_name(int metric)
+{
+    if (metric < 0 || metric >= OSSL_METRIC_NUM)
+        return NULL;
+    return metrics[metric].name;
+}
+
+int OSSL_METRIC_is_timed(int metric)
+{
+    return metric >= 0 && metric < OSSL_METRIC_NUM && metrics[metric].hist;
+}
+
+/* Monotonic time in microseconds, from an arbitrary starting point */
+uint64_t ossl_metric_now(void)
+{
+#if defined(_WIN32)
+    static LARGE_INTEGER freq;
+    LARGE_INTEGER count;
+
+    if (freq.QuadPart == 0 && !QueryPerformanceFrequency(&freq))
+        return (uint64_t)GetTickCount() * 1000;
+    QueryPerformanceCounter(&count);
+    return (uint64_t)(count.QuadPart / freq.QuadPart) * 1000000
+        + (uint64_t)(count.QuadPart % freq.QuadPart) * 1000000
+          / freq.QuadPart;
+#else
+# ifdef METRIC_MONOTONIC_CLOCK
+    struct timespec ts;
+
+    if (clock_gettime(CLOCK_MONOTONIC, &ts) == 0)
+        return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+# endif
+# if defined(OPENSSL_SYS_UNIX)
+    {
+        struct timeval tv;
+
+        if (gettimeofday(&tv, NULL) == 0)
+            return (uint64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+    }
+# endif
+    return (uint64_t)time(NULL) * 1000000;
+#endif
+}
+
+static size_t metric_bucket(uint64_t usec)
+{
+    size_t i = 0;
+
+    while (usec != 0 && i < OSSL_METRIC_HISTOGRAM_BUCKETS - 1) {
+        usec >>= 1;
+        i++;
+    }
+    return i;
+}
+
+/*
+ * Where native thread local variables are available, threads take turns in
+ * picking a stripe.  Elsewhere the stripe is derived from the thread id.
+ */
+#ifdef OSSL_THREAD_LOCAL
+static OSSL_THREAD_LOCAL int metric_thread_stripe; /* stripe + 1, or 0 */
+static int metric_next_stripe;
+#endif
+
+static OSSL_METRIC_STRIPE *metric_stripe(OSSL_METRICS *m)
+{
+#ifdef OSSL_THREAD_LOCAL
+    int s = metric_thread_stripe;
+
+    if (s == 0) {
+        /* Without lock-free atomics threads may just share a stripe more */
+        if (!CRYPTO_atomic_add(&metric_next_stripe, 1, &s, NULL))
+            s = ++metric_next_stripe;
+        s = (int)((unsigned int)s % OSSL_METRIC_STRIPES) + 1;
+        metric_thread_stripe = s;
+    }
+    return &m->stripe[s - 1];
+#else
+    CRYPTO_THREAD_ID id = CRYPTO_THREAD_get_current_id();
+    const unsigned char *p = (const unsigned char *)&id;
+    uint32_t h = 2166136261U;
+    size_t i;
+
+    for (i = 0; i < sizeof(id); i++)
+        h = (h ^ p[i]) * 16777619U;
+    return &m->stripe[(h ^ (h >> 16)) % OSSL_METRIC_STRIPES];
+#endif
+}
+
+void OSSL_METRIC_record(OSSL_LIB_CTX *ctx, int metric, uint64_t usec)
+{
+    OSSL_METRICS *m;
+    OSSL_METRIC_STRIPE *s;
+
+    if (metric < 0 || metric >= OSSL_METRIC_NUM
+            || (m = ossl_lib_ctx_get_metrics(ctx)) == NULL)
+        return;
+    s = metric_stripe(m);
+    metric_inc(&s->count[metric]);
+    if (metrics[metric].hist != 0)
+        metric_inc(&s->hist[metrics[metric].hist - 1][metric_bucket(usec)]);
+}
+
+uint64_t OSSL_METRIC_get_count(OSSL_LIB_CTX *ctx, int metric)
+{
+    OSSL_METRICS *m;
+    uint64_t count = 0;
+    size_t i;
+
+    if (metric < 0 || metric >= OSSL_METRIC_NUM
+            || (m = ossl_lib_ctx_get_metrics(ctx)) == NULL)
+        return 0;
+    for (i = 0; i < OSSL_METRIC_STRIPES; i++)
+        count += metric_load(&m->stripe[i].count[metric]);
+    return count;
+}
+
+/*
+ * Copies at most |num_buckets| buckets of the histogram of |metric| to
+ * |buckets| and returns how many there are, or 0 if |metric| is not timed.
+ */
+int OSSL_METRIC_get_histogram(OSSL_LIB_CTX *ctx, int metric,
+                              uint64_t *buckets, size_t num_buckets)
+{
+    OSSL_METRICS *m;
+    size_t i, j;
+
+    if (!OSSL_METRIC_is_timed(metric)
+            || (m = ossl_lib_ctx_get_metrics(ctx)) == NULL)
+        return 0;
+    for (i = 0; i < num_buckets && i < OSSL_METRIC_HISTOGRAM_BUCKETS; i++) {
+        buckets[i] = 0;
+        for (j = 0; j < OSSL_METRIC_STRIPES; j++)
+            buckets[i] +=
+                metric_load(&m->stripe[j].hist[metrics[metric].hist - 1][i]);
+    }
+    return OSSL_METRIC_HISTOGRAM_BUCKETS;
+}
+
+void OSSL_METRIC_reset(OSSL_LIB_CTX *ctx)
+{
+    OSSL_METRICS *m = ossl_lib_ctx_get_metrics(ctx);
+    OSSL_METRIC_STRIPE *s;
+    size_t i, j;
+
+    if (m == NULL)
+        return;
+    for (s = m->stripe; s < m->stripe + OSSL_METRIC_STRIPES; s++) {
+        for (i = 0; i < OSSL_METRIC_NUM; i++)
+            metric_store(&s->count[i], 0);
+        for (i = 0; i < OSSL_METRIC_TIMED_NUM; i++)
+            for (j = 0; j < OSSL_METRIC_HISTOGRAM_BUCKETS; j++)
+                metric_store(&s->hist[i][j], 0);
+    }
+}
+
+/*
+ * Prints one line per metric.  Timed metrics are followed by a line per
+ * non-empty histogram bucket, giving its upper bound.
+ */
+int OSSL_METRIC_print(BIO *out, OSSL_LIB_CTX *ctx)
+{
+    uint64_t hist[OSSL_METRIC_HISTOGRAM_BUCKETS];
+    int i;
+    size_t j;
+
+    if (ossl_lib_ctx_get_metrics(ctx) == NULL)
+        return 0;
+    for (i = 0; i < OSSL_METRIC_NUM; i++) {
+        if (BIO_printf(out, "%-24s %llu\n", metrics[i].name,
+                       (unsigned long long)OSSL_METRIC_get_count(ctx, i)) <= 0)
+            return 0;
+        if (!OSSL_METRIC_get_histogram(ctx, i, hist, OSSL_NELEM(hist)))
+            continue;
+        for (j = 0; j < OSSL_NELEM(hist); j++) {
+            if (hist[j] == 0)
+                continue;
+            if (j == OSSL_NELEM(hist) - 1) {
+                if (BIO_printf(out, "    >= %10llu us %llu\n",
+                               (unsigned long long)1 << (j - 1),
+                               (unsigned long long)hist[j]) <= 0)
+                    return 0;
+            } else if (BIO_printf(out, "    <  %10llu us %llu\n",
+                                  (unsigned long long)1 << j,
+                                  (unsigned long long)hist[j]) <= 0) {
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
@@ -1,5 +1,5 @@
 /*
- * Copyright 1995-2020 The OpenSSL Project Authors. All Rights Reserved.
+ * Copyright 1995-2021 The OpenSSL Project Authors. All Rights Reserved.
  *
  * Licensed under the Apache License 2.0 (the "License").  You may not use
  * this file except in compliance with the License.  You can obtain a copy
@@ -11,9 +11,12 @@
 #include "crypto/ctype.h"
 #include <limits.h>
 #include "internal/cryptlib.h"
+#include "internal/thread_once.h"
+#include "internal/tsan_assist.h"
 #include <openssl/lhash.h>
 #include <openssl/asn1.h>
 #include "crypto/objects.h"
+#include "crypto/hashtable.h"
 #include <openssl/bn.h>
 #include "crypto/asn1.h"
 #include "obj_local.h"
@@ -21,9 +24,22 @@
 /* obj_dat.h is generated from objects.h by obj_dat.pl */
 #include "obj_dat.h"
 
-DECLARE_OBJ_BSEARCH_CMP_FN(const ASN1_OBJECT *, unsigned int, sn);
-DECLARE_OBJ_BSEARCH_CMP_FN(const ASN1_OBJECT *, unsigned int, ln);
-DECLARE_OBJ_BSEARCH_CMP_FN(const ASN1_OBJECT *, unsigned int, obj);
+/*
+ * Lookups never take a lock.  The built-in objects are found through open
+ * addressing indexes over nid_objs, which are built once and never change
+ * afterwards.  Objects added at run time live in an OSSL_HT, which readers
+ * search inside an RCU read section.  Additions are serialised by obj_lock,
+ * so that OBJ_create() can check for duplicates and add atomically.  Added
+ * objects are only freed by obj_cleanup_int().  Nothing that waits for RCU
+ * readers is done with obj_lock held: inserting into the table of added
+ * objects never waits, and the caches below are only written without it.
+ *
+ * The conversions between dotted decimal text and OID content octets that
+ * OBJ_txt2obj() and OBJ_obj2txt() have to do for objects without a name are
+ * remembered in two small caches, which are emptied whenever they fill up.
+ * The results do not depend on which objects are registered, so the caches
+ * never go stale.
+ */
 
 #define ADDED_DATA      0
 #define ADDED_SNAME     1
@@ -32,119 +48,207 @@ DECLARE_OBJ_BSEARCH_CMP_FN(const ASN1_OBJECT *, unsigned int, obj);
 
 struct added_obj_st {
     int type;
+    unsigned long hash;
     ASN1_OBJECT *obj;
 };
 
+/* Size of each index, a power of two at least twice the number of entries */
+#define OBJ_INDEX_SIZE  4096
+
+#if NUM_OBJ > OBJ_INDEX_SIZE / 2 || NUM_SN > OBJ_INDEX_SIZE / 2 \
+    || NUM_LN > OBJ_INDEX_SIZE / 2 || NUM_NID >= 0xffff
+# error "OBJ_INDEX_SIZE is too small for the object table"
+#endif
+
+/* Indexes by ADDED_DATA, ADDED_SNAME and ADDED_LNAME: nid + 1, 0 if free */
+static unsigned short obj_index[ADDED_NID][OBJ_INDEX_SIZE];
+
+#define OBJ_TEXT_CACHE_MAX  256
+/* Longest content octets that are cached, longer OIDs are not worth it */
+#define OBJ_TEXT_DER_MAX    64
+
+typedef struct {
+    unsigned long hash;
+    const char *txt;
+    const unsigned char *der;
+    int derlen;
+} OID_TEXT;
+
+static CRYPTO_ONCE obj_init_once = CRYPTO_ONCE_STATIC_INIT;
+static CRYPTO_RWLOCK *obj_lock = NULL;
 static int new_nid = NUM_NID;
-static LHASH_OF(ADDED_OBJ) *added = NULL;
+static OSSL_HT *added = NULL;
+static TSAN_QUALIFIER int added_num;
+static OSSL_HT *txt2oid = NULL;     /* dotted decimal -> content octets */
+static OSSL_HT *oid2txt = NULL;     /* content octets -> dotted decimal */
 
-static int sn_cmp(const ASN1_OBJECT *const *a, const unsigned int *b)
+static unsigned long obj_hash(const void *data, size_t len)
 {
-    return strcmp((*a)->sn, nid_objs[*b].sn);
+    const unsigned char *p = data;
+    unsigned long ret = 2166136261UL;
+
+    while (len-- > 0)
+        ret = ((ret ^ *p++) * 16777619UL) & 0xffffffffUL;
+    return ret ^ (ret >> 15);
 }
 
-IMPLEMENT_OBJ_BSEARCH_CMP_FN(const ASN1_OBJECT *, unsigned int, sn);
+/* Does |o| match |key|, which is of the kind given by |type|? */
+static int obj_match(int type, const ASN1_OBJECT *o, const void *key,
+                     size_t len)
+{
+    switch (type) {
+    case ADDED_DATA:
+        return o->length == (int)len && memcmp(o->data, key, len) == 0;
+    case ADDED_SNAME:
+        return o->sn != NULL && strcmp(o->sn, key) == 0;
+    case ADDED_LNAME:
+        return o->ln != NULL && strcmp(o->ln, key) == 0;
+    }
+    return 0;
+}
 
-static int ln_cmp(const ASN1_OBJECT *const *a, const unsigned int *b)
+static void obj_index_add(int type, const void *key, size_t len,
+                          unsigned int nid)
 {
-    return strcmp((*a)->ln, nid_objs[*b].ln);
+    unsigned short *index = obj_index[type];
+    size_t i = obj_hash(key, len) & (OBJ_INDEX_SIZE - 1);
+
+    while (index[i] != 0)
+        i = (i + 1) & (OBJ_INDEX_SIZE - 1);
+    index[i] = (unsigned short)(nid + 1);
 }
 
-IMPLEMENT_OBJ_BSEARCH_CMP_FN(const ASN1_OBJECT *, unsigned int, ln);
+static int obj_index_find(int type, const void *key, size_t len)
+{
+    const unsigned short *index = obj_index[type];
+    size_t i = obj_hash(key, len) & (OBJ_INDEX_SIZE - 1);
+
+    for (; index[i] != 0; i = (i + 1) & (OBJ_INDEX_SIZE - 1))
+        if (obj_match(type, &nid_objs[index[i] - 1], key, len))
+            return nid_objs[index[i] - 1].nid;
+    return NID_undef;
+}
 
 static unsigned long added_obj_hash(const ADDED_OBJ *ca)
 {
-    const ASN1_OBJECT *a;
-    int i;
-    unsigned long ret = 0;
-    unsigned char *p;
+    return ca->hash;
+}
 
-    a = ca->obj;
+static int added_obj_cmp(const ADDED_OBJ *ca, const ADDED_OBJ *cb)
+{
+    const ASN1_OBJECT *b = cb->obj;
+
+    if (ca->type != cb->type)
+        return 1;
     switch (ca->type) {
     case ADDED_DATA:
-        ret = a->length << 20L;
-        p = (unsigned char *)a->data;
-        for (i = 0; i < a->length; i++)
-            ret ^= p[i] << ((i * 3) % 24);
-        break;
+        return !obj_match(ADDED_DATA, ca->obj, b->data, b->length);
     case ADDED_SNAME:
-        ret = OPENSSL_LH_strhash(a->sn);
-        break;
+        return b->sn == NULL || !obj_match(ADDED_SNAME, ca->obj, b->sn, 0);
     case ADDED_LNAME:
-        ret = OPENSSL_LH_strhash(a->ln);
-        break;
+        return b->ln == NULL || !obj_match(ADDED_LNAME, ca->obj, b->ln, 0);
     case ADDED_NID:
-        ret = a->nid;
-        break;
-    default:
-        /* abort(); */
-        return 0;
+        return ca->obj->nid != b->nid;
     }
-    ret &= 0x3fffffffL;
-    ret |= ((unsigned long)ca->type) << 30L;
-    return ret;
+    return 1;
 }
 
-static int added_obj_cmp(const ADDED_OBJ *ca, const ADDED_OBJ *cb)
+/* Set up |ad| for entering or looking up |o| by the key of kind |type| */
+static void added_obj_init(ADDED_OBJ *ad, int type, ASN1_OBJECT *o)
 {
-    ASN1_OBJECT *a, *b;
-    int i;
+    unsigned long hash;
 
-    i = ca->type - cb->type;
-    if (i)
-        return i;
-    a = ca->obj;
-    b = cb->obj;
-    switch (ca->type) {
+    switch (type) {
     case ADDED_DATA:
-        i = (a->length - b->length);
-        if (i)
-            return i;
-        return memcmp(a->data, b->data, (size_t)a->length);
+        hash = obj_hash(o->data, o->length);
+        break;
     case ADDED_SNAME:
-        if (a->sn == NULL)
-            return -1;
-        else if (b->sn == NULL)
-            return 1;
-        else
-            return strcmp(a->sn, b->sn);
+        hash = obj_hash(o->sn, strlen(o->sn));
+        break;
     case ADDED_LNAME:
-        if (a->ln == NULL)
-            return -1;
-        else if (b->ln == NULL)
-            return 1;
-        else
-            return strcmp(a->ln, b->ln);
-    case ADDED_NID:
-        return a->nid - b->nid;
+        hash = obj_hash(o->ln, strlen(o->ln));
+        break;
     default:
-        /* abort(); */
-        return 0;
+        hash = (unsigned long)o->nid;
+        break;
     }
+    ad->type = type;
+    ad->obj = o;
+    ad->hash = (hash & 0x3fffffffUL) | ((unsigned long)type << 30);
+}
+
+static unsigned long oid_text_hash(const OID_TEXT *a)
+{
+    return a->hash;
+}
+
+static int txt2oid_cmp(const OID_TEXT *a, const OID_TEXT *b)
+{
+    return strcmp(a->txt, b->txt);
 }
 
-static int init_added(void)
+static int oid2txt_cmp(const OID_TEXT *a, const OID_TEXT *b)
 {
-    if (added != NULL)
+    if (a->derlen != b->derlen)
         return 1;
-    added = lh_ADDED_OBJ_new(added_obj_hash, added_obj_cmp);
-    return added != NULL;
+    return memcmp(a->der, b->der, a->derlen);
+}
+
+static void oid_text_free(void *a)
+{
+    OPENSSL_free(a);
 }
 
-static void cleanup1_doall(ADDED_OBJ *a)
+DEFINE_RUN_ONCE_STATIC(obj_do_init)
 {
+    size_t i;
+
+    for (i = 0; i < NUM_OBJ; i++)
+        obj_index_add(ADDED_DATA, nid_objs[obj_objs[i]].data,
+                      nid_objs[obj_objs[i]].length, obj_objs[i]);
+    for (i = 0; i < NUM_SN; i++)
+        obj_index_add(ADDED_SNAME, nid_objs[sn_objs[i]].sn,
+                      strlen(nid_objs[sn_objs[i]].sn), sn_objs[i]);
+    for (i = 0; i < NUM_LN; i++)
+        obj_index_add(ADDED_LNAME, nid_objs[ln_objs[i]].ln,
+                      strlen(nid_objs[ln_objs[i]].ln), ln_objs[i]);
+
+    /* Without these, nothing can be added but lookups still work */
+    obj_lock = CRYPTO_THREAD_lock_new();
+    added = ossl_ht_new((OSSL_HT_HASHFUNC)added_obj_hash,
+                        (OSSL_HT_COMPFUNC)added_obj_cmp, NULL);
+    txt2oid = ossl_ht_new((OSSL_HT_HASHFUNC)oid_text_hash,
+                          (OSSL_HT_COMPFUNC)txt2oid_cmp, oid_text_free);
+    oid2txt = ossl_ht_new((OSSL_HT_HASHFUNC)oid_text_hash,
+                          (OSSL_HT_COMPFUNC)oid2txt_cmp, oid_text_free);
+    return 1;
+}
+
+static ossl_inline int obj_init(void)
+{
+    return RUN_ONCE(&obj_init_once, obj_do_init);
+}
+
+static void cleanup1_doall(void *data, void *arg)
+{
+    ADDED_OBJ *a = data;
+
     a->obj->nid = 0;
     a->obj->flags |= ASN1_OBJECT_FLAG_DYNAMIC |
         ASN1_OBJECT_FLAG_DYNAMIC_STRINGS | ASN1_OBJECT_FLAG_DYNAMIC_DATA;
 }
 
-static void cleanup2_doall(ADDED_OBJ *a)
+static void cleanup2_doall(void *data, void *arg)
 {
+    ADDED_OBJ *a = data;
+
     a->obj->nid++;
 }
 
-static void cleanup3_doall(ADDED_OBJ *a)
+static void cleanup3_doall(void *data, void *arg)
 {
+    ADDED_OBJ *a = data;
+
     if (--a->obj->nid == 0)
         ASN1_OBJECT_free(a->obj);
     OPENSSL_free(a);
@@ -152,17 +256,40 @@ static void cleanup3_doall(ADDED_OBJ *a)
 
 void obj_cleanup_int(void)
 {
+    ossl_ht_free(txt2oid);
+    ossl_ht_free(oid2txt);
+    txt2oid = oid2txt = NULL;
+    CRYPTO_THREAD_lock_free(obj_lock);
+    obj_lock = NULL;
     if (added == NULL)
         return;
-    lh_ADDED_OBJ_set_down_load(added, 0);
-    lh_ADDED_OBJ_doall(added, cleanup1_doall); /* zero counters */
-    lh_ADDED_OBJ_doall(added, cleanup2_doall); /* set counters */
-    lh_ADDED_OBJ_doall(added, cleanup3_doall); /* free objects */
-    lh_ADDED_OBJ_free(added);
+    tsan_store(&added_num, 0);
+    ossl_ht_doall(added, cleanup1_doall, NULL); /* zero counters */
+    ossl_ht_doall(added, cleanup2_doall, NULL); /* set counters */
+    ossl_ht_doall(added, cleanup3_doall, NULL); /* free objects */
+    ossl_ht_free(added);
     added = NULL;
 }
 
-int OBJ_new_nid(int num)
+/*
+ * Look up the added object with the key of kind |type| that is in |key|.
+ * The object stays valid until obj_cleanup_int().
+ */
+static ASN1_OBJECT *added_find(int type, ASN1_OBJECT *key)
+{
+    ADDED_OBJ ad, *adp;
+    ASN1_OBJECT *ret = NULL;
+
+    if (tsan_load(&added_num) == 0 || !ossl_ht_read_lock(added))
+        return NULL;
+    added_obj_init(&ad, type, key);
+    if ((adp = ossl_ht_get(added, &ad)) != NULL)
+        ret = adp->obj;
+    ossl_ht_read_unlock(added);
+    return ret;
+}
+
+static int obj_new_nid_unlocked(int num)
 {
     int i;
 
@@ -171,15 +298,26 @@ int OBJ_new_nid(int num)
     return i;
 }
 
-int OBJ_add_object(const ASN1_OBJECT *obj)
+int OBJ_new_nid(int num)
 {
-    ASN1_OBJECT *o;
-    ADDED_OBJ *ao[4] = { NULL, NULL, NULL, NULL }, *aop;
     int i;
 
+    if (!obj_init() || obj_lock == NULL
+            || !CRYPTO_THREAD_write_lock(obj_lock))
+        return NID_undef;
+    i = obj_new_nid_unlocked(num);
+    CRYPTO_THREAD_unlock(obj_lock);
+    return i;
+}
+
+static int obj_add_object_unlocked(const ASN1_OBJECT *obj)
+{
+    ASN1_OBJECT *o;
+    ADDED_OBJ *ao[4] = { NULL, NULL, NULL, NULL };
+    int i, inserted = 0;
+
     if (added == NULL)
-        if (!init_added())
-            return 0;
+        return 0;
     if ((o = OBJ_dup(obj)) == NULL)
         goto err;
     if ((ao[ADDED_NID] = OPENSSL_malloc(sizeof(*ao[0]))) == NULL)
@@ -194,18 +332,26 @@ int OBJ_add_object(const ASN1_OBJECT *obj)
         if ((ao[ADDED_LNAME] = OPENSSL_malloc(sizeof(*ao[0]))) == NULL)
             goto err2;
 
-    for (i = ADDED_DATA; i <= ADDED_NID; i++) {
-        if (ao[i] != NULL) {
-            ao[i]->type = i;
-            ao[i]->obj = o;
-            aop = lh_ADDED_OBJ_insert(added, ao[i]);
-            /* memory leak, but should not normally matter */
-            OPENSSL_free(aop);
-        }
-    }
+    /* Readers must only ever see the final flags */
     o->flags &=
         ~(ASN1_OBJECT_FLAG_DYNAMIC | ASN1_OBJECT_FLAG_DYNAMIC_STRINGS |
           ASN1_OBJECT_FLAG_DYNAMIC_DATA);
+    for (i = ADDED_DATA; i <= ADDED_NID; i++) {
+        if (ao[i] == NULL)
+            continue;
+        added_obj_init(ao[i], i, o);
+        /* An entry with the same key is replaced and leaked */
+        if (!ossl_ht_insert(added, ao[i])) {
+            if (!inserted)
+                goto err2;
+            /* The entries that are in keep |o| alive until cleanup */
+            OPENSSL_free(ao[i]);
+            ERR_raise(ERR_LIB_OBJ, ERR_R_MALLOC_FAILURE);
+            return NID_undef;
+        }
+        inserted = 1;
+        tsan_store(&added_num, tsan_load(&added_num) + 1);
+    }
 
     return o->nid;
  err2:
@@ -217,40 +363,51 @@ int OBJ_add_object(const ASN1_OBJECT *obj)
     return NID_undef;
 }
 
-ASN1_OBJECT *OBJ_nid2obj(int n)
+int OBJ_add_object(const ASN1_OBJECT *obj)
 {
-    ADDED_OBJ ad, *adp;
-    ASN1_OBJECT ob;
+    int ret;
 
-    if ((n >= 0) && (n < NUM_NID)) {
-        if ((n != NID_undef) && (nid_objs[n].nid == NID_undef)) {
-            ERR_raise(ERR_LIB_OBJ, OBJ_R_UNKNOWN_NID);
-            return NULL;
-        }
-        return (ASN1_OBJECT *)&(nid_objs[n]);
-    }
+    if (!obj_init() || obj_lock == NULL
+            || !CRYPTO_THREAD_write_lock(obj_lock))
+        return NID_undef;
+    ret = obj_add_object_unlocked(obj);
+    CRYPTO_THREAD_unlock(obj_lock);
+    return ret;
+}
+
+/* Find an added object by NID, raising an error if there is none */
+static ASN1_OBJECT *added_nid2obj(int n)
+{
+    ASN1_OBJECT ob, *ret;
 
     /* Make sure we've loaded config before checking for any "added" objects */
     OPENSSL_init_crypto(OPENSSL_INIT_LOAD_CONFIG, NULL);
 
-    if (added == NULL)
+    if (!obj_init() || added == NULL)
         return NULL;
 
-    ad.type = ADDED_NID;
-    ad.obj = &ob;
     ob.nid = n;
-    adp = lh_ADDED_OBJ_retrieve(added, &ad);
-    if (adp != NULL)
-        return adp->obj;
+    if ((ret = added_find(ADDED_NID, &ob)) == NULL)
+        ERR_raise(ERR_LIB_OBJ, OBJ_R_UNKNOWN_NID);
+    return ret;
+}
 
-    ERR_raise(ERR_LIB_OBJ, OBJ_R_UNKNOWN_NID);
-    return NULL;
+ASN1_OBJECT *OBJ_nid2obj(int n)
+{
+    if ((n >= 0) && (n < NUM_NID)) {
+        if ((n != NID_undef) && (nid_objs[n].nid == NID_undef)) {
+            ERR_raise(ERR_LIB_OBJ, OBJ_R_UNKNOWN_NID);
+            return NULL;
+        }
+        return (ASN1_OBJECT *)&(nid_objs[n]);
+    }
+
+    return added_nid2obj(n);
 }
 
 const char *OBJ_nid2sn(int n)
 {
-    ADDED_OBJ ad, *adp;
-    ASN1_OBJECT ob;
+    ASN1_OBJECT *ob;
 
     if ((n >= 0) && (n < NUM_NID)) {
         if ((n != NID_undef) && (nid_objs[n].nid == NID_undef)) {
@@ -260,27 +417,13 @@ const char *OBJ_nid2sn(int n)
         return nid_objs[n].sn;
     }
 
-    /* Make sure we've loaded config before checking for any "added" objects */
-    OPENSSL_init_crypto(OPENSSL_INIT_LOAD_CONFIG, NULL);
-
-    if (added == NULL)
-        return NULL;
-
-    ad.type = ADDED_NID;
-    ad.obj = &ob;
-    ob.nid = n;
-    adp = lh_ADDED_OBJ_retrieve(added, &ad);
-    if (adp != NULL)
-        return adp->obj->sn;
-
-    ERR_raise(ERR_LIB_OBJ, OBJ_R_UNKNOWN_NID);
-    return NULL;
+    ob = added_nid2obj(n);
+    return ob != NULL ? ob->sn : NULL;
 }
 
 const char *OBJ_nid2ln(int n)
 {
-    ADDED_OBJ ad, *adp;
-    ASN1_OBJECT ob;
+    ASN1_OBJECT *ob;
 
     if ((n >= 0) && (n < NUM_NID)) {
         if ((n != NID_undef) && (nid_objs[n].nid == NID_undef)) {
@@ -290,43 +433,13 @@ const char *OBJ_nid2ln(int n)
         return nid_objs[n].ln;
     }
 
-    /* Make sure we've loaded config before checking for any "added" objects */
-    OPENSSL_init_crypto(OPENSSL_INIT_LOAD_CONFIG, NULL);
-
-    if (added == NULL)
-        return NULL;
-
-    ad.type = ADDED_NID;
-    ad.obj = &ob;
-    ob.nid = n;
-    adp = lh_ADDED_OBJ_retrieve(added, &ad);
-    if (adp != NULL)
-        return adp->obj->ln;
-
-    ERR_raise(ERR_LIB_OBJ, OBJ_R_UNKNOWN_NID);
-    return NULL;
-}
-
-static int obj_cmp(const ASN1_OBJECT *const *ap, const unsigned int *bp)
-{
-    int j;
-    const ASN1_OBJECT *a = *ap;
-    const ASN1_OBJECT *b = &nid_objs[*bp];
-
-    j = (a->length - b->length);
-    if (j)
-        return j;
-    if (a->length == 0)
-        return 0;
-    return memcmp(a->data, b->data, a->length);
+    ob = added_nid2obj(n);
+    return ob != NULL ? ob->ln : NULL;
 }
 
-IMPLEMENT_OBJ_BSEARCH_CMP_FN(const ASN1_OBJECT *, unsigned int, obj);
-
 int OBJ_obj2nid(const ASN1_OBJECT *a)
 {
-    const unsigned int *op;
-    ADDED_OBJ ad, *adp;
+    ASN1_OBJECT *ob;
 
     if (a == NULL)
         return NID_undef;
@@ -339,17 +452,73 @@ int OBJ_obj2nid(const ASN1_OBJECT *a)
     /* Make sure we've loaded config before checking for any "added" objects */
     OPENSSL_init_crypto(OPENSSL_INIT_LOAD_CONFIG, NULL);
 
-    if (added != NULL) {
-        ad.type = ADDED_DATA;
-        ad.obj = (ASN1_OBJECT *)a; /* XXX: ugly but harmless */
-        adp = lh_ADDED_OBJ_retrieve(added, &ad);
-        if (adp != NULL)
-            return adp->obj->nid;
-    }
-    op = OBJ_bsearch_obj(&a, obj_objs, NUM_OBJ);
-    if (op == NULL)
+    if (!obj_init())
         return NID_undef;
-    return nid_objs[*op].nid;
+    if ((ob = added_find(ADDED_DATA, (ASN1_OBJECT *)a)) != NULL)
+        return ob->nid;
+    return obj_index_find(ADDED_DATA, a->data, a->length);
+}
+
+/*
+ * Find the content octets for the dotted decimal |s| in the cache and turn
+ * them into an object.  Returns NULL if they are not there.
+ */
+static ASN1_OBJECT *txt2oid_find(const char *s)
+{
+    OID_TEXT tmpl, *e;
+    ASN1_OBJECT ob;
+    unsigned char der[OBJ_TEXT_DER_MAX];
+    int nid, derlen = 0;
+
+    if (txt2oid == NULL)
+        return NULL;
+    tmpl.txt = s;
+    tmpl.hash = obj_hash(s, strlen(s));
+    if (!ossl_ht_read_lock(txt2oid))
+        return NULL;
+    /*
+     * Only copy the octets out here: resolving them can load the config,
+     * which may create objects and so must not happen in the read section.
+     */
+    if ((e = ossl_ht_get(txt2oid, &tmpl)) != NULL) {
+        derlen = e->derlen;
+        memcpy(der, e->der, derlen);
+    }
+    ossl_ht_read_unlock(txt2oid);
+    if (derlen == 0)
+        return NULL;
+
+    /* Like d2i_ASN1_OBJECT(), prefer the shared registered object */
+    ob.nid = NID_undef;
+    ob.data = der;
+    ob.length = derlen;
+    if ((nid = OBJ_obj2nid(&ob)) != NID_undef)
+        return OBJ_nid2obj(nid);
+    return ASN1_OBJECT_create(NID_undef, der, derlen, NULL, NULL);
+}
+
+/* Remember that the dotted decimal |txt| has the content octets |der| */
+static void oid_text_cache(OSSL_HT *cache, unsigned long hash,
+                           const char *txt, const unsigned char *der,
+                           int derlen)
+{
+    size_t txtlen = strlen(txt) + 1;
+    OID_TEXT *e;
+
+    if (cache == NULL || derlen > OBJ_TEXT_DER_MAX
+            || (e = OPENSSL_malloc(sizeof(*e) + derlen + txtlen)) == NULL)
+        return;
+    e->hash = hash;
+    e->derlen = derlen;
+    e->der = (unsigned char *)(e + 1);
+    e->txt = (char *)(e + 1) + derlen;
+    memcpy((unsigned char *)(e + 1), der, derlen);
+    memcpy((char *)(e + 1) + derlen, txt, txtlen);
+
+    if (ossl_ht_num(cache) >= OBJ_TEXT_CACHE_MAX)
+        ossl_ht_flush(cache);
+    if (!ossl_ht_insert(cache, e))
+        OPENSSL_free(e);
 }
 
 /*
@@ -378,6 +547,9 @@ ASN1_OBJECT *OBJ_txt2obj(const char *s, int no_name)
         }
     }
 
+    if (obj_init() && (op = txt2oid_find(s)) != NULL)
+        return op;
+
     /* Work out size of content octets */
     i = a2d_ASN1_OBJECT(NULL, 0, s, -1);
     if (i <= 0) {
@@ -405,41 +577,20 @@ ASN1_OBJECT *OBJ_txt2obj(const char *s, int no_name)
 
     cp = buf;
     op = d2i_ASN1_OBJECT(NULL, &cp, j);
+    if (op != NULL)
+        oid_text_cache(txt2oid, obj_hash(s, strlen(s)), s, p, i);
     OPENSSL_free(buf);
     return op;
 }
 
-int OBJ_obj2txt(char *buf, int buf_len, const ASN1_OBJECT *a, int no_name)
+static int obj_data2txt(char *buf, int buf_len, const unsigned char *p,
+                        int len)
 {
-    int i, n = 0, len, nid, first, use_bn;
+    int i, n = 0, first, use_bn;
     BIGNUM *bl;
     unsigned long l;
-    const unsigned char *p;
     char tbuf[DECIMAL_SIZE(i) + DECIMAL_SIZE(l) + 2];
 
-    /* Ensure that, at every state, |buf| is NUL-terminated. */
-    if (buf && buf_len > 0)
-        buf[0] = '\0';
-
-    if ((a == NULL) || (a->data == NULL))
-        return 0;
-
-    if (!no_name && (nid = OBJ_obj2nid(a)) != NID_undef) {
-        const char *s;
-        s = OBJ_nid2ln(nid);
-        if (s == NULL)
-            s = OBJ_nid2sn(nid);
-        if (s) {
-            if (buf)
-                OPENSSL_strlcpy(buf, s, buf_len);
-            n = strlen(s);
-            return n;
-        }
-    }
-
-    len = a->length;
-    p = a->data;
-
     first = 1;
     bl = NULL;
 
@@ -543,6 +694,56 @@ int OBJ_obj2txt(char *buf, int buf_len, const ASN1_OBJECT *a, int no_name)
     return -1;
 }
 
+int OBJ_obj2txt(char *buf, int buf_len, const ASN1_OBJECT *a, int no_name)
+{
+    int n, nid;
+    OID_TEXT tmpl, *e;
+
+    /* Ensure that, at every state, |buf| is NUL-terminated. */
+    if (buf && buf_len > 0)
+        buf[0] = '\0';
+
+    if ((a == NULL) || (a->data == NULL))
+        return 0;
+
+    if (!no_name && (nid = OBJ_obj2nid(a)) != NID_undef) {
+        const char *s;
+        s = OBJ_nid2ln(nid);
+        if (s == NULL)
+            s = OBJ_nid2sn(nid);
+        if (s) {
+            if (buf)
+                OPENSSL_strlcpy(buf, s, buf_len);
+            n = strlen(s);
+            return n;
+        }
+    }
+
+    if (a->length <= 0 || !obj_init() || oid2txt == NULL)
+        return obj_data2txt(buf, buf_len, a->data, a->length);
+
+    tmpl.der = a->data;
+    tmpl.derlen = a->length;
+    tmpl.hash = obj_hash(a->data, a->length);
+    n = -1;
+    if (ossl_ht_read_lock(oid2txt)) {
+        if ((e = ossl_ht_get(oid2txt, &tmpl)) != NULL) {
+            if (buf)
+                OPENSSL_strlcpy(buf, e->txt, buf_len);
+            n = strlen(e->txt);
+        }
+        ossl_ht_read_unlock(oid2txt);
+    }
+    if (n >= 0)
+        return n;
+
+    n = obj_data2txt(buf, buf_len, a->data, a->length);
+    /* Only what fitted into |buf| in full can be remembered */
+    if (n > 0 && buf != NULL && n < buf_len)
+        oid_text_cache(oid2txt, tmpl.hash, buf, a->data, a->length);
+    return n;
+}
+
 int OBJ_txt2nid(const char *s)
 {
     ASN1_OBJECT *obj;
@@ -555,50 +756,32 @@ int OBJ_txt2nid(const char *s)
 
 int OBJ_ln2nid(const char *s)
 {
-    ASN1_OBJECT o;
-    const ASN1_OBJECT *oo = &o;
-    ADDED_OBJ ad, *adp;
-    const unsigned int *op;
+    ASN1_OBJECT o, *ob;
 
     /* Make sure we've loaded config before checking for any "added" objects */
     OPENSSL_init_crypto(OPENSSL_INIT_LOAD_CONFIG, NULL);
 
-    o.ln = s;
-    if (added != NULL) {
-        ad.type = ADDED_LNAME;
-        ad.obj = &o;
-        adp = lh_ADDED_OBJ_retrieve(added, &ad);
-        if (adp != NULL)
-            return adp->obj->nid;
-    }
-    op = OBJ_bsearch_ln(&oo, ln_objs, NUM_LN);
-    if (op == NULL)
+    if (!obj_init())
         return NID_undef;
-    return nid_objs[*op].nid;
+    o.ln = s;
+    if ((ob = added_find(ADDED_LNAME, &o)) != NULL)
+        return ob->nid;
+    return obj_index_find(ADDED_LNAME, s, strlen(s));
 }
 
 int OBJ_sn2nid(const char *s)
 {
-    ASN1_OBJECT o;
-    const ASN1_OBJECT *oo = &o;
-    ADDED_OBJ ad, *adp;
-    const unsigned int *op;
+    ASN1_OBJECT o, *ob;
 
     /* Make sure we've loaded config before checking for any "added" objects */
     OPENSSL_init_crypto(OPENSSL_INIT_LOAD_CONFIG, NULL);
 
-    o.sn = s;
-    if (added != NULL) {
-        ad.type = ADDED_SNAME;
-        ad.obj = &o;
-        adp = lh_ADDED_OBJ_retrieve(added, &ad);
-        if (adp != NULL)
-            return adp->obj->nid;
-    }
-    op = OBJ_bsearch_sn(&oo, sn_objs, NUM_SN);
-    if (op == NULL)
+    if (!obj_init())
         return NID_undef;
-    return nid_objs[*op].nid;
+    o.sn = s;
+    if ((ob = added_find(ADDED_SNAME, &o)) != NULL)
+        return ob->nid;
+    return obj_index_find(ADDED_SNAME, s, strlen(s));
 }
 
 const void *OBJ_bsearch_(const void *key, const void *base, int num, int size,
@@ -694,34 +877,47 @@ int OBJ_create(const char *oid, const char *sn, const char *ln)
     ASN1_OBJECT *tmpoid = NULL;
     int ok = 0;
 
+    /* Loading the config may create objects, so do it before locking */
+    OPENSSL_init_crypto(OPENSSL_INIT_LOAD_CONFIG, NULL);
+
+    /*
+     * Convert numerical OID string to an ASN1_OBJECT structure.  This may
+     * flush the text cache, which waits for its readers, so it is done
+     * before locking.
+     */
+    if ((tmpoid = OBJ_txt2obj(oid, 1)) == NULL)
+        return 0;
+
+    if (!obj_init() || obj_lock == NULL
+            || !CRYPTO_THREAD_write_lock(obj_lock)) {
+        ASN1_OBJECT_free(tmpoid);
+        return 0;
+    }
+
     /* Check to see if short or long name already present */
     if ((sn != NULL && OBJ_sn2nid(sn) != NID_undef)
             || (ln != NULL && OBJ_ln2nid(ln) != NID_undef)) {
         ERR_raise(ERR_LIB_OBJ, OBJ_R_OID_EXISTS);
-        return 0;
+        goto err;
     }
 
-    /* Convert numerical OID string to an ASN1_OBJECT structure */
-    tmpoid = OBJ_txt2obj(oid, 1);
-    if (tmpoid == NULL)
-        return 0;
-
     /* If NID is not NID_undef then object already exists */
     if (OBJ_obj2nid(tmpoid) != NID_undef) {
         ERR_raise(ERR_LIB_OBJ, OBJ_R_OID_EXISTS);
         goto err;
     }
 
-    tmpoid->nid = OBJ_new_nid(1);
+    tmpoid->nid = obj_new_nid_unlocked(1);
     tmpoid->sn = (char *)sn;
     tmpoid->ln = (char *)ln;
 
-    ok = OBJ_add_object(tmpoid);
+    ok = obj_add_object_unlocked(tmpoid);
 
     tmpoid->sn = NULL;
     tmpoid->ln = NULL;
 
  err:
+    CRYPTO_THREAD_unlock(obj_lock);
     ASN1_OBJECT_free(tmpoid);
     return ok;
 }
@@ -1,5 +1,5 @@
 /*
- * Copyright 2019-2020 The OpenSSL Project Authors. All Rights Reserved.
+ * Copyright 2019-2021 The OpenSSL Project Authors. All Rights Reserved.
  * Copyright (c) 2019, Oracle and/or its affiliates.  All rights reserved.
  *
  * Licensed under the Apache License 2.0 (the "License").  You may not use
@@ -17,7 +17,9 @@
 #include <openssl/lhash.h>
 #include <openssl/rand.h>
 #include "internal/thread_once.h"
+#include "internal/metrics.h"
 #include "crypto/lhash.h"
+#include "crypto/hashtable.h"
 #include "crypto/sparse_array.h"
 #include "property_local.h"
 
@@ -43,33 +45,31 @@ typedef struct {
 DEFINE_STACK_OF(IMPLEMENTATION)
 
 typedef struct {
+    int nid;
     const char *query;
     METHOD method;
     char body[1];
 } QUERY;
 
-DEFINE_LHASH_OF(QUERY);
-
 typedef struct {
     int nid;
     STACK_OF(IMPLEMENTATION) *impls;
-    LHASH_OF(QUERY) *cache;
 } ALGORITHM;
 
+/*
+ * The query cache is shared by all algorithms and keyed by the nid and the
+ * query string.  It is read without taking the store lock, so that fetches
+ * of cached methods do not contend with each other.  Modifications of the
+ * cache are still done with the store lock held.
+ */
 struct ossl_method_store_st {
     OSSL_LIB_CTX *ctx;
-    size_t nelem;
     SPARSE_ARRAY_OF(ALGORITHM) *algs;
+    OSSL_HT *cache;
     int need_flush;
     CRYPTO_RWLOCK *lock;
 };
 
-typedef struct {
-    LHASH_OF(QUERY) *cache;
-    size_t nelem;
-    uint32_t seed;
-} IMPL_CACHE_FLUSH;
-
 DEFINE_SPARSE_ARRAY_OF(ALGORITHM);
 
 static void ossl_method_cache_flush(OSSL_METHOD_STORE *store, int nid);
@@ -132,13 +132,19 @@ int ossl_property_unlock(OSSL_METHOD_STORE *p)
     return p != 0 ? CRYPTO_THREAD_unlock(p->lock) : 0;
 }
 
-static unsigned long query_hash(const QUERY *a)
+static unsigned long query_hash(const void *va)
 {
-    return OPENSSL_LH_strhash(a->query);
+    const QUERY *a = va;
+
+    return OPENSSL_LH_strhash(a->query) ^ ((unsigned long)a->nid * 0x9E3779B1UL);
 }
 
-static int query_cmp(const QUERY *a, const QUERY *b)
+static int query_cmp(const void *va, const void *vb)
 {
+    const QUERY *a = va, *b = vb;
+
+    if (a->nid != b->nid)
+        return a->nid < b->nid ? -1 : 1;
     return strcmp(a->query, b->query);
 }
 
@@ -150,8 +156,10 @@ static void impl_free(IMPLEMENTATION *impl)
     }
 }
 
-static void impl_cache_free(QUERY *elem)
+static void impl_cache_free(void *velem)
 {
+    QUERY *elem = velem;
+
     if (elem != NULL) {
         ossl_method_free(&elem->method);
         OPENSSL_free(elem);
@@ -162,8 +170,6 @@ static void alg_cleanup(ossl_uintmax_t idx, ALGORITHM *a)
 {
     if (a != NULL) {
         sk_IMPLEMENTATION_pop_free(a->impls, &impl_free);
-        lh_QUERY_doall(a->cache, &impl_cache_free);
-        lh_QUERY_free(a->cache);
         OPENSSL_free(a);
     }
 }
@@ -183,7 +189,10 @@ OSSL_METHOD_STORE *ossl_method_store_new(OSSL_LIB_CTX *ctx)
             OPENSSL_free(res);
             return NULL;
         }
-        if ((res->lock = CRYPTO_THREAD_lock_new()) == NULL) {
+        if ((res->cache = ossl_ht_new(&query_hash, &query_cmp,
+                                      &impl_cache_free)) == NULL
+                || (res->lock = CRYPTO_THREAD_lock_new()) == NULL) {
+            ossl_ht_free(res->cache);
             ossl_sa_ALGORITHM_free(res->algs);
             OPENSSL_free(res);
             return NULL;
@@ -195,6 +204,7 @@ OSSL_METHOD_STORE *ossl_method_store_new(OSSL_LIB_CTX *ctx)
 void ossl_method_store_free(OSSL_METHOD_STORE *store)
 {
     if (store != NULL) {
+        ossl_ht_free(store->cache);
         ossl_sa_ALGORITHM_doall(store->algs, &alg_cleanup);
         ossl_sa_ALGORITHM_free(store->algs);
         CRYPTO_THREAD_lock_free(store->lock);
@@ -258,8 +268,7 @@ int ossl_method_store_add(OSSL_METHOD_STORE *store, const OSSL_PROVIDER *prov,
     alg = ossl_method_store_retrieve(store, nid);
     if (alg == NULL) {
         if ((alg = OPENSSL_zalloc(sizeof(*alg))) == NULL
-                || (alg->impls = sk_IMPLEMENTATION_new_null()) == NULL
-                || (alg->cache = lh_QUERY_new(&query_hash, &query_cmp)) == NULL)
+                || (alg->impls = sk_IMPLEMENTATION_new_null()) == NULL)
             goto err;
         alg->nid = nid;
         if (!ossl_method_store_insert(store, alg))
@@ -400,43 +409,33 @@ fin:
     return ret;
 }
 
-static void impl_cache_flush_alg(ossl_uintmax_t idx, ALGORITHM *alg, void *arg)
+static void impl_flush_alg(ossl_uintmax_t idx, ALGORITHM *alg, void *arg)
 {
     SPARSE_ARRAY_OF(ALGORITHM) *algs = arg;
 
-    lh_QUERY_doall(alg->cache, &impl_cache_free);
-    if (algs != NULL) {
-        sk_IMPLEMENTATION_pop_free(alg->impls, &impl_free);
-        lh_QUERY_free(alg->cache);
-        OPENSSL_free(alg);
-        ossl_sa_ALGORITHM_set(algs, idx, NULL);
-    } else {
-        lh_QUERY_flush(alg->cache);
-    }
+    alg_cleanup(idx, alg);
+    ossl_sa_ALGORITHM_set(algs, idx, NULL);
 }
 
-static void ossl_method_cache_flush(OSSL_METHOD_STORE *store, int nid)
+static int impl_cache_keep_other_nid(void *velem, void *arg)
 {
-    ALGORITHM *alg = ossl_method_store_retrieve(store, nid);
+    return ((QUERY *)velem)->nid != *(int *)arg;
+}
 
-    if (alg != NULL) {
-        store->nelem -= lh_QUERY_num_items(alg->cache);
-        impl_cache_flush_alg(0, alg, NULL);
-    }
+static void ossl_method_cache_flush(OSSL_METHOD_STORE *store, int nid)
+{
+    ossl_ht_filter(store->cache, &impl_cache_keep_other_nid, &nid);
 }
 
 void ossl_method_store_flush_cache(OSSL_METHOD_STORE *store, int all)
 {
-    void *arg = (all != 0 ? store->algs : NULL);
-
     ossl_property_write_lock(store);
-    ossl_sa_ALGORITHM_doall_arg(store->algs, &impl_cache_flush_alg, arg);
-    store->nelem = 0;
+    ossl_ht_flush(store->cache);
+    if (all != 0)
+        ossl_sa_ALGORITHM_doall_arg(store->algs, &impl_flush_alg, store->algs);
     ossl_property_unlock(store);
 }
 
-IMPLEMENT_LHASH_DOALL_ARG(QUERY, IMPL_CACHE_FLUSH);
-
 /*
  * Flush an element from the query cache (perhaps).
  *
@@ -453,8 +452,9 @@ IMPLEMENT_LHASH_DOALL_ARG(QUERY, IMPL_CACHE_FLUSH);
  * preferable to a more refined approach that imposes a performance
  * impact.
  */
-static void impl_cache_flush_cache(QUERY *c, IMPL_CACHE_FLUSH *state)
+static int impl_cache_keep_some(void *velem, void *arg)
 {
+    uint32_t *seed = arg;
     uint32_t n;
 
     /*
@@ -464,65 +464,46 @@ static void impl_cache_flush_cache(QUERY *c, IMPL_CACHE_FLUSH *state)
      * This is a very fast PRNG so there is no need to extract bits one at a
      * time and use the entire value each time.
      */
-    n = state->seed;
+    n = *seed;
     n ^= n << 13;
     n ^= n >> 17;
     n ^= n << 5;
-    state->seed = n;
+    *seed = n;
 
-    if ((n & 1) != 0)
-        impl_cache_free(lh_QUERY_delete(state->cache, c));
-    else
-        state->nelem++;
-}
-
-static void impl_cache_flush_one_alg(ossl_uintmax_t idx, ALGORITHM *alg,
-                                     void *v)
-{
-    IMPL_CACHE_FLUSH *state = (IMPL_CACHE_FLUSH *)v;
-
-    state->cache = alg->cache;
-    lh_QUERY_doall_IMPL_CACHE_FLUSH(state->cache, &impl_cache_flush_cache,
-                                    state);
+    return (n & 1) == 0;
 }
 
 static void ossl_method_cache_flush_some(OSSL_METHOD_STORE *store)
 {
-    IMPL_CACHE_FLUSH state;
+    uint32_t seed;
 
-    state.nelem = 0;
-    if ((state.seed = OPENSSL_rdtsc()) == 0)
-        state.seed = 1;
+    if ((seed = OPENSSL_rdtsc()) == 0)
+        seed = 1;
     store->need_flush = 0;
-    ossl_sa_ALGORITHM_doall_arg(store->algs, &impl_cache_flush_one_alg, &state);
-    store->nelem = state.nelem;
+    ossl_ht_filter(store->cache, &impl_cache_keep_some, &seed);
 }
 
 int ossl_method_store_cache_get(OSSL_METHOD_STORE *store, int nid,
                                 const char *prop_query, void **method)
 {
-    ALGORITHM *alg;
     QUERY elem, *r;
     int res = 0;
 
     if (nid <= 0 || store == NULL)
         return 0;
 
-    ossl_property_read_lock(store);
-    alg = ossl_method_store_retrieve(store, nid);
-    if (alg == NULL)
-        goto err;
-
+    elem.nid = nid;
     elem.query = prop_query != NULL ? prop_query : "";
-    r = lh_QUERY_retrieve(alg->cache, &elem);
-    if (r == NULL)
-        goto err;
-    if (ossl_method_up_ref(&r->method)) {
+    if (!ossl_ht_read_lock(store->cache))
+        return 0;
+    r = ossl_ht_get(store->cache, &elem);
+    if (r != NULL && ossl_method_up_ref(&r->method)) {
         *method = r->method.method;
         res = 1;
     }
-err:
-    ossl_property_unlock(store);
+    ossl_ht_read_unlock(store->cache);
+    ossl_metric_count(store->ctx, res ? OSSL_METRIC_FETCH_CACHE_HIT
+                                      : OSSL_METRIC_FETCH_CACHE_MISS);
     return res;
 }
 
@@ -531,7 +512,7 @@ int ossl_method_store_cache_set(OSSL_METHOD_STORE *store, int nid,
                                 int (*method_up_ref)(void *),
                                 void (*method_destruct)(void *))
 {
-    QUERY elem, *old, *p = NULL;
+    QUERY elem, *p = NULL;
     ALGORITHM *alg;
     size_t len;
     int res = 1;
@@ -549,15 +530,14 @@ int ossl_method_store_cache_set(OSSL_METHOD_STORE *store, int nid,
         goto err;
 
     if (method == NULL) {
+        elem.nid = nid;
         elem.query = prop_query;
-        if ((old = lh_QUERY_delete(alg->cache, &elem)) != NULL) {
-            impl_cache_free(old);
-            store->nelem--;
-        }
+        ossl_ht_delete(store->cache, &elem);
         goto end;
     }
     p = OPENSSL_malloc(sizeof(*p) + (len = strlen(prop_query)));
     if (p != NULL) {
+        p->nid = nid;
         p->query = p->body;
         p->method.method = method;
         p->method.up_ref = method_up_ref;
@@ -565,12 +545,8 @@ int ossl_method_store_cache_set(OSSL_METHOD_STORE *store, int nid,
         if (!ossl_method_up_ref(&p->method))
             goto err;
         memcpy((char *)p->query, prop_query, len + 1);
-        if ((old = lh_QUERY_insert(alg->cache, p)) != NULL) {
-            impl_cache_free(old);
-            goto end;
-        }
-        if (!lh_QUERY_error(alg->cache)) {
-            if (++store->nelem >= IMPL_CACHE_FLUSH_THRESHOLD)
+        if (ossl_ht_insert(store->cache, p)) {
+            if (ossl_ht_num(store->cache) >= IMPL_CACHE_FLUSH_THRESHOLD)
                 store->need_flush = 1;
             goto end;
         }
@@ -0,0 +1,45 @@
+/*
+ * Copyright 2021 The OpenSSL Project Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License 2.0 (the "License").  You may not use
+ * this file except in compliance with the License.  You can obtain a copy
+ * in the file LICENSE in the source distribution or at
+ * https://www.openssl.org/source/license.html
+ */
+
+#ifndef OSSL_CRYPTO_RCU_LOCAL_H
+# define OSSL_CRYPTO_RCU_LOCAL_H
+
+# include <openssl/crypto.h>
+# include "internal/rcu.h"
+
+/*
+ * With pthreads and compiler support for lock-free atomics, RCU is
+ * implemented natively in threads_pthread.c.  Without threads, there are no
+ * concurrent readers and threads_none.c implements it trivially.  Everywhere
+ * else threads_lib.c falls back to a read-write lock.
+ */
+# if defined(OPENSSL_THREADS) && !defined(CRYPTO_TDEBUG)
+#  if !defined(OPENSSL_SYS_WINDOWS) \
+      && defined(__GNUC__) && defined(__ATOMIC_ACQUIRE) \
+      && defined(__GCC_ATOMIC_POINTER_LOCK_FREE) \
+      && __GCC_ATOMIC_POINTER_LOCK_FREE >= 2 \
+      && defined(__GCC_ATOMIC_LONG_LOCK_FREE) && __GCC_ATOMIC_LONG_LOCK_FREE >= 2
+#   define OSSL_RCU_NATIVE
+#  else
+#   define OSSL_RCU_LOCKED
+#  endif
+# endif
+
+/* The number of locks a thread can be in read sections on at the same time */
+# define RCU_MAX_HELD 8
+
+struct rcu_cb_item {
+    rcu_cb_fn fn;
+    void *data;
+    struct rcu_cb_item *next;
+};
+
+void ossl_rcu_run_callbacks(struct rcu_cb_item *items);
+
+#endif
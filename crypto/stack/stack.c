@@ -10,6 +10,7 @@
 #include <stdio.h>
 #include "internal/cryptlib.h"
 #include "internal/numbers.h"
+#include "internal/mem_pool.h"
 #include <openssl/stack.h>
 #include <errno.h>
 #include <openssl/e_os2.h>      /* For ossl_inline */
@@ -45,7 +46,7 @@ OPENSSL_STACK *OPENSSL_sk_dup(const OPENSSL_STACK *sk)
 {
     OPENSSL_STACK *ret;
 
-    if ((ret = OPENSSL_malloc(sizeof(*ret))) == NULL)
+    if ((ret = ossl_pool_zalloc(OSSL_POOL_STACK, sizeof(*ret))) == NULL)
         goto err;
 
     if (sk == NULL) {
@@ -83,7 +84,7 @@ OPENSSL_STACK *OPENSSL_sk_deep_copy(const OPENSSL_STACK *sk,
     OPENSSL_STACK *ret;
     int i;
 
-    if ((ret = OPENSSL_malloc(sizeof(*ret))) == NULL)
+    if ((ret = ossl_pool_zalloc(OSSL_POOL_STACK, sizeof(*ret))) == NULL)
         goto err;
 
     if (sk == NULL) {
@@ -218,7 +219,8 @@ static int sk_reserve(OPENSSL_STACK *st, int n, int exact)
 
 OPENSSL_STACK *OPENSSL_sk_new_reserve(OPENSSL_sk_compfunc c, int n)
 {
-    OPENSSL_STACK *st = OPENSSL_zalloc(sizeof(OPENSSL_STACK));
+    OPENSSL_STACK *st = ossl_pool_zalloc(OSSL_POOL_STACK,
+                                         sizeof(OPENSSL_STACK));
 
     if (st == NULL)
         return NULL;
@@ -386,7 +388,7 @@ void OPENSSL_sk_free(OPENSSL_STACK *st)
     if (st == NULL)
         return;
     OPENSSL_free(st->data);
-    OPENSSL_free(st);
+    ossl_pool_free(OSSL_POOL_STACK, st);
 }
 
 int OPENSSL_sk_num(const OPENSSL_STACK *st)
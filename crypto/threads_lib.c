@@ -1,5 +1,5 @@
 /*
- * Copyright 2020 The OpenSSL Project Authors. All Rights Reserved.
+ * Copyright 2020-2021 The OpenSSL Project Authors. All Rights Reserved.
  *
  * Licensed under the Apache License 2.0 (the "License").  You may not use
  * this file except in compliance with the License.  You can obtain a copy
@@ -7,6 +7,7 @@
  * https://www.openssl.org/source/license.html
  */
 #include <openssl/crypto.h>
+#include "rcu_local.h"
 
 #ifndef OPENSSL_NO_DEPRECATED_3_0
 
@@ -23,3 +24,199 @@ void OPENSSL_fork_child(void)
 }
 
 #endif
+
+void ossl_rcu_run_callbacks(struct rcu_cb_item *items)
+{
+    struct rcu_cb_item *item, *prev = NULL;
+
+    /* Callbacks were queued last in first, run them in order */
+    while ((item = items) != NULL) {
+        items = item->next;
+        item->next = prev;
+        prev = item;
+    }
+    while ((item = prev) != NULL) {
+        prev = item->next;
+        item->fn(item->data);
+        OPENSSL_free(item);
+    }
+}
+
+#ifdef OSSL_RCU_LOCKED
+
+/*
+ * Read-copy-update on top of a read-write lock.  Writers exclude readers, so
+ * once a pointer has been replaced under the write lock no reader can still
+ * be using the old value.
+ *
+ * Read sections may nest, but a thread must not take the read side of the
+ * same lock twice, as a writer waiting in between would deadlock it.  So
+ * each thread keeps track of the locks it is currently reading under, and
+ * how deeply.  That record is freed again when the thread leaves its last
+ * read section, as thread-local destructors are not available everywhere.
+ */
+struct rcu_lock_st {
+    CRYPTO_RWLOCK *rw_lock;
+    CRYPTO_RWLOCK *cb_lock;
+    struct rcu_cb_item *cb_items;
+};
+
+typedef struct {
+    size_t num;
+    struct {
+        const CRYPTO_RCU_LOCK *lock;
+        size_t depth;
+    } held[RCU_MAX_HELD];
+} RCU_THREAD;
+
+static CRYPTO_ONCE rcu_once = CRYPTO_ONCE_STATIC_INIT;
+static int rcu_inited;
+static CRYPTO_THREAD_LOCAL rcu_key;
+
+static void rcu_init(void)
+{
+    rcu_inited = CRYPTO_THREAD_init_local(&rcu_key, NULL);
+}
+
+void ossl_rcu_cleanup(void)
+{
+    if (!rcu_inited)
+        return;
+    CRYPTO_THREAD_cleanup_local(&rcu_key);
+    rcu_inited = 0;
+}
+
+CRYPTO_RCU_LOCK *ossl_rcu_lock_new(void)
+{
+    CRYPTO_RCU_LOCK *lock;
+
+    if (!CRYPTO_THREAD_run_once(&rcu_once, rcu_init) || !rcu_inited
+            || (lock = OPENSSL_zalloc(sizeof(*lock))) == NULL)
+        return NULL;
+    if ((lock->rw_lock = CRYPTO_THREAD_lock_new()) == NULL
+            || (lock->cb_lock = CRYPTO_THREAD_lock_new()) == NULL) {
+        CRYPTO_THREAD_lock_free(lock->rw_lock);
+        OPENSSL_free(lock);
+        return NULL;
+    }
+    return lock;
+}
+
+void ossl_rcu_lock_free(CRYPTO_RCU_LOCK *lock)
+{
+    if (lock == NULL)
+        return;
+
+    ossl_rcu_run_callbacks(lock->cb_items);
+    CRYPTO_THREAD_lock_free(lock->cb_lock);
+    CRYPTO_THREAD_lock_free(lock->rw_lock);
+    OPENSSL_free(lock);
+}
+
+static void rcu_thread_release(RCU_THREAD *t)
+{
+    if (t->num == 0) {
+        CRYPTO_THREAD_set_local(&rcu_key, NULL);
+        OPENSSL_free(t);
+    }
+}
+
+int ossl_rcu_read_lock(CRYPTO_RCU_LOCK *lock)
+{
+    RCU_THREAD *t = CRYPTO_THREAD_get_local(&rcu_key);
+    size_t i;
+
+    if (t == NULL) {
+        if ((t = OPENSSL_zalloc(sizeof(*t))) == NULL)
+            return 0;
+        if (!CRYPTO_THREAD_set_local(&rcu_key, t)) {
+            OPENSSL_free(t);
+            return 0;
+        }
+    }
+    for (i = 0; i < t->num; i++) {
+        if (t->held[i].lock == lock) {
+            t->held[i].depth++;
+            return 1;
+        }
+    }
+    if (t->num == RCU_MAX_HELD || !CRYPTO_THREAD_read_lock(lock->rw_lock)) {
+        rcu_thread_release(t);
+        return 0;
+    }
+    t->held[t->num].lock = lock;
+    t->held[t->num].depth = 1;
+    t->num++;
+    return 1;
+}
+
+void ossl_rcu_read_unlock(CRYPTO_RCU_LOCK *lock)
+{
+    RCU_THREAD *t = CRYPTO_THREAD_get_local(&rcu_key);
+    size_t i;
+
+    if (t == NULL)
+        return;
+    for (i = 0; i < t->num; i++) {
+        if (t->held[i].lock != lock)
+            continue;
+        if (--t->held[i].depth == 0) {
+            CRYPTO_THREAD_unlock(lock->rw_lock);
+            t->held[i] = t->held[--t->num];
+            rcu_thread_release(t);
+        }
+        return;
+    }
+}
+
+int ossl_rcu_write_lock(CRYPTO_RCU_LOCK *lock)
+{
+    return CRYPTO_THREAD_write_lock(lock->rw_lock);
+}
+
+void ossl_rcu_write_unlock(CRYPTO_RCU_LOCK *lock)
+{
+    CRYPTO_THREAD_unlock(lock->rw_lock);
+}
+
+void ossl_synchronize_rcu(CRYPTO_RCU_LOCK *lock)
+{
+    struct rcu_cb_item *items;
+
+    if (!CRYPTO_THREAD_write_lock(lock->cb_lock))
+        return;
+    items = lock->cb_items;
+    lock->cb_items = NULL;
+    CRYPTO_THREAD_unlock(lock->cb_lock);
+    ossl_rcu_run_callbacks(items);
+}
+
+int ossl_rcu_call(CRYPTO_RCU_LOCK *lock, rcu_cb_fn cb, void *data)
+{
+    struct rcu_cb_item *item;
+
+    if ((item = OPENSSL_malloc(sizeof(*item))) == NULL)
+        return 0;
+    if (!CRYPTO_THREAD_write_lock(lock->cb_lock)) {
+        OPENSSL_free(item);
+        return 0;
+    }
+    item->fn = cb;
+    item->data = data;
+    item->next = lock->cb_items;
+    lock->cb_items = item;
+    CRYPTO_THREAD_unlock(lock->cb_lock);
+    return 1;
+}
+
+void *ossl_rcu_uptr_deref(void **p)
+{
+    return *p;
+}
+
+void ossl_rcu_assign_uptr(void **p, void *v)
+{
+    *p = v;
+}
+
+#endif
@@ -1,5 +1,5 @@
 /*
- * Copyright 2016-2018 The OpenSSL Project Authors. All Rights Reserved.
+ * Copyright 2016-2021 The OpenSSL Project Authors. All Rights Reserved.
  *
  * Licensed under the Apache License 2.0 (the "License").  You may not use
  * this file except in compliance with the License.  You can obtain a copy
@@ -9,6 +9,7 @@
 
 #include <openssl/crypto.h>
 #include "internal/cryptlib.h"
+#include "rcu_local.h"
 
 #if !defined(OPENSSL_THREADS) || defined(CRYPTO_TDEBUG)
 
@@ -149,6 +150,82 @@ int CRYPTO_atomic_load(uint64_t *val, uint64_t *ret, CRYPTO_RWLOCK *lock)
     return 1;
 }
 
+/*
+ * Read-copy-update.  Without threads there are no concurrent readers, so a
+ * grace period has elapsed immediately.  Deferred callbacks are still only
+ * run on ossl_synchronize_rcu(), as the caller may not be done yet.
+ */
+struct rcu_lock_st {
+    struct rcu_cb_item *cb_items;
+};
+
+void ossl_rcu_cleanup(void)
+{
+}
+
+CRYPTO_RCU_LOCK *ossl_rcu_lock_new(void)
+{
+    return OPENSSL_zalloc(sizeof(CRYPTO_RCU_LOCK));
+}
+
+void ossl_rcu_lock_free(CRYPTO_RCU_LOCK *lock)
+{
+    if (lock == NULL)
+        return;
+
+    ossl_rcu_run_callbacks(lock->cb_items);
+    OPENSSL_free(lock);
+}
+
+int ossl_rcu_read_lock(CRYPTO_RCU_LOCK *lock)
+{
+    return 1;
+}
+
+void ossl_rcu_read_unlock(CRYPTO_RCU_LOCK *lock)
+{
+}
+
+int ossl_rcu_write_lock(CRYPTO_RCU_LOCK *lock)
+{
+    return 1;
+}
+
+void ossl_rcu_write_unlock(CRYPTO_RCU_LOCK *lock)
+{
+}
+
+void ossl_synchronize_rcu(CRYPTO_RCU_LOCK *lock)
+{
+    struct rcu_cb_item *items = lock->cb_items;
+
+    lock->cb_items = NULL;
+    ossl_rcu_run_callbacks(items);
+}
+
+int ossl_rcu_call(CRYPTO_RCU_LOCK *lock, rcu_cb_fn cb, void *data)
+{
+    struct rcu_cb_item *item;
+
+    if ((item = OPENSSL_malloc(sizeof(*item))) == NULL)
+        return 0;
+    item->fn = cb;
+    item->data = data;
+    item->next = lock->cb_items;
+    lock->cb_items = item;
+    return 1;
+}
+
+void *ossl_rcu_uptr_deref(void **p)
+{
+    return *p;
+}
+
+void ossl_rcu_assign_uptr(void **p, void *v)
+{
+    *p = v;
+}
+
 int openssl_init_fork_handlers(void)
 {
     return 0;
@@ -12,6 +12,7 @@
 
 #include <openssl/crypto.h>
 #include "internal/cryptlib.h"
+#include "rcu_local.h"
 
 #if defined(__sun)
 # include <atomic.h>
@@ -254,6 +255,355 @@ int CRYPTO_atomic_load(uint64_t *val, uint64_t *ret, CRYPTO_RWLOCK *lock)
 
     return 1;
 }
+
+/*
+ * Read-copy-update.
+ *
+ * With compiler support for atomics this follows the "memb" flavour of
+ * userspace RCU: every thread that enters a read section registers a small
+ * record, once, and from then on only stores a snapshot of the lock's grace
+ * period counter in it on entry and clears it on exit.  Those are plain
+ * stores to memory that no other thread writes to.  The ordering between
+ * the reader's record and its accesses to the protected data is provided by
+ * a full memory barrier, unless the Linux membarrier() system call is
+ * available.  Then the writer forces that barrier on all running threads of
+ * the process instead, and readers only need to stop the compiler from
+ * reordering.
+ *
+ * There is one record per thread, shared by all locks, so creating a lock
+ * costs no more than creating a mutex.  The record has a slot for each lock
+ * the thread is in a read section on at the same time, which holds the lock
+ * and the counter snapshot.  So a grace period only waits for readers of its
+ * own lock.  Records are never freed while libcrypto is in use, but reused
+ * by new threads once their thread has exited, so that writers can walk the
+ * list of records without taking a lock.
+ *
+ * The writer waiting for a grace period flips the phase bit of the lock's
+ * counter and waits for all readers that are still in a read section on the
+ * lock begun in the previous phase.  This is done twice, as a reader may
+ * have read the counter before the first flip but only stored it after the
+ * writer looked at its record.
+ *
+ * Without atomics, threads_lib.c implements RCU with a read-write lock.
+ */
+# ifdef OSSL_RCU_NATIVE
+
+#  include <sched.h>
+#  if defined(__linux__)
+#   include <sys/syscall.h>
+#   ifdef __NR_membarrier
+#    define RCU_USE_MEMBARRIER
+/* From <linux/membarrier.h>, which older systems lack */
+#    define RCU_MEMBARRIER_CMD_QUERY                        0
+#    define RCU_MEMBARRIER_CMD_PRIVATE_EXPEDITED            (1 << 3)
+#    define RCU_MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED   (1 << 4)
+#   endif
+#  endif
+
+/*
+ * A slot's counter holds the read section nesting level in the lower half
+ * and the lock's phase at the outermost entry in the bit above.
+ */
+#  define RCU_COUNT         1UL
+#  define RCU_NEST_MASK     ((RCU_COUNT << (sizeof(long) * 4)) - 1)
+#  define RCU_PHASE         (RCU_NEST_MASK + 1)
+
+#  define RCU_CACHE_LINE    64
+
+typedef struct rcu_reader_st RCU_READER;
+
+struct rcu_reader_st {
+    struct {
+        const CRYPTO_RCU_LOCK *lock;
+        unsigned long ctr;
+    } held[RCU_MAX_HELD];
+    int in_use;
+    RCU_READER *next;
+    /* Keep other readers off the cache line of the last slots */
+    unsigned char pad[RCU_CACHE_LINE];
+};
+
+struct rcu_lock_st {
+    pthread_mutex_t write_lock;
+    /* Serialises the grace periods of this lock */
+    pthread_mutex_t gp_lock;
+    unsigned long gp_ctr;
+    struct rcu_cb_item *cb_items;
+};
+
+static pthread_once_t rcu_once = PTHREAD_ONCE_INIT;
+static int rcu_inited;
+static pthread_key_t rcu_key;
+/* Read by all readers, set before any lock exists */
+static int rcu_membarrier;
+/* Only ever grows until ossl_rcu_cleanup() */
+static RCU_READER *rcu_readers;
+
+static int rcu_membarrier_init(void)
+{
+#  ifdef RCU_USE_MEMBARRIER
+    long cmds = syscall(__NR_membarrier, RCU_MEMBARRIER_CMD_QUERY, 0);
+    long need = RCU_MEMBARRIER_CMD_PRIVATE_EXPEDITED
+                | RCU_MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED;
+
+    if (cmds > 0 && (cmds & need) == need
+            && syscall(__NR_membarrier,
+                       RCU_MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED, 0) == 0)
+        return 1;
+#  endif
+    return 0;
+}
+
+/* Pairs with rcu_writer_barrier() */
+static ossl_inline void rcu_reader_barrier(void)
+{
+    if (rcu_membarrier)
+        __atomic_signal_fence(__ATOMIC_SEQ_CST);
+    else
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+static void rcu_writer_barrier(void)
+{
+#  ifdef RCU_USE_MEMBARRIER
+    if (rcu_membarrier) {
+        syscall(__NR_membarrier, RCU_MEMBARRIER_CMD_PRIVATE_EXPEDITED, 0);
+        return;
+    }
+#  endif
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+/*
+ * Called on thread exit, when the thread is no longer in any read section,
+ * so all slots are idle and the record can be handed to another thread.
+ */
+static void rcu_unregister_reader(void *arg)
+{
+    RCU_READER *r = arg;
+
+    __atomic_store_n(&r->in_use, 0, __ATOMIC_RELEASE);
+}
+
+static RCU_READER *rcu_register_reader(void)
+{
+    RCU_READER *r;
+    int idle;
+
+    for (r = __atomic_load_n(&rcu_readers, __ATOMIC_ACQUIRE); r != NULL;
+         r = r->next) {
+        idle = 0;
+        if (!__atomic_load_n(&r->in_use, __ATOMIC_RELAXED)
+                && __atomic_compare_exchange_n(&r->in_use, &idle, 1, 0,
+                                               __ATOMIC_ACQUIRE,
+                                               __ATOMIC_RELAXED))
+            break;
+    }
+    if (r == NULL) {
+        if ((r = OPENSSL_zalloc(sizeof(*r))) == NULL)
+            return NULL;
+        r->in_use = 1;
+        r->next = __atomic_load_n(&rcu_readers, __ATOMIC_RELAXED);
+        while (!__atomic_compare_exchange_n(&rcu_readers, &r->next, r, 1,
+                                            __ATOMIC_RELEASE,
+                                            __ATOMIC_RELAXED))
+            continue;
+    }
+    if (pthread_setspecific(rcu_key, r) != 0) {
+        rcu_unregister_reader(r);
+        return NULL;
+    }
+    return r;
+}
+
+static void rcu_init(void)
+{
+    if (pthread_key_create(&rcu_key, rcu_unregister_reader) != 0)
+        return;
+    rcu_membarrier = rcu_membarrier_init();
+    rcu_inited = 1;
+}
+
+void ossl_rcu_cleanup(void)
+{
+    RCU_READER *r;
+
+    if (!rcu_inited)
+        return;
+    /* No thread may run our destructor once libcrypto has been unloaded */
+    pthread_key_delete(rcu_key);
+    rcu_inited = 0;
+    while ((r = rcu_readers) != NULL) {
+        rcu_readers = r->next;
+        OPENSSL_free(r);
+    }
+}
+
+CRYPTO_RCU_LOCK *ossl_rcu_lock_new(void)
+{
+    CRYPTO_RCU_LOCK *lock;
+
+    if (pthread_once(&rcu_once, rcu_init) != 0 || !rcu_inited)
+        return NULL;
+    if ((lock = OPENSSL_zalloc(sizeof(*lock))) == NULL)
+        return NULL;
+    if (pthread_mutex_init(&lock->write_lock, NULL) != 0) {
+        OPENSSL_free(lock);
+        return NULL;
+    }
+    if (pthread_mutex_init(&lock->gp_lock, NULL) != 0) {
+        pthread_mutex_destroy(&lock->write_lock);
+        OPENSSL_free(lock);
+        return NULL;
+    }
+    lock->gp_ctr = RCU_COUNT;
+    return lock;
+}
+
+void ossl_rcu_lock_free(CRYPTO_RCU_LOCK *lock)
+{
+    if (lock == NULL)
+        return;
+
+    ossl_rcu_run_callbacks(lock->cb_items);
+    pthread_mutex_destroy(&lock->gp_lock);
+    pthread_mutex_destroy(&lock->write_lock);
+    OPENSSL_free(lock);
+}
+
+int ossl_rcu_read_lock(CRYPTO_RCU_LOCK *lock)
+{
+    RCU_READER *r = pthread_getspecific(rcu_key);
+    unsigned long tmp;
+    int i, free_slot = -1;
+
+    if (r == NULL && (r = rcu_register_reader()) == NULL)
+        return 0;
+
+    /* Only this thread writes to its slots */
+    for (i = 0; i < RCU_MAX_HELD; i++) {
+        tmp = r->held[i].ctr;
+        if ((tmp & RCU_NEST_MASK) == 0) {
+            if (free_slot < 0)
+                free_slot = i;
+        } else if (r->held[i].lock == lock) {
+            __atomic_store_n(&r->held[i].ctr, tmp + RCU_COUNT,
+                             __ATOMIC_RELAXED);
+            return 1;
+        }
+    }
+    if (free_slot < 0)
+        return 0;
+
+    /* A writer seeing the new counter must also see the lock it is for */
+    __atomic_store_n(&r->held[free_slot].lock, lock, __ATOMIC_RELEASE);
+    __atomic_store_n(&r->held[free_slot].ctr,
+                     __atomic_load_n(&lock->gp_ctr, __ATOMIC_RELAXED),
+                     __ATOMIC_RELEASE);
+    rcu_reader_barrier();
+    return 1;
+}
+
+void ossl_rcu_read_unlock(CRYPTO_RCU_LOCK *lock)
+{
+    RCU_READER *r = pthread_getspecific(rcu_key);
+    unsigned long tmp;
+    int i;
+
+    if (r == NULL)
+        return;
+
+    for (i = 0; i < RCU_MAX_HELD; i++) {
+        tmp = r->held[i].ctr;
+        if ((tmp & RCU_NEST_MASK) == 0 || r->held[i].lock != lock)
+            continue;
+        if ((tmp & RCU_NEST_MASK) == RCU_COUNT)
+            rcu_reader_barrier();
+        __atomic_store_n(&r->held[i].ctr, tmp - RCU_COUNT, __ATOMIC_RELAXED);
+        return;
+    }
+}
+
+int ossl_rcu_write_lock(CRYPTO_RCU_LOCK *lock)
+{
+    return pthread_mutex_lock(&lock->write_lock) == 0;
+}
+
+void ossl_rcu_write_unlock(CRYPTO_RCU_LOCK *lock)
+{
+    pthread_mutex_unlock(&lock->write_lock);
+}
+
+/* Readers in a read section on another lock are not waited for */
+static void rcu_flip_and_wait(CRYPTO_RCU_LOCK *lock)
+{
+    unsigned long gp = lock->gp_ctr ^ RCU_PHASE, v;
+    RCU_READER *r;
+    int i;
+
+    __atomic_store_n(&lock->gp_ctr, gp, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    for (r = __atomic_load_n(&rcu_readers, __ATOMIC_ACQUIRE); r != NULL;
+         r = r->next) {
+        for (i = 0; i < RCU_MAX_HELD; i++) {
+            for (;;) {
+                v = __atomic_load_n(&r->held[i].ctr, __ATOMIC_ACQUIRE);
+                if ((v & RCU_NEST_MASK) == 0
+                        || __atomic_load_n(&r->held[i].lock,
+                                           __ATOMIC_RELAXED) != lock
+                        || ((v ^ gp) & RCU_PHASE) == 0)
+                    break;
+                sched_yield();
+            }
+        }
+    }
+}
+
+void ossl_synchronize_rcu(CRYPTO_RCU_LOCK *lock)
+{
+    struct rcu_cb_item *items;
+
+    items = __atomic_exchange_n(&lock->cb_items, NULL, __ATOMIC_ACQ_REL);
+    pthread_mutex_lock(&lock->gp_lock);
+    /* Make everything unpublished so far visible before looking at readers */
+    rcu_writer_barrier();
+    rcu_flip_and_wait(lock);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    rcu_flip_and_wait(lock);
+    /* And finish all the readers' accesses before anything gets freed */
+    rcu_writer_barrier();
+    pthread_mutex_unlock(&lock->gp_lock);
+    ossl_rcu_run_callbacks(items);
+}
+
+int ossl_rcu_call(CRYPTO_RCU_LOCK *lock, rcu_cb_fn cb, void *data)
+{
+    struct rcu_cb_item *item;
+
+    if ((item = OPENSSL_malloc(sizeof(*item))) == NULL)
+        return 0;
+    item->fn = cb;
+    item->data = data;
+    item->next = __atomic_load_n(&lock->cb_items, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&lock->cb_items, &item->next, item,
+                                        1, __ATOMIC_RELEASE,
+                                        __ATOMIC_RELAXED))
+        continue;
+    return 1;
+}
+
+void *ossl_rcu_uptr_deref(void **p)
+{
+    return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+
+void ossl_rcu_assign_uptr(void **p, void *v)
+{
+    __atomic_store_n(p, v, __ATOMIC_RELEASE);
+}
+
+# endif /* OSSL_RCU_NATIVE */
+
 # ifndef FIPS_MODULE
 #  ifdef OPENSSL_SYS_UNIX
 
@@ -24,6 +24,8 @@
 #include <openssl/x509v3.h>
 #include <openssl/objects.h>
 #include "internal/dane.h"
+#include "internal/err.h"
+#include "internal/metrics.h"
 #include "crypto/x509.h"
 #include "x509_local.h"
 
@@ -118,9 +120,9 @@ static int lookup_cert_match(X509 **result, X509_STORE_CTX *ctx, X509 *x)
 
     *result = NULL;
     /* Lookup all certs with matching subject name */
-    ERR_set_mark();
+    ossl_err_set_suppressed_mark();
     certs = ctx->lookup_certs(ctx, X509_get_subject_name(x));
-    ERR_pop_to_mark();
+    ossl_err_pop_to_suppressed_mark();
     if (certs == NULL)
         return -1;
     /* Look for exact match */
@@ -257,14 +259,10 @@ int X509_STORE_CTX_verify(X509_STORE_CTX *ctx)
     return X509_verify_cert(ctx);
 }
 
-int X509_verify_cert(X509_STORE_CTX *ctx)
+static int verify_cert(X509_STORE_CTX *ctx)
 {
     int ret;
 
-    if (ctx == NULL) {
-        ERR_raise(ERR_LIB_X509, ERR_R_PASSED_NULL_PARAMETER);
-        return -1;
-    }
     if (ctx->cert == NULL) {
         ERR_raise(ERR_LIB_X509, X509_R_NO_CERT_SET_FOR_US_TO_VERIFY);
         ctx->error = X509_V_ERR_INVALID_CALL;
@@ -303,6 +301,22 @@ int X509_verify_cert(X509_STORE_CTX *ctx)
     return ret;
 }
 
+int X509_verify_cert(X509_STORE_CTX *ctx)
+{
+    uint64_t start = ossl_metric_now();
+    int ret;
+
+    if (ctx == NULL) {
+        ERR_raise(ERR_LIB_X509, ERR_R_PASSED_NULL_PARAMETER);
+        return -1;
+    }
+    ret = verify_cert(ctx);
+    ossl_metric_time(ctx->libctx, OSSL_METRIC_X509_VERIFY, start);
+    if (ret <= 0)
+        ossl_metric_count(ctx->libctx, OSSL_METRIC_X509_VERIFY_FAIL);
+    return ret;
+}
+
 static int sk_X509_contains(STACK_OF(X509) *sk, X509 *cert)
 {
     int i, n = sk_X509_num(sk);
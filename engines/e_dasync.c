@@ -41,6 +41,12 @@
 # undef ASYNC_POSIX
 # define ASYNC_POSIX
 # include <unistd.h>
+# if defined(__linux__)
+/* A single eventfd is cheaper than a pipe as the wake-up signal */
+#  define DASYNC_EVENTFD
+#  include <stdint.h>
+#  include <sys/eventfd.h>
+# endif
 #elif defined(_WIN32)
 # undef ASYNC_WIN
 # define ASYNC_WIN
@@ -459,7 +465,8 @@ static void wait_cleanup(ASYNC_WAIT_CTX *ctx, const void *key,
     CloseHandle(*pwritefd);
 #elif defined(ASYNC_POSIX)
     close(readfd);
-    close(*pwritefd);
+    if (*pwritefd != readfd)
+        close(*pwritefd);
 #endif
     OPENSSL_free(pwritefd);
 }
@@ -476,6 +483,8 @@ static void dummy_pause_job(void) {
 #if defined(ASYNC_WIN)
     DWORD numwritten, numread;
     char buf = DUMMY_CHAR;
+#elif defined(DASYNC_EVENTFD)
+    uint64_t buf = 1;
 #elif defined(ASYNC_POSIX)
     char buf = DUMMY_CHAR;
 #endif
@@ -509,6 +518,12 @@ static void dummy_pause_job(void) {
             OPENSSL_free(writefd);
             return;
         }
+#elif defined(DASYNC_EVENTFD)
+        /* The same fd is used for both waking and waiting */
+        if ((pipefds[0] = pipefds[1] = eventfd(0, 0)) < 0) {
+            OPENSSL_free(writefd);
+            return;
+        }
 #elif defined(ASYNC_POSIX)
         if (pipe(pipefds) != 0) {
             OPENSSL_free(writefd);
@@ -531,7 +546,7 @@ static void dummy_pause_job(void) {
 #if defined(ASYNC_WIN)
     WriteFile(pipefds[1], &buf, 1, &numwritten, NULL);
 #elif defined(ASYNC_POSIX)
-    if (write(pipefds[1], &buf, 1) < 0)
+    if (write(pipefds[1], &buf, sizeof(buf)) < 0)
         return;
 #endif
 
@@ -542,7 +557,7 @@ static void dummy_pause_job(void) {
 #if defined(ASYNC_WIN)
     ReadFile(pipefds[0], &buf, 1, &numread, NULL);
 #elif defined(ASYNC_POSIX)
-    if (read(pipefds[0], &buf, 1) < 0)
+    if (read(pipefds[0], &buf, sizeof(buf)) < 0)
         return;
 #endif
 }
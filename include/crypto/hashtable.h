@@ -0,0 +1,55 @@
+/*
+ * Copyright 2021 The OpenSSL Project Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License 2.0 (the "License").  You may not use
+ * this file except in compliance with the License.  You can obtain a copy
+ * in the file LICENSE in the source distribution or at
+ * https://www.openssl.org/source/license.html
+ */
+
+#ifndef OSSL_CRYPTO_HASHTABLE_H
+# define OSSL_CRYPTO_HASHTABLE_H
+# pragma once
+
+# include <stddef.h>
+
+/*
+ * A hash table for shared, read-mostly data.
+ *
+ * Lookups are RCU read sections, so any number of threads can read
+ * concurrently without contending with each other.  Writers are serialised by a lock
+ * private to the table and never wait for readers, except when they free
+ * entries: replaced and deleted entries are passed to the free function
+ * only once no reader can still be looking at them.  Inserting a new key
+ * never waits, so it is safe while holding a lock that readers also take.
+ *
+ * Pointers returned by ossl_ht_get() and passed to ossl_ht_doall() callbacks
+ * are only guaranteed to stay valid until the matching ossl_ht_read_unlock().
+ * Apart from inserting new keys, readers must not modify the table from
+ * within a read section.
+ */
+
+typedef struct ossl_ht_st OSSL_HT;
+
+typedef unsigned long (*OSSL_HT_HASHFUNC)(const void *);
+typedef int (*OSSL_HT_COMPFUNC)(const void *, const void *);
+typedef void (*OSSL_HT_FREEFUNC)(void *);
+typedef void (*OSSL_HT_DOALLFUNC)(void *, void *);
+typedef int (*OSSL_HT_FILTERFUNC)(void *, void *);
+
+OSSL_HT *ossl_ht_new(OSSL_HT_HASHFUNC hash, OSSL_HT_COMPFUNC comp,
+                     OSSL_HT_FREEFUNC free_fn);
+void ossl_ht_free(OSSL_HT *ht);
+
+int ossl_ht_read_lock(OSSL_HT *ht);
+void ossl_ht_read_unlock(OSSL_HT *ht);
+void *ossl_ht_get(OSSL_HT *ht, const void *key);
+void ossl_ht_doall(OSSL_HT *ht, OSSL_HT_DOALLFUNC fn, void *arg);
+size_t ossl_ht_num(const OSSL_HT *ht);
+
+int ossl_ht_insert(OSSL_HT *ht, void *data);
+int ossl_ht_delete(OSSL_HT *ht, const void *key);
+size_t ossl_ht_filter(OSSL_HT *ht, OSSL_HT_FILTERFUNC keep, void *arg);
+void ossl_ht_flush(OSSL_HT *ht);
+
+#endif
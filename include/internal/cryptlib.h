@@ -99,6 +99,18 @@ int openssl_get_fork_id(void);
 
 char *ossl_safe_getenv(const char *name);
 
+/*
+ * Native thread local variables, where the compiler supports them.  There
+ * are no destructors, use ossl_init_thread_start() for cleanup.
+ */
+# if defined(OPENSSL_THREADS) && !defined(CRYPTO_TDEBUG)
+#  if defined(__GNUC__) && defined(__ELF__)
+#   define OSSL_THREAD_LOCAL __thread
+#  elif defined(_MSC_VER)
+#   define OSSL_THREAD_LOCAL __declspec(thread)
+#  endif
+# endif
+
 extern CRYPTO_RWLOCK *memdbg_lock;
 int openssl_strerror_r(int errnum, char *buf, size_t buflen);
 # if !defined(OPENSSL_NO_STDIO)
@@ -126,15 +138,30 @@ struct ex_callback_st {
 };
 
 /*
- * The state for each class.  This could just be a typedef, but
- * a structure allows future changes.
+ * An immutable copy of the callbacks of a class, which is what instances
+ * use.  Snapshots that have been replaced are kept until the library context
+ * goes away, so that a snapshot can be used outside of any lock.
+ */
+typedef struct ex_snapshot_st EX_SNAPSHOT;
+struct ex_snapshot_st {
+    EX_SNAPSHOT *retired;       /* Next older replaced snapshot */
+    int num;                    /* Number of indexes */
+    int has_new, has_dup, has_free;
+    EX_CALLBACK *meth;          /* |num| entries, following the snapshot */
+};
+
+/*
+ * The state for each class.  The stack is only used by the writers, which
+ * publish a new snapshot whenever they change it.
  */
 typedef struct ex_callbacks_st {
     STACK_OF(EX_CALLBACK) *meth;
+    EX_SNAPSHOT *snapshot;
 } EX_CALLBACKS;
 
 typedef struct ossl_ex_data_global_st {
     CRYPTO_RWLOCK *ex_data_lock;
+    EX_SNAPSHOT *retired;
     EX_CALLBACKS ex_data[CRYPTO_EX_INDEX__COUNT];
 } OSSL_EX_DATA_GLOBAL;
 
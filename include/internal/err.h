@@ -13,4 +13,14 @@
 
 void err_free_strings_int(void);
 
+/*
+ * Like the ERR_set_mark() family, for code that speculatively tries things
+ * and usually discards the errors raised on failure.  Until the suppressed
+ * mark is popped or cleared, raised errors are only recorded by their code,
+ * without location or additional data, which makes raising them very cheap.
+ */
+int ossl_err_set_suppressed_mark(void);
+int ossl_err_pop_to_suppressed_mark(void);
+int ossl_err_clear_last_suppressed_mark(void);
+
 #endif
@@ -0,0 +1,63 @@
+/*
+ * Copyright 2021 The OpenSSL Project Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License 2.0 (the "License").  You may not use
+ * this file except in compliance with the License.  You can obtain a copy
+ * in the file LICENSE in the source distribution or at
+ * https://www.openssl.org/source/license.html
+ */
+
+#ifndef OSSL_INTERNAL_MEM_POOL_H
+# define OSSL_INTERNAL_MEM_POOL_H
+# pragma once
+
+# include <openssl/crypto.h>
+
+/*
+ * Pools for small fixed size objects that are allocated and freed at a high
+ * rate.  Freed objects are kept in a small per-thread cache for their type
+ * and handed out again by the next allocation, so that most of them never
+ * reach the system allocator.
+ *
+ * Pooled objects are ordinary OPENSSL_malloc() allocations: objects of a
+ * pooled type may still be freed with OPENSSL_free(), and ossl_pool_free()
+ * accepts any allocation of exactly the pool's object size.
+ *
+ * Pooling is off unless OpenSSL is configured with enable-mem-pool, and the
+ * OPENSSL_MEM_POOL environment variable set to 0 or 1 overrides that at run
+ * time.  CRYPTO_get_mem_pool_stats() reports how well a pool is doing, so
+ * the pools are numbered as in the public API.
+ */
+
+typedef enum {
+    OSSL_POOL_BIGNUM = CRYPTO_MEM_POOL_BIGNUM,
+    OSSL_POOL_ASN1_STRING = CRYPTO_MEM_POOL_ASN1_STRING,
+    OSSL_POOL_STACK = CRYPTO_MEM_POOL_STACK,
+    OSSL_POOL_EVP_MD_CTX = CRYPTO_MEM_POOL_EVP_MD_CTX,
+    OSSL_POOL_NUM
+} OSSL_POOL_ID;
+
+typedef struct {
+    uint64_t allocs;            /* objects handed out */
+    uint64_t reused;            /* ... of which came from a cache */
+    uint64_t frees;             /* objects given back */
+    uint64_t released;          /* ... of which went to the system */
+} OSSL_POOL_STATS;
+
+# ifdef FIPS_MODULE
+#  define ossl_pool_zalloc(id, num) OPENSSL_zalloc(num)
+#  define ossl_pool_free(id, addr) OPENSSL_free(addr)
+# else
+#  define ossl_pool_zalloc(id, num) \
+        ossl_pool_zalloc_int(id, num, OPENSSL_FILE, OPENSSL_LINE)
+#  define ossl_pool_free(id, addr) \
+        ossl_pool_free_int(id, addr, OPENSSL_FILE, OPENSSL_LINE)
+
+void *ossl_pool_zalloc_int(OSSL_POOL_ID id, size_t num,
+                           const char *file, int line);
+void ossl_pool_free_int(OSSL_POOL_ID id, void *addr,
+                        const char *file, int line);
+void ossl_pool_cleanup(void);
+# endif
+
+#endif
@@ -0,0 +1,56 @@
+/*
+ * Copyright 2021 The OpenSSL Project Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License 2.0 (the "License").  You may not use
+ * this file except in compliance with the License.  You can obtain a copy
+ * in the file LICENSE in the source distribution or at
+ * https://www.openssl.org/source/license.html
+ */
+
+#ifndef OSSL_INTERNAL_METRICS_H
+# define OSSL_INTERNAL_METRICS_H
+# pragma once
+
+# include <openssl/metrics.h>
+
+/*
+ * The metrics of a library context.  They live in the context itself, so
+ * that recording a metric needs no lookup beyond finding the context.  Each
+ * thread records into one of several stripes, so that threads running on
+ * different cores rarely write to the same cache line, and reading a metric
+ * adds up all stripes.  Only the timed metrics have a histogram.  The
+ * counters are 64 bits wide on all platforms, so that they don't wrap.
+ */
+# define OSSL_METRIC_STRIPES        16
+# define OSSL_METRIC_TIMED_NUM      3
+
+typedef struct {
+    uint64_t count[OSSL_METRIC_NUM];
+    uint64_t hist[OSSL_METRIC_TIMED_NUM][OSSL_METRIC_HISTOGRAM_BUCKETS];
+    /* Keep the next stripe off the cache line of the last counters */
+    uint64_t pad[8];
+} OSSL_METRIC_STRIPE;
+
+typedef struct {
+    OSSL_METRIC_STRIPE stripe[OSSL_METRIC_STRIPES];
+} OSSL_METRICS;
+
+/*
+ * ossl_metric_count() records an event, ossl_metric_time() an operation
+ * that started at |start|, as returned by ossl_metric_now().  The FIPS
+ * provider has no access to the metrics.
+ */
+# ifdef FIPS_MODULE
+#  define ossl_metric_now() 0
+#  define ossl_metric_count(ctx, metric) ((void)0)
+#  define ossl_metric_time(ctx, metric, start) ((void)0)
+# else
+#  define ossl_metric_count(ctx, metric) OSSL_METRIC_record(ctx, metric, 0)
+#  define ossl_metric_time(ctx, metric, start) \
+        OSSL_METRIC_record(ctx, metric, ossl_metric_now() - (start))
+
+uint64_t ossl_metric_now(void);
+OSSL_METRICS *ossl_lib_ctx_get_metrics(OSSL_LIB_CTX *ctx);
+# endif
+
+#endif
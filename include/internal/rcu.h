@@ -0,0 +1,62 @@
+/*
+ * Copyright 2021 The OpenSSL Project Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License 2.0 (the "License").  You may not use
+ * this file except in compliance with the License.  You can obtain a copy
+ * in the file LICENSE in the source distribution or at
+ * https://www.openssl.org/source/license.html
+ */
+
+#ifndef OSSL_INTERNAL_RCU_H
+# define OSSL_INTERNAL_RCU_H
+# pragma once
+
+/*
+ * Read-copy-update for read-mostly shared data.
+ *
+ * Readers bracket their accesses with ossl_rcu_read_lock() and
+ * ossl_rcu_read_unlock() and fetch shared pointers with ossl_rcu_deref().
+ * Read sections may nest and never block.  Where the platform allows it
+ * they do not execute any atomic read-modify-write instruction either.
+ *
+ * Writers are serialised by ossl_rcu_write_lock().  They never modify data
+ * that readers may be looking at, but build a new version and publish it
+ * with ossl_rcu_assign_ptr().  The old version may only be freed once a
+ * grace period has elapsed, that is after every read section that was
+ * active when it was unpublished has ended.  ossl_synchronize_rcu() waits
+ * for a grace period.  Alternatively, ossl_rcu_call() defers a callback
+ * until the end of the next grace period.
+ *
+ * ossl_synchronize_rcu() must not be called from within a read section on
+ * the same lock.  It only waits for read sections on the same lock.  A
+ * thread can only be in read sections on a few different locks at the same
+ * time, beyond that ossl_rcu_read_lock() fails.
+ *
+ * ossl_rcu_cleanup() releases the per-thread state of all locks.  It is
+ * called from OPENSSL_cleanup(), after which no lock may be used any more.
+ */
+
+typedef struct rcu_lock_st CRYPTO_RCU_LOCK;
+
+typedef void (*rcu_cb_fn)(void *data);
+
+CRYPTO_RCU_LOCK *ossl_rcu_lock_new(void);
+void ossl_rcu_lock_free(CRYPTO_RCU_LOCK *lock);
+
+int ossl_rcu_read_lock(CRYPTO_RCU_LOCK *lock);
+void ossl_rcu_read_unlock(CRYPTO_RCU_LOCK *lock);
+int ossl_rcu_write_lock(CRYPTO_RCU_LOCK *lock);
+void ossl_rcu_write_unlock(CRYPTO_RCU_LOCK *lock);
+
+void ossl_synchronize_rcu(CRYPTO_RCU_LOCK *lock);
+int ossl_rcu_call(CRYPTO_RCU_LOCK *lock, rcu_cb_fn cb, void *data);
+
+void ossl_rcu_cleanup(void);
+
+void *ossl_rcu_uptr_deref(void **p);
+void ossl_rcu_assign_uptr(void **p, void *v);
+
+# define ossl_rcu_deref(p) ossl_rcu_uptr_deref((void **)(p))
+# define ossl_rcu_assign_ptr(p, v) ossl_rcu_assign_uptr((void **)(p), (v))
+
+#endif
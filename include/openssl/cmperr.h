@@ -61,6 +61,7 @@
 #  define CMP_R_FAIL_INFO_OUT_OF_RANGE                     129
 #  define CMP_R_INVALID_ARGS                               100
 #  define CMP_R_INVALID_OPTION                             174
+#  define CMP_R_MESSAGETIME_OUT_OF_RANGE                   195
 #  define CMP_R_MISSING_KEY_INPUT_FOR_CREATING_PROTECTION  130
 #  define CMP_R_MISSING_KEY_USAGE_DIGITALSIGNATURE         142
 #  define CMP_R_MISSING_P10CSR                             121
@@ -82,6 +83,7 @@
 #  define CMP_R_POTENTIALLY_INVALID_CERTIFICATE            147
 #  define CMP_R_RECEIVED_ERROR                             180
 #  define CMP_R_RECIPNONCE_UNMATCHED                       148
+#  define CMP_R_REPLAYED_MESSAGE                           196
 #  define CMP_R_REQUEST_NOT_ACCEPTED                       149
 #  define CMP_R_REQUEST_REJECTED_BY_SERVER                 182
 #  define CMP_R_SENDER_GENERALNAME_TYPE_NOT_SUPPORTED      150
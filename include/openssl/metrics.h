@@ -0,0 +1,75 @@
+/*
+ * Copyright 2021 The OpenSSL Project Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License 2.0 (the "License").  You may not use
+ * this file except in compliance with the License.  You can obtain a copy
+ * in the file LICENSE in the source distribution or at
+ * https://www.openssl.org/source/license.html
+ */
+
+#ifndef OPENSSL_METRICS_H
+# define OPENSSL_METRICS_H
+# pragma once
+
+# include <openssl/types.h>
+# include <openssl/bio.h>
+
+# ifdef  __cplusplus
+extern "C" {
+# endif
+
+/*
+ * METRICS
+ *
+ * Unlike tracing, metrics are always compiled in.  Every library context
+ * keeps a counter for each metric, and for the timed metrics also a
+ * histogram of how long the operations took.  Recording a metric costs no
+ * more than an atomic increment or two, on counters that are kept apart for
+ * different threads.
+ */
+# define OSSL_METRIC_FETCH_CACHE_HIT             0
+# define OSSL_METRIC_FETCH_CACHE_MISS            1
+# define OSSL_METRIC_DECODER_ATTEMPT             2
+# define OSSL_METRIC_DECODER_SUCCESS             3
+# define OSSL_METRIC_X509_VERIFY                 4 /* timed */
+# define OSSL_METRIC_X509_VERIFY_FAIL            5
+# define OSSL_METRIC_DRBG_RESEED                 6
+# define OSSL_METRIC_SSL_SESS_CACHE_HIT          7
+# define OSSL_METRIC_SSL_SESS_CACHE_MISS         8
+# define OSSL_METRIC_CMP_MSG_SENT                9
+# define OSSL_METRIC_CMP_MSG_RECEIVED           10
+# define OSSL_METRIC_CMP_TRANSFER               11 /* timed */
+# define OSSL_METRIC_CMP_TRANSFER_FAIL          12
+# define OSSL_METRIC_HTTP_TRANSFER              13 /* timed */
+# define OSSL_METRIC_HTTP_TRANSFER_FAIL         14
+# define OSSL_METRIC_CMP_SRV_REQUEST            15
+# define OSSL_METRIC_CMP_SRV_REJECT_SYNTAX      16
+# define OSSL_METRIC_CMP_SRV_REJECT_HEADER      17
+# define OSSL_METRIC_CMP_SRV_REJECT_REPLAY      18
+# define OSSL_METRIC_CMP_SRV_REJECT_VERIFY      19
+# define OSSL_METRIC_CMP_SRV_POPO_CACHED        20
+# define OSSL_METRIC_NUM                        21
+
+/*
+ * Bucket 0 of a histogram counts durations below 1 microsecond, bucket i
+ * those of at least 2^(i-1) and below 2^i microseconds.  The last bucket
+ * also counts everything longer.
+ */
+# define OSSL_METRIC_HISTOGRAM_BUCKETS          24
+
+int OSSL_METRIC_get_num(const char *name);
+const char *OSSL_METRIC_get_name(int metric);
+int OSSL_METRIC_is_timed(int metric);
+
+void OSSL_METRIC_record(OSSL_LIB_CTX *ctx, int metric, uint64_t usec);
+uint64_t OSSL_METRIC_get_count(OSSL_LIB_CTX *ctx, int metric);
+int OSSL_METRIC_get_histogram(OSSL_LIB_CTX *ctx, int metric,
+                              uint64_t *buckets, size_t num_buckets);
+void OSSL_METRIC_reset(OSSL_LIB_CTX *ctx);
+int OSSL_METRIC_print(BIO *out, OSSL_LIB_CTX *ctx);
+
+# ifdef  __cplusplus
+}
+# endif
+
+#endif
@@ -16,6 +16,7 @@
 #include <openssl/proverr.h>
 #include "drbg_local.h"
 #include "internal/thread_once.h"
+#include "internal/metrics.h"
 #include "crypto/cryptlib.h"
 #include "prov/seeding.h"
 #include "crypto/rand_pool.h"
@@ -593,6 +594,8 @@ int ossl_prov_drbg_reseed(PROV_DRBG *drbg, int prediction_resistance,
     tsan_store(&drbg->reseed_counter, drbg->reseed_next_counter);
     if (drbg->parent != NULL)
         drbg->parent_reseed_counter = get_parent_reseed_count(drbg);
+    ossl_metric_count(ossl_prov_ctx_get0_libctx(drbg->provctx),
+                      OSSL_METRIC_DRBG_RESEED);
 
  end:
     cleanup_entropy(drbg, entropy, entropylen);
@@ -13,6 +13,7 @@
 #include <openssl/engine.h>
 #include "internal/refcount.h"
 #include "internal/cryptlib.h"
+#include "internal/metrics.h"
 #include "ssl_local.h"
 #include "statem/statem_local.h"
 
@@ -437,6 +438,9 @@ SSL_SESSION *lookup_sess_in_cache(SSL *s, const unsigned char *sess_id,
         CRYPTO_THREAD_unlock(s->session_ctx->lock);
         if (ret == NULL)
             tsan_counter(&s->session_ctx->stats.sess_miss);
+        ossl_metric_count(s->ctx->libctx,
+                          ret != NULL ? OSSL_METRIC_SSL_SESS_CACHE_HIT
+                                      : OSSL_METRIC_SSL_SESS_CACHE_MISS);
     }
 
     if (ret == NULL && s->session_ctx->get_session_cb != NULL) {
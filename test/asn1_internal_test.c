@@ -15,6 +15,7 @@
 #include <openssl/asn1.h>
 #include <openssl/evp.h>
 #include <openssl/objects.h>
+#include <openssl/err.h>
 #include "testutil.h"
 #include "internal/nelem.h"
 
@@ -107,9 +108,68 @@ static int test_standard_methods(void)
     return 0;
 }
 
+/**********************************************************************
+ *
+ * Test of the object lookups
+ *
+ ***/
+
+static int test_obj_lookups(void)
+{
+    char txt[128], small[6];
+    ASN1_OBJECT *obj, *tobj = NULL;
+    const char *sn, *ln;
+    int nid, n, ok = 1;
+
+    for (nid = 1; nid < 2000 && ok; nid++) {
+        if ((obj = OBJ_nid2obj(nid)) == NULL) {
+            ERR_clear_error();
+            continue;
+        }
+        /* A few names are shared by two objects, only one of them is found */
+        if ((sn = OBJ_nid2sn(nid)) != NULL
+                && !TEST_str_eq(OBJ_nid2sn(OBJ_sn2nid(sn)), sn))
+            ok = 0;
+        if ((ln = OBJ_nid2ln(nid)) != NULL
+                && !TEST_str_eq(OBJ_nid2ln(OBJ_ln2nid(ln)), ln))
+            ok = 0;
+        if (OBJ_length(obj) == 0)
+            continue;
+        /* Twice, so that the second conversion comes from the cache */
+        for (n = 0; n < 2 && ok; n++) {
+            if (!TEST_int_gt(OBJ_obj2txt(txt, sizeof(txt), obj, 1), 0)
+                    || !TEST_ptr(tobj = OBJ_txt2obj(txt, 1))
+                    || !TEST_int_eq(OBJ_cmp(OBJ_nid2obj(OBJ_obj2nid(tobj)),
+                                            obj), 0))
+                ok = 0;
+            ASN1_OBJECT_free(tobj);
+            tobj = NULL;
+        }
+    }
+
+    /* An object that is not registered and a truncating buffer */
+    if (!TEST_ptr(obj = OBJ_txt2obj("1.3.6.1.4.1.99999.1.2.3", 1)))
+        return 0;
+    for (n = 0; n < 2; n++) {
+        if (!TEST_int_eq(OBJ_obj2nid(obj), NID_undef)
+                || !TEST_int_eq(OBJ_obj2txt(small, sizeof(small), obj, 0), 23)
+                || !TEST_str_eq(small, "1.3.6")
+                || !TEST_int_eq(OBJ_obj2txt(txt, sizeof(txt), obj, 0), 23)
+                || !TEST_str_eq(txt, "1.3.6.1.4.1.99999.1.2.3"))
+            ok = 0;
+    }
+    if (!TEST_ptr(tobj = OBJ_txt2obj(txt, 0))
+            || !TEST_int_eq(OBJ_cmp(obj, tobj), 0))
+        ok = 0;
+    ASN1_OBJECT_free(tobj);
+    ASN1_OBJECT_free(obj);
+    return ok;
+}
+
 int setup_tests(void)
 {
     ADD_TEST(test_tbl_standard);
     ADD_TEST(test_standard_methods);
+    ADD_TEST(test_obj_lookups);
     return 1;
 }
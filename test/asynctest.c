@@ -35,6 +35,19 @@ static int add_two(void *args)
     return 2;
 }
 
+static int sum_args(void *args)
+{
+    unsigned char *a = args;
+    int sum = 0;
+    size_t i;
+
+    ASYNC_pause_job();
+    for (i = 0; i < (size_t)a[0]; i++)
+        sum += a[i];
+
+    return sum;
+}
+
 static int save_current(void *args)
 {
     currjob = ASYNC_get_current_job();
@@ -221,6 +234,42 @@ static int test_ASYNC_start_job(void)
     return 1;
 }
 
+static int test_ASYNC_start_job_args(void)
+{
+    ASYNC_JOB *job = NULL;
+    int funcret;
+    ASYNC_WAIT_CTX *waitctx = NULL;
+    unsigned char small[2] = { 2, 5 }, large[8] = { 8, 1, 1, 1, 1, 1, 1, 1 };
+
+    /* The arguments must be copied afresh, even when the job is reused */
+    if (       !ASYNC_init_thread(1, 0)
+            || (waitctx = ASYNC_WAIT_CTX_new()) == NULL
+            || ASYNC_start_job(&job, waitctx, &funcret, sum_args, large,
+                               sizeof(large)) != ASYNC_PAUSE
+            || ASYNC_start_job(&job, waitctx, &funcret, sum_args, large,
+                               sizeof(large)) != ASYNC_FINISH
+            || funcret != 15
+            || ASYNC_start_job(&job, waitctx, &funcret, sum_args, small,
+                               sizeof(small)) != ASYNC_PAUSE
+            || ASYNC_start_job(&job, waitctx, &funcret, sum_args, small,
+                               sizeof(small)) != ASYNC_FINISH
+            || funcret != 7
+            || ASYNC_start_job(&job, waitctx, &funcret, sum_args, large,
+                               sizeof(large)) != ASYNC_PAUSE
+            || ASYNC_start_job(&job, waitctx, &funcret, sum_args, large,
+                               sizeof(large)) != ASYNC_FINISH
+            || funcret != 15) {
+        fprintf(stderr, "test_ASYNC_start_job_args() failed\n");
+        ASYNC_WAIT_CTX_free(waitctx);
+        ASYNC_cleanup_thread();
+        return 0;
+    }
+
+    ASYNC_WAIT_CTX_free(waitctx);
+    ASYNC_cleanup_thread();
+    return 1;
+}
+
 static int test_ASYNC_get_current_job(void)
 {
     ASYNC_JOB *job = NULL;
@@ -422,6 +471,7 @@ int main(int argc, char **argv)
         if (!test_ASYNC_init_thread()
                 || !test_ASYNC_callback_status()
                 || !test_ASYNC_start_job()
+                || !test_ASYNC_start_job_args()
                 || !test_ASYNC_get_current_job()
                 || !test_ASYNC_WAIT_CTX_get_all_fds()
                 || !test_ASYNC_block_pause()
@@ -297,6 +297,64 @@ static int test_exec_GENM_ses(void)
     return result;
 }
 
+static ASN1_OCTET_STRING *tid(const OSSL_CMP_MSG *msg)
+{
+    return OSSL_CMP_HDR_get0_transactionID(OSSL_CMP_MSG_get0_header(msg));
+}
+
+static int execute_exec_nested_test(CMP_SES_TEST_FIXTURE *fixture)
+{
+    OSSL_CMP_CTX *ctx = fixture->cmp_ctx;
+    STACK_OF(OSSL_CMP_MSG) *reqs = NULL, *rsps = NULL;
+    OSSL_CMP_MSG *req, *rsp;
+    const int num = 3;
+    int i, res = 0;
+
+    if (!TEST_ptr(reqs = sk_OSSL_CMP_MSG_new_null()))
+        return 0;
+    /* requests as if from different end entities, each with its own tid */
+    for (i = 0; i < num; i++) {
+        if (!TEST_true(OSSL_CMP_CTX_reinit(ctx))
+                || !TEST_ptr(req = ossl_cmp_certreq_new(ctx,
+                                                        OSSL_CMP_PKIBODY_CR,
+                                                        NULL)))
+            goto err;
+        if (!TEST_true(sk_OSSL_CMP_MSG_push(reqs, req))) {
+            OSSL_CMP_MSG_free(req);
+            goto err;
+        }
+    }
+
+    if (!TEST_ptr(rsps = OSSL_CMP_exec_nested(ctx, reqs))
+            || !TEST_int_eq(sk_OSSL_CMP_MSG_num(rsps), num))
+        goto err;
+    for (i = 0; i < num; i++) {
+        req = sk_OSSL_CMP_MSG_value(reqs, i);
+        rsp = sk_OSSL_CMP_MSG_value(rsps, i);
+        if (!TEST_ptr(rsp)
+                || !TEST_int_eq(ossl_cmp_msg_get_bodytype(rsp),
+                                OSSL_CMP_PKIBODY_CP)
+                || !TEST_int_eq(ASN1_OCTET_STRING_cmp(tid(req), tid(rsp)), 0))
+            goto err;
+    }
+    res = 1;
+
+ err:
+    sk_OSSL_CMP_MSG_pop_free(reqs, OSSL_CMP_MSG_free);
+    sk_OSSL_CMP_MSG_pop_free(rsps, OSSL_CMP_MSG_free);
+    return res;
+}
+
+static int test_exec_nested(void)
+{
+    SETUP_TEST_FIXTURE(CMP_SES_TEST_FIXTURE, set_up);
+    OSSL_CMP_CTX_set_option(fixture->cmp_ctx,
+                            OSSL_CMP_OPT_IMPLICIT_CONFIRM, 1);
+    OSSL_CMP_SRV_CTX_set_grant_implicit_confirm(fixture->srv_ctx, 1);
+    EXECUTE_TEST(execute_exec_nested_test, tear_down);
+    return result;
+}
+
 static int execute_exchange_certConf_test(CMP_SES_TEST_FIXTURE *fixture)
 {
     int res =
@@ -390,6 +448,7 @@ int setup_tests(void)
     ADD_TEST(test_try_certreq_poll);
     ADD_TEST(test_try_certreq_poll_abort);
     ADD_TEST(test_exec_GENM_ses);
+    ADD_TEST(test_exec_nested);
     ADD_TEST(test_exchange_certConf);
     ADD_TEST(test_exchange_error);
     return 1;
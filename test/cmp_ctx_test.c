@@ -62,6 +62,8 @@ static int execute_CTX_reinit_test(OSSL_CMP_CTX_TEST_FIXTURE *fixture)
     OSSL_CMP_CTX *ctx = fixture->ctx;
     ASN1_OCTET_STRING *bytes = NULL;
     STACK_OF(X509) *certs = NULL;
+    const ASN1_OCTET_STRING *tid;
+    const STACK_OF(X509) *chain;
     int res = 0;
 
     /* set non-default values in all relevant fields */
@@ -79,6 +81,8 @@ static int execute_CTX_reinit_test(OSSL_CMP_CTX_TEST_FIXTURE *fixture)
             || !OSSL_CMP_CTX_set1_senderNonce(ctx, bytes)
             || !ossl_cmp_ctx_set1_recipNonce(ctx, bytes))
         goto err;
+    tid = ctx->transactionID;
+    chain = ctx->newChain;
 
     if (!TEST_true(OSSL_CMP_CTX_reinit(ctx)))
         goto err;
@@ -97,6 +101,17 @@ static int execute_CTX_reinit_test(OSSL_CMP_CTX_TEST_FIXTURE *fixture)
                        && ctx->recipNonce == NULL))
         goto err;
 
+    /* check that the storage of cleared fields gets reused */
+    if (!TEST_true(ASN1_OCTET_STRING_set(bytes, (unsigned char *)"id", 2))
+            || !TEST_true(OSSL_CMP_CTX_set1_transactionID(ctx, bytes))
+            || !TEST_ptr_eq(ctx->transactionID, tid)
+            || !TEST_int_eq(ASN1_OCTET_STRING_cmp(ctx->transactionID, bytes),
+                            0)
+            || !TEST_true(ossl_cmp_ctx_set1_newChain(ctx, certs))
+            || !TEST_ptr_eq(ctx->newChain, chain)
+            || !TEST_int_eq(sk_X509_num(ctx->newChain), 1))
+        goto err;
+
     /* this does not check that all remaining fields are untouched */
     res = 1;
 
@@ -526,6 +526,7 @@ static int test_cmp_pkimessage_create(int bodytype)
     case OSSL_CMP_PKIBODY_CERTCONF:
     case OSSL_CMP_PKIBODY_POLLREQ:
     case OSSL_CMP_PKIBODY_POLLREP:
+    case OSSL_CMP_PKIBODY_NESTED:
         fixture->expected = 1;
         break;
     default:
@@ -10,12 +10,17 @@
  */
 
 #include "helpers/cmp_testlib.h"
+#include <openssl/metrics.h>
 
 typedef struct test_fixture {
     const char *test_case_name;
     int expected;
     OSSL_CMP_SRV_CTX *srv_ctx;
     OSSL_CMP_MSG *req;
+    int max_msg_age;
+    OSSL_CMP_MSG *before; /* sent once before req, if not NULL */
+    int errorCode;   /* expected in the error response */
+    int metric;      /* expected to be counted for req, or -1 */
 } CMP_SRV_TEST_FIXTURE;
 
 static OSSL_LIB_CTX *libctx = NULL;
@@ -67,6 +72,7 @@ static int execute_test_handle_request(CMP_SRV_TEST_FIXTURE *fixture)
     char *dummy_custom_ctx = "@test_dummy", *custom_ctx;
     OSSL_CMP_MSG *rsp = NULL;
     OSSL_CMP_ERRORMSGCONTENT *errorContent;
+    uint64_t count = 0;
     int res = 0;
 
     if (!TEST_ptr(client_ctx = OSSL_CMP_CTX_new(libctx, NULL))
@@ -83,7 +89,9 @@ static int execute_test_handle_request(CMP_SRV_TEST_FIXTURE *fixture)
     if (!TEST_true(OSSL_CMP_SRV_CTX_set_send_unprotected_errors(ctx, 0))
             || !TEST_true(OSSL_CMP_SRV_CTX_set_accept_unprotected(ctx, 0))
             || !TEST_true(OSSL_CMP_SRV_CTX_set_accept_raverified(ctx, 1))
-            || !TEST_true(OSSL_CMP_SRV_CTX_set_grant_implicit_confirm(ctx, 1)))
+            || !TEST_true(OSSL_CMP_SRV_CTX_set_grant_implicit_confirm(ctx, 1))
+            || !TEST_true(OSSL_CMP_SRV_CTX_set_max_msg_age(ctx,
+                                                           fixture->max_msg_age)))
         goto end;
 
     if (!TEST_ptr(cmp_ctx = OSSL_CMP_SRV_CTX_get0_cmp_ctx(ctx))
@@ -93,13 +101,30 @@ static int execute_test_handle_request(CMP_SRV_TEST_FIXTURE *fixture)
                                               (unsigned char *)"1234", 4))
         goto end;
 
+    if (fixture->before != NULL) {
+        if (!TEST_ptr(rsp = OSSL_CMP_CTX_server_perform(client_ctx,
+                                                        fixture->before))
+                || !TEST_int_eq(ossl_cmp_msg_get_bodytype(rsp),
+                                OSSL_CMP_PKIBODY_ERROR))
+            goto end;
+        OSSL_CMP_MSG_free(rsp);
+        ERR_clear_error();
+    }
+    if (fixture->metric >= 0)
+        count = OSSL_METRIC_get_count(libctx, fixture->metric);
+
     if (!TEST_ptr(rsp = OSSL_CMP_CTX_server_perform(client_ctx, fixture->req))
             || !TEST_int_eq(ossl_cmp_msg_get_bodytype(rsp),
                             OSSL_CMP_PKIBODY_ERROR)
             || !TEST_ptr(errorContent = rsp->body->value.error)
             || !TEST_int_eq(ASN1_INTEGER_get(errorContent->errorCode),
-                            dummy_errorCode))
+                            fixture->errorCode))
         goto end;
+    if (fixture->metric >= 0) {
+        count = OSSL_METRIC_get_count(libctx, fixture->metric) - count;
+        if (!TEST_ulong_eq((unsigned long)count, 1))
+            goto end;
+    }
 
     res = 1;
 
@@ -114,10 +139,161 @@ static int test_handle_request(void)
     SETUP_TEST_FIXTURE(CMP_SRV_TEST_FIXTURE, set_up);
     fixture->req = request;
     fixture->expected = 1;
+    fixture->errorCode = dummy_errorCode;
+    fixture->metric = -1;
+    EXECUTE_TEST(execute_test_handle_request, tear_down);
+    return result;
+}
+
+static int test_handle_request_replayed(void)
+{
+    SETUP_TEST_FIXTURE(CMP_SRV_TEST_FIXTURE, set_up);
+    fixture->req = request;
+    fixture->expected = 1;
+    fixture->before = request;
+    fixture->errorCode = CMP_R_REPLAYED_MESSAGE;
+    fixture->metric = OSSL_METRIC_CMP_SRV_REJECT_REPLAY;
     EXECUTE_TEST(execute_test_handle_request, tear_down);
     return result;
 }
 
+static int test_handle_request_stale(void)
+{
+    SETUP_TEST_FIXTURE(CMP_SRV_TEST_FIXTURE, set_up);
+    fixture->req = request; /* created long ago */
+    fixture->expected = 1;
+    fixture->max_msg_age = 3600;
+    fixture->errorCode = CMP_R_MESSAGETIME_OUT_OF_RANGE;
+    fixture->metric = OSSL_METRIC_CMP_SRV_REJECT_HEADER;
+    EXECUTE_TEST(execute_test_handle_request, tear_down);
+    return result;
+}
+
+/* The request as retried by a client, with a new senderNonce */
+static OSSL_CMP_MSG *retried_request(void)
+{
+    OSSL_CMP_CTX *ctx = NULL;
+    OSSL_CMP_MSG *msg = NULL;
+    static const unsigned char nonce[OSSL_CMP_SENDERNONCE_LENGTH] = { 1 };
+
+    if (!TEST_ptr(ctx = OSSL_CMP_CTX_new(libctx, NULL))
+            || !TEST_true(OSSL_CMP_CTX_set1_secretValue(ctx,
+                                                        (unsigned char *)"1234",
+                                                        4))
+            || !TEST_ptr(msg = OSSL_CMP_MSG_dup(request))
+            || !TEST_true(ASN1_OCTET_STRING_set(msg->header->senderNonce,
+                                                nonce, sizeof(nonce)))
+            || !TEST_true(ossl_cmp_msg_protect(ctx, msg))) {
+        OSSL_CMP_MSG_free(msg);
+        msg = NULL;
+    }
+    OSSL_CMP_CTX_free(ctx);
+    return msg;
+}
+
+static int test_handle_request_popo_cached(void)
+{
+    OSSL_CMP_MSG *retried;
+
+    SETUP_TEST_FIXTURE(CMP_SRV_TEST_FIXTURE, set_up);
+    if (!TEST_ptr(retried = retried_request())) {
+        tear_down(fixture);
+        return 0;
+    }
+    fixture->req = retried;
+    fixture->expected = 1;
+    fixture->before = request;
+    fixture->errorCode = dummy_errorCode;
+    fixture->metric = OSSL_METRIC_CMP_SRV_POPO_CACHED;
+    EXECUTE_TEST(execute_test_handle_request, tear_down);
+    OSSL_CMP_MSG_free(retried);
+    return result;
+}
+
+/* A nested request with |request| nested twice inside */
+static OSSL_CMP_MSG *doubly_nested_request(void)
+{
+    OSSL_CMP_CTX *ctx = NULL;
+    STACK_OF(OSSL_CMP_MSG) *msgs = NULL;
+    OSSL_CMP_MSG *inner = NULL, *msg = NULL;
+
+    if (!TEST_ptr(ctx = OSSL_CMP_CTX_new(libctx, NULL))
+            || !TEST_true(OSSL_CMP_CTX_set1_referenceValue(ctx,
+                                                           (unsigned char *)"client",
+                                                           6))
+            || !TEST_true(OSSL_CMP_CTX_set1_secretValue(ctx,
+                                                        (unsigned char *)"1234",
+                                                        4))
+            || !TEST_ptr(msgs = sk_OSSL_CMP_MSG_new_null())
+            || !TEST_true(sk_OSSL_CMP_MSG_push(msgs, request))
+            || !TEST_ptr(inner = ossl_cmp_nested_new(ctx, msgs)))
+        goto err;
+    (void)sk_OSSL_CMP_MSG_set(msgs, 0, inner);
+    /* the outer message must start a transaction of its own */
+    if (!TEST_true(OSSL_CMP_CTX_set1_transactionID(ctx, NULL)))
+        goto err;
+    msg = ossl_cmp_nested_new(ctx, msgs);
+    TEST_ptr(msg);
+
+ err:
+    sk_OSSL_CMP_MSG_free(msgs);
+    OSSL_CMP_MSG_free(inner);
+    OSSL_CMP_CTX_free(ctx);
+    return msg;
+}
+
+static int test_handle_request_nested_twice(void)
+{
+    OSSL_CMP_MSG *nested;
+
+    SETUP_TEST_FIXTURE(CMP_SRV_TEST_FIXTURE, set_up);
+    if (!TEST_ptr(nested = doubly_nested_request())) {
+        tear_down(fixture);
+        return 0;
+    }
+    fixture->req = nested;
+    fixture->expected = 1;
+    fixture->errorCode = CMP_R_UNEXPECTED_PKIBODY;
+    fixture->metric = -1;
+    EXECUTE_TEST(execute_test_handle_request, tear_down);
+    OSSL_CMP_MSG_free(nested);
+    return result;
+}
+
+/* Changing the template of a decoded request invalidates its signature */
+static int test_popo_template_changed(void)
+{
+    OSSL_CMP_MSG *msg = NULL;
+    OSSL_CRMF_MSG *crm;
+    X509_NAME *subject = NULL;
+    int res = 0;
+
+    if (!TEST_ptr(msg = OSSL_CMP_MSG_dup(request))
+            || !TEST_int_eq(ossl_cmp_msg_get_bodytype(msg), OSSL_CMP_PKIBODY_CR)
+            || !TEST_ptr(crm = sk_OSSL_CRMF_MSG_value(msg->body->value.cr, 0))
+            || !TEST_true(OSSL_CRMF_MSGS_verify_popo(msg->body->value.cr,
+                                                     OSSL_CMP_CERTREQID, 0,
+                                                     libctx, NULL))
+            || !TEST_ptr(subject = X509_NAME_new())
+            || !TEST_true(X509_NAME_add_entry_by_txt(subject, "CN",
+                                                     MBSTRING_ASC,
+                                                     (unsigned char *)"changed",
+                                                     -1, -1, 0))
+            || !TEST_true(OSSL_CRMF_CERTTEMPLATE_fill(OSSL_CRMF_MSG_get0_tmpl(crm),
+                                                      NULL, subject, NULL,
+                                                      NULL))
+            || !TEST_false(OSSL_CRMF_MSGS_verify_popo(msg->body->value.cr,
+                                                      OSSL_CMP_CERTREQID, 0,
+                                                      libctx, NULL)))
+        goto err;
+    res = 1;
+
+ err:
+    X509_NAME_free(subject);
+    OSSL_CMP_MSG_free(msg);
+    return res;
+}
+
 void cleanup_tests(void)
 {
     OSSL_CMP_MSG_free(request);
@@ -164,9 +340,15 @@ int setup_tests(void)
      * OSSL_CMP_SRV_CTX_get0_custom_ctx(),
      * OSSL_CMP_SRV_CTX_set_send_unprotected_errors(),
      * OSSL_CMP_SRV_CTX_set_accept_unprotected(),
-     * OSSL_CMP_SRV_CTX_set_accept_raverified(), and
-     * OSSL_CMP_SRV_CTX_set_grant_implicit_confirm()
+     * OSSL_CMP_SRV_CTX_set_accept_raverified(),
+     * OSSL_CMP_SRV_CTX_set_grant_implicit_confirm(), and
+     * OSSL_CMP_SRV_CTX_set_max_msg_age()
      */
     ADD_TEST(test_handle_request);
+    ADD_TEST(test_handle_request_replayed);
+    ADD_TEST(test_handle_request_stale);
+    ADD_TEST(test_handle_request_popo_cached);
+    ADD_TEST(test_handle_request_nested_twice);
+    ADD_TEST(test_popo_template_changed);
     return 1;
 }
@@ -0,0 +1,222 @@
+/*
+ * Copyright 2021 The OpenSSL Project Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License 2.0 (the "License").  You may not use
+ * this file except in compliance with the License.  You can obtain a copy
+ * in the file LICENSE in the source distribution or at
+ * https://www.openssl.org/source/license.html
+ */
+
+/*
+ * This test program checks when CONF_modules_load_file_ex() reuses the
+ * configuration file it parsed before.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <openssl/conf.h>
+#include <openssl/crypto.h>
+#include "testutil.h"
+
+#ifndef OPENSSL_NO_POSIX_IO
+# include <sys/types.h>
+# ifdef _WIN32
+#  include <sys/utime.h>
+#  define utime   _utime
+#  define utimbuf _utimbuf
+# else
+#  include <utime.h>
+# endif
+#endif
+
+#define CONF_FILE "conf_cache_test.cnf"
+#define INC_FILE  "conf_cache_test_inc.cnf"
+
+/* The value of "val" that the test module saw last */
+static char seen[16];
+
+/* The default configuration file, apps/openssl.cnf */
+static const char *default_conf = NULL;
+
+static int cachetest_init(CONF_IMODULE *md, const CONF *cnf)
+{
+    const char *val = NCONF_get_string(cnf, CONF_imodule_get_value(md), "val");
+
+    if (val == NULL)
+        return 0;
+    OPENSSL_strlcpy(seen, val, sizeof(seen));
+    return 1;
+}
+
+#ifndef OPENSSL_NO_POSIX_IO
+/* Writes |text| to |file| and sets its modification time to |mtime| */
+static int write_file(const char *file, const char *text, time_t mtime)
+{
+    FILE *f = fopen(file, "w");
+    struct utimbuf times;
+    int ok;
+
+    if (!TEST_ptr(f))
+        return 0;
+    ok = TEST_int_ge(fputs(text, f), 0);
+    ok = TEST_int_eq(fclose(f), 0) && ok;
+    times.actime = times.modtime = mtime;
+    return ok && TEST_int_eq(utime(file, &times), 0);
+}
+
+/* Loads CONF_FILE and returns the value the test module saw */
+static const char *load(void)
+{
+    seen[0] = '\0';
+    if (!TEST_int_gt(CONF_modules_load_file_ex(NULL, CONF_FILE, NULL, 0), 0))
+        return "";
+    return seen;
+}
+
+/* Long enough ago for the cache to trust the modification time */
+static time_t past(void)
+{
+    return time(NULL) - 100;
+}
+
+static int test_same_file(void)
+{
+    time_t t = past();
+
+    return write_file(CONF_FILE,
+                      "openssl_conf = main\n[main]\ncachetest = sect\n"
+                      "[sect]\nval = A\n", t)
+        && TEST_str_eq(load(), "A")
+        /* Same time and size: the parsed file is reused */
+        && write_file(CONF_FILE,
+                      "openssl_conf = main\n[main]\ncachetest = sect\n"
+                      "[sect]\nval = B\n", t)
+        && TEST_str_eq(load(), "A");
+}
+
+static int test_mtime_change(void)
+{
+    time_t t = past();
+
+    return write_file(CONF_FILE,
+                      "openssl_conf = main\n[main]\ncachetest = sect\n"
+                      "[sect]\nval = A\n", t)
+        && TEST_str_eq(load(), "A")
+        && write_file(CONF_FILE,
+                      "openssl_conf = main\n[main]\ncachetest = sect\n"
+                      "[sect]\nval = B\n", t + 1)
+        && TEST_str_eq(load(), "B");
+}
+
+static int test_include(void)
+{
+    time_t t = past();
+
+    return write_file(INC_FILE, "[other]\nx = 1\n", t)
+        && write_file(CONF_FILE,
+                      ".include " INC_FILE "\n"
+                      "openssl_conf = main\n[main]\ncachetest = sect\n"
+                      "[sect]\nval = A\n", t)
+        && TEST_str_eq(load(), "A")
+        && write_file(CONF_FILE,
+                      ".include " INC_FILE "\n"
+                      "openssl_conf = main\n[main]\ncachetest = sect\n"
+                      "[sect]\nval = B\n", t)
+        && TEST_str_eq(load(), "B");
+}
+
+static int test_env(void)
+{
+# if defined(_BSD_SOURCE) \
+        || (defined(_POSIX_C_SOURCE) && _POSIX_C_SOURCE >= 200112L) \
+        || (defined(_XOPEN_SOURCE) && _XOPEN_SOURCE >= 600)
+    int ok = TEST_int_eq(setenv("CONF_CACHE_VAL", "A", 1), 0)
+        && write_file(CONF_FILE,
+                      "openssl_conf = main\n[main]\ncachetest = sect\n"
+                      "[sect]\nval = $ENV::CONF_CACHE_VAL\n", past())
+        && TEST_str_eq(load(), "A")
+        && TEST_int_eq(setenv("CONF_CACHE_VAL", "B", 1), 0)
+        && TEST_str_eq(load(), "B");
+
+    unsetenv("CONF_CACHE_VAL");
+    return ok;
+# else
+    return TEST_skip("no setenv()");
+# endif
+}
+
+/*
+ * The default configuration mentions .include and $ENV:: in comments only,
+ * so it must be cached.  A copy of it is loaded, then overwritten with a
+ * broken file of the same size and time, which still loads from the cache.
+ */
+static int test_default_config(void)
+{
+    time_t t = past();
+    char *text = NULL;
+    long len;
+    FILE *f;
+    int ok = 0;
+
+    if (!TEST_ptr(f = fopen(default_conf, "rb")))
+        return 0;
+    if (!TEST_int_eq(fseek(f, 0, SEEK_END), 0)
+            || !TEST_long_gt(len = ftell(f), 1)
+            || !TEST_int_eq(fseek(f, 0, SEEK_SET), 0)
+            || !TEST_ptr(text = OPENSSL_malloc(len + 1))
+            || !TEST_size_t_eq(fread(text, 1, len, f), (size_t)len))
+        goto end;
+    text[len] = '\0';
+
+    if (!write_file(CONF_FILE, text, t)
+            || !TEST_int_gt(CONF_modules_load_file_ex(NULL, CONF_FILE,
+                                                      NULL, 0), 0))
+        goto end;
+    /* An unterminated section name, padded to the same size */
+    memset(text, ' ', len);
+    text[0] = '[';
+    ok = write_file(CONF_FILE, text, t)
+        && TEST_int_gt(CONF_modules_load_file_ex(NULL, CONF_FILE, NULL, 0), 0);
+
+ end:
+    fclose(f);
+    OPENSSL_free(text);
+    return ok;
+}
+#endif
+
+void cleanup_tests(void)
+{
+    CONF_modules_unload(1);
+#ifndef OPENSSL_NO_POSIX_IO
+    remove(CONF_FILE);
+    remove(INC_FILE);
+#endif
+}
+
+OPT_TEST_DECLARE_USAGE("conf_file\n")
+
+int setup_tests(void)
+{
+    if (!test_skip_common_options()) {
+        TEST_error("Error parsing test options\n");
+        return 0;
+    }
+    if (!TEST_ptr(default_conf = test_get_argument(0)))
+        return 0;
+
+#ifdef OPENSSL_NO_POSIX_IO
+    TEST_note("the parse cache is not available without posix-io");
+#else
+    if (!TEST_true(CONF_module_add("cachetest", cachetest_init, NULL)))
+        return 0;
+    ADD_TEST(test_same_file);
+    ADD_TEST(test_mtime_change);
+    ADD_TEST(test_include);
+    ADD_TEST(test_env);
+    ADD_TEST(test_default_config);
+#endif
+    return 1;
+}
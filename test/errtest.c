@@ -1,5 +1,5 @@
 /*
- * Copyright 2018-2020 The OpenSSL Project Authors. All Rights Reserved.
+ * Copyright 2018-2021 The OpenSSL Project Authors. All Rights Reserved.
  *
  * Licensed under the Apache License 2.0 (the "License").  You may not use
  * this file except in compliance with the License.  You can obtain a copy
@@ -11,6 +11,7 @@
 #include <openssl/opensslconf.h>
 #include <openssl/err.h>
 #include <openssl/macros.h>
+#include "internal/err.h"
 
 #include "testutil.h"
 
@@ -283,6 +284,76 @@ static int test_marks(void)
     return 1;
 }
 
+static int test_suppressed_marks(void)
+{
+    unsigned long mallocfail, e;
+    const char *file, *data;
+    int line, flags;
+
+    ERR_raise(ERR_LIB_CRYPTO, ERR_R_MALLOC_FAILURE);
+    mallocfail = ERR_peek_last_error();
+
+    /* Errors are still recorded by their code, but without any details */
+    if (!TEST_true(ossl_err_set_suppressed_mark()))
+        return 0;
+    ERR_raise_data(ERR_LIB_CRYPTO, ERR_R_INTERNAL_ERROR, "%s", "details");
+    ERR_add_error_data(1, "more details");
+    e = ERR_peek_last_error_all(&file, &line, NULL, &data, &flags);
+    if (!TEST_int_eq(ERR_GET_REASON(e), ERR_R_INTERNAL_ERROR)
+            || !TEST_str_eq(file, "")
+            || !TEST_str_eq(data, "")
+            || !TEST_true(ossl_err_pop_to_suppressed_mark())
+            || !TEST_ulong_eq(mallocfail, ERR_peek_last_error()))
+        return 0;
+
+    /* Suppressed marks nest with ordinary ones */
+    if (!TEST_true(ERR_set_mark())
+            || !TEST_true(ossl_err_set_suppressed_mark()))
+        return 0;
+    ERR_raise(ERR_LIB_CRYPTO, ERR_R_INTERNAL_ERROR);
+    if (!TEST_true(ossl_err_clear_last_suppressed_mark())
+            || !TEST_int_eq(ERR_GET_REASON(ERR_peek_last_error()),
+                            ERR_R_INTERNAL_ERROR)
+            || !TEST_true(ERR_pop_to_mark())
+            || !TEST_ulong_eq(mallocfail, ERR_peek_last_error()))
+        return 0;
+
+    /* Once the mark is gone, details are recorded again */
+    ERR_raise_data(ERR_LIB_CRYPTO, ERR_R_INTERNAL_ERROR, "%s", "details");
+    ERR_peek_last_error_data(&data, NULL);
+    if (!TEST_str_eq(data, "details"))
+        return 0;
+
+    /* Suppression ends with its mark, also when that is cleared otherwise */
+    if (!TEST_true(ossl_err_set_suppressed_mark()))
+        return 0;
+    ERR_clear_error();
+    ERR_raise_data(ERR_LIB_CRYPTO, ERR_R_INTERNAL_ERROR, "%s", "details");
+    ERR_peek_last_error_data(&data, NULL);
+    if (!TEST_str_eq(data, "details"))
+        return 0;
+
+    /* A suppressed mark on an empty stack outlives popping the errors */
+    ERR_clear_error();
+    (void)ossl_err_set_suppressed_mark();
+    ERR_raise_data(ERR_LIB_CRYPTO, ERR_R_INTERNAL_ERROR, "%s", "details");
+    if (!TEST_int_eq(ERR_GET_REASON(ERR_get_error()), ERR_R_INTERNAL_ERROR))
+        return 0;
+    ERR_raise_data(ERR_LIB_CRYPTO, ERR_R_INTERNAL_ERROR, "%s", "details");
+    ERR_peek_last_error_data(&data, NULL);
+    if (!TEST_str_eq(data, "")
+            || !TEST_false(ossl_err_pop_to_suppressed_mark())
+            || !TEST_ulong_eq(ERR_peek_error(), 0))
+        return 0;
+    ERR_raise_data(ERR_LIB_CRYPTO, ERR_R_INTERNAL_ERROR, "%s", "details");
+    ERR_peek_last_error_data(&data, NULL);
+    if (!TEST_str_eq(data, "details"))
+        return 0;
+
+    ERR_clear_error();
+    return 1;
+}
+
 int setup_tests(void)
 {
     ADD_TEST(preserves_system_error);
@@ -292,5 +363,6 @@ int setup_tests(void)
     ADD_TEST(test_print_error_format);
 #endif
     ADD_TEST(test_marks);
+    ADD_TEST(test_suppressed_marks);
     return 1;
 }
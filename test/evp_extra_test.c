@@ -999,6 +999,70 @@ static int test_EVP_Digest(void)
     return ret;
 }
 
+/*
+ * Re-initialising a context must give the same result as a fresh one, even
+ * if parameters were set on it before.
+ */
+static int test_EVP_Digest_reinit(void)
+{
+    int ret = 0;
+    EVP_MD_CTX *md_ctx = NULL;
+    EVP_MD *shake = NULL;
+    unsigned char md[EVP_MAX_MD_SIZE], fresh[EVP_MAX_MD_SIZE];
+    unsigned int len = 0, fresh_len = 0;
+    size_t xoflen = 10;
+    OSSL_PARAM params[2];
+
+    params[0] = OSSL_PARAM_construct_size_t(OSSL_DIGEST_PARAM_XOFLEN, &xoflen);
+    params[1] = OSSL_PARAM_construct_end();
+    memset(md, 0, sizeof(md));
+    memset(fresh, 0, sizeof(fresh));
+
+    if (!TEST_ptr(md_ctx = EVP_MD_CTX_new())
+            || !TEST_ptr(shake = EVP_MD_fetch(testctx, "SHAKE256", NULL))
+            || !TEST_true(EVP_DigestInit_ex(md_ctx, shake, NULL))
+            || !TEST_true(EVP_DigestUpdate(md_ctx, kMsg, sizeof(kMsg)))
+            || !TEST_true(EVP_DigestFinal_ex(md_ctx, fresh, &fresh_len)))
+        goto out;
+
+    /* The output length set on the context must not survive re-init */
+    if (!TEST_true(EVP_DigestInit_ex(md_ctx, shake, NULL))
+            || !TEST_true(EVP_MD_CTX_set_params(md_ctx, params))
+            || !TEST_true(EVP_DigestUpdate(md_ctx, kMsg, sizeof(kMsg)))
+            || !TEST_true(EVP_DigestFinal_ex(md_ctx, md, &len))
+            || !TEST_true(EVP_DigestInit_ex(md_ctx, shake, NULL))
+            || !TEST_true(EVP_DigestUpdate(md_ctx, kMsg, sizeof(kMsg)))
+            || !TEST_true(EVP_DigestFinal_ex(md_ctx, md, &len))
+            || !TEST_mem_eq(md, len, fresh, fresh_len))
+        goto out;
+
+    /* Nor when the digest is not given again */
+    memset(md, 0, sizeof(md));
+    if (!TEST_true(EVP_DigestInit_ex(md_ctx, shake, NULL))
+            || !TEST_true(EVP_MD_CTX_set_params(md_ctx, params))
+            || !TEST_true(EVP_DigestInit_ex(md_ctx, NULL, NULL))
+            || !TEST_true(EVP_DigestUpdate(md_ctx, kMsg, sizeof(kMsg)))
+            || !TEST_true(EVP_DigestFinal_ex(md_ctx, md, &len))
+            || !TEST_mem_eq(md, len, fresh, fresh_len))
+        goto out;
+
+    /* Re-init must also start over after a partial update */
+    memset(md, 0, sizeof(md));
+    if (!TEST_true(EVP_DigestInit_ex(md_ctx, shake, NULL))
+            || !TEST_true(EVP_DigestUpdate(md_ctx, kMsg, 1))
+            || !TEST_true(EVP_DigestInit_ex(md_ctx, shake, NULL))
+            || !TEST_true(EVP_DigestUpdate(md_ctx, kMsg, sizeof(kMsg)))
+            || !TEST_true(EVP_DigestFinal_ex(md_ctx, md, &len))
+            || !TEST_mem_eq(md, len, fresh, fresh_len))
+        goto out;
+    ret = 1;
+
+ out:
+    EVP_MD_free(shake);
+    EVP_MD_CTX_free(md_ctx);
+    return ret;
+}
+
 static int test_d2i_AutoPrivateKey(int i)
 {
     int ret = 0;
@@ -2561,6 +2625,7 @@ int setup_tests(void)
     ADD_ALL_TESTS(test_EVP_DigestSignInit, 9);
     ADD_TEST(test_EVP_DigestVerifyInit);
     ADD_TEST(test_EVP_Digest);
+    ADD_TEST(test_EVP_Digest_reinit);
     ADD_TEST(test_EVP_Enveloped);
     ADD_ALL_TESTS(test_d2i_AutoPrivateKey, OSSL_NELEM(keydata));
     ADD_TEST(test_privatekey_to_pkcs8);
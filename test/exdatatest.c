@@ -1,5 +1,5 @@
 /*
- * Copyright 2015-2020 The OpenSSL Project Authors. All Rights Reserved.
+ * Copyright 2015-2021 The OpenSSL Project Authors. All Rights Reserved.
  *
  * Licensed under the Apache License 2.0 (the "License").  You may not use
  * this file except in compliance with the License.  You can obtain a copy
@@ -304,8 +304,33 @@ static int test_exdata(void)
       return 0;
 }
 
+/* Items can be set in classes that no index was registered for */
+static int test_exdata_unregistered(void)
+{
+    CRYPTO_EX_DATA ad;
+    int ok = 0, dummy = 1;
+
+    if (!TEST_true(CRYPTO_new_ex_data(CRYPTO_EX_INDEX_UI_METHOD, NULL, &ad)))
+        return 0;
+    if (!TEST_ptr_null(CRYPTO_get_ex_data(&ad, 0))
+            || !TEST_ptr_null(CRYPTO_get_ex_data(&ad, -1))
+            || !TEST_true(CRYPTO_set_ex_data(&ad, 0, &dummy))
+            || !TEST_true(CRYPTO_set_ex_data(&ad, 7, &ad))
+            || !TEST_false(CRYPTO_set_ex_data(&ad, -1, &ad))
+            || !TEST_ptr_eq(CRYPTO_get_ex_data(&ad, 0), &dummy)
+            || !TEST_ptr_null(CRYPTO_get_ex_data(&ad, 3))
+            || !TEST_ptr_eq(CRYPTO_get_ex_data(&ad, 7), &ad)
+            || !TEST_ptr_null(CRYPTO_get_ex_data(&ad, 8)))
+        goto err;
+    ok = 1;
+ err:
+    CRYPTO_free_ex_data(CRYPTO_EX_INDEX_UI_METHOD, NULL, &ad);
+    return ok;
+}
+
 int setup_tests(void)
 {
     ADD_TEST(test_exdata);
+    ADD_TEST(test_exdata_unregistered);
     return 1;
 }
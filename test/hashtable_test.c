@@ -0,0 +1,183 @@
+/*
+ * Copyright 2021 The OpenSSL Project Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License 2.0 (the "License").  You may not use
+ * this file except in compliance with the License.  You can obtain a copy
+ * in the file LICENSE in the source distribution or at
+ * https://www.openssl.org/source/license.html
+ */
+
+#include <string.h>
+
+#include <openssl/crypto.h>
+#include "crypto/hashtable.h"
+#include "testutil.h"
+
+typedef struct {
+    int key;
+    int value;
+} ITEM;
+
+static int items_freed;
+
+static unsigned long item_hash(const void *v)
+{
+    return ((const ITEM *)v)->key & 7;     /* To force collisions */
+}
+
+static int item_cmp(const void *a, const void *b)
+{
+    return ((const ITEM *)a)->key != ((const ITEM *)b)->key;
+}
+
+static void item_free(void *v)
+{
+    items_freed++;
+    OPENSSL_free(v);
+}
+
+static ITEM *item_new(int key, int value)
+{
+    ITEM *it = OPENSSL_malloc(sizeof(*it));
+
+    if (it != NULL) {
+        it->key = key;
+        it->value = value;
+    }
+    return it;
+}
+
+static int get_value(OSSL_HT *ht, int key)
+{
+    ITEM tmpl, *it;
+    int value;
+
+    tmpl.key = key;
+    if (!ossl_ht_read_lock(ht))
+        return -2;
+    it = ossl_ht_get(ht, &tmpl);
+    value = it != NULL ? it->value : -1;
+    ossl_ht_read_unlock(ht);
+    return value;
+}
+
+static void sum_values(void *v, void *arg)
+{
+    *(long *)arg += ((ITEM *)v)->value;
+}
+
+static int keep_odd(void *v, void *arg)
+{
+    return ((ITEM *)v)->key % 2 != 0;
+}
+
+static int test_hashtable_basic(void)
+{
+    const int n = 1000;
+    OSSL_HT *ht = ossl_ht_new(&item_hash, &item_cmp, &item_free);
+    ITEM *it, tmpl;
+    long sum = 0;
+    int i, testresult = 0;
+
+    items_freed = 0;
+    if (!TEST_ptr(ht))
+        goto end;
+
+    for (i = 0; i < n; i++)
+        if (!TEST_ptr(it = item_new(i, i))
+                || !TEST_true(ossl_ht_insert(ht, it))) {
+            OPENSSL_free(it);
+            goto end;
+        }
+    if (!TEST_size_t_eq(ossl_ht_num(ht), n))
+        goto end;
+    for (i = 0; i < n; i++)
+        if (!TEST_int_eq(get_value(ht, i), i))
+            goto end;
+    if (!TEST_int_eq(get_value(ht, n), -1))
+        goto end;
+
+    /* Replacing frees the old entry */
+    if (!TEST_ptr(it = item_new(7, 700))
+            || !TEST_true(ossl_ht_insert(ht, it))
+            || !TEST_int_eq(items_freed, 1)
+            || !TEST_size_t_eq(ossl_ht_num(ht), n)
+            || !TEST_int_eq(get_value(ht, 7), 700))
+        goto end;
+
+    /* Delete */
+    tmpl.key = 3;
+    if (!TEST_true(ossl_ht_delete(ht, &tmpl))
+            || !TEST_false(ossl_ht_delete(ht, &tmpl))
+            || !TEST_int_eq(items_freed, 2)
+            || !TEST_int_eq(get_value(ht, 3), -1))
+        goto end;
+
+    if (!TEST_true(ossl_ht_read_lock(ht)))
+        goto end;
+    ossl_ht_doall(ht, &sum_values, &sum);
+    ossl_ht_read_unlock(ht);
+    if (!TEST_long_eq(sum, (long)n * (n - 1) / 2 - 3 - 7 + 700))
+        goto end;
+
+    /* Filter */
+    if (!TEST_size_t_eq(ossl_ht_filter(ht, &keep_odd, NULL), n / 2)
+            || !TEST_size_t_eq(ossl_ht_num(ht), n / 2 - 1)
+            || !TEST_int_eq(get_value(ht, 4), -1)
+            || !TEST_int_eq(get_value(ht, 5), 5))
+        goto end;
+
+    ossl_ht_flush(ht);
+    if (!TEST_size_t_eq(ossl_ht_num(ht), 0)
+            || !TEST_int_eq(items_freed, n + 1)
+            || !TEST_int_eq(get_value(ht, 5), -1))
+        goto end;
+
+    testresult = 1;
+end:
+    ossl_ht_free(ht);
+    return testresult;
+}
+
+/*
+ * Inserting new keys, growing the table included, must not wait for readers.
+ * It would wait for itself here if it did.
+ */
+static int test_hashtable_insert_no_wait(void)
+{
+    const int n = 1000;
+    OSSL_HT *ht = ossl_ht_new(&item_hash, &item_cmp, &item_free);
+    ITEM *it = NULL;
+    int i, locked = 0, testresult = 0;
+
+    items_freed = 0;
+    if (!TEST_ptr(ht)
+            || !TEST_true(locked = ossl_ht_read_lock(ht)))
+        goto end;
+    for (i = 0; i < n; i++) {
+        if (!TEST_ptr(it = item_new(i, i))
+                || !TEST_true(ossl_ht_insert(ht, it))) {
+            OPENSSL_free(it);
+            goto end;
+        }
+    }
+    ossl_ht_read_unlock(ht);
+    locked = 0;
+    if (!TEST_size_t_eq(ossl_ht_num(ht), n)
+            || !TEST_int_eq(get_value(ht, n - 1), n - 1))
+        goto end;
+
+    testresult = 1;
+end:
+    if (locked)
+        ossl_ht_read_unlock(ht);
+    ossl_ht_free(ht);
+    return testresult && TEST_int_eq(items_freed, n);
+}
+
+int setup_tests(void)
+{
+    ADD_TEST(test_hashtable_basic);
+    ADD_TEST(test_hashtable_insert_no_wait);
+    return 1;
+}
@@ -1,5 +1,5 @@
 /*
- * Copyright 2017-2020 The OpenSSL Project Authors. All Rights Reserved.
+ * Copyright 2017-2021 The OpenSSL Project Authors. All Rights Reserved.
  * Copyright (c) 2017, Oracle and/or its affiliates.  All rights reserved.
  *
  * Licensed under the Apache License 2.0 (the "License").  You may not use
@@ -10,6 +10,7 @@
 
 #include <stdio.h>
 #include <string.h>
+#include <time.h>
 
 #include <openssl/opensslconf.h>
 #include <openssl/lhash.h>
@@ -180,6 +181,44 @@ end:
     return testresult;
 }
 
+static LHASH_OF(int) *doall_h;
+
+static void int_doall_delete(int *p)
+{
+    if (*p % 2 == 0)
+        lh_int_delete(doall_h, p);
+}
+
+static int test_doall_delete(void)
+{
+    static int vals[1000];
+    unsigned int i;
+    int testresult = 0;
+
+    if (!TEST_ptr(doall_h = lh_int_new(&int_hash, &int_cmp)))
+        goto end;
+    for (i = 0; i < OSSL_NELEM(vals); i++) {
+        vals[i] = i;
+        lh_int_insert(doall_h, vals + i);
+    }
+
+    /* Deleting entries while iterating must not skip any */
+    lh_int_doall(doall_h, &int_doall_delete);
+    if (!TEST_int_eq(lh_int_num_items(doall_h), OSSL_NELEM(vals) / 2))
+        goto end;
+    for (i = 0; i < OSSL_NELEM(vals); i++)
+        if (!TEST_true((lh_int_retrieve(doall_h, vals + i) != NULL)
+                       == (vals[i] % 2 != 0))) {
+            TEST_info("lhash doall delete %d", i);
+            goto end;
+        }
+
+    testresult = 1;
+end:
+    lh_int_free(doall_h);
+    return testresult;
+}
+
 static unsigned long int stress_hash(const int *p)
 {
     return *p;
@@ -241,9 +280,227 @@ end:
     return testresult;
 }
 
+/* A hash that scatters its input like the hashes of real keys do */
+static unsigned long int scatter_hash(const int *p)
+{
+    unsigned long int h = (unsigned long int)*p * 2654435761UL;
+
+    return (h ^ (h >> 15)) & 0xffffffffUL;
+}
+
+/*
+ * Insert keys in a scrambled order, so that the table grows while its
+ * probe sequences are long, and check that exactly the inserted ones are
+ * found.
+ */
+static int test_scattered(void)
+{
+    const unsigned int n = 20000;
+    LHASH_OF(int) *h = lh_int_new(&scatter_hash, &int_cmp);
+    int *data = OPENSSL_malloc(n * sizeof(*data));
+    unsigned int i, j;
+    int testresult = 0, k;
+
+    if (!TEST_ptr(h) || !TEST_ptr(data))
+        goto end;
+    for (i = 0; i < n; i++) {
+        data[i] = (int)(3 * ((uint64_t)i * 999983 % n) + 1);
+        lh_int_insert(h, data + i);
+        if (!TEST_false(lh_int_error(h)))
+            goto end;
+    }
+    if (!TEST_ulong_eq(lh_int_num_items(h), n))
+        goto end;
+
+    for (i = 0; i < 2 * n; i++) {
+        j = (unsigned int)((uint64_t)i * 999983 % (2 * n));
+        k = (int)(3 * j + 1);
+        if (!TEST_int_eq(lh_int_retrieve(h, &k) != NULL, j < n))
+            goto end;
+    }
+    testresult = 1;
+end:
+    lh_int_free(h);
+    OPENSSL_free(data);
+    return testresult;
+}
+
+/*
+ * A minimal chained hash table with one allocation per entry, as used by
+ * LHASH before it moved to open addressing.  It only serves as a reference
+ * point for the timings in test_speed().
+ */
+typedef struct chain_node_st {
+    int *data;
+    unsigned long hash;
+    struct chain_node_st *next;
+} CHAIN_NODE;
+
+typedef struct {
+    CHAIN_NODE **b;
+    size_t num_buckets;
+    size_t num_items;
+} CHAIN_TABLE;
+
+static int chain_insert(CHAIN_TABLE *t, int *p)
+{
+    unsigned long hash = scatter_hash(p);
+    CHAIN_NODE *n, *nn, **nb;
+    size_t i;
+
+    if (t->num_items >= 2 * t->num_buckets) {
+        if ((nb = OPENSSL_zalloc(2 * t->num_buckets * sizeof(*nb))) == NULL)
+            return 0;
+        for (i = 0; i < t->num_buckets; i++)
+            for (n = t->b[i]; n != NULL; n = nn) {
+                nn = n->next;
+                n->next = nb[n->hash & (2 * t->num_buckets - 1)];
+                nb[n->hash & (2 * t->num_buckets - 1)] = n;
+            }
+        OPENSSL_free(t->b);
+        t->b = nb;
+        t->num_buckets *= 2;
+    }
+    if ((n = OPENSSL_malloc(sizeof(*n))) == NULL)
+        return 0;
+    n->data = p;
+    n->hash = hash;
+    n->next = t->b[hash & (t->num_buckets - 1)];
+    t->b[hash & (t->num_buckets - 1)] = n;
+    t->num_items++;
+    return 1;
+}
+
+static int *chain_retrieve(const CHAIN_TABLE *t, const int *p)
+{
+    unsigned long hash = scatter_hash(p);
+    CHAIN_NODE *n;
+
+    for (n = t->b[hash & (t->num_buckets - 1)]; n != NULL; n = n->next)
+        if (n->hash == hash && int_cmp(n->data, p) == 0)
+            return n->data;
+    return NULL;
+}
+
+static void chain_free(CHAIN_TABLE *t)
+{
+    CHAIN_NODE *n, *nn;
+    size_t i;
+
+    for (i = 0; t->b != NULL && i < t->num_buckets; i++)
+        for (n = t->b[i]; n != NULL; n = nn) {
+            nn = n->next;
+            OPENSSL_free(n);
+        }
+    OPENSSL_free(t->b);
+}
+
+static double elapsed(clock_t start)
+{
+    return (double)(clock() - start) / CLOCKS_PER_SEC;
+}
+
+/*
+ * Report insert and lookup timings of LHASH next to the chained reference
+ * table.  The numbers are informational only, nothing is asserted about
+ * them.  This only runs with the -bench option, as it takes a while.
+ */
+static int test_speed(void)
+{
+    const unsigned int n = 500000, rounds = 4;
+    LHASH_OF(int) *h = lh_int_new(&scatter_hash, &int_cmp);
+    CHAIN_TABLE chain = { NULL, 16, 0 };
+    int *data = OPENSSL_malloc(n * sizeof(*data));
+    unsigned int i, j, r;
+    int testresult = 0, k;
+    clock_t start;
+
+    if (!TEST_ptr(h)
+            || !TEST_ptr(data)
+            || !TEST_ptr(chain.b = OPENSSL_zalloc(16 * sizeof(*chain.b))))
+        goto end;
+    /* Insert and look up in a scrambled order to defeat the caches */
+    for (i = 0; i < n; i++)
+        data[i] = (int)(3 * ((uint64_t)i * 999983 % n) + 1);
+
+    start = clock();
+    for (i = 0; i < n; i++)
+        lh_int_insert(h, data + i);
+    TEST_info("lhash insert %u: %.3fs", n, elapsed(start));
+    start = clock();
+    for (i = 0; i < n; i++)
+        if (!chain_insert(&chain, data + i))
+            goto end;
+    TEST_info("chained insert %u: %.3fs", n, elapsed(start));
+
+    start = clock();
+    for (r = 0; r < rounds; r++)
+        for (i = 0; i < 2 * n; i++) {
+            j = (unsigned int)((uint64_t)i * 999983 % (2 * n));
+            k = (int)(3 * j + 1);
+            if (!TEST_true((lh_int_retrieve(h, &k) != NULL) == (j < n)))
+                goto end;
+        }
+    TEST_info("lhash lookup %u (50%% hits): %.3fs", 2 * n * rounds,
+              elapsed(start));
+    start = clock();
+    for (r = 0; r < rounds; r++)
+        for (i = 0; i < 2 * n; i++) {
+            j = (unsigned int)((uint64_t)i * 999983 % (2 * n));
+            k = (int)(3 * j + 1);
+            if (!TEST_true((chain_retrieve(&chain, &k) != NULL) == (j < n)))
+                goto end;
+        }
+    TEST_info("chained lookup %u (50%% hits): %.3fs", 2 * n * rounds,
+              elapsed(start));
+
+    testresult = 1;
+end:
+    chain_free(&chain);
+    lh_int_free(h);
+    OPENSSL_free(data);
+    return testresult;
+}
+
+typedef enum OPTION_choice {
+    OPT_ERR = -1,
+    OPT_EOF = 0,
+    OPT_BENCH,
+    OPT_TEST_ENUM
+} OPTION_CHOICE;
+
+const OPTIONS *test_get_options(void)
+{
+    static const OPTIONS options[] = {
+        OPT_TEST_OPTIONS_DEFAULT_USAGE,
+        { "bench", OPT_BENCH, '-', "Also time LHASH against a chained table" },
+        { NULL }
+    };
+    return options;
+}
+
 int setup_tests(void)
 {
+    OPTION_CHOICE o;
+    int bench = 0;
+
+    while ((o = opt_next()) != OPT_EOF) {
+        switch (o) {
+        case OPT_BENCH:
+            bench = 1;
+            break;
+        case OPT_TEST_CASES:
+            break;
+        default:
+            return 0;
+        }
+    }
+
     ADD_TEST(test_int_lhash);
+    ADD_TEST(test_doall_delete);
     ADD_TEST(test_stress);
+    ADD_TEST(test_scattered);
+    if (bench)
+        ADD_TEST(test_speed);
     return 1;
 }
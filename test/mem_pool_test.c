@@ -0,0 +1,89 @@
+/*
+ * Copyright 2021 The OpenSSL Project Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License 2.0 (the "License").  You may not use
+ * this file except in compliance with the License.  You can obtain a copy
+ * in the file LICENSE in the source distribution or at
+ * https://www.openssl.org/source/license.html
+ */
+
+#include <openssl/bn.h>
+#include <openssl/evp.h>
+#include <openssl/stack.h>
+#include <openssl/crypto.h>
+#include "testutil.h"
+
+#define NUM_OBJS 100
+
+/* The recipe enables pooling through OPENSSL_MEM_POOL */
+
+static int test_bn_reuse(void)
+{
+    BIGNUM *bn[NUM_OBJS];
+    uint64_t allocs[2], reused[2], frees[2];
+    int i, ok = 0;
+
+    if (!TEST_true(CRYPTO_get_mem_pool_stats(CRYPTO_MEM_POOL_BIGNUM,
+                                             &allocs[0], &reused[0],
+                                             &frees[0], NULL)))
+        return 0;
+    for (i = 0; i < NUM_OBJS; i++)
+        bn[i] = NULL;
+    for (i = 0; i < NUM_OBJS; i++)
+        if (!TEST_ptr(bn[i] = BN_new()) || !TEST_true(BN_set_word(bn[i], i)))
+            goto err;
+    for (i = 0; i < NUM_OBJS; i++) {
+        BN_free(bn[i]);
+        bn[i] = NULL;
+    }
+    /* These come out of the cache, and must look like fresh ones */
+    for (i = 0; i < NUM_OBJS; i++)
+        if (!TEST_ptr(bn[i] = BN_new())
+                || !TEST_true(BN_is_zero(bn[i]))
+                || !TEST_int_eq(BN_get_flags(bn[i], ~0), BN_FLG_MALLOCED))
+            goto err;
+    if (!TEST_true(CRYPTO_get_mem_pool_stats(CRYPTO_MEM_POOL_BIGNUM,
+                                             &allocs[1], &reused[1],
+                                             &frees[1], NULL))
+            || !TEST_size_t_ge((size_t)(allocs[1] - allocs[0]), 2 * NUM_OBJS)
+            || !TEST_size_t_ge((size_t)(frees[1] - frees[0]), NUM_OBJS)
+            || !TEST_size_t_ge((size_t)(reused[1] - reused[0]), NUM_OBJS / 2))
+        goto err;
+    ok = 1;
+ err:
+    for (i = 0; i < NUM_OBJS; i++)
+        BN_free(bn[i]);
+    return ok;
+}
+
+/* Pooled objects are ordinary allocations and may be freed as such */
+static int test_plain_free(void)
+{
+    OPENSSL_STACK *sk;
+    EVP_MD_CTX *ctx;
+
+    if (!TEST_ptr(sk = OPENSSL_sk_new_null()))
+        return 0;
+    OPENSSL_sk_free(sk);
+    if (!TEST_ptr(ctx = EVP_MD_CTX_new()))
+        return 0;
+    OPENSSL_free(ctx);
+    return 1;
+}
+
+static int test_stats_unknown_pool(void)
+{
+    uint64_t allocs = 0;
+
+    return TEST_false(CRYPTO_get_mem_pool_stats(-1, &allocs, NULL, NULL, NULL))
+        && TEST_false(CRYPTO_get_mem_pool_stats(CRYPTO_MEM_POOL_EVP_MD_CTX + 1,
+                                                &allocs, NULL, NULL, NULL));
+}
+
+int setup_tests(void)
+{
+    ADD_TEST(test_bn_reuse);
+    ADD_TEST(test_plain_free);
+    ADD_TEST(test_stats_unknown_pool);
+    return 1;
+}
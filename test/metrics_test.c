@@ -0,0 +1,148 @@
+/*
+ * Copyright 2021 The OpenSSL Project Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License 2.0 (the "License").  You may not use
+ * this file except in compliance with the License.  You can obtain a copy
+ * in the file LICENSE in the source distribution or at
+ * https://www.openssl.org/source/license.html
+ */
+
+#include <string.h>
+#include <openssl/bio.h>
+#include <openssl/evp.h>
+#include <openssl/pem.h>
+#include <openssl/x509_vfy.h>
+#include <openssl/metrics.h>
+#include "internal/nelem.h"
+#include "testutil.h"
+
+static const char *cert_file;
+
+static unsigned long get_count(OSSL_LIB_CTX *ctx, int metric)
+{
+    return (unsigned long)OSSL_METRIC_get_count(ctx, metric);
+}
+
+static int test_metric_names(void)
+{
+    int i;
+
+    for (i = 0; i < OSSL_METRIC_NUM; i++)
+        if (!TEST_ptr(OSSL_METRIC_get_name(i))
+                || !TEST_int_eq(OSSL_METRIC_get_num(OSSL_METRIC_get_name(i)),
+                                i))
+            return 0;
+    return TEST_ptr_null(OSSL_METRIC_get_name(OSSL_METRIC_NUM))
+        && TEST_int_eq(OSSL_METRIC_get_num("x509_verify"),
+                       OSSL_METRIC_X509_VERIFY)
+        && TEST_int_eq(OSSL_METRIC_get_num("no such metric"), -1)
+        && TEST_true(OSSL_METRIC_is_timed(OSSL_METRIC_HTTP_TRANSFER))
+        && TEST_false(OSSL_METRIC_is_timed(OSSL_METRIC_DRBG_RESEED));
+}
+
+static int test_metric_fetch(void)
+{
+    OSSL_LIB_CTX *ctx = NULL;
+    EVP_MD *md = NULL;
+    unsigned long dflt;
+    int i, ret = 0;
+
+    if (!TEST_ptr(ctx = OSSL_LIB_CTX_new()))
+        return 0;
+    dflt = get_count(NULL, OSSL_METRIC_FETCH_CACHE_HIT);
+    for (i = 0; i < 3; i++) {
+        if (!TEST_ptr(md = EVP_MD_fetch(ctx, "SHA2-256", "")))
+            goto err;
+        EVP_MD_free(md);
+    }
+    /*
+     * The first fetch may not even get as far as the cache, and fetches with
+     * NULL properties are never cached, hence the "" above.
+     */
+    if (!TEST_ulong_ge(get_count(ctx, OSSL_METRIC_FETCH_CACHE_HIT), 2)
+            || !TEST_ulong_eq(get_count(NULL, OSSL_METRIC_FETCH_CACHE_HIT),
+                              dflt))
+        goto err;
+
+    OSSL_METRIC_reset(ctx);
+    if (!TEST_ulong_eq(get_count(ctx, OSSL_METRIC_FETCH_CACHE_HIT), 0))
+        goto err;
+    ret = 1;
+ err:
+    OSSL_LIB_CTX_free(ctx);
+    return ret;
+}
+
+static int test_metric_verify(void)
+{
+    OSSL_LIB_CTX *ctx = NULL;
+    X509_STORE *store = NULL;
+    X509_STORE_CTX *sctx = NULL;
+    X509 *cert = NULL;
+    BIO *bio = NULL;
+    uint64_t hist[OSSL_METRIC_HISTOGRAM_BUCKETS], sum = 0;
+    char *out;
+    size_t i;
+    int ret = 0;
+
+    if (!TEST_ptr(ctx = OSSL_LIB_CTX_new())
+            || !TEST_ptr(bio = BIO_new_file(cert_file, "r"))
+            || !TEST_ptr(cert = PEM_read_bio_X509(bio, NULL, NULL, NULL))
+            || !TEST_ptr(store = X509_STORE_new())
+            || !TEST_ptr(sctx = X509_STORE_CTX_new_ex(ctx, NULL))
+            || !TEST_true(X509_STORE_CTX_init(sctx, store, cert, NULL)))
+        goto err;
+    BIO_free(bio);
+    bio = NULL;
+
+    /* Nothing is trusted, so this fails */
+    if (!TEST_int_le(X509_verify_cert(sctx), 0)
+            || !TEST_ulong_eq(get_count(ctx, OSSL_METRIC_X509_VERIFY), 1)
+            || !TEST_ulong_eq(get_count(ctx, OSSL_METRIC_X509_VERIFY_FAIL), 1)
+            || !TEST_int_eq(OSSL_METRIC_get_histogram(ctx,
+                                                      OSSL_METRIC_X509_VERIFY,
+                                                      hist, OSSL_NELEM(hist)),
+                            OSSL_METRIC_HISTOGRAM_BUCKETS)
+            || !TEST_false(OSSL_METRIC_get_histogram(ctx,
+                                                     OSSL_METRIC_X509_VERIFY_FAIL,
+                                                     hist, OSSL_NELEM(hist))))
+        goto err;
+    for (i = 0; i < OSSL_NELEM(hist); i++)
+        sum += hist[i];
+    if (!TEST_ulong_eq((unsigned long)sum, 1))
+        goto err;
+
+    if (!TEST_ptr(bio = BIO_new(BIO_s_mem()))
+            || !TEST_true(OSSL_METRIC_print(bio, ctx))
+            || !TEST_int_eq(BIO_write(bio, "", 1), 1)
+            || !TEST_long_gt(BIO_get_mem_data(bio, &out), 0)
+            || !TEST_ptr(strstr(out, "X509_VERIFY_FAIL"))
+            || !TEST_ptr(strstr(out, " us 1\n")))
+        goto err;
+    ret = 1;
+ err:
+    BIO_free(bio);
+    X509_STORE_CTX_free(sctx);
+    X509_STORE_free(store);
+    X509_free(cert);
+    OSSL_LIB_CTX_free(ctx);
+    return ret;
+}
+
+OPT_TEST_DECLARE_USAGE("cert.pem\n")
+
+int setup_tests(void)
+{
+    if (!test_skip_common_options()) {
+        TEST_error("Error parsing test options\n");
+        return 0;
+    }
+
+    if (!TEST_ptr(cert_file = test_get_argument(0)))
+        return 0;
+
+    ADD_TEST(test_metric_names);
+    ADD_TEST(test_metric_fetch);
+    ADD_TEST(test_metric_verify);
+    return 1;
+}
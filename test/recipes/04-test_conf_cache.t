@@ -0,0 +1,19 @@
+#! /usr/bin/env perl
+# Copyright 2021 The OpenSSL Project Authors. All Rights Reserved.
+#
+# Licensed under the Apache License 2.0 (the "License").  You may not use
+# this file except in compliance with the License.  You can obtain a copy
+# in the file LICENSE in the source distribution or at
+# https://www.openssl.org/source/license.html
+
+use strict;
+use warnings;
+
+use OpenSSL::Test qw/:DEFAULT srctop_file/;
+
+setup("test_conf_cache");
+
+plan tests => 1;
+
+ok(run(test(["conf_cache_test", srctop_file("apps", "openssl.cnf")])),
+   "test the configuration file parse cache");
@@ -23,7 +23,7 @@ setup("test_rehash");
 plan skip_all => "test_rehash is not available on this platform"
     unless run(app(["openssl", "rehash", "-help"]));
 
-plan tests => 4;
+plan tests => 7;
 
 indir "rehash.$$" => sub {
     prepare();
@@ -56,6 +56,98 @@ indir "rehash.$$" => sub {
     chmod 0700, curdir();       # make it writable again, so cleanup works
 }, create => 1, cleanup => 1;
 
+subtest "Testing incremental rehash with a manifest" => sub {
+    plan tests => 7;
+
+    indir "rehash.$$" => sub {
+        my @files = prepare();
+
+        ok(run(app(["openssl", "rehash", "-incremental", curdir()])),
+           'First run writes the manifest');
+        ok(-s ".rehash_manifest", 'Manifest is not empty');
+        my $links = links();
+        isnt($links, "", 'Links are created');
+
+        ok(run(app(["openssl", "rehash", "-incremental", curdir()])),
+           'Second run reads the manifest');
+        is(links(), $links, 'Same links from the manifest');
+
+        my $gone = basename($files[0]);
+        unlink $files[0];
+        ok(run(app(["openssl", "rehash", "-incremental", curdir()])),
+           'Run after removing a file');
+        ok(!grep({ $_ eq $gone } values %{ links_of() })
+           && !grep({ /^\Q$gone\E\t/ } read_manifest()),
+           'Removed file is gone from the links and the manifest');
+    }, create => 1, cleanup => 1;
+};
+
+subtest "Testing rehash in several threads" => sub {
+    plan tests => 3;
+
+    indir "rehash.$$" => sub {
+        prepare();
+
+        ok(run(app(["openssl", "rehash", curdir()])),
+           'Rehash in one thread');
+        my $links = links();
+        unlink keys %{ links_of() };
+        ok(run(app(["openssl", "rehash", "-threads", "4", curdir()])),
+           'Rehash in four threads');
+        is(links(), $links, 'Same links in four threads');
+    }, create => 1, cleanup => 1;
+};
+
+subtest "Testing links created under a temporary name" => sub {
+    plan tests => 4;
+
+    indir "rehash.$$" => sub {
+        prepare();
+
+        ok(run(app(["openssl", "rehash", curdir()])), 'Initial rehash');
+        my $links = links();
+
+        # Left behind by an interrupted run
+        open(my $fh, '>', ".rehash_tmp") or die "Can't write .rehash_tmp\n";
+        close($fh);
+        # A plain file in the place of a link, to be renamed over
+        my ($name) = sort keys %{ links_of() };
+        unlink $name;
+        open($fh, '>', $name) or die "Can't write $name\n";
+        close($fh);
+
+        ok(run(app(["openssl", "rehash", curdir()])), 'Rehash again');
+        ok(!-e ".rehash_tmp", 'No temporary link is left');
+        is(links(), $links, 'The file is replaced by the link');
+    }, create => 1, cleanup => 1;
+};
+
+# Returns the hash links in the current directory and their targets
+sub links_of {
+    my %links = ();
+
+    opendir(my $dh, curdir()) or die "Can't read the directory\n";
+    foreach (readdir($dh)) {
+        $links{$_} = readlink($_) if /^[0-9a-f]{8}\.r?\d+$/ && -l $_;
+    }
+    closedir($dh);
+    return \%links;
+}
+
+# Returns all hash links in the current directory as one string
+sub links {
+    my $links = links_of();
+
+    return join("\n", map { "$_ -> $links->{$_}" } sort keys %$links);
+}
+
+sub read_manifest {
+    open(my $fh, '<', ".rehash_manifest") or return ();
+    my @lines = <$fh>;
+    close($fh);
+    return @lines;
+}
+
 sub prepare {
     my @pemsourcefiles = sort glob(srctop_file('test', "*.pem"));
     my @destfiles = ();
@@ -95,4 +187,5 @@ sub prepare {
             unless (ref($_) eq 'CODE');
         $_->(@destfiles);
     }
+    return @destfiles;
 }
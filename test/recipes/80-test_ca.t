@@ -12,6 +12,7 @@ use warnings;
 
 use POSIX;
 use File::Path 2.00 qw/rmtree/;
+use File::Spec;
 use OpenSSL::Test qw/:DEFAULT cmdstr data_file srctop_file/;
 use OpenSSL::Test::Utils;
 use Time::Local qw/timegm/;
@@ -27,7 +28,7 @@ my $std_openssl_cnf = '"'
 
 rmtree("demoCA", { safe => 0 });
 
-plan tests => 15;
+plan tests => 18;
  SKIP: {
      $ENV{OPENSSL_CONFIG} = '-config ' . $cnf;
      skip "failed creating CA structure", 4
@@ -110,6 +111,120 @@ test_revoke('both_generalizedtime', {
     should_succeed => 1,
 });
 
+subtest "Append new certificates to the database" => sub {
+    plan tests => 5;
+
+    my $appendcnf = "append-index.cnf";
+    open my $fh, ">", $appendcnf or die "Trying to write $appendcnf: $!\n";
+    print $fh ".include ",
+        File::Spec->rel2abs(srctop_file("test", "ca-and-certs.cnf")), "\n";
+    print $fh "[ CA_default ]\nappend_index = yes\n";
+    close $fh;
+
+    my @before = read_lines("demoCA/index.txt");
+    my @old = read_lines("demoCA/index.txt.old");
+    unlink "demoCA/index.txt.attr";
+
+    $ENV{CN2} = "append_index";
+    ok(run(app(['openssl', 'req', '-config', $cnf, '-new',
+                '-key', data_file('revoked.key'), '-out', "append-req.pem",
+                '-section', 'userreq'])),
+       'Generate CSR');
+    delete $ENV{CN2};
+
+    ok(run(app(['openssl', 'ca', '-batch', '-config', $appendcnf,
+                '-in', "append-req.pem", '-out', "append-cert.pem"])),
+       'Sign CSR');
+
+    my @after = read_lines("demoCA/index.txt");
+    is_deeply([ @after[0 .. $#before] ], \@before,
+              'Existing entries are left alone');
+    ok(@after == @before + 1 && @old == read_lines("demoCA/index.txt.old")
+       && $after[-1] =~ /CN=append_index$/,
+       'New entry appended without rotating the database');
+    is_deeply([ read_lines("demoCA/index.txt.attr") ],
+              [ "unique_subject = yes" ],
+              'Database attributes written');
+};
+
+subtest "Sign several requests at once" => sub {
+    plan tests => 4;
+
+    foreach my $n (1, 2) {
+        $ENV{CN2} = "batch$n";
+        ok(run(app(['openssl', 'req', '-config', $cnf, '-new',
+                    '-key', data_file('revoked.key'), '-out', "batch$n-req.pem",
+                    '-section', 'userreq'])),
+           "Generate CSR $n");
+    }
+    delete $ENV{CN2};
+
+    ok(run(app(['openssl', 'ca', '-batch', '-config', $cnf, '-notext',
+                '-out', "batch-certs.pem",
+                '-infiles', "batch1-req.pem", "batch2-req.pem"])),
+       'Sign both CSRs');
+
+    my @certs = grep { /^-----BEGIN CERTIFICATE-----$/ }
+        read_lines("batch-certs.pem");
+    is(scalar @certs, 2, 'Both certificates are in the output file');
+};
+
+subtest "Sign several requests in threads" => sub {
+    plan skip_all => "no threads support"
+        if disabled("threads");
+    plan tests => 8;
+
+    my @n = (3 .. 6);
+    foreach my $n (@n) {
+        $ENV{CN2} = "batch$n";
+        ok(run(app(['openssl', 'req', '-config', $cnf, '-new',
+                    '-key', data_file('revoked.key'), '-out', "batch$n-req.pem",
+                    '-section', 'userreq'])),
+           "Generate CSR $n");
+    }
+    delete $ENV{CN2};
+
+    ok(run(app(['openssl', 'ca', '-batch', '-config', $cnf, '-notext',
+                '-out', "batch-threads.pem", '-threads', '3',
+                '-infiles', map { "batch$_-req.pem" } @n])),
+       'Sign all CSRs in three threads');
+
+    # Split the output, so that each certificate can be verified
+    my @certs = ();
+    foreach (read_lines("batch-threads.pem")) {
+        push @certs, "" if /^-----BEGIN CERTIFICATE-----$/;
+        $certs[-1] .= "$_\n" if @certs;
+    }
+    is(scalar @certs, scalar @n, 'All certificates are in the output file');
+
+    my $ok = 1;
+    for (my $i = 0; $i < @certs; $i++) {
+        my $file = "batch-threads-$i.pem";
+
+        open my $fh, ">", $file or die "Cannot write $file: $!";
+        print $fh $certs[$i];
+        close $fh;
+        $ok &&= run(app(['openssl', 'verify', '-CAfile', 'demoCA/cacert.pem',
+                         $file]));
+    }
+    ok($ok, 'All certificates are signed by the CA');
+
+    my @subjects = map { /CN=(batch\d+)$/ ? $1 : () }
+        read_lines("demoCA/index.txt");
+    is_deeply([ @subjects[-@n .. -1] ], [ map { "batch$_" } @n ],
+              'The database rows are in the order of the requests');
+};
+
+sub read_lines {
+    my ($file) = @_;
+
+    open my $fh, "<", $file or return ();
+    my @lines = <$fh>;
+    close $fh;
+    chomp @lines;
+    return @lines;
+}
+
 sub test_revoke {
     my ($filename, $opts) = @_;
 
@@ -14,7 +14,9 @@ use POSIX;
 use File::Spec::Functions qw/devnull catfile/;
 use File::Basename;
 use File::Copy;
-use OpenSSL::Test qw/:DEFAULT with pipe srctop_dir data_file/;
+use IO::Socket::INET;
+use OpenSSL::Test qw/:DEFAULT with pipe cmdstr srctop_dir srctop_file
+                    data_file/;
 use OpenSSL::Test::Utils;
 
 setup("test_ocsp");
@@ -49,7 +51,80 @@ sub test_ocsp {
                   $title); });
 }
 
-plan tests => 11;
+# Starts a responder in the background that answers |$nrequest| requests
+# on a port that was free a moment ago, and returns its pipe and port.
+sub start_responder {
+    my $nrequest = shift;
+    my $sock = IO::Socket::INET->new(LocalAddr => "127.0.0.1", LocalPort => 0,
+                                     Proto => "tcp", Listen => 1)
+        or return ();
+    my $port = $sock->sockport;
+    close($sock);
+
+    my $cmd = cmdstr(app(["openssl", "ocsp", "-port", $port,
+                          "-nrequest", $nrequest,
+                          "-rsigner", srctop_file("test", "certs", "ca-cert.pem"),
+                          "-rkey", srctop_file("test", "certs", "ca-key.pem"),
+                          "-CA", srctop_file("test", "certs", "ca-cert.pem"),
+                          @_]));
+    open(my $responder, "$cmd |") or return ();
+    return ($responder, $port);
+}
+
+# Asks the responder at |$port| about |$serial|, retrying while it is still
+# starting up, and returns the status reported.
+sub query_responder {
+    my ($port, $serial, @opts) = @_;
+
+    for (my $tries = 0; $tries < 10; $tries++) {
+        my @out = run(app(["openssl", "ocsp", "-noverify",
+                           "-url", "http://127.0.0.1:$port",
+                           "-issuer",
+                           srctop_file("test", "certs", "ca-cert.pem"),
+                           "-serial", $serial, @opts]), capture => 1);
+        foreach (@out) {
+            return $1 if /^\Q$serial\E: (\w+)/;
+        }
+        sleep 1;
+    }
+    return "";
+}
+
+# POSTs the DER request |$der| up to |$n| times on a single HTTP/1.1
+# connection to |$port|, as long as the responder keeps it alive, and returns
+# the number of successful OCSP responses received.
+sub post_keep_alive {
+    my ($port, $der, $n) = @_;
+    my $sock = IO::Socket::INET->new(PeerAddr => "127.0.0.1",
+                                     PeerPort => $port, Proto => "tcp")
+        or return 0;
+    my $answered = 0;
+
+    binmode($sock);
+    while ($answered < $n) {
+        my ($len, $keep_alive, $body) = (0, 0, "");
+
+        print $sock "POST / HTTP/1.1\r\nHost: 127.0.0.1\r\n",
+            "Content-Type: application/ocsp-request\r\n",
+            "Content-Length: ", length($der), "\r\n\r\n", $der;
+        my $status = <$sock>;
+        last unless defined($status) && $status =~ m|^HTTP/1\.\d 200 |;
+        while (my $line = <$sock>) {
+            last if $line =~ /^\r?\n$/;
+            $len = $1 if $line =~ /^Content-Length:\s*(\d+)/i;
+            $keep_alive = 1 if $line =~ /^Connection:\s*keep-alive/i;
+        }
+        last unless read($sock, $body, $len) == $len;
+        # OCSPResponse ::= SEQUENCE { responseStatus ENUMERATED successful(0)
+        last unless $body =~ /^\x30(?:[\x00-\x7f]|\x81.|\x82..)\x0a\x01\x00/s;
+        $answered++;
+        last unless $keep_alive;
+    }
+    close($sock);
+    return $answered;
+}
+
+plan tests => 13;
 
 subtest "=== VALID OCSP RESPONSES ===" => sub {
     plan tests => 7;
@@ -217,4 +292,69 @@ subtest "=== OCSP API TESTS===" => sub {
 
     ok(run(test(["ocspapitest", data_file("cert.pem"), data_file("key.pem")])),
                  "running ocspapitest");
-}
+};
+
+subtest "=== OCSP RESPONDER INDEX RELOAD ===" => sub {
+    plan skip_all => "The OCSP responder is not supported on this platform"
+        if disabled("sock") || $^O =~ /^(VMS|MSWin32)$/;
+    plan tests => 4;
+
+    my $index = "ocsp-reload-index.txt";
+    open(my $fh, ">", $index) or die "Cannot write $index: $!";
+    print $fh "V\t300101000000Z\t\t01\tunknown\t/CN=one\n";
+    close($fh);
+
+    my ($responder, $port) = start_responder(2, "-index", $index);
+    ok(defined($responder), "starting responder");
+    is(query_responder($port, "0x1"), "good", "entry loaded at startup");
+
+    # Make sure that the change is visible in the modification time
+    sleep 1;
+    open($fh, ">>", $index) or die "Cannot append to $index: $!";
+    print $fh "R\t300101000000Z\t210101000000Z\t02\tunknown\t/CN=two\n";
+    close($fh);
+    is(query_responder($port, "0x2"), "revoked", "appended entry seen");
+
+    ok(defined($responder) && close($responder),
+       "responder stops after -nrequest");
+};
+
+subtest "=== THREADED OCSP RESPONDER ===" => sub {
+    plan skip_all => "no sockets or threads in this build"
+        if disabled("sock") || disabled("threads");
+    plan skip_all => "responder tests are not supported on this platform"
+        if $^O =~ /^(VMS|MSWin32)$/;
+    plan tests => 8;
+
+    my $index = "ocsp-threads-index.txt";
+    open(my $fh, ">", $index) or die "Cannot create $index: $!";
+    print $fh "V\t300101000000Z\t\t01\tunknown\t/CN=one\n";
+    print $fh "R\t300101000000Z\t210101000000Z\t02\tunknown\t/CN=two\n";
+    close($fh);
+
+    ok(run(app(["openssl", "ocsp", "-no_nonce", "-reqout", "ocsp-req.der",
+                "-issuer", srctop_file("test", "certs", "ca-cert.pem"),
+                "-serial", "0x1"])),
+       "writing a request without nonce");
+    open($fh, "<", "ocsp-req.der") or die "Cannot read ocsp-req.der: $!";
+    binmode($fh);
+    my $der = do { local $/; <$fh> };
+    close($fh);
+
+    # 1 + 2 + 1 + 2 requests
+    my ($responder, $port) = start_responder(6, "-index", $index,
+                                             "-threads", "2",
+                                             "-resp_cache", "60");
+    ok(defined($responder), "starting threaded responder");
+    is(query_responder($port, "0x1"), "good", "request with nonce");
+    is(query_responder($port, "0x1", "-no_nonce"), "good",
+       "request without nonce, cached");
+    is(query_responder($port, "0x1", "-no_nonce"), "good",
+       "request without nonce, answered from the cache");
+    is(query_responder($port, "0x2"), "revoked", "revoked entry");
+    is(post_keep_alive($port, $der, 2), 2,
+       "two requests on one kept-alive connection");
+
+    ok(defined($responder) && close($responder),
+       "threaded responder stops after -nrequest");
+};
@@ -9,10 +9,11 @@
 use strict;
 use warnings;
 
-use OpenSSL::Test qw/:DEFAULT srctop_file/;
+use OpenSSL::Test qw/:DEFAULT srctop_file data_file/;
 use OpenSSL::Test::Utils;
 
 use Encode;
+use File::Compare qw(compare_text);
 
 setup("test_pkcs12");
 
@@ -57,7 +58,7 @@ if (eval { require Win32::API; 1; }) {
 }
 $ENV{OPENSSL_WIN32_UTF8}=1;
 
-plan tests => 5;
+plan tests => 6;
 
 # Test different PKCS#12 formats
 ok(run(test(["pkcs12_format_test"])), "test pkcs12 formats");
@@ -103,4 +104,24 @@ SKIP: {
     "test_pkcs12_passcerts_legacy");
 }
 
+SKIP: {
+    skip "Skipping the -threads test because threads are disabled", 1
+        if disabled("threads");
+    my $infile = data_file("many-bags.p12");
+    my $pemfile1 = "out1.pem";
+    my $pemfile2 = "out2.pem";
+
+    # Test that reading in threads gives the same result.  The keystore has
+    # four encrypted safes with two certificates each and two plain safes
+    # with four shrouded keys each, so that there is work for every thread.
+    ok(run(app(["openssl", "pkcs12", "-in", $infile,
+                "-passin", "pass:threads", "-noenc",
+                "-out", $pemfile1]))
+       && run(app(["openssl", "pkcs12", "-in", $infile,
+                   "-passin", "pass:threads", "-noenc", "-threads", "3",
+                   "-out", $pemfile2]))
+       && compare_text($pemfile1, $pemfile2) == 0,
+       "test_pkcs12_threads");
+}
+
 SetConsoleOutputCP($savedcp) if (defined($savedcp));
@@ -12,8 +12,10 @@ use strict;
 use warnings;
 
 use POSIX;
+use File::Spec;
 use File::Compare qw/compare_text/;
-use OpenSSL::Test qw/:DEFAULT with srctop_file srctop_dir bldtop_dir result_file/;
+use OpenSSL::Test qw/:DEFAULT with srctop_file srctop_dir bldtop_dir result_file
+                      result_dir/;
 use OpenSSL::Test::Utils;
 
 BEGIN {
@@ -47,7 +49,7 @@ my @cmp_server_tests = (
       !disabled("deprecated-3.0")  ]
     );
 
-plan tests => @cmp_basic_tests + @cmp_server_tests;
+plan tests => @cmp_basic_tests + @cmp_server_tests + 3;
 
 foreach (@cmp_basic_tests) {
     my $title = $$_[0];
@@ -80,3 +82,37 @@ foreach (@cmp_server_tests) {
        $title);
     # not unlinking $outfile
 }
+
+# the mock server answering requests saved in files, as for an offline CA
+{
+    my $secret = "pass:test";
+    my $rsp_cert = srctop_file('test',  'certs', 'ee-cert-1024.pem');
+    my $reqdir = File::Spec->catdir(result_dir(), "reqdir");
+    my $rspdir = File::Spec->catdir(result_dir(), "rspdir");
+    my @srv_args = ("-srv_ref", "mock server", "-srv_secret", $secret,
+                    "-rsp_cert", $rsp_cert, "-grant_implicitconf");
+    my @cli_args = ("-cmd", "cr", "-subject", "/CN=any",
+                    "-newkey", srctop_file('test', 'certs', 'ee-key-1024.pem'),
+                    "-secret", $secret, "-ref", "client under test",
+                    "-implicit_confirm");
+    my @threads = disabled("threads") ? () : ("-threads", "2");
+    my $outfile = result_file("test.reqdir.certout.pem");
+
+    mkdir $reqdir;
+    mkdir $rspdir;
+    ok(run(cmd([$app, "-config", '""', @srv_args, "-use_mock_srv", @cli_args,
+                "-reqout", "$reqdir/req1.der", "-certout", $outfile]))
+       && run(cmd([$app, "-config", '""', @srv_args, "-use_mock_srv",
+                   @cli_args, "-reqout", "$reqdir/req2.der",
+                   "-certout", $outfile])),
+       "save requests for offline mock server");
+    ok(run(cmd([$app, "-config", '""', @srv_args, @threads,
+                "-reqdir", $reqdir, "-rspdir", $rspdir])),
+       "offline mock server with -reqdir");
+    unlink $outfile;
+    ok(run(cmd([$app, "-config", '""', "-server", "127.0.0.1", @cli_args,
+                "-reqin", "$reqdir/req2.der", "-rspin", "$rspdir/req2.der",
+                "-certout", $outfile]))
+       && compare_text($outfile, $rsp_cert) == 0,
+       "use response of offline mock server");
+}
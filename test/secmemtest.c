@@ -1,5 +1,5 @@
 /*
- * Copyright 2015-2020 The OpenSSL Project Authors. All Rights Reserved.
+ * Copyright 2015-2021 The OpenSSL Project Authors. All Rights Reserved.
  *
  * Licensed under the Apache License 2.0 (the "License").  You may not use
  * this file except in compliance with the License.  You can obtain a copy
@@ -7,6 +7,7 @@
  * https://www.openssl.org/source/license.html
  */
 
+#include <string.h>
 #include <openssl/crypto.h>
 
 #include "testutil.h"
@@ -175,9 +176,82 @@ err:
 #endif
 }
 
+/* A heap large enough to be split into arenas and cached per thread */
+static int test_sec_mem_arenas(void)
+{
+#ifndef OPENSSL_NO_SECURE_MEMORY
+    unsigned char *p[64];
+    size_t used = 0;
+    int i, j, res = 0;
+
+    memset(p, 0, sizeof(p));
+    if (!TEST_true(CRYPTO_secure_malloc_init(1 << 20, 16)))
+        return 0;
+
+    for (j = 0; j < 2; j++) {
+        for (i = 0; i < (int)OSSL_NELEM(p); i++) {
+            size_t size = 16 << (i % 8);
+
+            if (!TEST_ptr(p[i] = OPENSSL_secure_malloc(size))
+                    || !TEST_true(CRYPTO_secure_allocated(p[i]))
+                    || !TEST_size_t_eq(CRYPTO_secure_actual_size(p[i]), size)
+                    || !TEST_uchar_eq(p[i][size - 1], 0))
+                goto err;
+            memset(p[i], 0xff, size);
+            used += size;
+        }
+        if (!TEST_size_t_eq(CRYPTO_secure_used(), used))
+            goto err;
+        for (i = 0; i < (int)OSSL_NELEM(p); i++) {
+            OPENSSL_secure_free(p[i]);
+            p[i] = NULL;
+        }
+        used = 0;
+        if (!TEST_size_t_eq(CRYPTO_secure_used(), 0))
+            goto err;
+    }
+
+    /* Larger allocations take several arenas, up to the whole heap */
+    if (!TEST_ptr(p[0] = OPENSSL_secure_malloc((1 << 18) + 1))
+            || !TEST_size_t_eq(CRYPTO_secure_actual_size(p[0]), 1 << 19)
+            || !TEST_ptr(p[1] = OPENSSL_secure_malloc(1 << 19))
+            || !TEST_ptr_null(OPENSSL_secure_malloc(1 << 18))
+            || !TEST_size_t_eq(CRYPTO_secure_used(), 1 << 20))
+        goto err;
+    OPENSSL_secure_free(p[0]);
+    OPENSSL_secure_free(p[1]);
+    p[0] = p[1] = NULL;
+    if (!TEST_ptr(p[0] = OPENSSL_secure_malloc(1 << 20))
+            || !TEST_size_t_eq(CRYPTO_secure_actual_size(p[0]), 1 << 20)
+            || !TEST_uchar_eq(p[0][(1 << 20) - 1], 0))
+        goto err;
+    OPENSSL_secure_free(p[0]);
+    p[0] = NULL;
+
+    /* Chunks that were cached must not survive the heap */
+    if (!TEST_true(CRYPTO_secure_malloc_done())
+            || !TEST_false(CRYPTO_secure_malloc_initialized())
+            || !TEST_true(CRYPTO_secure_malloc_init(1 << 20, 16))
+            || !TEST_ptr(p[0] = OPENSSL_secure_malloc(16))
+            || !TEST_true(CRYPTO_secure_allocated(p[0])))
+        goto err;
+
+    res = 1;
+ err:
+    for (i = 0; i < (int)OSSL_NELEM(p); i++)
+        OPENSSL_secure_free(p[i]);
+    if (!TEST_true(CRYPTO_secure_malloc_done()))
+        res = 0;
+    return res;
+#else
+    return 1;
+#endif
+}
+
 int setup_tests(void)
 {
     ADD_TEST(test_sec_mem);
     ADD_TEST(test_sec_mem_clear);
+    ADD_TEST(test_sec_mem_arenas);
     return 1;
 }
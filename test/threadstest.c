@@ -16,6 +16,12 @@
 #include <openssl/evp.h>
 #include <openssl/aes.h>
 #include <openssl/rsa.h>
+#include <openssl/objects.h>
+#include <openssl/metrics.h>
+#include "internal/nelem.h"
+#include "internal/cryptlib.h"
+#include "internal/rcu.h"
+#include "crypto/hashtable.h"
 #include "testutil.h"
 
 static int do_fips = 0;
@@ -501,6 +507,595 @@ static int test_multi_load(void)
     return 1;
 }
 
+/*
+ * Readers look up entries of a shared hash table while the main thread keeps
+ * replacing, deleting and reinserting them.  Every entry found must be intact
+ * and carry the key it was looked up with.
+ */
+#define HT_KEYS     256
+#define HT_ROUNDS   200
+#define HT_READER_PASSES 2000
+
+typedef struct {
+    int key;
+    int generation;
+} HT_ITEM;
+
+static OSSL_HT *shared_ht;
+static CRYPTO_RWLOCK *ht_done_lock;
+static uint64_t ht_writer_done;
+static int ht_reader_ok;
+
+static unsigned long ht_item_hash(const void *v)
+{
+    return ((const HT_ITEM *)v)->key;
+}
+
+static int ht_item_cmp(const void *a, const void *b)
+{
+    return ((const HT_ITEM *)a)->key != ((const HT_ITEM *)b)->key;
+}
+
+static void ht_item_free(void *v)
+{
+    HT_ITEM *it = v;
+
+    /* Make use after free visible to the readers */
+    it->key = -1;
+    OPENSSL_free(it);
+}
+
+static void ht_reader_worker(void)
+{
+    HT_ITEM tmpl, *it;
+    uint64_t done = 0;
+
+    int pass;
+
+    /* Bounded, as without threads the readers run before the writer */
+    for (pass = 0; pass < HT_READER_PASSES
+                   && CRYPTO_atomic_load(&ht_writer_done, &done, ht_done_lock)
+                   && !done; pass++) {
+        for (tmpl.key = 0; tmpl.key < HT_KEYS; tmpl.key++) {
+            if (!ossl_ht_read_lock(shared_ht)) {
+                ht_reader_ok = 0;
+                return;
+            }
+            it = ossl_ht_get(shared_ht, &tmpl);
+            if (it != NULL && it->key != tmpl.key)
+                ht_reader_ok = 0;
+            ossl_ht_read_unlock(shared_ht);
+        }
+    }
+}
+
+static int ht_insert_item(int key, int generation)
+{
+    HT_ITEM *it = OPENSSL_malloc(sizeof(*it));
+
+    if (it == NULL)
+        return 0;
+    it->key = key;
+    it->generation = generation;
+    if (!ossl_ht_insert(shared_ht, it)) {
+        OPENSSL_free(it);
+        return 0;
+    }
+    return 1;
+}
+
+static int test_hashtable_concurrent(void)
+{
+    thread_t threads[2];
+    HT_ITEM tmpl;
+    uint64_t ret;
+    int i, r, started = 0, testresult = 0;
+
+    ht_reader_ok = 1;
+    ht_writer_done = 0;
+    if (!TEST_ptr(ht_done_lock = CRYPTO_THREAD_lock_new())
+            || !TEST_ptr(shared_ht = ossl_ht_new(&ht_item_hash, &ht_item_cmp,
+                                                 &ht_item_free)))
+        goto err;
+
+    for (; started < (int)OSSL_NELEM(threads); started++)
+        if (!TEST_true(run_thread(&threads[started], ht_reader_worker)))
+            goto err;
+
+    for (r = 0; r < HT_ROUNDS; r++) {
+        for (i = 0; i < HT_KEYS; i++)
+            if (!TEST_true(ht_insert_item(i, r)))
+                goto err;
+        for (i = r % 2; i < HT_KEYS; i += 2) {
+            tmpl.key = i;
+            ossl_ht_delete(shared_ht, &tmpl);
+        }
+        if (r % 50 == 49)
+            ossl_ht_flush(shared_ht);
+    }
+    testresult = 1;
+
+ err:
+    CRYPTO_atomic_or(&ht_writer_done, 1, &ret, ht_done_lock);
+    for (i = 0; i < started; i++)
+        if (!TEST_true(wait_for_thread(threads[i])))
+            testresult = 0;
+    ossl_ht_free(shared_ht);
+    CRYPTO_THREAD_lock_free(ht_done_lock);
+    return testresult && TEST_true(ht_reader_ok);
+}
+
+static int rcu_cb_count;
+static int rcu_cb_order[4];
+
+static void rcu_record_cb(void *arg)
+{
+    rcu_cb_order[rcu_cb_count++ % OSSL_NELEM(rcu_cb_order)] = *(int *)arg;
+}
+
+static int test_rcu_basic(void)
+{
+    CRYPTO_RCU_LOCK *lock = ossl_rcu_lock_new();
+    static int vals[] = { 1, 2, 3 };
+    int *p = NULL, testresult = 0;
+
+    rcu_cb_count = 0;
+    if (!TEST_ptr(lock))
+        return 0;
+
+    /* Read sections nest */
+    if (!TEST_true(ossl_rcu_read_lock(lock)))
+        goto err;
+    if (!TEST_true(ossl_rcu_read_lock(lock))) {
+        ossl_rcu_read_unlock(lock);
+        goto err;
+    }
+    ossl_rcu_read_unlock(lock);
+    ossl_rcu_read_unlock(lock);
+
+    if (!TEST_true(ossl_rcu_write_lock(lock)))
+        goto err;
+    ossl_rcu_assign_ptr(&p, &vals[0]);
+    if (!TEST_true(ossl_rcu_call(lock, rcu_record_cb, &vals[0]))
+            || !TEST_true(ossl_rcu_call(lock, rcu_record_cb, &vals[1]))) {
+        ossl_rcu_write_unlock(lock);
+        goto err;
+    }
+    ossl_rcu_write_unlock(lock);
+
+    /* Callbacks are deferred until the grace period and run in order */
+    if (!TEST_int_eq(rcu_cb_count, 0))
+        goto err;
+    ossl_synchronize_rcu(lock);
+    if (!TEST_int_eq(rcu_cb_count, 2)
+            || !TEST_int_eq(rcu_cb_order[0], 1)
+            || !TEST_int_eq(rcu_cb_order[1], 2))
+        goto err;
+    ossl_synchronize_rcu(lock);
+    if (!TEST_int_eq(rcu_cb_count, 2))
+        goto err;
+
+    if (!TEST_true(ossl_rcu_read_lock(lock)))
+        goto err;
+    if (!TEST_ptr_eq(ossl_rcu_deref(&p), &vals[0])) {
+        ossl_rcu_read_unlock(lock);
+        goto err;
+    }
+    ossl_rcu_read_unlock(lock);
+
+    /* Pending callbacks are run when the lock is freed */
+    if (!TEST_true(ossl_rcu_call(lock, rcu_record_cb, &vals[2])))
+        goto err;
+    ossl_rcu_lock_free(lock);
+    lock = NULL;
+    if (!TEST_int_eq(rcu_cb_count, 3)
+            || !TEST_int_eq(rcu_cb_order[2], 3))
+        goto err;
+
+    testresult = 1;
+ err:
+    ossl_rcu_lock_free(lock);
+    return testresult;
+}
+
+/*
+ * Every hash table has its own lock, so there may be many more of them than
+ * a thread can have thread-specific keys.  Read sections on different locks
+ * nest.
+ */
+#define RCU_MANY_LOCKS 2000
+
+static int test_rcu_many_locks(void)
+{
+    CRYPTO_RCU_LOCK **locks;
+    int i, n = 0, testresult = 0;
+
+    if (!TEST_ptr(locks = OPENSSL_zalloc(sizeof(*locks) * RCU_MANY_LOCKS)))
+        return 0;
+    for (; n < RCU_MANY_LOCKS; n++)
+        if (!TEST_ptr(locks[n] = ossl_rcu_lock_new()))
+            goto err;
+    for (i = 0; i < RCU_MANY_LOCKS; i++) {
+        if (!TEST_true(ossl_rcu_read_lock(locks[i])))
+            goto err;
+        if (!TEST_true(ossl_rcu_read_lock(locks[RCU_MANY_LOCKS - 1 - i]))) {
+            ossl_rcu_read_unlock(locks[i]);
+            goto err;
+        }
+        ossl_rcu_read_unlock(locks[RCU_MANY_LOCKS - 1 - i]);
+        ossl_rcu_read_unlock(locks[i]);
+    }
+    /* Not in any read section any more, so this does not wait for us */
+    ossl_synchronize_rcu(locks[0]);
+    testresult = 1;
+ err:
+    for (i = 0; i < n; i++)
+        ossl_rcu_lock_free(locks[i]);
+    OPENSSL_free(locks);
+    return testresult;
+}
+
+/*
+ * Readers keep dereferencing a shared pointer while the main thread replaces
+ * it and frees the old version after a grace period, alternately by waiting
+ * for it and by deferring the free to a callback.  Readers must only ever see
+ * intact versions, in order.
+ */
+#define RCU_READERS         3
+#define RCU_UPDATES         2000
+#define RCU_READER_PASSES   200000
+
+typedef struct {
+    int valid;
+    int generation;
+} RCU_DATA;
+
+static CRYPTO_RCU_LOCK *rcu_lock;
+static RCU_DATA *rcu_shared;
+static CRYPTO_RWLOCK *rcu_done_lock;
+static uint64_t rcu_writer_done;
+static int rcu_reader_ok;
+
+static RCU_DATA *rcu_data_new(int generation)
+{
+    RCU_DATA *d = OPENSSL_malloc(sizeof(*d));
+
+    if (d != NULL) {
+        d->valid = 1;
+        d->generation = generation;
+    }
+    return d;
+}
+
+static void rcu_data_free(void *v)
+{
+    RCU_DATA *d = v;
+
+    /* Make use after free visible to the readers */
+    d->valid = 0;
+    OPENSSL_free(d);
+}
+
+static void rcu_reader_worker(void)
+{
+    RCU_DATA *d;
+    uint64_t done = 0;
+    int pass, last = 0;
+
+    for (pass = 0; pass < RCU_READER_PASSES
+                   && CRYPTO_atomic_load(&rcu_writer_done, &done, rcu_done_lock)
+                   && !done; pass++) {
+        if (!ossl_rcu_read_lock(rcu_lock)) {
+            rcu_reader_ok = 0;
+            return;
+        }
+        d = ossl_rcu_deref(&rcu_shared);
+        if (d == NULL || !d->valid || d->generation < last)
+            rcu_reader_ok = 0;
+        else
+            last = d->generation;
+
+        /* A nested section must not end the protection of the outer one */
+        if (ossl_rcu_read_lock(rcu_lock))
+            ossl_rcu_read_unlock(rcu_lock);
+        if (d != NULL && !d->valid)
+            rcu_reader_ok = 0;
+        ossl_rcu_read_unlock(rcu_lock);
+    }
+}
+
+static int test_rcu_concurrent(void)
+{
+    thread_t threads[RCU_READERS];
+    RCU_DATA *d, *old;
+    uint64_t ret;
+    int i, started = 0, testresult = 0;
+
+    rcu_reader_ok = 1;
+    rcu_writer_done = 0;
+    rcu_shared = NULL;
+    if (!TEST_ptr(rcu_done_lock = CRYPTO_THREAD_lock_new())
+            || !TEST_ptr(rcu_lock = ossl_rcu_lock_new())
+            || !TEST_ptr(rcu_shared = rcu_data_new(0)))
+        goto err;
+
+    for (; started < RCU_READERS; started++)
+        if (!TEST_true(run_thread(&threads[started], rcu_reader_worker)))
+            goto err;
+
+    for (i = 1; i <= RCU_UPDATES; i++) {
+        if (!TEST_ptr(d = rcu_data_new(i))
+                || !TEST_true(ossl_rcu_write_lock(rcu_lock))) {
+            OPENSSL_free(d);
+            goto err;
+        }
+        old = rcu_shared;
+        ossl_rcu_assign_ptr(&rcu_shared, d);
+        if (i % 2 == 0) {
+            if (!TEST_true(ossl_rcu_call(rcu_lock, rcu_data_free, old))) {
+                ossl_rcu_write_unlock(rcu_lock);
+                goto err;
+            }
+            ossl_rcu_write_unlock(rcu_lock);
+            ossl_synchronize_rcu(rcu_lock);
+        } else {
+            ossl_rcu_write_unlock(rcu_lock);
+            ossl_synchronize_rcu(rcu_lock);
+            rcu_data_free(old);
+        }
+    }
+    testresult = 1;
+
+ err:
+    CRYPTO_atomic_or(&rcu_writer_done, 1, &ret, rcu_done_lock);
+    for (i = 0; i < started; i++)
+        if (!TEST_true(wait_for_thread(threads[i])))
+            testresult = 0;
+    /* The readers have exited and must no longer hold up grace periods */
+    if (rcu_lock != NULL)
+        ossl_synchronize_rcu(rcu_lock);
+    if (rcu_shared != NULL)
+        rcu_data_free(rcu_shared);
+    ossl_rcu_lock_free(rcu_lock);
+    CRYPTO_THREAD_lock_free(rcu_done_lock);
+    return testresult && TEST_true(rcu_reader_ok);
+}
+
+#if defined(OPENSSL_THREADS) && !defined(CRYPTO_TDEBUG)
+/*
+ * A grace period on one lock must not wait for a reader that stays in a read
+ * section on another lock until the grace period has ended.  The reader gives
+ * up after a few seconds instead of letting the test hang.
+ */
+# define RCU_OTHER_INSIDE   1
+# define RCU_OTHER_SYNCED   2
+
+static CRYPTO_RCU_LOCK *rcu_other_lock;
+static uint64_t rcu_other_state;
+static int rcu_other_ok;
+
+static int rcu_other_wait_for(uint64_t flag)
+{
+    uint64_t state = 0;
+    int i;
+
+    for (i = 0; i < 500; i++) {
+        if (!CRYPTO_atomic_load(&rcu_other_state, &state, rcu_done_lock))
+            return 0;
+        if ((state & flag) != 0)
+            return 1;
+        ossl_sleep(10);
+    }
+    return 0;
+}
+
+static void rcu_other_reader(void)
+{
+    uint64_t ret;
+
+    if (!ossl_rcu_read_lock(rcu_other_lock))
+        return;
+    CRYPTO_atomic_or(&rcu_other_state, RCU_OTHER_INSIDE, &ret, rcu_done_lock);
+    rcu_other_ok = rcu_other_wait_for(RCU_OTHER_SYNCED);
+    ossl_rcu_read_unlock(rcu_other_lock);
+}
+
+static int test_rcu_other_lock(void)
+{
+    CRYPTO_RCU_LOCK *lock = NULL;
+    thread_t thread;
+    uint64_t ret;
+    int started = 0, testresult = 0;
+
+    rcu_other_state = 0;
+    rcu_other_ok = 0;
+    if (!TEST_ptr(rcu_done_lock = CRYPTO_THREAD_lock_new())
+            || !TEST_ptr(lock = ossl_rcu_lock_new())
+            || !TEST_ptr(rcu_other_lock = ossl_rcu_lock_new())
+            || !TEST_true(started = run_thread(&thread, rcu_other_reader))
+            || !TEST_true(rcu_other_wait_for(RCU_OTHER_INSIDE)))
+        goto err;
+
+    ossl_synchronize_rcu(lock);
+    testresult = 1;
+
+ err:
+    CRYPTO_atomic_or(&rcu_other_state, RCU_OTHER_SYNCED, &ret, rcu_done_lock);
+    if (started && !TEST_true(wait_for_thread(thread)))
+        testresult = 0;
+    ossl_rcu_lock_free(rcu_other_lock);
+    ossl_rcu_lock_free(lock);
+    CRYPTO_THREAD_lock_free(rcu_done_lock);
+    return testresult && TEST_true(rcu_other_ok);
+}
+#endif
+
+/*
+ * Threads record into different stripes of the counters, but reading a
+ * metric must still see all of them.
+ */
+#define METRIC_THREADS      4
+#define METRIC_PER_THREAD   10000
+
+static OSSL_LIB_CTX *metric_ctx;
+
+static void metric_worker(void)
+{
+    int i;
+
+    for (i = 0; i < METRIC_PER_THREAD; i++)
+        OSSL_METRIC_record(metric_ctx, OSSL_METRIC_HTTP_TRANSFER, i % 100);
+}
+
+static int test_metrics_concurrent(void)
+{
+    thread_t threads[METRIC_THREADS];
+    uint64_t hist[OSSL_METRIC_HISTOGRAM_BUCKETS], sum = 0;
+    int i, started = 0, testresult = 0;
+
+    if (!TEST_ptr(metric_ctx = OSSL_LIB_CTX_new()))
+        return 0;
+    for (; started < METRIC_THREADS; started++)
+        if (!TEST_true(run_thread(&threads[started], metric_worker)))
+            break;
+    testresult = started == METRIC_THREADS;
+    for (i = 0; i < started; i++)
+        if (!TEST_true(wait_for_thread(threads[i])))
+            testresult = 0;
+    if (!TEST_int_eq(OSSL_METRIC_get_histogram(metric_ctx,
+                                               OSSL_METRIC_HTTP_TRANSFER,
+                                               hist, OSSL_NELEM(hist)),
+                     OSSL_METRIC_HISTOGRAM_BUCKETS))
+        testresult = 0;
+    for (i = 0; i < (int)OSSL_NELEM(hist); i++)
+        sum += hist[i];
+    if (!TEST_true(OSSL_METRIC_get_count(metric_ctx, OSSL_METRIC_HTTP_TRANSFER)
+                   == (uint64_t)started * METRIC_PER_THREAD)
+            || !TEST_true(sum == (uint64_t)started * METRIC_PER_THREAD))
+        testresult = 0;
+    OSSL_METRIC_reset(metric_ctx);
+    if (!TEST_true(OSSL_METRIC_get_count(metric_ctx,
+                                         OSSL_METRIC_HTTP_TRANSFER) == 0))
+        testresult = 0;
+    OSSL_LIB_CTX_free(metric_ctx);
+    return testresult;
+}
+
+#ifndef OPENSSL_NO_SECURE_MEMORY
+# define SECMEM_THREADS 4
+# define SECMEM_PASSES 1000
+
+static int secmem_ok;
+
+static void secmem_worker(void)
+{
+    unsigned char *p[8];
+    size_t i, size;
+    int pass;
+
+    for (pass = 0; pass < SECMEM_PASSES; pass++) {
+        for (i = 0; i < OSSL_NELEM(p); i++) {
+            size = 32 << (i % 5);
+            p[i] = OPENSSL_secure_malloc(size);
+            if (p[i] == NULL || !CRYPTO_secure_allocated(p[i])
+                    || p[i][0] != 0 || p[i][size - 1] != 0)
+                secmem_ok = 0;
+            else
+                memset(p[i], 0xa5, size);
+        }
+        for (i = 0; i < OSSL_NELEM(p); i++)
+            OPENSSL_secure_free(p[i]);
+    }
+}
+
+static int test_secure_heap_concurrent(void)
+{
+    thread_t threads[SECMEM_THREADS];
+    int i, started = 0, testresult = 0;
+
+    secmem_ok = 1;
+    if (!TEST_true(CRYPTO_secure_malloc_init(1 << 20, 16)))
+        return 0;
+    for (; started < SECMEM_THREADS; started++)
+        if (!TEST_true(run_thread(&threads[started], secmem_worker)))
+            break;
+    testresult = started == SECMEM_THREADS;
+    for (i = 0; i < started; i++)
+        if (!TEST_true(wait_for_thread(threads[i])))
+            testresult = 0;
+    /* Chunks cached by the workers went back to the heap when they exited */
+    if (!TEST_true(secmem_ok)
+            || !TEST_size_t_eq(CRYPTO_secure_used(), 0))
+        testresult = 0;
+    if (!TEST_true(CRYPTO_secure_malloc_done()))
+        testresult = 0;
+    return testresult;
+}
+#endif
+
+#define OBJ_THREADS     2
+#define OBJ_PER_THREAD  64
+
+static CRYPTO_RWLOCK *obj_count_lock;
+static int obj_thread_count;
+static int obj_ok;
+
+static void obj_worker(void)
+{
+    char oid[64], sn[32], txt[64];
+    int id, i, nid;
+    ASN1_OBJECT *obj;
+
+    if (!CRYPTO_atomic_add(&obj_thread_count, 1, &id, obj_count_lock)) {
+        obj_ok = 0;
+        return;
+    }
+    for (i = 0; i < OBJ_PER_THREAD; i++) {
+        obj = NULL;
+        BIO_snprintf(oid, sizeof(oid), "1.3.6.1.4.1.99999.%d.%d", id, i);
+        BIO_snprintf(sn, sizeof(sn), "threadsTest-%d-%d", id, i);
+        if ((nid = OBJ_create(oid, sn, NULL)) == NID_undef
+                || OBJ_sn2nid(sn) != nid
+                || OBJ_txt2nid(oid) != nid
+                || OBJ_obj2txt(txt, sizeof(txt), OBJ_nid2obj(nid), 1) <= 0
+                || strcmp(txt, oid) != 0)
+            obj_ok = 0;
+        /* Lookups of built-in objects while others add theirs */
+        if (OBJ_txt2nid("2.5.29.19") != NID_basic_constraints
+                || OBJ_sn2nid("CN") != NID_commonName
+                || (obj = OBJ_txt2obj("2.5.4.3", 1)) == NULL
+                || OBJ_obj2nid(obj) != NID_commonName)
+            obj_ok = 0;
+        ASN1_OBJECT_free(obj);
+    }
+}
+
+static int test_obj_concurrent(void)
+{
+    thread_t threads[OBJ_THREADS];
+    int i, started = 0, testresult = 0;
+
+    obj_ok = 1;
+    if (!TEST_ptr(obj_count_lock = CRYPTO_THREAD_lock_new()))
+        return 0;
+    for (; started < OBJ_THREADS; started++)
+        if (!TEST_true(run_thread(&threads[started], obj_worker)))
+            break;
+    testresult = started == OBJ_THREADS;
+    for (i = 0; i < started; i++)
+        if (!TEST_true(wait_for_thread(threads[i])))
+            testresult = 0;
+    CRYPTO_THREAD_lock_free(obj_count_lock);
+    /* Every object is there exactly once */
+    if (!TEST_true(obj_ok)
+            || !TEST_int_eq(OBJ_create("1.3.6.1.4.1.99999.1.0", NULL, NULL),
+                            0)
+            || !TEST_int_ne(OBJ_sn2nid("threadsTest-1-0"),
+                            OBJ_sn2nid("threadsTest-2-0")))
+        testresult = 0;
+    return testresult;
+}
+
 typedef enum OPTION_choice {
     OPT_ERR = -1,
     OPT_EOF = 0,
@@ -547,6 +1142,18 @@ int setup_tests(void)
     ADD_TEST(test_thread_local);
     ADD_TEST(test_atomic);
     ADD_TEST(test_multi_load);
+    ADD_TEST(test_hashtable_concurrent);
+    ADD_TEST(test_rcu_basic);
+    ADD_TEST(test_rcu_many_locks);
+    ADD_TEST(test_rcu_concurrent);
+#if defined(OPENSSL_THREADS) && !defined(CRYPTO_TDEBUG)
+    ADD_TEST(test_rcu_other_lock);
+#endif
+    ADD_TEST(test_obj_concurrent);
+    ADD_TEST(test_metrics_concurrent);
+#ifndef OPENSSL_NO_SECURE_MEMORY
+    ADD_TEST(test_secure_heap_concurrent);
+#endif
     ADD_ALL_TESTS(test_multi, 4);
     return 1;
 }